@@ -0,0 +1,124 @@
+// This file is compiled without /clr, so that std::thread can be used
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#include "CpuKernels.h"
+#include "CpuKernelsImpl.h"
+
+#define ROWS_PER_TASK 4
+
+bool IsAvxSupported()
+{
+#ifdef _MSC_VER
+	int cpuInfo[4];
+	__cpuid(cpuInfo, 1);
+	bool osUsesXSave = (cpuInfo[2] & (1 << 27)) != 0;
+	bool cpuSupportsAvx = (cpuInfo[2] & (1 << 28)) != 0;
+	if (!osUsesXSave || !cpuSupportsAvx)
+		return false;
+
+	// Check that OS saves YMM registers
+	unsigned long long xcrFeatureMask = _xgetbv(0);
+	return (xcrFeatureMask & 0x6) == 0x6;
+#else
+	return __builtin_cpu_supports("avx");
+#endif
+}
+
+static void UpdateRowPenalties(const CpuEdgeTermsParams &edge, int y, int width, float *objectPenalties, float *backgroundPenalties)
+{
+	for (int x = 0; x < width; ++x)
+	{
+		float objectPenalty, backgroundPenalty;
+		CalculateEdgePenalties(edge, x, y, objectPenalty, backgroundPenalty);
+		objectPenalties[x] = std::min(objectPenalties[x], objectPenalty);
+		backgroundPenalties[x] = std::max(backgroundPenalties[x], backgroundPenalty);
+	}
+}
+
+static CpuEdgeTermsParams MakeEdgeTermsParams(
+	CpuPoint *convexHull, int convexHullSize, CpuPoint *corners1, CpuPoint *corners2, CpuPoint widthLimits, float saturation)
+{
+	CpuEdgeTermsParams result;
+	
+	result.convexHullSize = convexHullSize;
+	for (int i = 0; i < convexHullSize; ++i)
+	{
+		CpuPoint start = convexHull[i];
+		CpuPoint end = convexHull[(i + 1) % convexHullSize];
+		result.convexHullSegments[i] = MakeSegment(start.x, start.y, end.x, end.y);
+	}
+
+	for (int i = 0; i < 4; ++i)
+		for (int j = 0; j < 4; ++j)
+			result.cornerSegments[i * 4 + j] = MakeSegment(corners1[i].x, corners1[i].y, corners2[j].x, corners2[j].y);
+
+	result.objectPenaltyDenominator = widthLimits.y * widthLimits.y + 1e-6;
+	result.backgroundPenaltyDenominator = widthLimits.x * widthLimits.x + 1e-6;
+	result.saturation = saturation;
+
+	return result;
+}
+
+void CalculateShapeUnaryTermsCpu(
+	int edgeCount,
+	CpuPoint **convexHulls,
+	int *convexHullSizes,
+	CpuPoint **corners1,
+	CpuPoint **corners2,
+	CpuPoint *edgeWidthLimits,
+	int imageWidth,
+	int imageHeight,
+	float saturation,
+	int threadCount,
+	bool useAvx,
+	float *objectPenalties,
+	float *backgroundPenalties)
+{
+	std::vector<CpuEdgeTermsParams> edges(edgeCount);
+	for (int i = 0; i < edgeCount; ++i)
+	{
+		edges[i] = MakeEdgeTermsParams(
+			convexHulls[i], convexHullSizes[i], corners1[i], corners2[i], edgeWidthLimits[i], saturation);
+	}
+
+	useAvx = useAvx && IsAvxSupported();
+
+	// Rows are processed for all edges at once, so that penalties of a row stay in cache
+	std::atomic<int> nextRow(0);
+	auto processRows = [&]()
+	{
+		for (;;)
+		{
+			int firstRow = nextRow.fetch_add(ROWS_PER_TASK);
+			if (firstRow >= imageHeight)
+				break;
+			int lastRow = std::min(firstRow + ROWS_PER_TASK, imageHeight);
+			for (int y = firstRow; y < lastRow; ++y)
+			{
+				float *objectPenaltiesRow = objectPenalties + y * imageWidth;
+				float *backgroundPenaltiesRow = backgroundPenalties + y * imageWidth;
+				for (int i = 0; i < edgeCount; ++i)
+				{
+					if (useAvx)
+						UpdateRowPenaltiesAvx(edges[i], y, imageWidth, objectPenaltiesRow, backgroundPenaltiesRow);
+					else
+						UpdateRowPenalties(edges[i], y, imageWidth, objectPenaltiesRow, backgroundPenaltiesRow);
+				}
+			}
+		}
+	};
+
+	std::vector<std::thread> threads;
+	for (int i = 1; i < threadCount; ++i)
+		threads.push_back(std::thread(processRows));
+	processRows();
+	for (size_t i = 0; i < threads.size(); ++i)
+		threads[i].join();
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+struct CpuPoint
+{
+	double x;
+	double y;
+};
+
+bool IsAvxSupported();
+
+// CPU counterpart of CalculateShapeUnaryTerms: computes the same per-edge penalties as CalcMinPenaltiesForEdgeKernel,
+// processing 4 pixels at once with AVX (if supported and requested) and splitting image rows between threads.
+// Distances are computed in double precision, penalties never exceed the ones of the managed calculator
+void CalculateShapeUnaryTermsCpu(
+	int edgeCount,
+	CpuPoint **convexHulls,
+	int *convexHullSizes,
+	CpuPoint **corners1,
+	CpuPoint **corners2,
+	CpuPoint *edgeWidthLimits,
+	int imageWidth,
+	int imageHeight,
+	float saturation,
+	int threadCount,
+	bool useAvx,
+	float *objectPenalties,
+	float *backgroundPenalties);
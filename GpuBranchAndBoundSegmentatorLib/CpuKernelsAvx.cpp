@@ -0,0 +1,103 @@
+// This file is compiled with /arch:AVX, its functions are called only if AVX is supported
+
+#include <immintrin.h>
+
+#include "CpuKernelsImpl.h"
+
+static inline __m256d DistanceToSegmentSqrAvx(__m256d x, __m256d y, const CpuSegment &segment)
+{
+	__m256d directionX = _mm256_set1_pd(segment.directionX);
+	__m256d directionY = _mm256_set1_pd(segment.directionY);
+	__m256d pX = _mm256_sub_pd(x, _mm256_set1_pd(segment.startX));
+	__m256d pY = _mm256_sub_pd(y, _mm256_set1_pd(segment.startY));
+
+	__m256d alpha = _mm256_mul_pd(
+		_mm256_add_pd(_mm256_mul_pd(pX, directionX), _mm256_mul_pd(pY, directionY)),
+		_mm256_set1_pd(segment.invLengthSqr));
+	alpha = _mm256_min_pd(_mm256_max_pd(alpha, _mm256_setzero_pd()), _mm256_set1_pd(1.0));
+
+	__m256d diffX = _mm256_sub_pd(pX, _mm256_mul_pd(directionX, alpha));
+	__m256d diffY = _mm256_sub_pd(pY, _mm256_mul_pd(directionY, alpha));
+	return _mm256_add_pd(_mm256_mul_pd(diffX, diffX), _mm256_mul_pd(diffY, diffY));
+}
+
+// Same rule as SaturatePenalty for non-negative values: lanes rounded up by the conversion are moved one float down
+static inline __m128 SaturatePenaltyAvx(__m256d value, float saturation)
+{
+	value = _mm256_min_pd(value, _mm256_set1_pd(saturation));
+	__m128 result = _mm256_cvtpd_ps(value);
+	__m256d roundedUp = _mm256_cmp_pd(_mm256_cvtps_pd(result), value, _CMP_GT_OQ);
+
+	// Low halves of the 64-bit masks are packed into 32-bit masks, which are -1 for the lanes to decrement
+	__m128 roundedUpMask = _mm_shuffle_ps(
+		_mm256_castps256_ps128(_mm256_castpd_ps(roundedUp)), _mm256_extractf128_ps(_mm256_castpd_ps(roundedUp), 1), _MM_SHUFFLE(2, 0, 2, 0));
+	return _mm_castsi128_ps(_mm_add_epi32(_mm_castps_si128(result), _mm_castps_si128(roundedUpMask)));
+}
+
+void UpdateRowPenaltiesAvx(const CpuEdgeTermsParams &edge, int y, int width, float *objectPenalties, float *backgroundPenalties)
+{
+	const __m256d zero = _mm256_setzero_pd();
+	const __m256d pixelOffsets = _mm256_set_pd(3, 2, 1, 0);
+	const __m256d yVec = _mm256_set1_pd(y);
+	const __m256d distanceMargin = _mm256_set1_pd(DistanceMargin);
+	const __m256d penaltyScale = _mm256_set1_pd(CPU_KERNELS_FOUR_LOG_2);
+	const __m256d objectPenaltyDenominator = _mm256_set1_pd(edge.objectPenaltyDenominator);
+
+	int x = 0;
+	for (; x + 4 <= width; x += 4)
+	{
+		__m256d xVec = _mm256_add_pd(_mm256_set1_pd(x), pixelOffsets);
+
+		// Point is inside the hull if it is on the same side of every hull segment
+		__m256d allNonNegative = _mm256_cmp_pd(zero, zero, _CMP_EQ_OQ);
+		__m256d allNonPositive = allNonNegative;
+		for (int i = 0; i < edge.convexHullSize; ++i)
+		{
+			const CpuSegment &segment = edge.convexHullSegments[i];
+			__m256d cross = _mm256_sub_pd(
+				_mm256_mul_pd(_mm256_sub_pd(xVec, _mm256_set1_pd(segment.startX)), _mm256_set1_pd(segment.directionY)),
+				_mm256_mul_pd(_mm256_sub_pd(yVec, _mm256_set1_pd(segment.startY)), _mm256_set1_pd(segment.directionX)));
+			allNonNegative = _mm256_and_pd(allNonNegative, _mm256_cmp_pd(cross, zero, _CMP_GE_OQ));
+			allNonPositive = _mm256_and_pd(allNonPositive, _mm256_cmp_pd(cross, zero, _CMP_LE_OQ));
+		}
+		__m256d inside = _mm256_or_pd(allNonNegative, allNonPositive);
+
+		__m256d minDistanceSqr = DistanceToSegmentSqrAvx(xVec, yVec, edge.convexHullSegments[0]);
+		for (int i = 1; i < edge.convexHullSize; ++i)
+			minDistanceSqr = _mm256_min_pd(minDistanceSqr, DistanceToSegmentSqrAvx(xVec, yVec, edge.convexHullSegments[i]));
+		minDistanceSqr = _mm256_andnot_pd(inside, minDistanceSqr);
+
+		__m256d maxDistanceSqr = zero;
+		for (int i = 0; i < CornerSegmentCount; ++i)
+			maxDistanceSqr = _mm256_max_pd(maxDistanceSqr, DistanceToSegmentSqrAvx(xVec, yVec, edge.cornerSegments[i]));
+
+		// Distances are relaxed and penalties are computed with the same operations as in the scalar code
+		__m256d minDistance = _mm256_max_pd(_mm256_sub_pd(_mm256_sqrt_pd(minDistanceSqr), distanceMargin), zero);
+		__m256d maxDistance = _mm256_add_pd(_mm256_sqrt_pd(maxDistanceSqr), distanceMargin);
+		maxDistanceSqr = _mm256_mul_pd(maxDistance, maxDistance);
+
+		// Object penalty is linear in squared distance, so it is computed for all 4 pixels at once
+		__m256d objectPenalty = _mm256_div_pd(
+			_mm256_mul_pd(penaltyScale, _mm256_mul_pd(minDistance, minDistance)), objectPenaltyDenominator);
+		_mm_storeu_ps(
+			objectPenalties + x, _mm_min_ps(_mm_loadu_ps(objectPenalties + x), SaturatePenaltyAvx(objectPenalty, edge.saturation)));
+
+		// Background penalty needs exp/log, which are computed per pixel to match the reference
+		double maxDistanceSqrValues[4];
+		_mm256_storeu_pd(maxDistanceSqrValues, maxDistanceSqr);
+		for (int i = 0; i < 4; ++i)
+		{
+			float backgroundPenalty = SaturatePenalty(
+				DistanceSqrToBackgroundPenalty(maxDistanceSqrValues[i], edge.backgroundPenaltyDenominator), edge.saturation);
+			backgroundPenalties[x + i] = std::max(backgroundPenalties[x + i], backgroundPenalty);
+		}
+	}
+
+	for (; x < width; ++x)
+	{
+		float objectPenalty, backgroundPenalty;
+		CalculateEdgePenalties(edge, x, y, objectPenalty, backgroundPenalty);
+		objectPenalties[x] = std::min(objectPenalties[x], objectPenalty);
+		backgroundPenalties[x] = std::max(backgroundPenalties[x], backgroundPenalty);
+	}
+}
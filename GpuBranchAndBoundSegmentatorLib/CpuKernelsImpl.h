@@ -0,0 +1,145 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+#define CPU_KERNELS_FOUR_LOG_2 2.7725887222397811
+
+static const int MaxConvexHullSize = 8;
+static const int CornerSegmentCount = 16;
+
+// Min distances are reduced and max distances are increased by this margin, so that rounding differences
+// from the managed calculator can't make penalties exceed the ones it computes
+static const double DistanceMargin = 1e-6;
+
+struct CpuSegment
+{
+	double startX;
+	double startY;
+	double directionX;
+	double directionY;
+	double invLengthSqr; // Zero for degenerate segments, so that distance to the start point is used
+};
+
+struct CpuEdgeTermsParams
+{
+	int convexHullSize;
+	CpuSegment convexHullSegments[MaxConvexHullSize];
+	CpuSegment cornerSegments[CornerSegmentCount];
+	double objectPenaltyDenominator; // Applied to min distance, uses max width
+	double backgroundPenaltyDenominator; // Applied to max distance, uses min width
+	float saturation;
+};
+
+// Helpers below are compiled into both the scalar and the AVX translation units, so they have internal linkage
+// to keep the linker from picking the AVX-encoded copy for the scalar code
+static inline CpuSegment MakeSegment(double startX, double startY, double endX, double endY)
+{
+	CpuSegment result;
+	result.startX = startX;
+	result.startY = startY;
+	result.directionX = endX - startX;
+	result.directionY = endY - startY;
+	double lengthSqr = result.directionX * result.directionX + result.directionY * result.directionY;
+	result.invLengthSqr = lengthSqr > 0 ? 1.0 / lengthSqr : 0;
+	return result;
+}
+
+static inline double DistanceToSegmentSqr(double x, double y, const CpuSegment &segment)
+{
+	double pX = x - segment.startX;
+	double pY = y - segment.startY;
+	double alpha = (pX * segment.directionX + pY * segment.directionY) * segment.invLengthSqr;
+	alpha = alpha < 0 ? 0 : (alpha > 1 ? 1 : alpha);
+	double diffX = pX - segment.directionX * alpha;
+	double diffY = pY - segment.directionY * alpha;
+	return diffX * diffX + diffY * diffY;
+}
+
+static inline double RelaxMinDistanceSqr(double distanceSqr)
+{
+	double distance = std::sqrt(distanceSqr) - DistanceMargin;
+	return distance > 0 ? distance * distance : 0;
+}
+
+static inline double RelaxMaxDistanceSqr(double distanceSqr)
+{
+	double distance = std::sqrt(distanceSqr) + DistanceMargin;
+	return distance * distance;
+}
+
+// Returns the largest float that is less than the given finite one
+static inline float NextFloatDown(float value)
+{
+	if (value == 0)
+		return -std::numeric_limits<float>::denorm_min();
+
+	unsigned int bits;
+	std::memcpy(&bits, &value, sizeof(bits));
+	if (value > 0)
+		--bits;
+	else
+		++bits;
+	std::memcpy(&value, &bits, sizeof(bits));
+	return value;
+}
+
+// Penalties are lower bounds, so they are rounded down to float instead of rounding to nearest
+static inline float SaturatePenalty(double value, float saturation)
+{
+	if (value >= saturation)
+		return saturation;
+	if (value <= -saturation)
+		return -saturation;
+
+	float result = static_cast<float>(value);
+	if (result > value)
+		result = NextFloatDown(result);
+	return result;
+}
+
+// Same expressions as in the managed shape model
+static inline double DistanceSqrToObjectPenalty(double distanceSqr, double penaltyDenominator)
+{
+	return CPU_KERNELS_FOUR_LOG_2 * distanceSqr / penaltyDenominator;
+}
+
+static inline double DistanceSqrToBackgroundPenalty(double distanceSqr, double penaltyDenominator)
+{
+	return -std::log(1 + 1e-6 - std::exp(-DistanceSqrToObjectPenalty(distanceSqr, penaltyDenominator)));
+}
+
+static inline void CalculateEdgePenalties(const CpuEdgeTermsParams &edge, double x, double y, float &objectPenalty, float &backgroundPenalty)
+{
+	// Hull can be oriented either way, point is inside if it is on the same side of every hull segment
+	bool allNonNegative = true, allNonPositive = true;
+	for (int i = 0; i < edge.convexHullSize; ++i)
+	{
+		const CpuSegment &segment = edge.convexHullSegments[i];
+		double cross = (x - segment.startX) * segment.directionY - (y - segment.startY) * segment.directionX;
+		allNonNegative &= cross >= 0;
+		allNonPositive &= cross <= 0;
+	}
+
+	double minDistanceSqr = 0;
+	if (!allNonNegative && !allNonPositive)
+	{
+		minDistanceSqr = DistanceToSegmentSqr(x, y, edge.convexHullSegments[0]);
+		for (int i = 1; i < edge.convexHullSize; ++i)
+			minDistanceSqr = std::min(minDistanceSqr, DistanceToSegmentSqr(x, y, edge.convexHullSegments[i]));
+	}
+
+	double maxDistanceSqr = 0;
+	for (int i = 0; i < CornerSegmentCount; ++i)
+		maxDistanceSqr = std::max(maxDistanceSqr, DistanceToSegmentSqr(x, y, edge.cornerSegments[i]));
+
+	objectPenalty = SaturatePenalty(
+		DistanceSqrToObjectPenalty(RelaxMinDistanceSqr(minDistanceSqr), edge.objectPenaltyDenominator), edge.saturation);
+	backgroundPenalty = SaturatePenalty(
+		DistanceSqrToBackgroundPenalty(RelaxMaxDistanceSqr(maxDistanceSqr), edge.backgroundPenaltyDenominator), edge.saturation);
+}
+
+// Updates row penalties with the penalties of the given edge, processes 4 pixels per iteration
+void UpdateRowPenaltiesAvx(const CpuEdgeTermsParams &edge, int y, int width, float *objectPenalties, float *backgroundPenalties);
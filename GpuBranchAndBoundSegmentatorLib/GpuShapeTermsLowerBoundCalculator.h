@@ -1,4 +1,4 @@
-#pragma once
+﻿#pragma once
 
 #include <cutil_math.h>
 
@@ -17,7 +17,6 @@ namespace Research
 		{
 		private:
 			static const int maxConvexHullSize = 8;
-			static const float infinity = 1e+20f;
 
 			float2 **convexHulls;
 			int *convexHullSizes;
@@ -25,8 +24,6 @@ namespace Research
 			float2 **corners1;
 			float2 **corners2;
 			
-			float *objectPenaltiesCpu;
-			float *backgroundPenaltiesCpu;
 			float *objectPenaltiesGpu;
 			float *backgroundPenaltiesGpu;
 
@@ -64,8 +61,6 @@ namespace Research
 				edgeWidthLimits = new float2[lastEdgeCount];
 
 				size_t totalPixels = lastImageSize.Width * lastImageSize.Height;
-				objectPenaltiesCpu = new float[totalPixels];
-				backgroundPenaltiesCpu = new float[totalPixels];
 
 				pin_ptr<float*> pinnedObjectPenaltiesGpu = &objectPenaltiesGpu;
 				cudaMalloc((void**) pinnedObjectPenaltiesGpu, totalPixels * sizeof(float));
@@ -81,9 +76,6 @@ namespace Research
 				delete[] convexHullSizes;
 				delete[] edgeWidthLimits;
 
-				delete[] objectPenaltiesCpu;
-				delete[] backgroundPenaltiesCpu;
-				
 				cudaFree(objectPenaltiesGpu);
 				cudaFree(backgroundPenaltiesGpu);
 			}
@@ -95,8 +87,6 @@ namespace Research
 				, edgeWidthLimits(NULL)
 				, corners1(NULL)
 				, corners2(NULL)
-				, objectPenaltiesCpu(NULL)
-				, backgroundPenaltiesCpu(NULL)
 				, objectPenaltiesGpu(NULL)
 				, backgroundPenaltiesGpu(NULL)
 				, lastEdgeCount(-1)
@@ -114,7 +104,7 @@ namespace Research
 				Deallocate();
 			}
 
-			virtual void CalculateShapeTerms(ShapeModel ^shapeModel, ShapeConstraints ^shapeConstraints, Image2D<ObjectBackgroundTerm> ^result)
+			virtual void CalculateShapeTerms(ShapeModel ^shapeModel, ShapeConstraints ^shapeConstraints, ObjectBackgroundTermPlanes ^result)
 			{
 				int edgeCount = shapeConstraints->ShapeStructure->Edges->Count;
 				Size imageSize = Size(result->Width, result->Height);
@@ -143,22 +133,22 @@ namespace Research
 						corners2[edgeIndex][i] = VectorToFloat2(vertexConstraints2->Corners[i]);
 					}
 					
-					Polygon ^convexHull = shapeConstraints->GetConvexHullForVertexPair(edge.Index1, edge.Index2);
-					Debug::Assert(convexHull->Vertices->Count <= maxConvexHullSize);
-					convexHullSizes[edgeIndex] = convexHull->Vertices->Count;
-					for (int i = 0; i < convexHull->Vertices->Count; ++i)
-						convexHulls[edgeIndex][i] = make_float2(static_cast<float>(convexHull->Vertices[i].X), static_cast<float>(convexHull->Vertices[i].Y));
+					VertexPairConvexHull ^convexHull = shapeConstraints->GetVertexPairConvexHull(edge.Index1, edge.Index2);
+					array<float> ^hullCoords = convexHull->FloatCoords;
+					Debug::Assert(convexHull->VertexCount <= maxConvexHullSize);
+					convexHullSizes[edgeIndex] = convexHull->VertexCount;
+					for (int i = 0; i < convexHull->VertexCount; ++i)
+						convexHulls[edgeIndex][i] = make_float2(hullCoords[2 * i], hullCoords[2 * i + 1]);
 				}
 
 				size_t totalImageSize = lastImageSize.Width * lastImageSize.Height;
 				size_t totalImageByteSize = totalImageSize * sizeof(float);
 				
-				// Cleanup object/background penalties
-				for (size_t i = 0; i < totalImageSize; ++i)
-				{
-					objectPenaltiesCpu[i] = infinity;
-					backgroundPenaltiesCpu[i] = -infinity;
-				}
+				// Initialize object penalties with saturated values and background penalties with zeros, like other calculators do,
+				// result planes are used as host buffers directly
+				result->Fill(result->Saturation, 0);
+				pin_ptr<float> objectPenaltiesCpu = &result->ObjectTerms[0];
+				pin_ptr<float> backgroundPenaltiesCpu = &result->BackgroundTerms[0];
 				cudaMemcpy(objectPenaltiesGpu, objectPenaltiesCpu, totalImageByteSize, cudaMemcpyHostToDevice);
 				cudaMemcpy(backgroundPenaltiesGpu, backgroundPenaltiesCpu, totalImageByteSize, cudaMemcpyHostToDevice);
 
@@ -178,14 +168,6 @@ namespace Research
 				// Copy results
 				cudaMemcpy(objectPenaltiesCpu, objectPenaltiesGpu, totalImageByteSize, cudaMemcpyDeviceToHost);
 				cudaMemcpy(backgroundPenaltiesCpu, backgroundPenaltiesGpu, totalImageByteSize, cudaMemcpyDeviceToHost);
-				for (int x = 0; x < result->Width; ++x)
-				{
-					for (int y = 0; y < result->Height; ++y)
-					{
-						int index = y * result->Width + x;
-						result[x, y] = ObjectBackgroundTerm(objectPenaltiesCpu[index], backgroundPenaltiesCpu[index]);
-					}
-				}
 			}
 		};
 	}
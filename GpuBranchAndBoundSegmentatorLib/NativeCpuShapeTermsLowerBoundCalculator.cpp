@@ -0,0 +1,3 @@
+#include "stdafx.h"
+
+#include "NativeCpuShapeTermsLowerBoundCalculator.h"
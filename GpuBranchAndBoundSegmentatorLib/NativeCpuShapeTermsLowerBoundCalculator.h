@@ -0,0 +1,193 @@
+#pragma once
+
+#include "CpuKernels.h"
+
+using namespace System;
+using namespace System::Diagnostics;
+using namespace System::Drawing;
+using namespace Research::GraphBasedShapePrior::Util;
+
+namespace Research
+{
+	namespace GraphBasedShapePrior
+	{
+		public ref class NativeCpuShapeTermsLowerBoundCalculator : public IShapeTermsLowerBoundCalculator
+		{
+		private:
+			static const int maxConvexHullSize = 8;
+
+			CpuPoint **convexHulls;
+			int *convexHullSizes;
+			CpuPoint *edgeWidthLimits;
+			CpuPoint **corners1;
+			CpuPoint **corners2;
+
+			int lastEdgeCount;
+
+			int threadCount;
+			bool useAvx;
+
+			CpuPoint VectorToCpuPoint(Vector vec)
+			{
+				CpuPoint result;
+				result.x = vec.X;
+				result.y = vec.Y;
+				return result;
+			}
+
+			template<class T>
+			void FreeArray2D(T **arr, int size)
+			{
+				if (arr == NULL)
+					return;
+				for (int i = 0; i < size; ++i)
+					delete[] arr[i];
+				delete[] arr;
+			}
+
+			void Allocate()
+			{
+				convexHulls = new CpuPoint*[lastEdgeCount];
+				corners1 = new CpuPoint*[lastEdgeCount];
+				corners2 = new CpuPoint*[lastEdgeCount];
+				for (int i = 0; i < lastEdgeCount; ++i)
+				{
+					convexHulls[i] = new CpuPoint[maxConvexHullSize];
+					corners1[i] = new CpuPoint[4];
+					corners2[i] = new CpuPoint[4];
+				}
+
+				convexHullSizes = new int[lastEdgeCount];
+				edgeWidthLimits = new CpuPoint[lastEdgeCount];
+			}
+
+			void Deallocate()
+			{
+				FreeArray2D(convexHulls, lastEdgeCount);
+				FreeArray2D(corners1, lastEdgeCount);
+				FreeArray2D(corners2, lastEdgeCount);
+				delete[] convexHullSizes;
+				delete[] edgeWidthLimits;
+
+				convexHulls = NULL;
+				corners1 = NULL;
+				corners2 = NULL;
+				convexHullSizes = NULL;
+				edgeWidthLimits = NULL;
+			}
+
+		public:
+			NativeCpuShapeTermsLowerBoundCalculator()
+				: convexHulls(NULL)
+				, convexHullSizes(NULL)
+				, edgeWidthLimits(NULL)
+				, corners1(NULL)
+				, corners2(NULL)
+				, lastEdgeCount(-1)
+				, threadCount(Environment::ProcessorCount)
+				, useAvx(true)
+			{
+			}
+
+			~NativeCpuShapeTermsLowerBoundCalculator()
+			{
+				this->!NativeCpuShapeTermsLowerBoundCalculator();
+			}
+
+			!NativeCpuShapeTermsLowerBoundCalculator()
+			{
+				Deallocate();
+			}
+
+			property int ThreadCount
+			{
+				int get() { return threadCount; }
+				void set(int value)
+				{
+					if (value <= 0)
+						throw gcnew ArgumentOutOfRangeException("value", "Property value should be positive.");
+					threadCount = value;
+				}
+			}
+
+			// If AVX is not supported by the CPU, scalar code is used regardless of this setting
+			property bool UseAvx
+			{
+				bool get() { return useAvx; }
+				void set(bool value) { useAvx = value; }
+			}
+
+			static property bool IsAvxAvailable
+			{
+				bool get() { return IsAvxSupported(); }
+			}
+
+			virtual void CalculateShapeTerms(ShapeModel ^shapeModel, ShapeConstraints ^shapeConstraints, ObjectBackgroundTermPlanes ^result)
+			{
+				if (shapeModel == nullptr)
+					throw gcnew ArgumentNullException("shapeModel");
+				if (shapeConstraints == nullptr)
+					throw gcnew ArgumentNullException("shapeConstraints");
+				if (result == nullptr)
+					throw gcnew ArgumentNullException("result");
+				
+				int edgeCount = shapeConstraints->ShapeStructure->Edges->Count;
+				if (edgeCount != lastEdgeCount)
+				{
+					Deallocate();
+					lastEdgeCount = edgeCount;
+					Allocate();
+				}
+
+				// Copy params
+				for (int edgeIndex = 0; edgeIndex < edgeCount; ++edgeIndex)
+				{
+					ShapeEdge edge = shapeConstraints->ShapeStructure->Edges[edgeIndex];
+					EdgeConstraints ^edgeConstraints = shapeConstraints->EdgeConstraints[edgeIndex];
+					VertexConstraints ^vertexConstraints1 = shapeConstraints->VertexConstraints[edge.Index1];
+					VertexConstraints ^vertexConstraints2 = shapeConstraints->VertexConstraints[edge.Index2];
+
+					edgeWidthLimits[edgeIndex].x = edgeConstraints->MinWidth;
+					edgeWidthLimits[edgeIndex].y = edgeConstraints->MaxWidth;
+
+					for (int i = 0; i < 4; ++i)
+					{
+						corners1[edgeIndex][i] = VectorToCpuPoint(vertexConstraints1->Corners[i]);
+						corners2[edgeIndex][i] = VectorToCpuPoint(vertexConstraints2->Corners[i]);
+					}
+
+					VertexPairConvexHull ^convexHull = shapeConstraints->GetVertexPairConvexHull(edge.Index1, edge.Index2);
+					array<double> ^hullCoords = convexHull->Coords;
+					Debug::Assert(convexHull->VertexCount <= maxConvexHullSize);
+					convexHullSizes[edgeIndex] = convexHull->VertexCount;
+					for (int i = 0; i < convexHull->VertexCount; ++i)
+					{
+						convexHulls[edgeIndex][i].x = hullCoords[2 * i];
+						convexHulls[edgeIndex][i].y = hullCoords[2 * i + 1];
+					}
+				}
+
+				result->Fill(result->Saturation, 0);
+				if (result->Width == 0 || result->Height == 0)
+					return;
+
+				pin_ptr<float> objectPenalties = &result->ObjectTerms[0];
+				pin_ptr<float> backgroundPenalties = &result->BackgroundTerms[0];
+				CalculateShapeUnaryTermsCpu(
+					edgeCount,
+					convexHulls,
+					convexHullSizes,
+					corners1,
+					corners2,
+					edgeWidthLimits,
+					result->Width,
+					result->Height,
+					result->Saturation,
+					threadCount,
+					useAvx,
+					objectPenalties,
+					backgroundPenalties);
+			}
+		};
+	}
+}
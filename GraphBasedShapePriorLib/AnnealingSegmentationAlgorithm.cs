@@ -1,16 +1,18 @@
 ﻿using System;
-using System.Threading.Tasks;
 using Research.GraphBasedShapePrior.Util;
 
 namespace Research.GraphBasedShapePrior
 {
     public class AnnealingSegmentationAlgorithm : SegmentationAlgorithmBase
     {
-        private Image2D<ObjectBackgroundTerm> shapeTerms;
+        private ObjectBackgroundTermPlanes shapeTerms;
+
+        private IncrementalShapeTermsCalculator shapeTermsCalculator;
         
         public AnnealingSegmentationAlgorithm()
         {
             this.ShapeMutator = new ShapeMutator();
+            this.shapeTermsCalculator = new IncrementalShapeTermsCalculator();
 
             this.SolutionFitter = new SimulatedAnnealingMinimizer<Shape>();
             this.SolutionFitter.MaxIterations = 5000;
@@ -37,35 +39,22 @@ namespace Research.GraphBasedShapePrior
                     this.ImageSegmentator.ImageSize.Width, this.ImageSegmentator.ImageSize.Height);
             }
 
-            this.shapeTerms = new Image2D<ObjectBackgroundTerm>(this.ImageSegmentator.ImageSize.Width, this.ImageSegmentator.ImageSize.Height);
+            this.shapeTerms = new ObjectBackgroundTermPlanes(
+                this.ImageSegmentator.ImageSize.Width, this.ImageSegmentator.ImageSize.Height, this.ShapeTermsSaturation);
 
             Shape solutionShape = this.SolutionFitter.Run(startShape, this.MutateSolution, s => this.CalcObjective(s, false));
             double solutionEnergy = CalcObjective(solutionShape, true);
-            Image2D<bool> solutionMask = this.ImageSegmentator.GetLastSegmentationMask();
+            Mask2D solutionMask = this.ImageSegmentator.GetLastSegmentationMask();
             return new SegmentationSolution(solutionShape, solutionMask, solutionEnergy);
         }
 
-        private void UpdateShapeTerms(Shape shape)
-        {
-            Parallel.For(
-                0,
-                this.shapeTerms.Width,
-                i =>
-                    {
-                        for (int j = 0; j < this.shapeTerms.Height; ++j)
-                        {
-                            this.shapeTerms[i, j] =
-                                this.ShapeModel.CalculatePenalties(shape, new Vector(i, j));
-                        }
-                    });
-        }
-
         private double CalcObjective(Shape shape, bool report)
         {
-            this.UpdateShapeTerms(shape);
+            this.shapeTermsCalculator.CalculateShapeTerms(this.ShapeModel, shape, this.shapeTerms);
             
             double shapeEnergy = this.ShapeModel.CalculateEnergy(shape);
-            double labelingEnergy = this.ImageSegmentator.SegmentImageWithShapeTerms((x, y) => this.shapeTerms[x, y]);
+            double labelingEnergy = this.ImageSegmentator.SegmentImageWithShapeTerms(
+                this.shapeTerms, this.shapeTermsCalculator.LastChangedRegion);
             double energy = shapeEnergy * this.ShapeEnergyWeight + labelingEnergy;
             double additionalPenalty = this.AdditionalShapePenalty == null ? 0 : this.AdditionalShapePenalty(shape);
             double totalEnergy = energy + additionalPenalty;
@@ -5,7 +5,7 @@ namespace Research.GraphBasedShapePrior
 {
     public class BranchAndBoundCompletedEventArgs : EventArgs
     {
-        public Image2D<bool> CollapsedSolutionSegmentationMask { get; private set; }
+        public Mask2D CollapsedSolutionSegmentationMask { get; private set; }
 
         public Image2D<ObjectBackgroundTerm> CollapsedSolutionUnaryTermsImage { get; private set; }
 
@@ -16,7 +16,7 @@ namespace Research.GraphBasedShapePrior
         public double LowerBound { get; private set; }
 
         public BranchAndBoundCompletedEventArgs(
-            Image2D<bool> collapsedSolutionSegmentationMask,
+            Mask2D collapsedSolutionSegmentationMask,
             Image2D<ObjectBackgroundTerm> collapsedSolutionUnaryTermsImage,
             Image2D<ObjectBackgroundTerm> collapsedSolutionShapeTermsImage,
             ShapeConstraints resultConstraints,
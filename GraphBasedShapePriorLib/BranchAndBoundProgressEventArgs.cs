@@ -7,7 +7,7 @@ namespace Research.GraphBasedShapePrior
     {
         public double LowerBound { get; private set; }
 
-        public Image2D<bool> SegmentationMask { get; private set; }
+        public Mask2D SegmentationMask { get; private set; }
 
         public Image2D<ObjectBackgroundTerm> UnaryTermsImage { get; private set; }
 
@@ -15,12 +15,36 @@ namespace Research.GraphBasedShapePrior
 
         public ShapeConstraints Constraints { get; private set; }
 
+        /// <summary>
+        /// Gets the fraction of bounds calculated with coarse shape terms since the last report.
+        /// </summary>
+        public double CoarseBoundFraction { get; private set; }
+
+        /// <summary>
+        /// Gets how much the current lower bound would grow if it was calculated with full-resolution shape terms.
+        /// </summary>
+        public double CoarseBoundLooseness { get; private set; }
+
+        /// <summary>
+        /// Gets the fraction of shape energy bounds calculated on coarse grids first since the last report.
+        /// </summary>
+        public double CoarseGridBoundFraction { get; private set; }
+
+        /// <summary>
+        /// Gets the average number of cells in the grids of the distance transforms computed since the last report.
+        /// </summary>
+        public double MeanGridCellCount { get; private set; }
+
         public BranchAndBoundProgressEventArgs(
             double lowerBound,
-            Image2D<bool> segmentationMask,
+            Mask2D segmentationMask,
             Image2D<ObjectBackgroundTerm> unaryTermsImage,
             Image2D<ObjectBackgroundTerm> shapeTermsImage,
-            ShapeConstraints constraints)
+            ShapeConstraints constraints,
+            double coarseBoundFraction,
+            double coarseBoundLooseness,
+            double coarseGridBoundFraction,
+            double meanGridCellCount)
         {
             if (segmentationMask == null)
                 throw new ArgumentNullException("segmentationMask");
@@ -36,6 +60,10 @@ namespace Research.GraphBasedShapePrior
             this.UnaryTermsImage = unaryTermsImage;
             this.ShapeTermsImage = shapeTermsImage;
             this.Constraints = constraints;
+            this.CoarseBoundFraction = coarseBoundFraction;
+            this.CoarseBoundLooseness = coarseBoundLooseness;
+            this.CoarseGridBoundFraction = coarseGridBoundFraction;
+            this.MeanGridCellCount = meanGridCellCount;
         }
     }
 }
\ No newline at end of file
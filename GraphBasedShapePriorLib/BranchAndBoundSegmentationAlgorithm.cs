@@ -2,8 +2,10 @@
 using System.Collections.Generic;
 using System.Diagnostics;
 using System.Drawing;
+using System.IO;
 using System.Linq;
 using System.Threading;
+using System.Threading.Tasks;
 using Research.GraphBasedShapePrior.Util;
 using Vector = Research.GraphBasedShapePrior.Util.Vector;
 
@@ -15,7 +17,14 @@ namespace Research.GraphBasedShapePrior
 
         private const int DefaultAngleGridSize = 201;
 
-        private IShapeEnergyLowerBoundCalculator shapeEnergyLowerBoundCalculator = new ShapeEnergyLowerBoundCalculator(DefaultLengthGridSize, DefaultAngleGridSize);
+        // "BBCP" in little-endian order
+        private const int CheckpointSignature = 0x50434242;
+
+        private const int CheckpointFormatVersion = 2;
+
+        private const int CheckpointFileBufferSize = 1 << 16;
+
+        private IShapeEnergyLowerBoundCalculator shapeEnergyLowerBoundCalculator = CreateDefaultShapeEnergyLowerBoundCalculator();
 
         private int progressReportRate = 50;
 
@@ -27,20 +36,74 @@ namespace Research.GraphBasedShapePrior
 
         private double maxWidthFreedom = 1;
 
-        private Image2D<ObjectBackgroundTerm> shapeUnaryTerms;
-
         private IShapeTermsLowerBoundCalculator shapeTermsCalculator = new CpuShapeTermsLowerBoundCalculator();
 
+        private IShapeTermsLowerBoundCalculator coarseShapeTermsCalculator = new CoarseShapeTermsLowerBoundCalculator();
+
+        private double coarseShapeTermsMinVertexFreedom = Double.PositiveInfinity;
+
+        private int workerCount = 1;
+
+        private int divingRate = 100;
+
+        private long frontMemoryBudget = Int64.MaxValue;
+
+        private TimeSpan checkpointInterval = TimeSpan.FromMinutes(10);
+
+        private string resumeCheckpointPath;
+
+        private Func<IShapeTermsLowerBoundCalculator> shapeTermsCalculatorFactory;
+
+        private Func<IShapeTermsLowerBoundCalculator> coarseShapeTermsCalculatorFactory;
+
+        private Func<IShapeEnergyLowerBoundCalculator> shapeEnergyLowerBoundCalculatorFactory;
+
+        // Counters below are shared by all the workers
+
+        private int processedConstraintSets;
+
+        private int splitCount;
+
+        private int coarseBoundCount;
+
+        private int deferredBoundCount;
+
+        private double boundCascadeMargin;
+
+        // Grid statistics of the shape energy calculator at the time of the last progress report
+
+        private long reportedShapeBoundCount;
+
+        private long reportedCoarseGridBoundCount;
+
+        private long reportedTransformCount;
+
+        private long reportedGridCellCount;
+
         private DateTime startTime;
 
         private ShapeConstraints startConstraints;
 
+        // Checkpoint being written in background
+        private Task checkpointTask;
+
+        private DateTime lastCheckpointTime;
+
+        // Hash of the image and the energy terms of the current search, checkpoints are written and checked with it
+        private long segmentationTermsHash;
+
         public event EventHandler<BranchAndBoundProgressEventArgs> BreadthFirstBranchAndBoundProgress;
 
         public event EventHandler BranchAndBoundStarted;
 
         public event EventHandler<BranchAndBoundCompletedEventArgs> BranchAndBoundCompleted;
 
+        public BranchAndBoundSegmentationAlgorithm()
+        {
+            this.UseBoundCascade = true;
+            this.UseDiving = true;
+        }
+
         public int ProgressReportRate
         {
             get { return this.progressReportRate; }
@@ -107,6 +170,122 @@ namespace Research.GraphBasedShapePrior
             }
         }
 
+        public IShapeTermsLowerBoundCalculator CoarseShapeTermsCalculator
+        {
+            get { return this.coarseShapeTermsCalculator; }
+            set
+            {
+                if (value == null)
+                    throw new ArgumentNullException("value");
+                this.coarseShapeTermsCalculator = value;
+            }
+        }
+
+        /// <summary>
+        /// Gets or sets the max vertex freedom starting from which bounds are calculated with coarse shape terms.
+        /// Coarse terms are cheaper, but give less tight bounds. By default coarse terms are never used.
+        /// </summary>
+        public double CoarseShapeTermsMinVertexFreedom
+        {
+            get { return this.coarseShapeTermsMinVertexFreedom; }
+            set
+            {
+                if (value <= 0)
+                    throw new ArgumentOutOfRangeException("value", "Value of this property should be positive.");
+                this.coarseShapeTermsMinVertexFreedom = value;
+            }
+        }
+
+        /// <summary>
+        /// Gets or sets whether bounds of the new constraint sets should be calculated in stages, from the cheapest to the tightest.
+        /// Expensive stages are postponed until the bound gets to the top of the front,
+        /// so they are never calculated for the constraint sets that are never split.
+        /// </summary>
+        public bool UseBoundCascade { get; set; }
+
+        /// <summary>
+        /// Gets or sets how much the bound of a cheap stage should exceed the best bound in the front to postpone the remaining stages.
+        /// </summary>
+        public double BoundCascadeMargin
+        {
+            get { return this.boundCascadeMargin; }
+            set
+            {
+                if (value < 0)
+                    throw new ArgumentOutOfRangeException("value", "Value of this property should not be negative.");
+                this.boundCascadeMargin = value;
+            }
+        }
+
+        /// <summary>
+        /// Gets or sets whether the search should periodically dive from the best new bound to a single shape,
+        /// always following the child with the best bound. Energy of the best shape found so far is an upper bound
+        /// for the solution, so bounds exceeding it are dropped from the front.
+        /// </summary>
+        public bool UseDiving { get; set; }
+
+        /// <summary>
+        /// Gets or sets the number of constraint set splits between dives. First dive is made after the first split.
+        /// </summary>
+        public int DivingRate
+        {
+            get { return this.divingRate; }
+            set
+            {
+                if (value < 1)
+                    throw new ArgumentOutOfRangeException("value", "Value of this property should be positive.");
+                this.divingRate = value;
+            }
+        }
+
+        /// <summary>
+        /// Gets or sets the amount of memory the bounds in the front may occupy.
+        /// When it is exceeded, the worse half of the front is moved to a temporary file,
+        /// from which bounds are merged back when they become competitive with the ones left in memory.
+        /// </summary>
+        public long FrontMemoryBudget
+        {
+            get { return this.frontMemoryBudget; }
+            set
+            {
+                if (value <= 0)
+                    throw new ArgumentOutOfRangeException("value", "Value of this property should be positive.");
+                this.frontMemoryBudget = value;
+            }
+        }
+
+        /// <summary>
+        /// Gets or sets the file the state of the search is periodically saved to. Checkpoints are not written if it is null.
+        /// Checkpoints are written in background from a snapshot of the front, and one is written when the search is stopped.
+        /// </summary>
+        public string CheckpointPath { get; set; }
+
+        public TimeSpan CheckpointInterval
+        {
+            get { return this.checkpointInterval; }
+            set
+            {
+                if (value <= TimeSpan.Zero)
+                    throw new ArgumentOutOfRangeException("value", "Value of this property should be positive.");
+                this.checkpointInterval = value;
+            }
+        }
+
+        /// <summary>
+        /// Gets or sets the checkpoint the search should be resumed from instead of starting from the start constraints.
+        /// Search should be resumed with the same shape model, image and energy settings.
+        /// </summary>
+        public string ResumeCheckpointPath
+        {
+            get { return this.resumeCheckpointPath; }
+            set
+            {
+                if (this.IsRunning)
+                    throw new InvalidOperationException("You can't change the value of this property while segmentation is running.");
+                this.resumeCheckpointPath = value;
+            }
+        }
+
         public IShapeEnergyLowerBoundCalculator ShapeEnergyLowerBoundCalculator
         {
             get { return this.shapeEnergyLowerBoundCalculator; }
@@ -118,6 +297,57 @@ namespace Research.GraphBasedShapePrior
             }
         }
 
+        /// <summary>
+        /// Gets or sets the number of workers taking the best bounds from the front and calculating bounds of their children concurrently.
+        /// First worker uses the calculators of the algorithm, every other one gets its own calculators from the factories below,
+        /// which should be set explicitly to build calculators with the same settings if more than one worker is used.
+        /// All the workers share the front under a single lock, and workers waiting for the bounds in progress recheck the front
+        /// every 10 ms, so the speedup is limited when bounds are cheap compared to the front operations.
+        /// </summary>
+        public int WorkerCount
+        {
+            get { return this.workerCount; }
+            set
+            {
+                if (value < 1)
+                    throw new ArgumentOutOfRangeException("value", "Value of this property should be positive.");
+                this.workerCount = value;
+            }
+        }
+
+        public Func<IShapeTermsLowerBoundCalculator> ShapeTermsCalculatorFactory
+        {
+            get { return this.shapeTermsCalculatorFactory; }
+            set
+            {
+                if (value == null)
+                    throw new ArgumentNullException("value");
+                this.shapeTermsCalculatorFactory = value;
+            }
+        }
+
+        public Func<IShapeTermsLowerBoundCalculator> CoarseShapeTermsCalculatorFactory
+        {
+            get { return this.coarseShapeTermsCalculatorFactory; }
+            set
+            {
+                if (value == null)
+                    throw new ArgumentNullException("value");
+                this.coarseShapeTermsCalculatorFactory = value;
+            }
+        }
+
+        public Func<IShapeEnergyLowerBoundCalculator> ShapeEnergyLowerBoundCalculatorFactory
+        {
+            get { return this.shapeEnergyLowerBoundCalculatorFactory; }
+            set
+            {
+                if (value == null)
+                    throw new ArgumentNullException("value");
+                this.shapeEnergyLowerBoundCalculatorFactory = value;
+            }
+        }
+
         public ShapeConstraints StartConstraints
         {
             get { return this.startConstraints; }
@@ -147,8 +377,7 @@ namespace Research.GraphBasedShapePrior
                 //}
             }
 
-            this.shapeUnaryTerms = new Image2D<ObjectBackgroundTerm>(
-                this.ImageSegmentator.ImageSize.Width, this.ImageSegmentator.ImageSize.Height);
+            BoundCalculationContext[] contexts = this.CreateBoundCalculationContexts();
 
             ShapeConstraints constraints = this.startConstraints;
             if (constraints == null)
@@ -165,189 +394,970 @@ namespace Research.GraphBasedShapePrior
                 this.BranchAndBoundStarted(this, EventArgs.Empty);
 
             this.startTime = DateTime.Now;
+            this.RememberReportedGridStatistics();
             DebugConfiguration.WriteImportantDebugText("Breadth-first branch-and-bound started.");
 
-            SortedSet<EnergyBound> front = this.BreadthFirstBranchAndBoundTraverse(constraints);
-            ReportBranchAndBoundCompletion(front.Min);
+            EnergyBound bestBound, incumbent;
+            double frontMinBound;
+            using (SearchFront front = this.BreadthFirstBranchAndBoundTraverse(contexts, constraints))
+            {
+                bestBound = front.Solution ?? front.Min;
+                incumbent = front.Incumbent;
+                frontMinBound = front.MinBound;
+            }
+
+            // Shape found by diving can be better than the collapsed best bound, and the front can even be pruned completely
+            EnergyBound solutionEnergy = null;
+            if (bestBound != null)
+                solutionEnergy = this.CalculateShapeEnergy(contexts[0], bestBound.Constraints.CollapseToShape());
+            if (incumbent != null && (solutionEnergy == null || incumbent.Bound < solutionEnergy.Bound))
+            {
+                bestBound = incumbent;
+                solutionEnergy = incumbent;
+            }
 
-            if (front.Min.Constraints.CheckIfSatisfied(this.maxCoordFreedom, this.maxWidthFreedom))
+            ReportBranchAndBoundCompletion(contexts[0], bestBound);
+
+            if (bestBound.Constraints.CheckIfSatisfied(this.maxCoordFreedom, this.maxWidthFreedom))
             {
                 DebugConfiguration.WriteImportantDebugText("Breadth-first branch-and-bound finished in {0}.",
                                                            DateTime.Now - this.startTime);
-                DebugConfiguration.WriteImportantDebugText("Best lower bound is {0:0.0000}", front.Min.Bound);
             }
             else
-            {
                 DebugConfiguration.WriteImportantDebugText("Breadth-first branch-and-bound forced to stop after {0}.", DateTime.Now - this.startTime);
-                DebugConfiguration.WriteImportantDebugText("Min energy value achieved is {0:0.0000}", front.Min.Bound);
-            }
 
-            EnergyBound collapsedBfsSolution = this.CalculateEnergyBound(front.Min.Constraints.Collapse());
-            Shape resultShape = front.Min.Constraints.CollapseToShape();
+            // Result can be the shape found by diving, which is an upper bound, so the bounds are reported separately
+            if (Double.IsPositiveInfinity(frontMinBound))
+                DebugConfiguration.WriteImportantDebugText("Front was completely pruned by the best shape found.");
+            else
+                DebugConfiguration.WriteImportantDebugText("Best lower bound in the front is {0:0.0000}", frontMinBound);
+            if (incumbent != null)
+                DebugConfiguration.WriteImportantDebugText("Best shape found by diving has energy {0:0.0000}", incumbent.Bound);
+
+            // Segmentation is repeated for the solution shape, since the completion report has segmented the image with its bound
+            Shape resultShape = bestBound.Constraints.CollapseToShape();
+            this.CalculateShapeEnergy(contexts[0], resultShape);
 
             DebugConfiguration.WriteImportantDebugText(
-                "Collapsed solution energy value is {0:0.0000} ({1:0.0000} + {2:0.0000})",
-                collapsedBfsSolution.Bound,
-                collapsedBfsSolution.SegmentationEnergy,
-                collapsedBfsSolution.ShapeEnergy * this.ShapeEnergyWeight);
-            return new SegmentationSolution(resultShape, this.ImageSegmentator.GetLastSegmentationMask(), collapsedBfsSolution.Bound);
+                "Solution energy value is {0:0.0000} ({1:0.0000} + {2:0.0000})",
+                solutionEnergy.Bound,
+                solutionEnergy.SegmentationEnergy,
+                solutionEnergy.ShapeEnergy * this.ShapeEnergyWeight);
+            return new SegmentationSolution(resultShape, this.ImageSegmentator.GetLastSegmentationMask(), solutionEnergy.Bound);
         }
 
-        private SortedSet<EnergyBound> BreadthFirstBranchAndBoundTraverse(ShapeConstraints constraints)
+        private SearchFront BreadthFirstBranchAndBoundTraverse(BoundCalculationContext[] contexts, ShapeConstraints constraints)
         {
-            SortedSet<EnergyBound> front = new SortedSet<EnergyBound> { this.CalculateEnergyBound(constraints) };
-
-            int currentIteration = 1;
-            DateTime lastOutputTime = startTime;
-            int processedConstraintSets = 0;
-            while (!front.Min.Constraints.CheckIfSatisfied(this.maxCoordFreedom, this.maxWidthFreedom) && !this.IsStopping)
+            this.processedConstraintSets = 0;
+            this.splitCount = 0;
+            this.coarseBoundCount = 0;
+            this.deferredBoundCount = 0;
+
+            SearchFront front = new SearchFront(constraints.ShapeStructure, this.frontMemoryBudget);
+            this.checkpointTask = null;
+            this.lastCheckpointTime = DateTime.Now;
+            if (this.CheckpointPath != null || this.resumeCheckpointPath != null)
+                this.segmentationTermsHash = this.CalculateSegmentationTermsHash();
+            try
             {
-                this.WaitIfPaused();
+                if (this.resumeCheckpointPath != null)
+                    this.LoadCheckpoint(this.resumeCheckpointPath, front);
+                else
+                {
+                    EnergyBound rootBound = this.CalculateEnergyBound(contexts[0], constraints);
+                    rootBound.Compact(null);
+                    front.Add(rootBound);
+                }
+
+                // First worker runs on the calling thread and reports progress
+                Task[] workerTasks = new Task[contexts.Length - 1];
+                for (int i = 1; i < contexts.Length; ++i)
+                {
+                    BoundCalculationContext context = contexts[i];
+                    workerTasks[i - 1] = Task.Factory.StartNew(
+                        () => this.RunBranchAndBoundWorker(context, front, false), TaskCreationOptions.LongRunning);
+                }
 
-                EnergyBound parentLowerBound = front.Min;
-                front.Remove(parentLowerBound);
+                try
+                {
+                    this.RunBranchAndBoundWorker(contexts[0], front, true);
+                }
+                finally
+                {
+                    Task.WaitAll(workerTasks);
+                }
 
-                List<ShapeConstraints> expandedConstraints = parentLowerBound.Constraints.SplitMostFree(this.maxCoordFreedom, this.maxWidthFreedom);
-                foreach (ShapeConstraints constraintsSet in expandedConstraints)
+                this.WaitForCheckpoint();
+                if (this.CheckpointPath != null && this.IsStopping)
+                {
+                    using (FrontSnapshot snapshot = front.CreateSnapshot())
+                        this.WriteCheckpoint(this.CheckpointPath, snapshot, this.splitCount);
+                }
+            }
+            catch
+            {
+                // Spilled runs should not be deleted while the checkpoint is copying them
+                try
+                {
+                    this.WaitForCheckpoint();
+                }
+                catch (AggregateException)
                 {
-                    EnergyBound lowerBound = this.CalculateEnergyBound(constraintsSet);
-                    front.Add(lowerBound);
+                }
 
-                    // Uncomment for strong invariants check
-                    //ObjectBackgroundTerm[,] lowerBoundShapeTerm = new ObjectBackgroundTerm[this.segmentedImage.Width, this.segmentedImage.Height];
-                    //for (int i = 0; i < this.segmentedImage.Width; ++i)
-                    //    for (int j = 0; j < this.segmentedImage.Height; ++j)
-                    //        lowerBoundShapeTerm[i, j] = CpuBranchAndBoundShapeTermsCalculator.CalculateShapeTerm(lowerBound.Constraints, new Point(i, j));
-                    //ObjectBackgroundTerm[,] parentLowerBoundShapeTerm = new ObjectBackgroundTerm[this.segmentedImage.Width, this.segmentedImage.Height];
-                    //for (int i = 0; i < this.segmentedImage.Width; ++i)
-                    //    for (int j = 0; j < this.segmentedImage.Height; ++j)
-                    //        parentLowerBoundShapeTerm[i, j] = CpuBranchAndBoundShapeTermsCalculator.CalculateShapeTerm(parentLowerBound.Constraints, new Point(i, j));
-                    //for (int i = 0; i < this.segmentedImage.Width; ++i)
-                    //    for (int j = 0; j < this.segmentedImage.Height; ++j)
-                    //    {
-                    //        Debug.Assert(lowerBoundShapeTerm[i, j].ObjectTerm >= parentLowerBoundShapeTerm[i, j].ObjectTerm - 1e-7);
-                    //        Debug.Assert(lowerBoundShapeTerm[i, j].BackgroundTerm >= parentLowerBoundShapeTerm[i, j].BackgroundTerm - 1e-7);
-                    //        //CalculateShapeTerm(lowerBound.Constraints, new Point(0, 67));
-                    //        //CalculateShapeTerm(parentLowerBound.Constraints, new Point(0, 67));
-                    //    }
+                front.Dispose();
+                throw;
+            }
 
-                    // Lower bound should not decrease (check always, it's important!)
-                    Trace.Assert(lowerBound.SegmentationEnergy >= parentLowerBound.SegmentationEnergy - 1e-6);
-                    Trace.Assert(lowerBound.ShapeEnergy >= parentLowerBound.ShapeEnergy - 1e-6);
+            if (front.PrunedBoundCount > 0)
+                DebugConfiguration.WriteImportantDebugText("{0} bounds exceeding the best shape energy were pruned.", front.PrunedBoundCount);
+            if (front.SpilledBoundCount > 0)
+                DebugConfiguration.WriteImportantDebugText("{0} bounds were moved from memory to disk.", front.SpilledBoundCount);
 
-                    //this.CalculateEnergyBound(lowerBound.Constraints);
-                    //this.CalculateEnergyBound(parentLowerBound.Constraints);
+            return front;
+        }
 
-                    ++processedConstraintSets;
+        private void RunBranchAndBoundWorker(BoundCalculationContext context, SearchFront front, bool reportProgress)
+        {
+            try
+            {
+                DateTime lastOutputTime = startTime;
+                int nextReportIteration = this.ProgressReportRate;
+                while (true)
+                {
+                    this.WaitIfPaused();
+
+                    EnergyBound parentLowerBound = front.TakeBest(
+                        bound => bound.IsComplete && bound.CompactConstraints.CheckIfSatisfied(this.maxCoordFreedom, this.maxWidthFreedom),
+                        () => this.IsStopping);
+                    if (parentLowerBound == null)
+                        break;
+
+                    // Cheap and coarse bounds are completed only when they get to the top of the front
+                    if (!parentLowerBound.IsComplete)
+                    {
+                        EnergyBound completedBound = this.CompleteEnergyBound(context, parentLowerBound, front);
+                        completedBound.Compact(parentLowerBound);
+                        front.FinishProcessing(parentLowerBound, new[] { completedBound });
+                        continue;
+                    }
+
+                    // Children are added to the front along with finishing the parent, so that checkpoints don't contain both
+                    List<ShapeConstraints> expandedConstraints = parentLowerBound.Constraints.SplitMostFree(this.maxCoordFreedom, this.maxWidthFreedom);
+                    List<EnergyBound> childLowerBounds = new List<EnergyBound>(expandedConstraints.Count);
+                    EnergyBound bestChildLowerBound = null;
+                    foreach (ShapeConstraints constraintsSet in expandedConstraints)
+                    {
+                        EnergyBound lowerBound = this.CalculateEnergyBound(context, constraintsSet, parentLowerBound, front);
+                        lowerBound.Compact(parentLowerBound);
+                        childLowerBounds.Add(lowerBound);
+                        if (bestChildLowerBound == null || lowerBound.Bound < bestChildLowerBound.Bound)
+                            bestChildLowerBound = lowerBound;
+
+                        // Uncomment for strong invariants check
+                        //ObjectBackgroundTerm[,] lowerBoundShapeTerm = new ObjectBackgroundTerm[this.segmentedImage.Width, this.segmentedImage.Height];
+                        //for (int i = 0; i < this.segmentedImage.Width; ++i)
+                        //    for (int j = 0; j < this.segmentedImage.Height; ++j)
+                        //        lowerBoundShapeTerm[i, j] = CpuBranchAndBoundShapeTermsCalculator.CalculateShapeTerm(lowerBound.Constraints, new Point(i, j));
+                        //ObjectBackgroundTerm[,] parentLowerBoundShapeTerm = new ObjectBackgroundTerm[this.segmentedImage.Width, this.segmentedImage.Height];
+                        //for (int i = 0; i < this.segmentedImage.Width; ++i)
+                        //    for (int j = 0; j < this.segmentedImage.Height; ++j)
+                        //        parentLowerBoundShapeTerm[i, j] = CpuBranchAndBoundShapeTermsCalculator.CalculateShapeTerm(parentLowerBound.Constraints, new Point(i, j));
+                        //for (int i = 0; i < this.segmentedImage.Width; ++i)
+                        //    for (int j = 0; j < this.segmentedImage.Height; ++j)
+                        //    {
+                        //        Debug.Assert(lowerBoundShapeTerm[i, j].ObjectTerm >= parentLowerBoundShapeTerm[i, j].ObjectTerm - 1e-7);
+                        //        Debug.Assert(lowerBoundShapeTerm[i, j].BackgroundTerm >= parentLowerBoundShapeTerm[i, j].BackgroundTerm - 1e-7);
+                        //        //CalculateShapeTerm(lowerBound.Constraints, new Point(0, 67));
+                        //        //CalculateShapeTerm(parentLowerBound.Constraints, new Point(0, 67));
+                        //    }
+
+                        // Lower bound should not decrease (check always, it's important!)
+                        Trace.Assert(lowerBound.SegmentationEnergy >= parentLowerBound.SegmentationEnergy - 1e-6);
+                        Trace.Assert(lowerBound.ShapeEnergy >= parentLowerBound.ShapeEnergy - 1e-6);
+
+                        //this.CalculateEnergyBound(lowerBound.Constraints);
+                        //this.CalculateEnergyBound(parentLowerBound.Constraints);
+
+                        Interlocked.Increment(ref this.processedConstraintSets);
+                    }
+
+                    front.FinishProcessing(parentLowerBound, childLowerBounds);
+                    int currentIteration = Interlocked.Increment(ref this.splitCount);
+
+                    if (this.UseDiving && (currentIteration == 1 || currentIteration % this.divingRate == 0))
+                        this.DiveToIncumbent(context, bestChildLowerBound, front);
+
+                    if (reportProgress)
+                        this.StartCheckpointIfDue(front);
+
+                    // Some debug output
+                    if (reportProgress && currentIteration >= nextReportIteration)
+                    {
+                        nextReportIteration = currentIteration - currentIteration % this.ProgressReportRate + this.ProgressReportRate;
+
+                        // Front can be taken completely by the other workers
+                        EnergyBound currentMin = front.Min;
+                        if (currentMin == null)
+                            continue;
+
+                        DateTime currentTime = DateTime.Now;
+                        int processedConstraintSetCount = Interlocked.Exchange(ref this.processedConstraintSets, 0);
+
+                        DebugConfiguration.WriteDebugText(
+                            "On iteration {0} front contains {1} constraint sets.", currentIteration, front.Count);
+                        DebugConfiguration.WriteDebugText(
+                            "Current lower bound is {0:0.0000} ({1:0.0000} + {2:0.0000}).",
+                            currentMin.Bound,
+                            currentMin.SegmentationEnergy,
+                            currentMin.ShapeEnergy * this.ShapeEnergyWeight);
+                        double processingSpeed = processedConstraintSetCount / (currentTime - lastOutputTime).TotalSeconds;
+                        DebugConfiguration.WriteDebugText("Processing speed is {0:0.000} items per sec", processingSpeed);
+
+                        double maxVertexConstraintsFreedom = currentMin.Constraints.VertexConstraints.Max(c => c.Freedom);
+                        double maxEdgeConstraintsFreedom = currentMin.Constraints.EdgeConstraints.Max(c => c.Freedom);
+                        DebugConfiguration.WriteDebugText(
+                            "Max vertex freedom: {0:0.00}, max edge freedom: {1:0.00}",
+                            maxVertexConstraintsFreedom,
+                            maxEdgeConstraintsFreedom);
+
+                        DebugConfiguration.WriteDebugText("Elapsed time: {0}", DateTime.Now - this.startTime);
+
+                        DebugConfiguration.WriteDebugText();
+
+                        this.ReportBranchAndBoundProgress(context, currentMin, processedConstraintSetCount);
+
+                        lastOutputTime = currentTime;
+                        Interlocked.Exchange(ref this.coarseBoundCount, 0);
+                        Interlocked.Exchange(ref this.deferredBoundCount, 0);
+                    }
                 }
+            }
+            catch
+            {
+                // Other workers should not wait for the bounds this worker will never finish
+                front.Abort();
+                throw;
+            }
+        }
+
+        private void DiveToIncumbent(BoundCalculationContext context, EnergyBound startBound, SearchFront front)
+        {
+            // Bounds in the dive are never compared with the front, so they are calculated in full
+            EnergyBound currentBound = startBound;
+            while (!currentBound.Constraints.CheckIfSatisfied(this.maxCoordFreedom, this.maxWidthFreedom))
+            {
+                if (this.IsStopping)
+                    return;
 
-                // Some debug output
-                if (currentIteration % this.ProgressReportRate == 0)
+                EnergyBound bestChildBound = null;
+                foreach (ShapeConstraints constraintsSet in currentBound.Constraints.SplitMostFree(this.maxCoordFreedom, this.maxWidthFreedom))
                 {
-                    DateTime currentTime = DateTime.Now;
-                    EnergyBound currentMin = front.Min;
+                    EnergyBound childBound = this.CalculateFullEnergyBound(context, constraintsSet, currentBound, null);
+                    if (bestChildBound == null || childBound.Bound < bestChildBound.Bound)
+                        bestChildBound = childBound;
+                }
 
-                    DebugConfiguration.WriteDebugText(
-                        "On iteration {0} front contains {1} constraint sets.", currentIteration, front.Count);
-                    DebugConfiguration.WriteDebugText(
-                        "Current lower bound is {0:0.0000} ({1:0.0000} + {2:0.0000}).",
-                        currentMin.Bound,
-                        currentMin.SegmentationEnergy,
-                        currentMin.ShapeEnergy * this.ShapeEnergyWeight);
-                    double processingSpeed = processedConstraintSets / (currentTime - lastOutputTime).TotalSeconds;
-                    DebugConfiguration.WriteDebugText("Processing speed is {0:0.000} items per sec", processingSpeed);
-
-                    double maxVertexConstraintsFreedom = currentMin.Constraints.VertexConstraints.Max(c => c.Freedom);
-                    double maxEdgeConstraintsFreedom = currentMin.Constraints.EdgeConstraints.Max(c => c.Freedom);
-                    DebugConfiguration.WriteDebugText(
-                        "Max vertex freedom: {0:0.00}, max edge freedom: {1:0.00}",
-                        maxVertexConstraintsFreedom,
-                        maxEdgeConstraintsFreedom);
+                currentBound = bestChildBound;
+            }
+
+            // Incumbent prunes the front, so it should be the exact energy of a shape and not a lower bound
+            EnergyBound shapeEnergyBound = this.CalculateShapeEnergy(context, currentBound.Constraints.CollapseToShape());
+            shapeEnergyBound.Compact(null);
+            int prunedBoundCount;
+            if (front.TryImproveIncumbent(shapeEnergyBound, out prunedBoundCount))
+            {
+                DebugConfiguration.WriteDebugText(
+                    "Diving found a shape with energy {0:0.0000}, {1} bounds pruned.", shapeEnergyBound.Bound, prunedBoundCount);
+            }
+        }
+
+        private void StartCheckpointIfDue(SearchFront front)
+        {
+            if (this.CheckpointPath == null || DateTime.Now - this.lastCheckpointTime < this.checkpointInterval)
+                return;
+
+            // Search should not wait for the previous checkpoint, it's better to write the next one a bit later
+            if (this.checkpointTask != null && !this.checkpointTask.IsCompleted)
+                return;
+            this.WaitForCheckpoint();
+
+            FrontSnapshot snapshot = front.CreateSnapshot();
+            string path = this.CheckpointPath;
+            int currentSplitCount = this.splitCount;
+            this.lastCheckpointTime = DateTime.Now;
+            this.checkpointTask = Task.Factory.StartNew(
+                () =>
+                {
+                    using (snapshot)
+                        this.WriteCheckpoint(path, snapshot, currentSplitCount);
+                },
+                TaskCreationOptions.LongRunning);
+        }
+
+        private void WaitForCheckpoint()
+        {
+            // Failure of the background checkpoint is reported here
+            if (this.checkpointTask != null)
+            {
+                Task task = this.checkpointTask;
+                this.checkpointTask = null;
+                task.Wait();
+            }
+        }
 
-                    DebugConfiguration.WriteDebugText("Elapsed time: {0}", DateTime.Now - this.startTime);
+        private void WriteCheckpoint(string path, FrontSnapshot snapshot, int currentSplitCount)
+        {
+            // Previous checkpoint is replaced only by the complete new one
+            string temporaryPath = path + ".tmp";
+            using (FileStream stream = new FileStream(temporaryPath, FileMode.Create, FileAccess.Write, FileShare.None, CheckpointFileBufferSize))
+            using (BinaryWriter writer = new BinaryWriter(stream))
+            {
+                writer.Write(CheckpointSignature);
+                writer.Write(CheckpointFormatVersion);
+                writer.Write(CalculateShapeModelHash(this.ShapeModel));
+                writer.Write(this.ImageSegmentator.ImageSize.Width);
+                writer.Write(this.ImageSegmentator.ImageSize.Height);
+                writer.Write(this.segmentationTermsHash);
+                writer.Write(currentSplitCount);
+
+                writer.Write(snapshot.Incumbent != null);
+                if (snapshot.Incumbent != null)
+                    snapshot.Incumbent.WriteTo(writer);
+
+                writer.Write(snapshot.BoundCount);
+                snapshot.WriteBoundsTo(writer);
+            }
 
-                    DebugConfiguration.WriteDebugText();
+            if (File.Exists(path))
+                File.Replace(temporaryPath, path, null);
+            else
+                File.Move(temporaryPath, path);
 
-                    this.ReportBranchAndBoundProgress(front);
+            DebugConfiguration.WriteDebugText("Checkpoint with {0} constraint sets written to {1}.", snapshot.BoundCount, path);
+        }
 
-                    lastOutputTime = currentTime;
-                    processedConstraintSets = 0;
+        private void LoadCheckpoint(string path, SearchFront front)
+        {
+            using (FileStream stream = new FileStream(path, FileMode.Open, FileAccess.Read, FileShare.Read, CheckpointFileBufferSize))
+            using (BinaryReader reader = new BinaryReader(stream))
+            {
+                if (reader.ReadInt32() != CheckpointSignature || reader.ReadInt32() != CheckpointFormatVersion)
+                    throw new InvalidOperationException("Given file is not a branch-and-bound checkpoint of the supported version.");
+                if (reader.ReadInt64() != CalculateShapeModelHash(this.ShapeModel))
+                    throw new InvalidOperationException("Given checkpoint was made with a different shape model.");
+                if (reader.ReadInt32() != this.ImageSegmentator.ImageSize.Width || reader.ReadInt32() != this.ImageSegmentator.ImageSize.Height)
+                    throw new InvalidOperationException("Given checkpoint was made for an image of different size.");
+                if (reader.ReadInt64() != this.segmentationTermsHash)
+                    throw new InvalidOperationException("Given checkpoint was made for a different image, color models or energy term weights.");
+
+                this.splitCount = reader.ReadInt32();
+
+                ShapeStructure structure = this.ShapeModel.Structure;
+                if (reader.ReadBoolean())
+                {
+                    int prunedBoundCount;
+                    front.TryImproveIncumbent(EnergyBound.ReadFrom(reader, structure), out prunedBoundCount);
                 }
 
-                currentIteration += 1;
+                long boundCount = reader.ReadInt64();
+                for (long i = 0; i < boundCount; ++i)
+                    front.Add(EnergyBound.ReadFrom(reader, structure));
+
+                DebugConfiguration.WriteImportantDebugText(
+                    "Search resumed from iteration {0} with {1} constraint sets in the front.", this.splitCount, boundCount);
             }
+        }
 
-            return front;
+        private static long CalculateShapeModelHash(ShapeModel model)
+        {
+            // Values the bounds depend on
+            List<long> values = new List<long>();
+            values.Add(model.Structure.VertexCount);
+            for (int i = 0; i < model.Structure.Edges.Count; ++i)
+            {
+                ShapeEdge edge = model.Structure.Edges[i];
+                ShapeEdgeParams edgeParams = model.GetEdgeParams(i);
+                values.Add(edge.Index1);
+                values.Add(edge.Index2);
+                values.Add(BitConverter.DoubleToInt64Bits(edgeParams.WidthToEdgeLengthRatio));
+                values.Add(BitConverter.DoubleToInt64Bits(edgeParams.WidthToEdgeLengthRatioDeviation));
+            }
+
+            foreach (Tuple<int, int> edgePair in model.ConstrainedEdgePairs)
+            {
+                ShapeEdgePairParams edgePairParams = model.GetEdgePairParams(edgePair.Item1, edgePair.Item2);
+                values.Add(edgePair.Item1);
+                values.Add(edgePair.Item2);
+                values.Add(BitConverter.DoubleToInt64Bits(edgePairParams.MeanAngle));
+                values.Add(BitConverter.DoubleToInt64Bits(edgePairParams.MeanLengthRatio));
+                values.Add(BitConverter.DoubleToInt64Bits(edgePairParams.AngleDeviation));
+                values.Add(BitConverter.DoubleToInt64Bits(edgePairParams.LengthDiffDeviation));
+            }
+
+            values.Add(model.RootEdgeIndex);
+            values.Add(BitConverter.DoubleToInt64Bits(model.RootEdgeMeanLength));
+            values.Add(BitConverter.DoubleToInt64Bits(model.RootEdgeLengthDeviation));
+
+            return CalculateHash(values);
         }
 
-        private void ReportBranchAndBoundProgress(SortedSet<EnergyBound> front)
+        private long CalculateSegmentationTermsHash()
         {
-            EnergyBound currentMin = front.Min;
+            // Bounds depend on the image through its color terms and the pairwise terms, which are built from pixel colors
+            List<long> values = new List<long>();
+            Image2D<Color> image = this.ImageSegmentator.GetSegmentedImage();
+            Image2D<ObjectBackgroundTerm> colorTerms = this.ImageSegmentator.GetColorTerms();
+            for (int x = 0; x < image.Width; ++x)
+            {
+                for (int y = 0; y < image.Height; ++y)
+                {
+                    values.Add(image[x, y].ToArgb());
+                    values.Add(BitConverter.DoubleToInt64Bits(colorTerms[x, y].ObjectTerm));
+                    values.Add(BitConverter.DoubleToInt64Bits(colorTerms[x, y].BackgroundTerm));
+                }
+            }
 
-            // In order to report various masks we need to segment image again
-            this.SegmentImageWithConstraints(currentMin.Constraints);
+            values.Add(BitConverter.DoubleToInt64Bits(this.ObjectColorUnaryTermWeight));
+            values.Add(BitConverter.DoubleToInt64Bits(this.BackgroundColorUnaryTermWeight));
+            values.Add(BitConverter.DoubleToInt64Bits(this.ObjectShapeUnaryTermWeight));
+            values.Add(BitConverter.DoubleToInt64Bits(this.BackgroundShapeUnaryTermWeight));
+            values.Add(BitConverter.DoubleToInt64Bits(this.ColorDifferencePairwiseTermCutoff));
+            values.Add(BitConverter.DoubleToInt64Bits(this.ColorDifferencePairwiseTermWeight));
+            values.Add(BitConverter.DoubleToInt64Bits(this.ConstantPairwiseTermWeight));
+            values.Add(BitConverter.DoubleToInt64Bits(this.ShapeEnergyWeight));
+
+            return CalculateHash(values);
+        }
+
+        private static long CalculateHash(IEnumerable<long> values)
+        {
+            // 64-bit FNV-1a over the bytes of the values
+            ulong hash = 14695981039346656037;
+            foreach (long value in values)
+            {
+                for (int i = 0; i < sizeof(long); ++i)
+                {
+                    hash ^= (byte)(value >> (i * 8));
+                    hash = unchecked(hash * 1099511628211);
+                }
+            }
+
+            return unchecked((long)hash);
+        }
+
+        private void ReportBranchAndBoundProgress(BoundCalculationContext context, EnergyBound currentMin, int processedConstraintSets)
+        {
+            // In order to report various masks we need to segment image again (always in full resolution)
+            double fullResolutionSegmentationEnergy = this.SegmentImageWithShapeTermsLowerBound(context, currentMin.Constraints, true);
+            double coarseBoundFraction = processedConstraintSets == 0 ? 0 : (double)this.coarseBoundCount / processedConstraintSets;
+            double coarseBoundLooseness = fullResolutionSegmentationEnergy - currentMin.SegmentationEnergy;
+            if (coarseBoundFraction > 0)
+            {
+                DebugConfiguration.WriteDebugText(
+                    "Coarse shape terms used for {0:0.0}% of bounds, current bound looseness is {1:0.0000}.",
+                    coarseBoundFraction * 100,
+                    coarseBoundLooseness);
+            }
+
+            if (this.deferredBoundCount > 0)
+            {
+                DebugConfiguration.WriteDebugText(
+                    "Expensive bound stages postponed for {0:0.0}% of bounds.",
+                    processedConstraintSets == 0 ? 0 : this.deferredBoundCount * 100.0 / processedConstraintSets);
+            }
+
+            // Statistics of the reporting worker are representative for the others
+            ShapeEnergyLowerBoundCalculator treeLowerBoundCalculator = context.ShapeEnergyLowerBoundCalculator as ShapeEnergyLowerBoundCalculator;
+            if (treeLowerBoundCalculator != null && treeLowerBoundCalculator.CachedSubtreeTransformCount > 0)
+            {
+                DebugConfiguration.WriteDebugText(
+                    "{0} subtree transforms cached, cache hit rate is {1:0.0}%.",
+                    treeLowerBoundCalculator.CachedSubtreeTransformCount,
+                    treeLowerBoundCalculator.SubtreeTransformCacheHitRate * 100);
+            }
+
+            double coarseGridBoundFraction = 0, meanGridCellCount = 0;
+            if (treeLowerBoundCalculator != null)
+            {
+                long shapeBoundCount = treeLowerBoundCalculator.CalculatedBoundCount - this.reportedShapeBoundCount;
+                long transformCount = treeLowerBoundCalculator.ComputedTransformCount - this.reportedTransformCount;
+                if (shapeBoundCount > 0)
+                {
+                    coarseGridBoundFraction =
+                        (double)(treeLowerBoundCalculator.CoarseGridBoundCount - this.reportedCoarseGridBoundCount) / shapeBoundCount;
+                }
+                if (transformCount > 0)
+                    meanGridCellCount = (double)(treeLowerBoundCalculator.ComputedGridCellCount - this.reportedGridCellCount) / transformCount;
+                if (coarseGridBoundFraction > 0)
+                {
+                    DebugConfiguration.WriteDebugText(
+                        "Coarse grids used for {0:0.0}% of shape energy bounds, {1:0} grid cells per transform on average.",
+                        coarseGridBoundFraction * 100,
+                        meanGridCellCount);
+                }
+
+                this.RememberReportedGridStatistics();
+            }
 
             // Raise status report event
             BranchAndBoundProgressEventArgs args = new BranchAndBoundProgressEventArgs(
-                front.Min.Bound, this.ImageSegmentator.GetLastSegmentationMask(), this.ImageSegmentator.GetLastUnaryTerms(), this.ImageSegmentator.GetLastShapeTerms(), currentMin.Constraints);
+                currentMin.Bound,
+                context.ImageSegmentator.GetLastSegmentationMask(),
+                context.ImageSegmentator.GetLastUnaryTerms(),
+                context.ImageSegmentator.GetLastShapeTerms(),
+                currentMin.Constraints,
+                coarseBoundFraction,
+                coarseBoundLooseness,
+                coarseGridBoundFraction,
+                meanGridCellCount);
             if (this.BreadthFirstBranchAndBoundProgress != null)
                 this.BreadthFirstBranchAndBoundProgress.Invoke(this, args);
         }
 
-        private void ReportBranchAndBoundCompletion(EnergyBound result)
+        private void ReportBranchAndBoundCompletion(BoundCalculationContext context, EnergyBound result)
         {
             // In order to report various masks we need to segment image again
-            this.SegmentImageWithConstraints(result.Constraints.Collapse());
+            this.SegmentImageWithConstraints(context, result.Constraints.Collapse());
 
             BranchAndBoundCompletedEventArgs args = new BranchAndBoundCompletedEventArgs(
-                this.ImageSegmentator.GetLastSegmentationMask(), this.ImageSegmentator.GetLastUnaryTerms(), this.ImageSegmentator.GetLastShapeTerms(), result.Constraints, result.Bound);
+                context.ImageSegmentator.GetLastSegmentationMask(), context.ImageSegmentator.GetLastUnaryTerms(), context.ImageSegmentator.GetLastShapeTerms(), result.Constraints, result.Bound);
             if (this.BranchAndBoundCompleted != null)
                 this.BranchAndBoundCompleted.Invoke(this, args);
         }
 
-        private EnergyBound CalculateEnergyBound(ShapeConstraints constraintsSet)
+        private void RememberReportedGridStatistics()
         {
-            this.shapeTermsCalculator.CalculateShapeTerms(this.ShapeModel, constraintsSet, this.shapeUnaryTerms);
-            double segmentationEnergy = this.ImageSegmentator.SegmentImageWithShapeTerms((x, y) => this.shapeUnaryTerms[x, y]);
-            double shapeEnergy = this.shapeEnergyLowerBoundCalculator.CalculateLowerBound(this.ImageSegmentator.ImageSize, this.ShapeModel, constraintsSet);
-            return new EnergyBound(constraintsSet, shapeEnergy, segmentationEnergy, this.ShapeEnergyWeight);
+            // Progress is reported by the first worker, which uses the calculator of the algorithm
+            ShapeEnergyLowerBoundCalculator treeLowerBoundCalculator = this.shapeEnergyLowerBoundCalculator as ShapeEnergyLowerBoundCalculator;
+            if (treeLowerBoundCalculator == null)
+                return;
+
+            this.reportedShapeBoundCount = treeLowerBoundCalculator.CalculatedBoundCount;
+            this.reportedCoarseGridBoundCount = treeLowerBoundCalculator.CoarseGridBoundCount;
+            this.reportedTransformCount = treeLowerBoundCalculator.ComputedTransformCount;
+            this.reportedGridCellCount = treeLowerBoundCalculator.ComputedGridCellCount;
         }
 
-        private Image2D<bool> SegmentImageWithConstraints(ShapeConstraints constraintsSet)
+        private static ShapeEnergyLowerBoundCalculator CreateDefaultShapeEnergyLowerBoundCalculator()
         {
-            this.shapeTermsCalculator.CalculateShapeTerms(this.ShapeModel, constraintsSet, this.shapeUnaryTerms);
-            this.ImageSegmentator.SegmentImageWithShapeTerms((x, y) => this.shapeUnaryTerms[x, y]);
-            return this.ImageSegmentator.GetLastSegmentationMask();
+            ShapeEnergyLowerBoundCalculator result = new ShapeEnergyLowerBoundCalculator(DefaultLengthGridSize, DefaultAngleGridSize);
+            result.UseAdaptiveGrids = true;
+            return result;
         }
 
-        private class EnergyBound : IComparable<EnergyBound>
+        private BoundCalculationContext[] CreateBoundCalculationContexts()
         {
-            public ShapeConstraints Constraints { get; private set; }
+            // Calculators of the other workers should give the same bounds, which can't be guaranteed by default factories
+            if (this.workerCount > 1 &&
+                (this.shapeTermsCalculatorFactory == null ||
+                 this.coarseShapeTermsCalculatorFactory == null ||
+                 this.shapeEnergyLowerBoundCalculatorFactory == null))
+            {
+                throw new InvalidOperationException("Calculator factories should be specified if more than one worker is used.");
+            }
 
-            public double Bound { get; private set; }
+            BoundCalculationContext[] result = new BoundCalculationContext[this.workerCount];
+            result[0] = new BoundCalculationContext(
+                this.ImageSegmentator, this.shapeTermsCalculator, this.coarseShapeTermsCalculator, this.shapeEnergyLowerBoundCalculator);
+            for (int i = 1; i < result.Length; ++i)
+            {
+                IShapeTermsLowerBoundCalculator workerShapeTermsCalculator = this.shapeTermsCalculatorFactory();
+                IShapeTermsLowerBoundCalculator workerCoarseShapeTermsCalculator = this.coarseShapeTermsCalculatorFactory();
+                IShapeEnergyLowerBoundCalculator workerShapeEnergyLowerBoundCalculator = this.shapeEnergyLowerBoundCalculatorFactory();
+                if (workerShapeTermsCalculator == null || workerCoarseShapeTermsCalculator == null || workerShapeEnergyLowerBoundCalculator == null)
+                    throw new InvalidOperationException("Calculator factories should never return null.");
+
+                result[i] = new BoundCalculationContext(
+                    this.ImageSegmentator.Clone(),
+                    workerShapeTermsCalculator,
+                    workerCoarseShapeTermsCalculator,
+                    workerShapeEnergyLowerBoundCalculator);
+            }
 
-            public double ShapeEnergy { get; private set; }
+            return result;
+        }
 
-            public double SegmentationEnergy { get; private set; }
+        private EnergyBound CalculateEnergyBound(BoundCalculationContext context, ShapeConstraints constraintsSet)
+        {
+            return this.CalculateFullEnergyBound(context, constraintsSet, null, null);
+        }
 
-            private static long instanceCount;
+        private EnergyBound CalculateEnergyBound(BoundCalculationContext context, ShapeConstraints constraintsSet, EnergyBound parentBound, SearchFront front)
+        {
+            if (!this.UseBoundCascade)
+                return this.CalculateFullEnergyBound(context, constraintsSet, parentBound, front);
+
+            // Bound of the parent is valid for its children, so it is the first stage of the cascade
+            EnergyBound inheritedBound = new EnergyBound(
+                constraintsSet,
+                parentBound.ShapeEnergy,
+                parentBound.SegmentationEnergy,
+                this.ShapeEnergyWeight,
+                false,
+                EnergyBoundStage.Inherited);
+            EnergyBound result = this.ContinueBoundCascade(context, inheritedBound, front);
+            if (result.Stage != EnergyBoundStage.Full)
+                Interlocked.Increment(ref this.deferredBoundCount);
+            return result;
+        }
 
-            private readonly long instanceId;
+        private EnergyBound CompleteEnergyBound(BoundCalculationContext context, EnergyBound bound, SearchFront front)
+        {
+            return bound.Stage == EnergyBoundStage.Full
+                ? this.RefineEnergyBound(context, bound, front)
+                : this.ContinueBoundCascade(context, bound, front);
+        }
 
-            public EnergyBound(
-                ShapeConstraints constraints,
-                double shapeEnergy,
-                double segmentationEnergy,
-                double shapeEnergyWeight)
+        private EnergyBound ContinueBoundCascade(BoundCalculationContext context, EnergyBound bound, SearchFront front)
+        {
+            while (bound.Stage != EnergyBoundStage.Full)
             {
-                Debug.Assert(constraints != null);
-
-                this.Constraints = constraints;
-                this.ShapeEnergy = shapeEnergy;
-                this.SegmentationEnergy = segmentationEnergy;
-                this.Bound = shapeEnergy * shapeEnergyWeight + segmentationEnergy;
+                bound = this.CalculateNextStageEnergyBound(context, bound, front);
 
-                this.instanceId = Interlocked.Increment(ref instanceCount);
+                // Bounds that can't get to the top of the front soon wait there for the remaining stages
+                if (bound.Stage != EnergyBoundStage.Full && bound.Bound > front.MinBound + this.boundCascadeMargin)
+                    break;
+            }
+
+            return bound;
+        }
+
+        private EnergyBound CalculateNextStageEnergyBound(BoundCalculationContext context, EnergyBound bound, SearchFront front)
+        {
+            switch (bound.Stage)
+            {
+                case EnergyBoundStage.Inherited:
+                {
+                    // Shape energy without pairwise terms
+                    double shapeEnergy = bound.ShapeEnergy;
+                    ShapeEnergyLowerBoundCalculator treeLowerBoundCalculator = context.ShapeEnergyLowerBoundCalculator as ShapeEnergyLowerBoundCalculator;
+                    if (treeLowerBoundCalculator != null)
+                    {
+                        shapeEnergy = Math.Max(
+                            shapeEnergy, treeLowerBoundCalculator.CalculateIndependentEdgesLowerBound(this.ShapeModel, bound.Constraints));
+                    }
+
+                    return new EnergyBound(
+                        bound.Constraints, shapeEnergy, bound.SegmentationEnergy, this.ShapeEnergyWeight, false, EnergyBoundStage.IndependentEdges);
+                }
+
+                case EnergyBoundStage.IndependentEdges:
+                {
+                    // Segmentation energy without pairwise terms, shape terms are kept for the next stage
+                    ObjectBackgroundTermPlanes shapeTerms = this.CalculateShapeTermsLowerBound(
+                        context, bound.Constraints, !this.ShouldUseCoarseShapeTerms(bound.Constraints));
+                    double segmentationEnergy = Math.Max(
+                        bound.SegmentationEnergy, context.ImageSegmentator.CalculateUnaryEnergyLowerBound(shapeTerms));
+                    return new EnergyBound(
+                        bound.Constraints, bound.ShapeEnergy, segmentationEnergy, this.ShapeEnergyWeight, false, EnergyBoundStage.UnaryTerms);
+                }
+
+                default:
+                    return this.CalculateFullEnergyBound(context, bound.Constraints, bound, front);
+            }
+        }
+
+        private EnergyBound CalculateFullEnergyBound(BoundCalculationContext context, ShapeConstraints constraintsSet, EnergyBound lowerBound, SearchFront front)
+        {
+            double segmentationEnergy = this.SegmentImageWithShapeTermsLowerBound(context, constraintsSet);
+            bool isShapeEnergyRefined;
+            double shapeEnergy = this.CalculateShapeEnergyLowerBound(
+                context, constraintsSet, this.GetShapeEnergyRefinementThreshold(front, segmentationEnergy), out isShapeEnergyRefined);
+
+            // Bounds of the parent and of the cheaper stages are valid too, and coarse bounds can be looser than them
+            if (lowerBound != null)
+            {
+                segmentationEnergy = Math.Max(segmentationEnergy, lowerBound.SegmentationEnergy);
+                shapeEnergy = Math.Max(shapeEnergy, lowerBound.ShapeEnergy);
+            }
+
+            return new EnergyBound(
+                constraintsSet, shapeEnergy, segmentationEnergy, this.ShapeEnergyWeight, isShapeEnergyRefined, EnergyBoundStage.Full);
+        }
+
+        private EnergyBound RefineEnergyBound(BoundCalculationContext context, EnergyBound bound, SearchFront front)
+        {
+            bool isShapeEnergyRefined;
+            double shapeEnergy = this.CalculateShapeEnergyLowerBound(
+                context, bound.Constraints, this.GetShapeEnergyRefinementThreshold(front, bound.SegmentationEnergy), out isShapeEnergyRefined);
+            return new EnergyBound(
+                bound.Constraints,
+                Math.Max(shapeEnergy, bound.ShapeEnergy),
+                bound.SegmentationEnergy,
+                this.ShapeEnergyWeight,
+                isShapeEnergyRefined,
+                EnergyBoundStage.Full);
+        }
+
+        private double GetShapeEnergyRefinementThreshold(SearchFront front, double segmentationEnergy)
+        {
+            // Bound should be refined if it can get to the top of the front
+            if (front == null || this.ShapeEnergyWeight <= 0)
+                return Double.PositiveInfinity;
+            return (front.MinBound - segmentationEnergy) / this.ShapeEnergyWeight;
+        }
+
+        private double CalculateShapeEnergyLowerBound(BoundCalculationContext context, ShapeConstraints constraintsSet, double refinementThreshold, out bool isRefined)
+        {
+            ShapeEnergyLowerBoundCalculator treeLowerBoundCalculator = context.ShapeEnergyLowerBoundCalculator as ShapeEnergyLowerBoundCalculator;
+            if (treeLowerBoundCalculator == null)
+            {
+                isRefined = true;
+                return context.ShapeEnergyLowerBoundCalculator.CalculateLowerBound(context.ImageSegmentator.ImageSize, this.ShapeModel, constraintsSet);
+            }
+
+            double result = treeLowerBoundCalculator.CalculateLowerBound(
+                context.ImageSegmentator.ImageSize, this.ShapeModel, constraintsSet, refinementThreshold);
+            isRefined = treeLowerBoundCalculator.LastBoundGridLevel == 0;
+            return result;
+        }
+
+        /// <summary>
+        /// Calculates the energy of the given shape exactly, which makes it an upper bound for the solution.
+        /// </summary>
+        private EnergyBound CalculateShapeEnergy(BoundCalculationContext context, Shape shape)
+        {
+            this.ShapeModel.CalculatePenalties(shape, context.ShapePenalties);
+            double segmentationEnergy = context.ImageSegmentator.SegmentImageWithShapeTerms(context.ShapePenalties);
+            context.LastSegmentedShapeTerms = context.ShapePenalties;
+            context.UnsegmentedChangedRegion = Rectangle.Empty;
+
+            return new EnergyBound(
+                ShapeConstraints.CreateFromShape(shape),
+                this.ShapeModel.CalculateEnergy(shape),
+                segmentationEnergy,
+                this.ShapeEnergyWeight,
+                true,
+                EnergyBoundStage.Full);
+        }
+
+        private Mask2D SegmentImageWithConstraints(BoundCalculationContext context, ShapeConstraints constraintsSet)
+        {
+            this.SegmentImageWithShapeTermsLowerBound(context, constraintsSet, true);
+            return context.ImageSegmentator.GetLastSegmentationMask();
+        }
+
+        private bool ShouldUseCoarseShapeTerms(ShapeConstraints constraintsSet)
+        {
+            return constraintsSet.VertexConstraints.Max(c => c.Freedom) >= this.coarseShapeTermsMinVertexFreedom;
+        }
+
+        private double SegmentImageWithShapeTermsLowerBound(BoundCalculationContext context, ShapeConstraints constraintsSet)
+        {
+            // Coarse terms are lower bounds of the full-resolution ones, and vertex freedom never grows from parent to child,
+            // so bounds still never decrease along the search tree
+            bool useCoarseShapeTerms = this.ShouldUseCoarseShapeTerms(constraintsSet);
+            if (useCoarseShapeTerms)
+                Interlocked.Increment(ref this.coarseBoundCount);
+            return this.SegmentImageWithShapeTermsLowerBound(context, constraintsSet, !useCoarseShapeTerms);
+        }
+
+        private double SegmentImageWithShapeTermsLowerBound(BoundCalculationContext context, ShapeConstraints constraintsSet, bool fullResolution)
+        {
+            ObjectBackgroundTermPlanes shapeTerms = this.CalculateShapeTermsLowerBound(context, constraintsSet, fullResolution);
+
+            // Changed region is only meaningful if segmentator has seen the previous version of the same terms
+            Rectangle changedRegion = shapeTerms == context.LastSegmentedShapeTerms ? context.UnsegmentedChangedRegion : shapeTerms.Rectangle;
+            context.LastSegmentedShapeTerms = shapeTerms;
+            context.UnsegmentedChangedRegion = Rectangle.Empty;
+
+            return context.ImageSegmentator.SegmentImageWithShapeTerms(shapeTerms, changedRegion);
+        }
+
+        private ObjectBackgroundTermPlanes CalculateShapeTermsLowerBound(BoundCalculationContext context, ShapeConstraints constraintsSet, bool fullResolution)
+        {
+            ObjectBackgroundTermPlanes shapeTerms = fullResolution ? context.ShapeUnaryTerms : context.CoarseShapeUnaryTerms;
+
+            // Terms can be left by the previous stage of the bound cascade
+            if (shapeTerms == context.LastCalculatedShapeTerms && constraintsSet == context.LastShapeTermsConstraints)
+                return shapeTerms;
+
+            Rectangle changedRegion;
+            if (fullResolution)
+            {
+                context.ShapeTermsCalculator.CalculateShapeTerms(this.ShapeModel, constraintsSet, shapeTerms);
+
+                // Shape terms are always calculated into the same planes,
+                // so the segmentator only has to look at the regions changed by the calculator
+                changedRegion = shapeTerms.Rectangle;
+                CpuShapeTermsLowerBoundCalculator cpuShapeTermsCalculator = context.ShapeTermsCalculator as CpuShapeTermsLowerBoundCalculator;
+                if (cpuShapeTermsCalculator != null)
+                    changedRegion = cpuShapeTermsCalculator.LastChangedRegion;
+            }
+            else
+            {
+                context.CoarseShapeTermsCalculator.CalculateShapeTerms(this.ShapeModel, constraintsSet, shapeTerms);
+                changedRegion = shapeTerms.Rectangle;
+            }
+
+            // Terms can be calculated several times between segmentations
+            if (shapeTerms == context.LastSegmentedShapeTerms)
+                context.UnsegmentedChangedRegion = Union(context.UnsegmentedChangedRegion, changedRegion);
+            context.LastCalculatedShapeTerms = shapeTerms;
+            context.LastShapeTermsConstraints = constraintsSet;
+
+            return shapeTerms;
+        }
+
+        private static Rectangle Union(Rectangle region1, Rectangle region2)
+        {
+            return
+                region1.IsEmpty ? region2 :
+                region2.IsEmpty ? region1 :
+                Rectangle.Union(region1, region2);
+        }
+
+        private enum EnergyBoundStage
+        {
+            Inherited,
+            IndependentEdges,
+            UnaryTerms,
+            Full,
+        }
+
+        private class EnergyBound : IComparable<EnergyBound>
+        {
+            /// <summary>
+            /// Gets the constraints of the bound, expanding them from the compact representation if necessary.
+            /// </summary>
+            public ShapeConstraints Constraints
+            {
+                get
+                {
+                    // Bound can be expanded by several threads at once, any of the results will do
+                    ShapeConstraints result = this.constraints;
+                    if (result == null)
+                    {
+                        result = this.CompactConstraints.Expand();
+                        this.constraints = result;
+                    }
+
+                    return result;
+                }
+            }
+
+            public CompactShapeConstraints CompactConstraints { get; private set; }
+
+            public double Bound { get; private set; }
+
+            public double ShapeEnergy { get; private set; }
+
+            public double SegmentationEnergy { get; private set; }
+
+            public bool IsShapeEnergyRefined { get; private set; }
+
+            public EnergyBoundStage Stage { get; private set; }
+
+            public bool IsComplete
+            {
+                get { return this.Stage == EnergyBoundStage.Full && this.IsShapeEnergyRefined; }
+            }
+
+            public long ByteSize
+            {
+                get { return ObjectOverheadBytes + this.CompactConstraints.ByteSize; }
+            }
+
+            // Rough size of the bound object itself, used for memory estimates
+            private const int ObjectOverheadBytes = 80;
+
+            private static long instanceCount;
+
+            private readonly long instanceId;
+
+            private ShapeConstraints constraints;
+
+            public EnergyBound(
+                ShapeConstraints constraints,
+                double shapeEnergy,
+                double segmentationEnergy,
+                double shapeEnergyWeight,
+                bool isShapeEnergyRefined,
+                EnergyBoundStage stage)
+            {
+                Debug.Assert(constraints != null);
+
+                this.constraints = constraints;
+                this.ShapeEnergy = shapeEnergy;
+                this.SegmentationEnergy = segmentationEnergy;
+                this.IsShapeEnergyRefined = isShapeEnergyRefined;
+                this.Stage = stage;
+                this.Bound = shapeEnergy * shapeEnergyWeight + segmentationEnergy;
+
+                this.instanceId = Interlocked.Increment(ref instanceCount);
+            }
+
+            private EnergyBound(
+                long instanceId,
+                CompactShapeConstraints compactConstraints,
+                double bound,
+                double shapeEnergy,
+                double segmentationEnergy,
+                bool isShapeEnergyRefined,
+                EnergyBoundStage stage)
+            {
+                this.instanceId = instanceId;
+                this.CompactConstraints = compactConstraints;
+                this.Bound = bound;
+                this.ShapeEnergy = shapeEnergy;
+                this.SegmentationEnergy = segmentationEnergy;
+                this.IsShapeEnergyRefined = isShapeEnergyRefined;
+                this.Stage = stage;
+            }
+
+            public static EnergyBound ReadFrom(BinaryReader reader, ShapeStructure structure)
+            {
+                long instanceId = reader.ReadInt64();
+                double bound = reader.ReadDouble();
+                double shapeEnergy = reader.ReadDouble();
+                double segmentationEnergy = reader.ReadDouble();
+                bool isShapeEnergyRefined = reader.ReadBoolean();
+                EnergyBoundStage stage = (EnergyBoundStage)reader.ReadInt32();
+                CompactShapeConstraints compactConstraints = CompactShapeConstraints.ReadFrom(reader, structure);
+
+                // Bounds created after resuming from a checkpoint should never get the ids of the restored ones
+                long currentInstanceCount = Interlocked.Read(ref instanceCount);
+                while (currentInstanceCount < instanceId)
+                {
+                    long replacedInstanceCount = Interlocked.CompareExchange(ref instanceCount, instanceId, currentInstanceCount);
+                    if (replacedInstanceCount == currentInstanceCount)
+                        break;
+                    currentInstanceCount = replacedInstanceCount;
+                }
+
+                return new EnergyBound(
+                    instanceId, compactConstraints, bound, shapeEnergy, segmentationEnergy, isShapeEnergyRefined, stage);
+            }
+
+            /// <summary>
+            /// Replaces the constraints with their compact representation, which is shared with the given bound when possible.
+            /// Should be called before the bound is put into the front.
+            /// </summary>
+            /// <param name="basis">Bound of the parent constraints or of the same constraints, can be null.</param>
+            public void Compact(EnergyBound basis)
+            {
+                if (this.CompactConstraints == null)
+                {
+                    this.CompactConstraints = basis == null || basis.CompactConstraints == null
+                        ? CompactShapeConstraints.FromConstraints(this.constraints)
+                        : CompactShapeConstraints.FromConstraints(this.constraints, basis.CompactConstraints, basis.Constraints);
+                }
+
+                this.constraints = null;
+            }
+
+            public void WriteTo(BinaryWriter writer)
+            {
+                Debug.Assert(this.CompactConstraints != null);
+
+                writer.Write(this.instanceId);
+                writer.Write(this.Bound);
+                writer.Write(this.ShapeEnergy);
+                writer.Write(this.SegmentationEnergy);
+                writer.Write(this.IsShapeEnergyRefined);
+                writer.Write((int)this.Stage);
+                this.CompactConstraints.WriteTo(writer);
             }
 
             public int CompareTo(EnergyBound other)
@@ -359,5 +1369,605 @@ namespace Research.GraphBasedShapePrior
                 return Comparer<long>.Default.Compare(this.instanceId, other.instanceId);
             }
         }
+
+        /// <summary>
+        /// Calculators and term planes of a single worker along with the state they leave between bound calculations.
+        /// </summary>
+        private class BoundCalculationContext
+        {
+            public BoundCalculationContext(
+                ImageSegmentator imageSegmentator,
+                IShapeTermsLowerBoundCalculator shapeTermsCalculator,
+                IShapeTermsLowerBoundCalculator coarseShapeTermsCalculator,
+                IShapeEnergyLowerBoundCalculator shapeEnergyLowerBoundCalculator)
+            {
+                Debug.Assert(imageSegmentator != null);
+                Debug.Assert(shapeTermsCalculator != null);
+                Debug.Assert(coarseShapeTermsCalculator != null);
+                Debug.Assert(shapeEnergyLowerBoundCalculator != null);
+
+                this.ImageSegmentator = imageSegmentator;
+                this.ShapeTermsCalculator = shapeTermsCalculator;
+                this.CoarseShapeTermsCalculator = coarseShapeTermsCalculator;
+                this.ShapeEnergyLowerBoundCalculator = shapeEnergyLowerBoundCalculator;
+                this.ShapeUnaryTerms = new ObjectBackgroundTermPlanes(imageSegmentator.ImageSize.Width, imageSegmentator.ImageSize.Height);
+                this.CoarseShapeUnaryTerms = new ObjectBackgroundTermPlanes(imageSegmentator.ImageSize.Width, imageSegmentator.ImageSize.Height);
+                this.ShapePenalties = new ObjectBackgroundTermPlanes(imageSegmentator.ImageSize.Width, imageSegmentator.ImageSize.Height);
+            }
+
+            public ImageSegmentator ImageSegmentator { get; private set; }
+
+            public IShapeTermsLowerBoundCalculator ShapeTermsCalculator { get; private set; }
+
+            public IShapeTermsLowerBoundCalculator CoarseShapeTermsCalculator { get; private set; }
+
+            public IShapeEnergyLowerBoundCalculator ShapeEnergyLowerBoundCalculator { get; private set; }
+
+            public ObjectBackgroundTermPlanes ShapeUnaryTerms { get; private set; }
+
+            public ObjectBackgroundTermPlanes CoarseShapeUnaryTerms { get; private set; }
+
+            // Exact penalties of the shapes found by diving
+            public ObjectBackgroundTermPlanes ShapePenalties { get; private set; }
+
+            public ObjectBackgroundTermPlanes LastSegmentedShapeTerms { get; set; }
+
+            // Region of the last segmented terms changed since they were segmented
+            public Rectangle UnsegmentedChangedRegion { get; set; }
+
+            public ObjectBackgroundTermPlanes LastCalculatedShapeTerms { get; set; }
+
+            public ShapeConstraints LastShapeTermsConstraints { get; set; }
+        }
+
+        /// <summary>
+        /// Front of the search shared by the workers.
+        /// Bounds taken by the workers are remembered until their children are added to the front,
+        /// so that the best bound of the front is accepted as the solution only if no better one can appear later.
+        /// Bounds are kept in a 4-ary heap, and when they take more memory than allowed,
+        /// the worse half of them is written to a sorted run on disk.
+        /// Parents kept alive by the compact constraints of the bounds in memory are charged to the budget once.
+        /// </summary>
+        private class SearchFront : IDisposable
+        {
+            // Workers waiting for the front to change should notice pausing and stopping too
+            private const int WaitTimeout = 10;
+
+            private const int HeapArity = 4;
+
+            // Number of bounds moved back from a spilled run to memory at once
+            private const int MergeBatchSize = 1024;
+
+            private readonly DaryHeap<EnergyBound> bounds = new DaryHeap<EnergyBound>(HeapArity);
+
+            private readonly SortedSet<EnergyBound> boundsInProgress = new SortedSet<EnergyBound>();
+
+            private readonly List<SpilledRun> spilledRuns = new List<SpilledRun>();
+
+            // Number of bounds in memory and of other retained parents having the given constraints as their parent
+            private readonly Dictionary<CompactShapeConstraints, int> parentReferenceCounts = new Dictionary<CompactShapeConstraints, int>();
+
+            private readonly object syncRoot = new object();
+
+            private readonly ShapeStructure structure;
+
+            private readonly long memoryBudget;
+
+            private long boundsByteSize;
+
+            private bool isAborted;
+
+            private EnergyBound solution;
+
+            private EnergyBound incumbent;
+
+            private long prunedBoundCount;
+
+            private long spilledBoundCount;
+
+            public SearchFront(ShapeStructure structure, long memoryBudget)
+            {
+                Debug.Assert(structure != null);
+                Debug.Assert(memoryBudget > 0);
+
+                this.structure = structure;
+                this.memoryBudget = memoryBudget;
+            }
+
+            public int Count
+            {
+                get
+                {
+                    lock (this.syncRoot)
+                        return this.bounds.Count + this.spilledRuns.Sum(run => run.Count);
+                }
+            }
+
+            public EnergyBound Min
+            {
+                get
+                {
+                    lock (this.syncRoot)
+                        return this.GetBest();
+                }
+            }
+
+            public double MinBound
+            {
+                get
+                {
+                    // Heads of the spilled runs are kept in memory, so nothing has to be read here
+                    lock (this.syncRoot)
+                    {
+                        double result = this.bounds.Count == 0 ? Double.PositiveInfinity : this.bounds.Min.Bound;
+                        foreach (SpilledRun run in this.spilledRuns)
+                            result = Math.Min(result, run.Head.Bound);
+                        return result;
+                    }
+                }
+            }
+
+            public EnergyBound Solution
+            {
+                get
+                {
+                    lock (this.syncRoot)
+                        return this.solution;
+                }
+            }
+
+            /// <summary>
+            /// Gets the bound of the best collapsed constraints found so far, which is an upper bound for the solution.
+            /// </summary>
+            public EnergyBound Incumbent
+            {
+                get
+                {
+                    lock (this.syncRoot)
+                        return this.incumbent;
+                }
+            }
+
+            public long PrunedBoundCount
+            {
+                get
+                {
+                    lock (this.syncRoot)
+                        return this.prunedBoundCount;
+                }
+            }
+
+            public long SpilledBoundCount
+            {
+                get
+                {
+                    lock (this.syncRoot)
+                        return this.spilledBoundCount;
+                }
+            }
+
+            public void Add(EnergyBound bound)
+            {
+                Debug.Assert(bound.CompactConstraints != null);
+
+                lock (this.syncRoot)
+                {
+                    if (!this.AddToHeap(bound))
+                        return;
+
+                    this.SpillIfOverBudget();
+                    Monitor.PulseAll(this.syncRoot);
+                }
+            }
+
+            public bool TryImproveIncumbent(EnergyBound bound, out int prunedBoundCount)
+            {
+                lock (this.syncRoot)
+                {
+                    prunedBoundCount = 0;
+                    if (this.incumbent != null && bound.Bound >= this.incumbent.Bound)
+                        return false;
+
+                    this.incumbent = bound;
+                    prunedBoundCount = this.bounds.RemoveWhere(b => b.Bound > bound.Bound);
+                    this.RecalculateBoundsByteSize();
+
+                    // Runs are sorted, so the ones with bad heads are dropped completely, others are pruned while merged back
+                    foreach (SpilledRun run in this.spilledRuns.Where(run => run.Head.Bound > bound.Bound))
+                    {
+                        prunedBoundCount += run.Count;
+                        run.Dispose();
+                    }
+                    this.spilledRuns.RemoveAll(run => run.Head.Bound > bound.Bound);
+
+                    this.prunedBoundCount += prunedBoundCount;
+                    Monitor.PulseAll(this.syncRoot);
+                    return true;
+                }
+            }
+
+            /// <summary>
+            /// Takes the best bound of the front for processing, waiting while it is the solution candidate
+            /// but some bound in progress is still better.
+            /// </summary>
+            /// <returns>Bound to process or null if solution was found or search should stop.</returns>
+            public EnergyBound TakeBest(Predicate<EnergyBound> isSolution, Func<bool> shouldStop)
+            {
+                lock (this.syncRoot)
+                {
+                    while (this.solution == null && !this.isAborted && !shouldStop())
+                    {
+                        EnergyBound best = this.GetBest();
+
+                        // Incumbent is the solution if nothing left can be better
+                        if (this.incumbent != null &&
+                            (best == null || best.Bound >= this.incumbent.Bound) &&
+                            (this.boundsInProgress.Count == 0 || this.boundsInProgress.Min.Bound >= this.incumbent.Bound))
+                        {
+                            this.solution = this.incumbent;
+                            Monitor.PulseAll(this.syncRoot);
+                            return null;
+                        }
+
+                        if (best != null && !isSolution(best))
+                        {
+                            this.bounds.RemoveMin();
+                            this.ReleaseBound(best);
+                            this.boundsInProgress.Add(best);
+                            return best;
+                        }
+
+                        // Children are never better than their parents
+                        if (best != null && (this.boundsInProgress.Count == 0 || this.boundsInProgress.Min.Bound >= best.Bound))
+                        {
+                            this.solution = best;
+                            Monitor.PulseAll(this.syncRoot);
+                            return null;
+                        }
+
+                        Monitor.Wait(this.syncRoot, WaitTimeout);
+                    }
+
+                    return null;
+                }
+            }
+
+            /// <summary>
+            /// Adds the bounds that replace the given bound in progress and finishes its processing at once,
+            /// so that a snapshot never captures the bound together with some of its children.
+            /// </summary>
+            public void FinishProcessing(EnergyBound bound, IEnumerable<EnergyBound> children)
+            {
+                lock (this.syncRoot)
+                {
+                    foreach (EnergyBound child in children)
+                    {
+                        Debug.Assert(child.CompactConstraints != null);
+                        this.AddToHeap(child);
+                    }
+
+                    this.boundsInProgress.Remove(bound);
+                    this.SpillIfOverBudget();
+                    Monitor.PulseAll(this.syncRoot);
+                }
+            }
+
+            public void Abort()
+            {
+                lock (this.syncRoot)
+                {
+                    this.isAborted = true;
+                    Monitor.PulseAll(this.syncRoot);
+                }
+            }
+
+            /// <summary>
+            /// Captures the bounds of the front and the incumbent, so that they can be written without blocking the workers.
+            /// Bounds in progress are captured too, since their children are not in the front yet.
+            /// </summary>
+            public FrontSnapshot CreateSnapshot()
+            {
+                lock (this.syncRoot)
+                {
+                    List<EnergyBound> snapshotBounds = new List<EnergyBound>(this.bounds.ToArray());
+                    snapshotBounds.AddRange(this.boundsInProgress);
+
+                    SpilledRun[] snapshotRuns = this.spilledRuns.ToArray();
+                    long[] snapshotRunPositions = new long[snapshotRuns.Length];
+                    long boundCount = snapshotBounds.Count;
+                    for (int i = 0; i < snapshotRuns.Length; ++i)
+                    {
+                        snapshotRuns[i].Retain();
+                        snapshotBounds.Add(snapshotRuns[i].Head);
+                        snapshotRunPositions[i] = snapshotRuns[i].TailPosition;
+                        boundCount += snapshotRuns[i].Count;
+                    }
+
+                    return new FrontSnapshot(snapshotBounds.ToArray(), snapshotRuns, snapshotRunPositions, boundCount, this.incumbent);
+                }
+            }
+
+            public void Dispose()
+            {
+                lock (this.syncRoot)
+                {
+                    foreach (SpilledRun run in this.spilledRuns)
+                        run.Dispose();
+                    this.spilledRuns.Clear();
+                }
+            }
+
+            private bool AddToHeap(EnergyBound bound)
+            {
+                // Bound exceeding the incumbent can't lead to a better solution
+                if (this.incumbent != null && bound.Bound > this.incumbent.Bound)
+                {
+                    this.prunedBoundCount += 1;
+                    return false;
+                }
+
+                this.bounds.Add(bound);
+                this.ChargeBound(bound);
+                return true;
+            }
+
+            private void ChargeBound(EnergyBound bound)
+            {
+                this.boundsByteSize += bound.ByteSize;
+
+                // Parent chain is walked only until the first parent retained already
+                CompactShapeConstraints parent = bound.CompactConstraints.Parent;
+                while (parent != null)
+                {
+                    int referenceCount;
+                    this.parentReferenceCounts.TryGetValue(parent, out referenceCount);
+                    this.parentReferenceCounts[parent] = referenceCount + 1;
+                    if (referenceCount > 0)
+                        break;
+
+                    this.boundsByteSize += parent.ByteSize;
+                    parent = parent.Parent;
+                }
+            }
+
+            private void ReleaseBound(EnergyBound bound)
+            {
+                this.boundsByteSize -= bound.ByteSize;
+
+                CompactShapeConstraints parent = bound.CompactConstraints.Parent;
+                while (parent != null)
+                {
+                    int referenceCount = this.parentReferenceCounts[parent] - 1;
+                    if (referenceCount > 0)
+                    {
+                        this.parentReferenceCounts[parent] = referenceCount;
+                        break;
+                    }
+
+                    this.parentReferenceCounts.Remove(parent);
+                    this.boundsByteSize -= parent.ByteSize;
+                    parent = parent.Parent;
+                }
+            }
+
+            private void RecalculateBoundsByteSize()
+            {
+                this.boundsByteSize = 0;
+                this.parentReferenceCounts.Clear();
+                foreach (EnergyBound bound in this.bounds.ToArray())
+                    this.ChargeBound(bound);
+            }
+
+            private void SpillIfOverBudget()
+            {
+                if (this.boundsByteSize > this.memoryBudget && this.bounds.Count > 1)
+                    this.SpillWorseHalf();
+            }
+
+            private EnergyBound GetBest()
+            {
+                // Spilled bounds are merged back in batches once they can be better than the bounds in memory
+                bool isMerged = false;
+                for (int i = this.spilledRuns.Count - 1; i >= 0; --i)
+                {
+                    SpilledRun run = this.spilledRuns[i];
+                    if (this.bounds.Count > 0 && run.Head.CompareTo(this.bounds.Min) > 0)
+                        continue;
+
+                    for (int j = 0; j < MergeBatchSize && run.Count > 0; ++j)
+                        this.AddToHeap(run.TakeHead());
+                    isMerged = true;
+
+                    if (run.Count == 0)
+                    {
+                        run.Dispose();
+                        this.spilledRuns.RemoveAt(i);
+                    }
+                }
+
+                // Merged batches can exceed the budget too, the best bounds are kept in memory anyway
+                if (isMerged)
+                    this.SpillIfOverBudget();
+
+                return this.bounds.Count == 0 ? null : this.bounds.Min;
+            }
+
+            private void SpillWorseHalf()
+            {
+                EnergyBound[] sortedBounds = this.bounds.ToArray();
+                Array.Sort(sortedBounds);
+
+                int keptBoundCount = sortedBounds.Length / 2;
+                this.spilledRuns.Add(new SpilledRun(sortedBounds, keptBoundCount, this.structure));
+                this.spilledBoundCount += sortedBounds.Length - keptBoundCount;
+
+                this.bounds.Reset(sortedBounds.Take(keptBoundCount));
+                this.RecalculateBoundsByteSize();
+            }
+        }
+
+        /// <summary>
+        /// Sorted sequence of bounds stored in a temporary file, which is deleted when the run is disposed
+        /// by the front and by all the snapshots referencing it. Only the head of the run is kept in memory.
+        /// </summary>
+        private class SpilledRun : IDisposable
+        {
+            private const int FileBufferSize = 1 << 16;
+
+            private readonly FileStream stream;
+
+            private readonly BinaryReader reader;
+
+            private readonly ShapeStructure structure;
+
+            private readonly object syncRoot = new object();
+
+            private int referenceCount = 1;
+
+            public SpilledRun(EnergyBound[] sortedBounds, int startIndex, ShapeStructure structure)
+            {
+                Debug.Assert(startIndex < sortedBounds.Length);
+
+                this.structure = structure;
+                this.stream = new FileStream(
+                    Path.GetTempFileName(), FileMode.Create, FileAccess.ReadWrite, FileShare.None, FileBufferSize, FileOptions.DeleteOnClose);
+
+                // Writer is not disposed, since it would close the stream
+                BinaryWriter writer = new BinaryWriter(this.stream);
+                for (int i = startIndex + 1; i < sortedBounds.Length; ++i)
+                    sortedBounds[i].WriteTo(writer);
+                writer.Flush();
+
+                this.stream.Position = 0;
+                this.reader = new BinaryReader(this.stream);
+                this.Head = sortedBounds[startIndex];
+                this.Count = sortedBounds.Length - startIndex;
+            }
+
+            /// <summary>
+            /// Gets the number of bounds left in the run, including the head.
+            /// </summary>
+            public int Count { get; private set; }
+
+            public EnergyBound Head { get; private set; }
+
+            /// <summary>
+            /// Gets the position in the file of the bound following the head.
+            /// </summary>
+            public long TailPosition
+            {
+                get
+                {
+                    lock (this.syncRoot)
+                        return this.stream.Position;
+                }
+            }
+
+            public EnergyBound TakeHead()
+            {
+                Debug.Assert(this.Count > 0);
+
+                lock (this.syncRoot)
+                {
+                    EnergyBound result = this.Head;
+                    this.Count -= 1;
+                    this.Head = this.Count > 0 ? EnergyBound.ReadFrom(this.reader, this.structure) : null;
+                    return result;
+                }
+            }
+
+            /// <summary>
+            /// Copies serialized bounds starting from the given position to the given stream.
+            /// Bounds are copied in chunks, so that the run can be read concurrently.
+            /// </summary>
+            public void CopyTo(Stream destination, long position)
+            {
+                byte[] buffer = new byte[FileBufferSize];
+                while (true)
+                {
+                    int readByteCount;
+                    lock (this.syncRoot)
+                    {
+                        long readPosition = this.stream.Position;
+                        this.stream.Position = position;
+                        readByteCount = this.stream.Read(buffer, 0, buffer.Length);
+                        this.stream.Position = readPosition;
+                    }
+
+                    if (readByteCount == 0)
+                        break;
+
+                    destination.Write(buffer, 0, readByteCount);
+                    position += readByteCount;
+                }
+            }
+
+            public void Retain()
+            {
+                lock (this.syncRoot)
+                {
+                    Debug.Assert(this.referenceCount > 0);
+                    this.referenceCount += 1;
+                }
+            }
+
+            public void Dispose()
+            {
+                lock (this.syncRoot)
+                {
+                    this.referenceCount -= 1;
+                    if (this.referenceCount == 0)
+                        this.stream.Dispose();
+                }
+            }
+        }
+
+        /// <summary>
+        /// Contents of the front at some moment, which can be written to a checkpoint while the search goes on.
+        /// Bounds are never changed once they are in the front, and the spilled runs are retained until the snapshot is disposed.
+        /// </summary>
+        private class FrontSnapshot : IDisposable
+        {
+            private readonly EnergyBound[] bounds;
+
+            private readonly SpilledRun[] spilledRuns;
+
+            private readonly long[] spilledRunPositions;
+
+            public FrontSnapshot(
+                EnergyBound[] bounds, SpilledRun[] spilledRuns, long[] spilledRunPositions, long boundCount, EnergyBound incumbent)
+            {
+                Debug.Assert(spilledRuns.Length == spilledRunPositions.Length);
+
+                this.bounds = bounds;
+                this.spilledRuns = spilledRuns;
+                this.spilledRunPositions = spilledRunPositions;
+                this.BoundCount = boundCount;
+                this.Incumbent = incumbent;
+            }
+
+            public long BoundCount { get; private set; }
+
+            public EnergyBound Incumbent { get; private set; }
+
+            /// <summary>
+            /// Writes all the bounds of the snapshot, spilled bounds are copied as they are.
+            /// </summary>
+            public void WriteBoundsTo(BinaryWriter writer)
+            {
+                foreach (EnergyBound bound in this.bounds)
+                    bound.WriteTo(writer);
+                writer.Flush();
+
+                for (int i = 0; i < this.spilledRuns.Length; ++i)
+                    this.spilledRuns[i].CopyTo(writer.BaseStream, this.spilledRunPositions[i]);
+            }
+
+            public void Dispose()
+            {
+                foreach (SpilledRun run in this.spilledRuns)
+                    run.Dispose();
+            }
+        }
     }
 }
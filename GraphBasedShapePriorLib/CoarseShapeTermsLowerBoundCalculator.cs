@@ -0,0 +1,104 @@
+﻿using System;
+using System.Threading.Tasks;
+using Research.GraphBasedShapePrior.Util;
+
+namespace Research.GraphBasedShapePrior
+{
+    /// <summary>
+    /// Calculates shape terms that are constant inside square blocks of pixels.
+    /// Terms of a block are lower bounds for the terms of every pixel inside it,
+    /// so they can be used instead of the per-pixel terms when constraints are loose.
+    /// </summary>
+    public class CoarseShapeTermsLowerBoundCalculator : IShapeTermsLowerBoundCalculator
+    {
+        // Conservative margin for distance bounds, protects from rounding errors
+        private const double DistanceMargin = 1e-3;
+
+        private int blockSize = 8;
+
+        public int BlockSize
+        {
+            get { return this.blockSize; }
+            set
+            {
+                if (value <= 0)
+                    throw new ArgumentOutOfRangeException("value", "Property value should be positive.");
+                this.blockSize = value;
+            }
+        }
+
+        public void CalculateShapeTerms(ShapeModel model, ShapeConstraints constraintsSet, ObjectBackgroundTermPlanes result)
+        {
+            if (model == null)
+                throw new ArgumentNullException("model");
+            if (constraintsSet == null)
+                throw new ArgumentNullException("constraintsSet");
+            if (result == null)
+                throw new ArgumentNullException("result");
+            if (model.Structure != constraintsSet.ShapeStructure)
+                throw new ArgumentException("Shape model and shape constraints correspond to different shape structures.");
+
+            Polygon[] convexHulls = new Polygon[model.Structure.Edges.Count];
+            for (int edgeIndex = 0; edgeIndex < model.Structure.Edges.Count; ++edgeIndex)
+            {
+                ShapeEdge edge = model.Structure.Edges[edgeIndex];
+                convexHulls[edgeIndex] = constraintsSet.GetConvexHullForVertexPair(edge.Index1, edge.Index2);
+            }
+
+            int blockCountX = (result.Width + this.blockSize - 1) / this.blockSize;
+            int blockCountY = (result.Height + this.blockSize - 1) / this.blockSize;
+            Parallel.For(
+                0,
+                blockCountX * blockCountY,
+                blockIndex => this.CalculateBlockTerms(
+                    model, constraintsSet, convexHulls, blockIndex % blockCountX, blockIndex / blockCountX, result));
+        }
+
+        private void CalculateBlockTerms(
+            ShapeModel model,
+            ShapeConstraints constraintsSet,
+            Polygon[] convexHulls,
+            int blockX,
+            int blockY,
+            ObjectBackgroundTermPlanes result)
+        {
+            int minX = blockX * this.blockSize, maxX = Math.Min(minX + this.blockSize, result.Width) - 1;
+            int minY = blockY * this.blockSize, maxY = Math.Min(minY + this.blockSize, result.Height) - 1;
+            Vector blockCenter = new Vector((minX + maxX) * 0.5, (minY + maxY) * 0.5);
+            double blockHalfDiagonal = 0.5 * Math.Sqrt(MathHelper.Sqr(maxX - minX) + MathHelper.Sqr(maxY - minY));
+
+            // Distances to a set change by at most the block half-diagonal inside the block.
+            // Object penalty grows and background penalty decreases with distance, so min and max distances are bounded accordingly.
+            float objectTerm = result.Saturation, backgroundTerm = 0;
+            for (int edgeIndex = 0; edgeIndex < model.Structure.Edges.Count; ++edgeIndex)
+            {
+                ShapeEdge edge = model.Structure.Edges[edgeIndex];
+                EdgeConstraints edgeConstraints = constraintsSet.EdgeConstraints[edgeIndex];
+
+                double centerMinDistance = convexHulls[edgeIndex].IsPointInside(blockCenter)
+                    ? 0
+                    : Math.Sqrt(CpuShapeTermsLowerBoundCalculator.MinDistanceToPolygonBoundarySqr(blockCenter, convexHulls[edgeIndex]));
+                double minDistanceLowerBound = Math.Max(centerMinDistance - blockHalfDiagonal - DistanceMargin, 0);
+                objectTerm = Math.Min(
+                    objectTerm,
+                    result.Saturate(model.CalculateObjectPenaltyForEdge(MathHelper.Sqr(minDistanceLowerBound), edgeConstraints.MaxWidth)));
+
+                double centerMaxDistanceSqr = CpuShapeTermsLowerBoundCalculator.MaxDistanceToEdgeSegmentsSqr(
+                    blockCenter, constraintsSet.VertexConstraints[edge.Index1], constraintsSet.VertexConstraints[edge.Index2]);
+                double maxDistanceUpperBound = Math.Sqrt(centerMaxDistanceSqr) + blockHalfDiagonal + DistanceMargin;
+                backgroundTerm = Math.Max(
+                    backgroundTerm,
+                    result.Saturate(model.CalculateBackgroundPenaltyForEdge(MathHelper.Sqr(maxDistanceUpperBound), edgeConstraints.MinWidth)));
+            }
+
+            for (int y = minY; y <= maxY; ++y)
+            {
+                for (int index = result.GetIndex(minX, y), rowEnd = index + maxX - minX + 1; index < rowEnd; ++index)
+                {
+                    result.ObjectTerms[index] = objectTerm;
+                    result.BackgroundTerms[index] = backgroundTerm;
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,253 @@
+﻿using System;
+using System.Collections.Generic;
+using System.Diagnostics;
+using System.IO;
+using Research.GraphBasedShapePrior.Util;
+
+namespace Research.GraphBasedShapePrior
+{
+    /// <summary>
+    /// Memory-efficient representation of shape constraints for long-living search nodes.
+    /// Bounds are stored as a flat array of vertex boxes (min x, min y, max x, max y) followed by edge width ranges (min, max).
+    /// Constraints that differ from their parent in a single vertex or edge store only the values of that item
+    /// along with a reference to the parent, while every few generations a full copy is made,
+    /// so that expansion stays cheap and old ancestors can be collected.
+    /// </summary>
+    public class CompactShapeConstraints
+    {
+        public const int MaxDeltaChainLength = 16;
+
+        private const int VertexValueCount = 4;
+
+        private const int EdgeValueCount = 2;
+
+        // Rough size of an object header and its fields, used for memory estimates
+        private const int ObjectOverheadBytes = 64;
+
+        private readonly CompactShapeConstraints parent;
+
+        // Index of the vertex or the edge (after all the vertices) changed relative to the parent
+        private readonly int changedItemIndex;
+
+        private readonly double[] values;
+
+        private readonly int deltaChainLength;
+
+        private CompactShapeConstraints(
+            ShapeStructure structure, CompactShapeConstraints parent, int changedItemIndex, double[] values, ShapeConstraints constraints)
+        {
+            this.ShapeStructure = structure;
+            this.parent = parent;
+            this.changedItemIndex = changedItemIndex;
+            this.values = values;
+            this.deltaChainLength = parent == null ? 0 : parent.deltaChainLength + 1;
+
+            double maxVertexFreedom = 0, maxEdgeFreedom = 0;
+            foreach (VertexConstraints vertexConstraints in constraints.VertexConstraints)
+                maxVertexFreedom = Math.Max(maxVertexFreedom, vertexConstraints.Freedom);
+            foreach (EdgeConstraints edgeConstraints in constraints.EdgeConstraints)
+                maxEdgeFreedom = Math.Max(maxEdgeFreedom, edgeConstraints.Freedom);
+            this.MaxVertexFreedom = maxVertexFreedom;
+            this.MaxEdgeFreedom = maxEdgeFreedom;
+        }
+
+        public ShapeStructure ShapeStructure { get; private set; }
+
+        public double MaxVertexFreedom { get; private set; }
+
+        public double MaxEdgeFreedom { get; private set; }
+
+        /// <summary>
+        /// Gets the constraints these ones store the difference from, or null if all the values are stored.
+        /// </summary>
+        public CompactShapeConstraints Parent
+        {
+            get { return this.parent; }
+        }
+
+        /// <summary>
+        /// Gets the approximate amount of memory occupied by these constraints, not counting the shared parents.
+        /// </summary>
+        public long ByteSize
+        {
+            get { return ObjectOverheadBytes + sizeof(double) * this.values.Length; }
+        }
+
+        public static CompactShapeConstraints FromConstraints(ShapeConstraints constraints)
+        {
+            if (constraints == null)
+                throw new ArgumentNullException("constraints");
+
+            int vertexCount = constraints.ShapeStructure.VertexCount;
+            double[] values = new double[GetValueCount(constraints.ShapeStructure)];
+            for (int i = 0; i < vertexCount; ++i)
+                GetValues(constraints.VertexConstraints[i], values, i * VertexValueCount);
+            for (int i = 0; i < constraints.EdgeConstraints.Count; ++i)
+                GetValues(constraints.EdgeConstraints[i], values, vertexCount * VertexValueCount + i * EdgeValueCount);
+
+            return new CompactShapeConstraints(constraints.ShapeStructure, null, -1, values, constraints);
+        }
+
+        /// <summary>
+        /// Creates compact representation of the given constraints, sharing values with the given parent if possible.
+        /// </summary>
+        /// <param name="constraints">Constraints to represent.</param>
+        /// <param name="parent">Compact representation of the parent constraints.</param>
+        /// <param name="parentConstraints">Parent constraints, should be equal to the expanded <paramref name="parent"/>.</param>
+        public static CompactShapeConstraints FromConstraints(
+            ShapeConstraints constraints, CompactShapeConstraints parent, ShapeConstraints parentConstraints)
+        {
+            if (constraints == null)
+                throw new ArgumentNullException("constraints");
+            if (parent == null)
+                throw new ArgumentNullException("parent");
+            if (parentConstraints == null)
+                throw new ArgumentNullException("parentConstraints");
+            if (constraints.ShapeStructure != parentConstraints.ShapeStructure || parent.ShapeStructure != parentConstraints.ShapeStructure)
+                throw new ArgumentException("Constraints and their parent should have the same shape structure.");
+
+            int vertexCount = constraints.ShapeStructure.VertexCount;
+            int changedItemIndex = -1, changedItemCount = 0;
+            for (int i = 0; i < vertexCount; ++i)
+            {
+                if (constraints.VertexConstraints[i] != parentConstraints.VertexConstraints[i])
+                {
+                    changedItemIndex = i;
+                    changedItemCount += 1;
+                }
+            }
+            for (int i = 0; i < constraints.EdgeConstraints.Count; ++i)
+            {
+                if (constraints.EdgeConstraints[i] != parentConstraints.EdgeConstraints[i])
+                {
+                    changedItemIndex = vertexCount + i;
+                    changedItemCount += 1;
+                }
+            }
+
+            if (changedItemCount == 0)
+                return parent;
+            if (changedItemCount > 1 || parent.deltaChainLength >= MaxDeltaChainLength)
+                return FromConstraints(constraints);
+
+            double[] values;
+            if (changedItemIndex < vertexCount)
+            {
+                values = new double[VertexValueCount];
+                GetValues(constraints.VertexConstraints[changedItemIndex], values, 0);
+            }
+            else
+            {
+                values = new double[EdgeValueCount];
+                GetValues(constraints.EdgeConstraints[changedItemIndex - vertexCount], values, 0);
+            }
+
+            return new CompactShapeConstraints(constraints.ShapeStructure, parent, changedItemIndex, values, constraints);
+        }
+
+        public static CompactShapeConstraints ReadFrom(BinaryReader reader, ShapeStructure structure)
+        {
+            if (reader == null)
+                throw new ArgumentNullException("reader");
+            if (structure == null)
+                throw new ArgumentNullException("structure");
+
+            double[] values = new double[GetValueCount(structure)];
+            for (int i = 0; i < values.Length; ++i)
+                values[i] = reader.ReadDouble();
+
+            return FromConstraints(CreateConstraints(structure, values));
+        }
+
+        /// <summary>
+        /// Writes all the values of the constraints, so that they can be read back without the parents.
+        /// </summary>
+        public void WriteTo(BinaryWriter writer)
+        {
+            if (writer == null)
+                throw new ArgumentNullException("writer");
+
+            foreach (double value in this.GetAllValues())
+                writer.Write(value);
+        }
+
+        public bool CheckIfSatisfied(double maxCoordFreedom, double maxWidthFreedom)
+        {
+            return this.MaxVertexFreedom <= maxCoordFreedom && this.MaxEdgeFreedom <= maxWidthFreedom;
+        }
+
+        public ShapeConstraints Expand()
+        {
+            return CreateConstraints(this.ShapeStructure, this.GetAllValues());
+        }
+
+        private double[] GetAllValues()
+        {
+            if (this.parent == null)
+                return this.values;
+
+            // Deltas are applied to the nearest full copy starting from the oldest one
+            Stack<CompactShapeConstraints> deltas = new Stack<CompactShapeConstraints>();
+            CompactShapeConstraints current = this;
+            while (current.parent != null)
+            {
+                deltas.Push(current);
+                current = current.parent;
+            }
+
+            double[] result = (double[])current.values.Clone();
+            int vertexCount = this.ShapeStructure.VertexCount;
+            while (deltas.Count > 0)
+            {
+                CompactShapeConstraints delta = deltas.Pop();
+                int offset = delta.changedItemIndex < vertexCount
+                    ? delta.changedItemIndex * VertexValueCount
+                    : vertexCount * VertexValueCount + (delta.changedItemIndex - vertexCount) * EdgeValueCount;
+                Array.Copy(delta.values, 0, result, offset, delta.values.Length);
+            }
+
+            return result;
+        }
+
+        private static ShapeConstraints CreateConstraints(ShapeStructure structure, double[] values)
+        {
+            Debug.Assert(values.Length == GetValueCount(structure));
+
+            VertexConstraints[] vertexConstraints = new VertexConstraints[structure.VertexCount];
+            for (int i = 0; i < vertexConstraints.Length; ++i)
+            {
+                int offset = i * VertexValueCount;
+                vertexConstraints[i] = new VertexConstraints(
+                    new Vector(values[offset], values[offset + 1]), new Vector(values[offset + 2], values[offset + 3]));
+            }
+
+            EdgeConstraints[] edgeConstraints = new EdgeConstraints[structure.Edges.Count];
+            for (int i = 0; i < edgeConstraints.Length; ++i)
+            {
+                int offset = vertexConstraints.Length * VertexValueCount + i * EdgeValueCount;
+                edgeConstraints[i] = new EdgeConstraints(values[offset], values[offset + 1]);
+            }
+
+            return ShapeConstraints.CreateFromConstraints(structure, vertexConstraints, edgeConstraints);
+        }
+
+        private static int GetValueCount(ShapeStructure structure)
+        {
+            return structure.VertexCount * VertexValueCount + structure.Edges.Count * EdgeValueCount;
+        }
+
+        private static void GetValues(VertexConstraints constraints, double[] values, int offset)
+        {
+            values[offset] = constraints.MinCoord.X;
+            values[offset + 1] = constraints.MinCoord.Y;
+            values[offset + 2] = constraints.MaxCoord.X;
+            values[offset + 3] = constraints.MaxCoord.Y;
+        }
+
+        private static void GetValues(EdgeConstraints constraints, double[] values, int offset)
+        {
+            values[offset] = constraints.MinWidth;
+            values[offset + 1] = constraints.MaxWidth;
+        }
+    }
+}
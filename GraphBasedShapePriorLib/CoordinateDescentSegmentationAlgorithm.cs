@@ -68,10 +68,12 @@ namespace Research.GraphBasedShapePrior
         {
             DebugConfiguration.WriteImportantDebugText("Performing initial segmentation...");
             this.ImageSegmentator.SegmentImageWithShapeTerms((x, y) => ObjectBackgroundTerm.Zero);
-            Image2D<bool> prevMask = this.ImageSegmentator.GetLastSegmentationMask();
+            Mask2D prevMask = this.ImageSegmentator.GetLastSegmentationMask();
             Shape prevShape = this.ShapeModel.FitMeanShape(
                 this.ImageSegmentator.ImageSize.Width, this.ImageSegmentator.ImageSize.Height);
             double prevEnergy = 0;
+            ObjectBackgroundTermPlanes shapeTerms = new ObjectBackgroundTermPlanes(
+                this.ImageSegmentator.ImageSize.Width, this.ImageSegmentator.ImageSize.Height, this.ShapeTermsSaturation);
 
             for (int iteration = 1; iteration <= this.MaxIterationCount && !this.IsStopping; ++iteration)
             {
@@ -79,16 +81,17 @@ namespace Research.GraphBasedShapePrior
                 
                 DebugConfiguration.WriteImportantDebugText("Iteration {0}", iteration);
 
-                Image2D<bool> prevMaskCopy = prevMask;
+                Mask2D prevMaskCopy = prevMask;
                 Shape currentShape = this.ShapeFitter.Run(
                     prevShape,
                     (s, t) => this.ShapeMutator.MutateShape(s, this.ShapeModel, this.ImageSegmentator.ImageSize, t / this.ShapeFitter.StartTemperature),
                     s => this.CalcObjective(s, prevMaskCopy));
                 
-                double currentEnergy = this.ImageSegmentator.SegmentImageWithShapeTerms((x, y) => this.ShapeModel.CalculatePenalties(currentShape, new Vector(x, y)));
-                Image2D<bool> currentMask = this.ImageSegmentator.GetLastSegmentationMask();
+                this.ShapeModel.CalculatePenalties(currentShape, shapeTerms);
+                double currentEnergy = this.ImageSegmentator.SegmentImageWithShapeTerms(shapeTerms);
+                Mask2D currentMask = this.ImageSegmentator.GetLastSegmentationMask();
 
-                int differentValues = Image2D<bool>.DifferentValueCount(prevMask, currentMask);
+                int differentValues = Mask2D.DifferentValueCount(prevMask, currentMask);
                 double changedPixelRate = (double)differentValues / (this.ImageSegmentator.ImageSize.Width * this.ImageSegmentator.ImageSize.Height);
 
                 DebugConfiguration.WriteImportantDebugText("On iteration {0}:", iteration);
@@ -120,14 +123,14 @@ namespace Research.GraphBasedShapePrior
             return new SegmentationSolution(prevShape, prevMask, prevEnergy);
         }
 
-        private double CalcObjective(Shape shape, Image2D<bool> mask)
+        private double CalcObjective(Shape shape, Mask2D mask)
         {
             double shapeEnergy = this.ShapeModel.CalculateEnergy(shape);
             double labelingEnergy = CalcShapeLabelingEnergy(shape, mask);
             return shapeEnergy * this.ShapeEnergyWeight + labelingEnergy;
         }
 
-        private double CalcShapeLabelingEnergy(Shape shape, Image2D<bool> mask)
+        private double CalcShapeLabelingEnergy(Shape shape, Mask2D mask)
         {
             double shapeTermSum = 0;
             for (int x = 0; x < mask.Width; ++x)
@@ -2,6 +2,7 @@
 using System.Collections.Generic;
 using System.Diagnostics;
 using System.Drawing;
+using System.Linq;
 using System.Threading.Tasks;
 using Research.GraphBasedShapePrior.Util;
 
@@ -9,17 +10,174 @@ namespace Research.GraphBasedShapePrior
 {
     public class CpuShapeTermsLowerBoundCalculator : IShapeTermsLowerBoundCalculator
     {
-        private const int CacheCapacity = 500;
+        private const long DefaultCacheByteBudget = 512L * 1024 * 1024;
+
+        private const double DefaultDistanceTransformMinHullArea = 1024;
+
+        // Max distance from a point of a pixel cell to its center
+        private const double PixelCellHalfDiagonal = 0.70710678118654757;
+
+        private const int TemplateCacheCapacity = 100;
+
+        // Object penalty at this distance (relative to the edge width) exceeds BackgroundPenaltyConstantThreshold,
+        // so background terms outside of the template band are equal to their limit at infinity
+        private const double TemplateBandMarginToWidthRatio = 4.25;
+
+        // Distances of template terms are relaxed by this margin, so that rounding errors of evaluation
+        // at a different translation can't make shifted terms exceed directly evaluated ones
+        private const double TemplateDistanceMargin = 1e-6;
+
+        private const int TileSize = 16;
+
+        // Conservative margin for distance bounds, protects tile classification from rounding errors
+        private const double TileDistanceMargin = 1e-3;
+
+        // For penalties above this value background penalty doesn't depend on distance in double (or extended) precision
+        private const double BackgroundPenaltyConstantThreshold = 50;
 
         private ShapeModel shapeModel;
 
         private Size imageSize;
 
-        private LinkedList<Image2D<ObjectBackgroundTerm>> freeTermImages;
+        private float saturation;
+
+        private int tileCountX;
+
+        private int tileCountY;
+
+        private LinkedList<EdgeTerms> freeTermImages;
+
+        private long cacheByteBudget = DefaultCacheByteBudget;
+
+        private double distanceTransformMinHullArea = DefaultDistanceTransformMinHullArea;
+
+        // Edge terms are calculated here before compression
+        private ObjectBackgroundTermPlanes compressionBuffer;
+
+        // Distance transform buffers, reused by all edges
+        private double[] distanceTransformWindow;
+
+        private double[] hullDistanceSqrLowerBounds;
+
+        private LruCache<EdgeDescription, EdgeTerms> cachedEdgeTerms;
+
+        private LruCache<EdgeDescription, EdgeTermsTemplate> edgeTermsTemplates;
+
+        // Segment tree over edges, internal nodes store min object and max background terms of their subtrees
+
+        private ShapeStructure combinationTreeStructure;
+
+        private EdgeDescription[] combinationTreeEdges;
+
+        private ObjectBackgroundTermPlanes[] combinationTreeNodes;
+
+        private ObjectBackgroundTermPlanes lastResult;
+
+        public CpuShapeTermsLowerBoundCalculator()
+        {
+            this.UseTiling = true;
+            this.UseIncrementalCombination = true;
+        }
+
+        /// <summary>
+        /// Gets or sets whether terms should be evaluated tile by tile, skipping per-pixel work
+        /// for tiles where it can be proven to be unnecessary. Results are the same in both modes.
+        /// </summary>
+        public bool UseTiling { get; set; }
+
+        /// <summary>
+        /// Gets or sets whether terms of an edge should be obtained by shifting the terms of an edge
+        /// with the same geometry up to an integer translation, if such terms were computed before.
+        /// Templates store only a band around the edge hull, object terms outside of it are bounded using the distance
+        /// to the hull bounding box. Shifted terms never exceed directly evaluated ones, but are less tight,
+        /// so this is disabled by default. Templates are used only for edges not handled by distance transform.
+        /// </summary>
+        public bool UseTemplateCache { get; set; }
+
+        /// <summary>
+        /// Gets or sets whether cached edge terms should be stored with reduced precision and run-length encoding.
+        /// Terms are rounded down when compressed, so they remain lower bounds, but become less tight.
+        /// </summary>
+        public bool CompressCachedEdgeTerms { get; set; }
+
+        /// <summary>
+        /// Gets or sets the amount of memory that cached edge terms, edge term templates and the combination tree may occupy.
+        /// Terms of the edges used in the current calculation and the combination tree are never discarded.
+        /// </summary>
+        public long CacheByteBudget
+        {
+            get { return this.cacheByteBudget; }
+            set
+            {
+                if (value <= 0)
+                    throw new ArgumentOutOfRangeException("value", "Property value should be positive.");
+                this.cacheByteBudget = value;
+            }
+        }
+
+        public long CachedEdgeTermsByteSize { get; private set; }
+
+        public long TemplateCacheByteSize { get; private set; }
+
+        /// <summary>
+        /// Gets the amount of memory occupied by the inner nodes of the tree used for incremental combination of edge terms.
+        /// </summary>
+        public long CombinationTreeByteSize { get; private set; }
+
+        /// <summary>
+        /// Gets or sets the way min distance from pixels to edge convex hulls is calculated.
+        /// Distance transform takes time linear in the number of pixels, but gives less tight bounds near hull boundary,
+        /// since distances to the rasterized hull are reduced by pixel half-diagonal to remain lower bounds.
+        /// Cached edge terms are not invalidated when this property changes.
+        /// </summary>
+        public HullDistanceMethod HullDistanceMethod { get; set; }
+
+        /// <summary>
+        /// Gets or sets the min hull area for which distance transform is used in <see cref="Research.GraphBasedShapePrior.HullDistanceMethod.Automatic"/> mode.
+        /// </summary>
+        public double DistanceTransformMinHullArea
+        {
+            get { return this.distanceTransformMinHullArea; }
+            set
+            {
+                if (value < 0)
+                    throw new ArgumentOutOfRangeException("value", "Property value should not be negative.");
+                this.distanceTransformMinHullArea = value;
+            }
+        }
+
+        /// <summary>
+        /// Gets or sets the store that is used to share edge terms with other calculators and processes.
+        /// </summary>
+        public PersistentEdgeTermsStore PersistentStore { get; set; }
+
+        /// <summary>
+        /// Gets or sets whether edge terms should be combined using a segment tree over edges,
+        /// so that only the subtrees containing changed edges are recombined.
+        /// </summary>
+        public bool UseIncrementalCombination { get; set; }
 
-        private LruCache<EdgeDescription, Image2D<ObjectBackgroundTerm>> cachedEdgeTerms;
+        /// <summary>
+        /// Gets the region of the result that was changed by the last call to <see cref="CalculateShapeTerms"/>.
+        /// Terms outside of it are the same as after the previous call with the same result planes,
+        /// provided that those planes were not modified by anyone else in between.
+        /// </summary>
+        public Rectangle LastChangedRegion { get; private set; }
 
-        public void CalculateShapeTerms(ShapeModel model, ShapeConstraints constraintsSet, Image2D<ObjectBackgroundTerm> result)
+        public long TemplateCacheHitCount { get; private set; }
+
+        public long TemplateCacheMissCount { get; private set; }
+
+        public double TemplateCacheHitRate
+        {
+            get
+            {
+                long lookupCount = this.TemplateCacheHitCount + this.TemplateCacheMissCount;
+                return lookupCount == 0 ? 0 : (double)this.TemplateCacheHitCount / lookupCount;
+            }
+        }
+
+        public void CalculateShapeTerms(ShapeModel model, ShapeConstraints constraintsSet, ObjectBackgroundTermPlanes result)
         {
             if (model == null)
                 throw new ArgumentNullException("model");
@@ -30,95 +188,869 @@ namespace Research.GraphBasedShapePrior
             if (model.Structure != constraintsSet.ShapeStructure)
                 throw new ArgumentException("Shape model and shape constraints correspond to different shape structures.");
 
-            if (model != this.shapeModel || result.Rectangle.Size != this.imageSize)
-                this.SetTarget(model, result.Rectangle.Size);
+            if (this.PersistentStore != null && (this.PersistentStore.ImageSize != result.Size || this.PersistentStore.Saturation != result.Saturation))
+                throw new InvalidOperationException("Persistent edge terms store was created for different image size or saturation.");
+            if (this.PersistentStore != null &&
+                (this.PersistentStore.HullDistanceMethod != this.HullDistanceMethod ||
+                 (this.HullDistanceMethod == HullDistanceMethod.Automatic && this.PersistentStore.DistanceTransformMinHullArea != this.distanceTransformMinHullArea) ||
+                 this.PersistentStore.CompressedTerms != this.CompressCachedEdgeTerms))
+            {
+                throw new InvalidOperationException("Persistent edge terms store was created for different hull distance or compression settings.");
+            }
 
-            for (int x = 0; x < imageSize.Width; ++x)
-                for (int y = 0; y < imageSize.Height; ++y)
-                    result[x, y] = new ObjectBackgroundTerm(Double.PositiveInfinity, 0);
+            // Edge terms don't depend on the shape model, so cached terms are kept when only the model changes
+            if (this.cachedEdgeTerms == null || result.Size != this.imageSize || result.Saturation != this.saturation)
+                this.SetTarget(result.Size, result.Saturation);
+            this.shapeModel = model;
 
+            EdgeTerms[] edgeTermsList = new EdgeTerms[this.shapeModel.Structure.Edges.Count];
             for (int edgeIndex = 0; edgeIndex < this.shapeModel.Structure.Edges.Count; ++edgeIndex)
+                edgeTermsList[edgeIndex] = this.GetEdgeTerms(constraintsSet, edgeIndex);
+
+            if (this.UseIncrementalCombination)
             {
-                ShapeEdge edge = this.shapeModel.Structure.Edges[edgeIndex];
-                VertexConstraints vertexConstraints1 = constraintsSet.VertexConstraints[edge.Index1];
-                VertexConstraints vertexConstraints2 = constraintsSet.VertexConstraints[edge.Index2];
-                EdgeConstraints edgeConstraints = constraintsSet.EdgeConstraints[edgeIndex];
+                this.CombineEdgeTermsIncrementally(constraintsSet, edgeTermsList, result);
+                return;
+            }
 
-                Image2D<ObjectBackgroundTerm> edgeTerms;
-                EdgeDescription edgeDescription = new EdgeDescription(
-                    vertexConstraints1, vertexConstraints2, edgeConstraints);
-                if (!this.cachedEdgeTerms.TryGetValue(edgeDescription, out edgeTerms))
-                {
-                    edgeTerms = this.AllocateImage();
-                    this.cachedEdgeTerms.Add(edgeDescription, edgeTerms);
+            result.Fill(result.Saturation, 0);
+            if (this.UseTiling)
+                this.CombineEdgeTermsTiled(edgeTermsList, result);
+            else
+                this.CombineEdgeTerms(edgeTermsList, result);
+            this.lastResult = null;
+            this.LastChangedRegion = result.Rectangle;
+        }
+
+        private EdgeTerms GetEdgeTerms(ShapeConstraints constraintsSet, int edgeIndex)
+        {
+            ShapeEdge edge = this.shapeModel.Structure.Edges[edgeIndex];
+            VertexConstraints vertexConstraints1 = constraintsSet.VertexConstraints[edge.Index1];
+            VertexConstraints vertexConstraints2 = constraintsSet.VertexConstraints[edge.Index2];
+            EdgeConstraints edgeConstraints = constraintsSet.EdgeConstraints[edgeIndex];
 
-                    Polygon convexHull = constraintsSet.GetConvexHullForVertexPair(edge.Index1, edge.Index2);
+            EdgeTerms edgeTerms;
+            EdgeDescription edgeDescription = new EdgeDescription(
+                vertexConstraints1, vertexConstraints2, edgeConstraints);
+            if (this.cachedEdgeTerms.TryGetValue(edgeDescription, out edgeTerms))
+                return edgeTerms;
 
+            // Compressed terms are calculated in a shared buffer first
+            ObjectBackgroundTermPlanes terms;
+            if (this.CompressCachedEdgeTerms)
+            {
+                edgeTerms = null;
+                terms = this.compressionBuffer;
+            }
+            else
+            {
+                edgeTerms = this.AllocateImage();
+                terms = edgeTerms.Terms;
+            }
+
+            if (this.PersistentStore == null ||
+                !this.PersistentStore.TryLoad(vertexConstraints1, vertexConstraints2, edgeConstraints, terms))
+            {
+                this.CalculateEdgeTerms(terms, constraintsSet, edgeIndex);
+            }
+
+            if (edgeTerms == null)
+            {
+                CompressedTermsPlane.RoundDown(terms.ObjectTerms);
+                CompressedTermsPlane.RoundDown(terms.BackgroundTerms);
+                edgeTerms = new EdgeTerms(
+                    new CompressedTermsPlane(terms.ObjectTerms, terms.Width, terms.Height),
+                    new CompressedTermsPlane(terms.BackgroundTerms, terms.Width, terms.Height),
+                    this.tileCountX * this.tileCountY);
+            }
+
+            this.UpdateTileBounds(edgeTerms, terms);
+            this.AddToCache(edgeDescription, edgeTerms, edgeIndex + 1);
+            return edgeTerms;
+        }
+
+        private void CalculateEdgeTerms(ObjectBackgroundTermPlanes terms, ShapeConstraints constraintsSet, int edgeIndex)
+        {
+            ShapeEdge edge = this.shapeModel.Structure.Edges[edgeIndex];
+            VertexConstraints vertexConstraints1 = constraintsSet.VertexConstraints[edge.Index1];
+            VertexConstraints vertexConstraints2 = constraintsSet.VertexConstraints[edge.Index2];
+            EdgeConstraints edgeConstraints = constraintsSet.EdgeConstraints[edgeIndex];
+            Polygon convexHull = constraintsSet.GetConvexHullForVertexPair(edge.Index1, edge.Index2);
+            bool useDistanceTransform =
+                this.HullDistanceMethod == HullDistanceMethod.DistanceTransform ||
+                (this.HullDistanceMethod == HullDistanceMethod.Automatic && convexHull.Area >= this.distanceTransformMinHullArea);
+
+            // Edge terms are translation-invariant, so templates are keyed by constraints relative to an integer anchor.
+            // Distance transform bounds depend on the position of the hull in the image, so such edges don't use templates
+            int anchorX = (int)Math.Floor(vertexConstraints1.MinCoord.X);
+            int anchorY = (int)Math.Floor(vertexConstraints1.MinCoord.Y);
+            bool useTemplateCache = this.UseTemplateCache && !useDistanceTransform;
+            EdgeDescription templateDescription = null;
+            EdgeTermsTemplate template = null;
+            if (useTemplateCache)
+            {
+                Vector anchor = new Vector(anchorX, anchorY);
+                templateDescription = new EdgeDescription(
+                    new VertexConstraints(vertexConstraints1.MinCoord - anchor, vertexConstraints1.MaxCoord - anchor),
+                    new VertexConstraints(vertexConstraints2.MinCoord - anchor, vertexConstraints2.MaxCoord - anchor),
+                    edgeConstraints);
+                if (this.edgeTermsTemplates.TryGetValue(templateDescription, out template))
+                    this.TemplateCacheHitCount += 1;
+                else
+                    this.TemplateCacheMissCount += 1;
+            }
+
+            if (template != null)
+            {
+                this.CalculateEdgeTermsFromTemplate(
+                    terms,
+                    template,
+                    anchorX - template.AnchorX,
+                    anchorY - template.AnchorY,
+                    convexHull,
+                    vertexConstraints1,
+                    vertexConstraints2,
+                    edgeConstraints);
+            }
+            else
+            {
+                double[] hullDistanceSqrLowerBounds = null;
+                if (useDistanceTransform)
+                    hullDistanceSqrLowerBounds = this.CalculateHullDistanceSqrLowerBounds(convexHull, edgeConstraints);
+
+                if (this.UseTiling)
+                {
                     Parallel.For(
                         0,
-                        imageSize.Width,
-                        x =>
+                        this.tileCountX * this.tileCountY,
+                        tileIndex => this.CalculateEdgeTermsForTile(
+                            terms,
+                            tileIndex % this.tileCountX,
+                            tileIndex / this.tileCountX,
+                            convexHull,
+                            hullDistanceSqrLowerBounds,
+                            vertexConstraints1,
+                            vertexConstraints2,
+                            edgeConstraints));
+                }
+                else
+                {
+                    Parallel.For(
+                        0,
+                        this.imageSize.Height,
+                        y =>
+                        {
+                            for (int x = 0; x < this.imageSize.Width; ++x)
+                                this.CalculateEdgeTermsForPixel(terms, x, y, convexHull, hullDistanceSqrLowerBounds, vertexConstraints1, vertexConstraints2, edgeConstraints);
+                        });
+                }
+            }
+
+            // Only directly evaluated terms are persisted, shifted ones are less tight
+            if (useTemplateCache && template == null)
+            {
+                this.AddTemplate(
+                    templateDescription,
+                    this.CreateTemplate(terms, convexHull, vertexConstraints1, vertexConstraints2, edgeConstraints, anchorX, anchorY));
+            }
+            if (this.PersistentStore != null && template == null)
+                this.PersistentStore.TrySave(vertexConstraints1, vertexConstraints2, edgeConstraints, terms);
+        }
+
+        private void AddToCache(EdgeDescription edgeDescription, EdgeTerms edgeTerms, int protectedItemCount)
+        {
+            this.cachedEdgeTerms.Add(edgeDescription, edgeTerms);
+            this.CachedEdgeTermsByteSize += edgeTerms.ByteSize;
+            this.DiscardCachedItemsOverBudget(protectedItemCount);
+        }
+
+        private void DiscardCachedItemsOverBudget(int protectedItemCount)
+        {
+            // Templates are discarded first, since they only save part of the work.
+            // Most recently used items are the terms of the edges already processed in the current calculation
+            while (this.CachedEdgeTermsByteSize + this.TemplateCacheByteSize + this.CombinationTreeByteSize > this.cacheByteBudget)
+            {
+                if (!this.edgeTermsTemplates.RemoveLeastRecentlyUsed() &&
+                    (this.cachedEdgeTerms.Count <= protectedItemCount || !this.cachedEdgeTerms.RemoveLeastRecentlyUsed()))
+                {
+                    break;
+                }
+            }
+        }
+
+        private void AddTemplate(EdgeDescription templateDescription, EdgeTermsTemplate template)
+        {
+            this.edgeTermsTemplates.Add(templateDescription, template);
+            this.TemplateCacheByteSize += template.ByteSize;
+
+            while (this.CachedEdgeTermsByteSize + this.TemplateCacheByteSize + this.CombinationTreeByteSize > this.cacheByteBudget &&
+                this.edgeTermsTemplates.Count > 0)
+            {
+                this.edgeTermsTemplates.RemoveLeastRecentlyUsed();
+            }
+        }
+
+        private EdgeTermsTemplate CreateTemplate(
+            ObjectBackgroundTermPlanes terms,
+            Polygon convexHull,
+            VertexConstraints vertexConstraints1,
+            VertexConstraints vertexConstraints2,
+            EdgeConstraints edgeConstraints,
+            int anchorX,
+            int anchorY)
+        {
+            // Background penalty decreases with distance, so its limit at infinity bounds it outside of the band
+            double margin = Math.Ceiling(edgeConstraints.MaxWidth * TemplateBandMarginToWidthRatio);
+            Rectangle band = Rectangle.FromLTRB(
+                (int)Math.Floor(convexHull.Vertices.Min(v => v.X) - margin),
+                (int)Math.Floor(convexHull.Vertices.Min(v => v.Y) - margin),
+                (int)Math.Ceiling(convexHull.Vertices.Max(v => v.X) + margin) + 1,
+                (int)Math.Ceiling(convexHull.Vertices.Max(v => v.Y) + margin) + 1);
+            float backgroundFill = terms.Saturate(
+                this.shapeModel.CalculateBackgroundPenaltyForEdge(Double.PositiveInfinity, edgeConstraints.MinWidth));
+
+            // Band terms are evaluated again with relaxed distances instead of being copied
+            Rectangle storedRegion = Rectangle.Intersect(band, terms.Rectangle);
+            ObjectBackgroundTermPlanes templateTerms = new ObjectBackgroundTermPlanes(storedRegion.Width, storedRegion.Height, terms.Saturation);
+            Parallel.For(
+                storedRegion.Top,
+                storedRegion.Bottom,
+                y =>
+                {
+                    for (int x = storedRegion.Left; x < storedRegion.Right; ++x)
+                    {
+                        this.CalculateEdgeTermsForPixel(
+                            templateTerms,
+                            x,
+                            y,
+                            templateTerms.GetIndex(x - storedRegion.Left, y - storedRegion.Top),
+                            convexHull,
+                            null,
+                            vertexConstraints1,
+                            vertexConstraints2,
+                            edgeConstraints,
+                            TemplateDistanceMargin);
+                    }
+                });
+
+            return new EdgeTermsTemplate(
+                band, storedRegion, templateTerms.ObjectTerms, templateTerms.BackgroundTerms, backgroundFill, anchorX, anchorY);
+        }
+
+        private void CalculateEdgeTermsFromTemplate(
+            ObjectBackgroundTermPlanes edgeTerms,
+            EdgeTermsTemplate template,
+            int shiftX,
+            int shiftY,
+            Polygon convexHull,
+            VertexConstraints vertexConstraints1,
+            VertexConstraints vertexConstraints2,
+            EdgeConstraints edgeConstraints)
+        {
+            // Outside of the shifted band object terms are bounded using the distance to the hull bounding box,
+            // pixels of the band that were outside of the image when the template was made are computed directly
+            Rectangle band = template.Band;
+            band.Offset(shiftX, shiftY);
+            Rectangle storedRegion = template.StoredRegion;
+            storedRegion.Offset(shiftX, shiftY);
+            double hullMinX = convexHull.Vertices.Min(v => v.X), hullMaxX = convexHull.Vertices.Max(v => v.X);
+            double hullMinY = convexHull.Vertices.Min(v => v.Y), hullMaxY = convexHull.Vertices.Max(v => v.Y);
+            Parallel.For(
+                0,
+                this.imageSize.Height,
+                y =>
+                {
+                    bool rowInBand = y >= band.Top && y < band.Bottom;
+                    bool rowStored = y >= storedRegion.Top && y < storedRegion.Bottom;
+                    int templateRowStart = (y - storedRegion.Top) * storedRegion.Width - storedRegion.Left;
+                    for (int x = 0; x < this.imageSize.Width; ++x)
+                    {
+                        int index = edgeTerms.GetIndex(x, y);
+                        if (!rowInBand || x < band.Left || x >= band.Right)
+                        {
+                            double boxDistanceX = Math.Max(Math.Max(hullMinX - x, x - hullMaxX), 0);
+                            double boxDistanceY = Math.Max(Math.Max(hullMinY - y, y - hullMaxY), 0);
+                            double boxDistance = Math.Max(Math.Sqrt(boxDistanceX * boxDistanceX + boxDistanceY * boxDistanceY) - TemplateDistanceMargin, 0);
+                            edgeTerms.ObjectTerms[index] = edgeTerms.Saturate(
+                                this.shapeModel.CalculateObjectPenaltyForEdge(boxDistance * boxDistance, edgeConstraints.MaxWidth));
+                            edgeTerms.BackgroundTerms[index] = template.BackgroundFill;
+                        }
+                        else if (!rowStored || x < storedRegion.Left || x >= storedRegion.Right)
+                        {
+                            this.CalculateEdgeTermsForPixel(
+                                edgeTerms, x, y, index, convexHull, null, vertexConstraints1, vertexConstraints2, edgeConstraints, TemplateDistanceMargin);
+                        }
+                        else
+                        {
+                            edgeTerms.ObjectTerms[index] = template.ObjectTerms[templateRowStart + x];
+                            edgeTerms.BackgroundTerms[index] = template.BackgroundTerms[templateRowStart + x];
+                        }
+                    }
+                });
+        }
+
+        private void CalculateEdgeTermsForPixel(
+            ObjectBackgroundTermPlanes edgeTerms,
+            int x,
+            int y,
+            Polygon convexHull,
+            double[] hullDistanceSqrLowerBounds,
+            VertexConstraints vertexConstraints1,
+            VertexConstraints vertexConstraints2,
+            EdgeConstraints edgeConstraints)
+        {
+            this.CalculateEdgeTermsForPixel(
+                edgeTerms,
+                x,
+                y,
+                edgeTerms.GetIndex(x, y),
+                convexHull,
+                hullDistanceSqrLowerBounds,
+                vertexConstraints1,
+                vertexConstraints2,
+                edgeConstraints,
+                0);
+        }
+
+        /// <summary>
+        /// Evaluates terms of the pixel at (x, y) and stores them at the given index.
+        /// Min distance is reduced and max distance is increased by the distance margin.
+        /// </summary>
+        private void CalculateEdgeTermsForPixel(
+            ObjectBackgroundTermPlanes edgeTerms,
+            int x,
+            int y,
+            int index,
+            Polygon convexHull,
+            double[] hullDistanceSqrLowerBounds,
+            VertexConstraints vertexConstraints1,
+            VertexConstraints vertexConstraints2,
+            EdgeConstraints edgeConstraints,
+            double distanceMargin)
+        {
+            Vector pointAsVec = new Vector(x, y);
+            double minDistanceSqr, maxDistanceSqr;
+            if (hullDistanceSqrLowerBounds != null)
+            {
+                minDistanceSqr = hullDistanceSqrLowerBounds[index];
+                maxDistanceSqr = MaxDistanceToEdgeSegmentsSqr(pointAsVec, vertexConstraints1, vertexConstraints2);
+            }
+            else
+            {
+                MinMaxDistanceForEdge(
+                    pointAsVec,
+                    convexHull,
+                    vertexConstraints1,
+                    vertexConstraints2,
+                    out minDistanceSqr,
+                    out maxDistanceSqr);
+            }
+
+            if (distanceMargin > 0)
+            {
+                minDistanceSqr = MathHelper.Sqr(Math.Max(Math.Sqrt(minDistanceSqr) - distanceMargin, 0));
+                maxDistanceSqr = MathHelper.Sqr(Math.Sqrt(maxDistanceSqr) + distanceMargin);
+            }
+
+            edgeTerms.ObjectTerms[index] = edgeTerms.Saturate(
+                this.shapeModel.CalculateObjectPenaltyForEdge(minDistanceSqr, edgeConstraints.MaxWidth));
+            edgeTerms.BackgroundTerms[index] = edgeTerms.Saturate(
+                this.shapeModel.CalculateBackgroundPenaltyForEdge(maxDistanceSqr, edgeConstraints.MinWidth));
+        }
+
+        private void CalculateEdgeTermsForTile(
+            ObjectBackgroundTermPlanes edgeTerms,
+            int tileX,
+            int tileY,
+            Polygon convexHull,
+            double[] hullDistanceSqrLowerBounds,
+            VertexConstraints vertexConstraints1,
+            VertexConstraints vertexConstraints2,
+            EdgeConstraints edgeConstraints)
+        {
+            int minX = tileX * TileSize, maxX = Math.Min(minX + TileSize, this.imageSize.Width) - 1;
+            int minY = tileY * TileSize, maxY = Math.Min(minY + TileSize, this.imageSize.Height) - 1;
+            Vector tileCenter = new Vector((minX + maxX) * 0.5, (minY + maxY) * 0.5);
+            double tileHalfDiagonal = 0.5 * Math.Sqrt(MathHelper.Sqr(maxX - minX) + MathHelper.Sqr(maxY - minY));
+
+            // Distance to a set changes by at most the tile half-diagonal inside the tile
+            double centerDistanceToHullBoundary = Math.Sqrt(MinDistanceToPolygonBoundarySqr(tileCenter, convexHull));
+            bool tileNotCrossingHull = centerDistanceToHullBoundary > tileHalfDiagonal + TileDistanceMargin;
+            bool tileInsideHull = tileNotCrossingHull && convexHull.IsPointInside(tileCenter);
+            bool tileOutsideHull = tileNotCrossingHull && !tileInsideHull;
+            double minDistanceLowerBound = Math.Max(centerDistanceToHullBoundary - tileHalfDiagonal - TileDistanceMargin, 0);
+
+            double centerMaxDistanceSqr = MaxDistanceToEdgeSegmentsSqr(tileCenter, vertexConstraints1, vertexConstraints2);
+            double maxDistanceLowerBound = Math.Max(Math.Sqrt(centerMaxDistanceSqr) - tileHalfDiagonal - TileDistanceMargin, 0);
+
+            bool objectTermsConstant = false;
+            float objectTerm = 0;
+            if (tileInsideHull)
+            {
+                objectTermsConstant = true;
+                objectTerm = edgeTerms.Saturate(this.shapeModel.CalculateObjectPenaltyForEdge(0, edgeConstraints.MaxWidth));
+            }
+            else if (tileOutsideHull && hullDistanceSqrLowerBounds == null &&
+                this.shapeModel.CalculateObjectPenaltyForEdge(MathHelper.Sqr(minDistanceLowerBound), edgeConstraints.MaxWidth) >= edgeTerms.Saturation)
+            {
+                objectTermsConstant = true;
+                objectTerm = edgeTerms.Saturation;
+            }
+
+            bool backgroundTermsConstant = false;
+            float backgroundTerm = 0;
+            double maxDistanceLowerBoundSqr = MathHelper.Sqr(maxDistanceLowerBound);
+            if (this.shapeModel.CalculateObjectPenaltyForEdge(maxDistanceLowerBoundSqr, edgeConstraints.MinWidth) >= BackgroundPenaltyConstantThreshold)
+            {
+                backgroundTermsConstant = true;
+                backgroundTerm = edgeTerms.Saturate(
+                    this.shapeModel.CalculateBackgroundPenaltyForEdge(maxDistanceLowerBoundSqr, edgeConstraints.MinWidth));
+            }
+
+            float[] objectTerms = edgeTerms.ObjectTerms;
+            float[] backgroundTerms = edgeTerms.BackgroundTerms;
+            for (int y = minY; y <= maxY; ++y)
+            {
+                for (int x = minX; x <= maxX; ++x)
+                {
+                    int index = edgeTerms.GetIndex(x, y);
+                    if (objectTermsConstant && backgroundTermsConstant)
+                    {
+                        objectTerms[index] = objectTerm;
+                        backgroundTerms[index] = backgroundTerm;
+                        continue;
+                    }
+
+                    Vector point = new Vector(x, y);
+                    if (objectTermsConstant)
+                        objectTerms[index] = objectTerm;
+                    else
+                    {
+                        double minDistanceSqr;
+                        if (hullDistanceSqrLowerBounds != null)
+                            minDistanceSqr = hullDistanceSqrLowerBounds[index];
+                        else
+                            minDistanceSqr = !tileOutsideHull && convexHull.IsPointInside(point) ? 0 : MinDistanceToPolygonBoundarySqr(point, convexHull);
+                        objectTerms[index] = edgeTerms.Saturate(
+                            this.shapeModel.CalculateObjectPenaltyForEdge(minDistanceSqr, edgeConstraints.MaxWidth));
+                    }
+
+                    if (backgroundTermsConstant)
+                        backgroundTerms[index] = backgroundTerm;
+                    else
+                    {
+                        double maxDistanceSqr = MaxDistanceToEdgeSegmentsSqr(point, vertexConstraints1, vertexConstraints2);
+                        backgroundTerms[index] = edgeTerms.Saturate(
+                            this.shapeModel.CalculateBackgroundPenaltyForEdge(maxDistanceSqr, edgeConstraints.MinWidth));
+                    }
+                }
+            }
+        }
+
+        /// <summary>
+        /// Calculates lower bounds of squared distance from every pixel to the hull using distance transform
+        /// of the conservatively rasterized hull. Every point of the hull is within half-diagonal from the center
+        /// of some rasterized pixel, so distances to the rasterized hull are reduced by it.
+        /// Returned array is owned by the calculator and is overwritten by the next call.
+        /// </summary>
+        private double[] CalculateHullDistanceSqrLowerBounds(Polygon convexHull, EdgeConstraints edgeConstraints)
+        {
+            // Window covers both image and hull, so that hull parts outside of the image are taken into account.
+            // Hull points farther than the margin from the image are dropped: distances to them exceed the margin,
+            // which is limited by the distance where object terms saturate and by the image size
+            double saturationDistance = Math.Sqrt(
+                this.saturation / this.shapeModel.CalculateObjectPenaltyForEdge(1, edgeConstraints.MaxWidth));
+            double margin = Math.Ceiling(
+                Math.Min(saturationDistance + PixelCellHalfDiagonal + TileDistanceMargin, Math.Max(this.imageSize.Width, this.imageSize.Height)));
+            double hullMinX = convexHull.Vertices.Min(v => v.X), hullMaxX = convexHull.Vertices.Max(v => v.X);
+            double hullMinY = convexHull.Vertices.Min(v => v.Y), hullMaxY = convexHull.Vertices.Max(v => v.Y);
+            int windowMinX = (int)MathHelper.Trunc(Math.Floor(hullMinX), -margin, 0);
+            int windowMaxX = (int)MathHelper.Trunc(Math.Ceiling(hullMaxX), this.imageSize.Width - 1, this.imageSize.Width - 1 + margin);
+            int windowMinY = (int)MathHelper.Trunc(Math.Floor(hullMinY), -margin, 0);
+            int windowMaxY = (int)MathHelper.Trunc(Math.Ceiling(hullMaxY), this.imageSize.Height - 1, this.imageSize.Height - 1 + margin);
+            int windowWidth = windowMaxX - windowMinX + 1, windowHeight = windowMaxY - windowMinY + 1;
+            bool hullClipped = hullMinX < windowMinX || hullMaxX > windowMaxX || hullMinY < windowMinY || hullMaxY > windowMaxY;
+
+            if (this.distanceTransformWindow == null || this.distanceTransformWindow.Length < windowWidth * windowHeight)
+                this.distanceTransformWindow = new double[windowWidth * windowHeight];
+            if (this.hullDistanceSqrLowerBounds == null || this.hullDistanceSqrLowerBounds.Length != this.imageSize.Width * this.imageSize.Height)
+                this.hullDistanceSqrLowerBounds = new double[this.imageSize.Width * this.imageSize.Height];
+
+            double[] windowDistances = this.distanceTransformWindow;
+            for (int windowY = 0; windowY < windowHeight; ++windowY)
+            {
+                int rowStart = windowY * windowWidth;
+                for (int windowX = 0; windowX < windowWidth; ++windowX)
+                    windowDistances[rowStart + windowX] = EuclideanDistanceTransform.Infinity;
+
+                // Mark every pixel whose cell intersects the hull (cells are slightly enlarged to be safe from rounding errors)
+                double cellHalfSize = 0.5 + TileDistanceMargin;
+                double slabMinY = windowMinY + windowY - cellHalfSize, slabMaxY = windowMinY + windowY + cellHalfSize;
+                double rowMinX, rowMaxX;
+                if (!GetPolygonExtentInSlab(convexHull, slabMinY, slabMaxY, out rowMinX, out rowMaxX))
+                    continue;
+                int firstX = Math.Max((int)Math.Ceiling(rowMinX - cellHalfSize), windowMinX);
+                int lastX = Math.Min((int)Math.Floor(rowMaxX + cellHalfSize), windowMaxX);
+                for (int x = firstX; x <= lastX; ++x)
+                    windowDistances[rowStart + x - windowMinX] = 0;
+            }
+
+            EuclideanDistanceTransform.ComputeSquared(windowDistances, windowWidth, windowHeight);
+
+            double[] result = this.hullDistanceSqrLowerBounds;
+            for (int y = 0; y < this.imageSize.Height; ++y)
+            {
+                for (int x = 0; x < this.imageSize.Width; ++x)
+                {
+                    double distance = Math.Sqrt(windowDistances[(y - windowMinY) * windowWidth + x - windowMinX]);
+                    double distanceLowerBound = distance - PixelCellHalfDiagonal - TileDistanceMargin;
+
+                    // If the closest hull point was dropped, it is still farther than the margin and the hull bounding box
+                    if (hullClipped)
+                    {
+                        double boxDistanceX = Math.Max(Math.Max(hullMinX - x, x - hullMaxX), 0);
+                        double boxDistanceY = Math.Max(Math.Max(hullMinY - y, y - hullMaxY), 0);
+                        double boxDistance = Math.Sqrt(boxDistanceX * boxDistanceX + boxDistanceY * boxDistanceY);
+                        distanceLowerBound = Math.Max(Math.Min(distanceLowerBound, margin), boxDistance - TileDistanceMargin);
+                    }
+
+                    result[y * this.imageSize.Width + x] = distanceLowerBound > 0 ? distanceLowerBound * distanceLowerBound : 0;
+                }
+            }
+
+            return result;
+        }
+
+        private static bool GetPolygonExtentInSlab(Polygon polygon, double slabMinY, double slabMaxY, out double minX, out double maxX)
+        {
+            // Intersection of a convex polygon with a slab is convex, so its extent is determined by clipped boundary segments
+            minX = Double.PositiveInfinity;
+            maxX = Double.NegativeInfinity;
+            for (int i = 0; i < polygon.Vertices.Count; ++i)
+            {
+                Vector start = polygon.Vertices[i], end = polygon.Vertices[(i + 1) % polygon.Vertices.Count];
+                if (start.Y > end.Y)
+                {
+                    Vector temp = start;
+                    start = end;
+                    end = temp;
+                }
+
+                if (end.Y < slabMinY || start.Y > slabMaxY)
+                    continue;
+
+                double clippedStartX = start.X, clippedEndX = end.X;
+                if (end.Y > start.Y)
+                {
+                    double slope = (end.X - start.X) / (end.Y - start.Y);
+                    clippedStartX = start.X + slope * (Math.Max(start.Y, slabMinY) - start.Y);
+                    clippedEndX = start.X + slope * (Math.Min(end.Y, slabMaxY) - start.Y);
+                }
+
+                minX = Math.Min(minX, Math.Min(clippedStartX, clippedEndX));
+                maxX = Math.Max(maxX, Math.Max(clippedStartX, clippedEndX));
+            }
+
+            return minX <= maxX;
+        }
+
+        private void UpdateTileBounds(EdgeTerms edgeTerms, ObjectBackgroundTermPlanes terms)
+        {
+            float[] objectTerms = terms.ObjectTerms;
+            float[] backgroundTerms = terms.BackgroundTerms;
+            for (int tileY = 0; tileY < this.tileCountY; ++tileY)
+            {
+                for (int tileX = 0; tileX < this.tileCountX; ++tileX)
+                {
+                    float minObjectTerm = Single.PositiveInfinity, maxBackgroundTerm = Single.NegativeInfinity;
+                    int maxX = Math.Min((tileX + 1) * TileSize, this.imageSize.Width);
+                    int maxY = Math.Min((tileY + 1) * TileSize, this.imageSize.Height);
+                    for (int y = tileY * TileSize; y < maxY; ++y)
+                    {
+                        for (int x = tileX * TileSize; x < maxX; ++x)
+                        {
+                            int index = terms.GetIndex(x, y);
+                            minObjectTerm = Math.Min(minObjectTerm, objectTerms[index]);
+                            maxBackgroundTerm = Math.Max(maxBackgroundTerm, backgroundTerms[index]);
+                        }
+                    }
+
+                    edgeTerms.TileMinObjectTerms[tileY * this.tileCountX + tileX] = minObjectTerm;
+                    edgeTerms.TileMaxBackgroundTerms[tileY * this.tileCountX + tileX] = maxBackgroundTerm;
+                }
+            }
+        }
+
+        private void CombineEdgeTerms(EdgeTerms[] edgeTermsList, ObjectBackgroundTermPlanes result)
+        {
+            float[] resultObjectTerms = result.ObjectTerms;
+            float[] resultBackgroundTerms = result.BackgroundTerms;
+            foreach (EdgeTerms edgeTerms in edgeTermsList)
+            {
+                for (int y = 0; y < this.imageSize.Height; ++y)
+                    edgeTerms.CombineRow(y, 0, this.imageSize.Width, resultObjectTerms, resultBackgroundTerms, result.GetIndex(0, y));
+            }
+        }
+
+        private void CombineEdgeTermsTiled(EdgeTerms[] edgeTermsList, ObjectBackgroundTermPlanes result)
+        {
+            float[] resultObjectTerms = result.ObjectTerms;
+            float[] resultBackgroundTerms = result.BackgroundTerms;
+            for (int tileY = 0; tileY < this.tileCountY; ++tileY)
+            {
+                for (int tileX = 0; tileX < this.tileCountX; ++tileX)
+                {
+                    int tileIndex = tileY * this.tileCountX + tileX;
+                    int minX = tileX * TileSize, maxX = Math.Min(minX + TileSize, this.imageSize.Width);
+                    int minY = tileY * TileSize, maxY = Math.Min(minY + TileSize, this.imageSize.Height);
+
+                    // Bounds of the terms combined so far
+                    float maxObjectTerm = result.Saturation, minBackgroundTerm = 0;
+                    foreach (EdgeTerms edgeTerms in edgeTermsList)
+                    {
+                        // Edge can't change this tile
+                        if (edgeTerms.TileMinObjectTerms[tileIndex] >= maxObjectTerm &&
+                            edgeTerms.TileMaxBackgroundTerms[tileIndex] <= minBackgroundTerm)
                         {
-                            for (int y = 0; y < imageSize.Height; ++y)
+                            continue;
+                        }
+
+                        maxObjectTerm = Single.NegativeInfinity;
+                        minBackgroundTerm = Single.PositiveInfinity;
+                        for (int y = minY; y < maxY; ++y)
+                        {
+                            int rowStart = result.GetIndex(minX, y);
+                            edgeTerms.CombineRow(y, minX, maxX - minX, resultObjectTerms, resultBackgroundTerms, rowStart);
+                            for (int index = rowStart, rowEnd = index + maxX - minX; index < rowEnd; ++index)
                             {
-                                Vector pointAsVec = new Vector(x, y);
-                                double minDistanceSqr, maxDistanceSqr;
-                                MinMaxDistanceForEdge(
-                                    pointAsVec,
-                                    convexHull,
-                                    vertexConstraints1,
-                                    vertexConstraints2,
-                                    out minDistanceSqr,
-                                    out maxDistanceSqr);
-
-                                edgeTerms[x, y] = new ObjectBackgroundTerm(
-                                    this.shapeModel.CalculateObjectPenaltyForEdge(
-                                        minDistanceSqr, edgeConstraints.MaxWidth),
-                                    this.shapeModel.CalculateBackgroundPenaltyForEdge(
-                                        maxDistanceSqr, edgeConstraints.MinWidth));
+                                maxObjectTerm = Math.Max(maxObjectTerm, resultObjectTerms[index]);
+                                minBackgroundTerm = Math.Min(minBackgroundTerm, resultBackgroundTerms[index]);
                             }
-                        });
+                        }
+                    }
+                }
+            }
+        }
+
+        private void CombineEdgeTermsIncrementally(ShapeConstraints constraintsSet, EdgeTerms[] edgeTermsList, ObjectBackgroundTermPlanes result)
+        {
+            int edgeCount = edgeTermsList.Length;
+            bool treeIsNew = this.combinationTreeStructure != this.shapeModel.Structure;
+            if (treeIsNew)
+            {
+                this.combinationTreeStructure = this.shapeModel.Structure;
+                this.combinationTreeEdges = new EdgeDescription[edgeCount];
+                this.combinationTreeNodes = new ObjectBackgroundTermPlanes[4 * edgeCount];
+                this.CombinationTreeByteSize = 0;
+            }
+
+            bool[] changedEdges = new bool[edgeCount];
+            for (int edgeIndex = 0; edgeIndex < edgeCount; ++edgeIndex)
+            {
+                ShapeEdge edge = this.shapeModel.Structure.Edges[edgeIndex];
+                EdgeDescription edgeDescription = new EdgeDescription(
+                    constraintsSet.VertexConstraints[edge.Index1],
+                    constraintsSet.VertexConstraints[edge.Index2],
+                    constraintsSet.EdgeConstraints[edgeIndex]);
+                changedEdges[edgeIndex] = treeIsNew || !edgeDescription.Equals(this.combinationTreeEdges[edgeIndex]);
+                this.combinationTreeEdges[edgeIndex] = edgeDescription;
+            }
+
+            // Nodes are allocated on first use, cached items can be discarded to make room for them
+            long oldCombinationTreeByteSize = this.CombinationTreeByteSize;
+            Rectangle changedRegion = this.UpdateCombinationTreeNode(0, 0, edgeCount, edgeTermsList, changedEdges);
+            if (this.CombinationTreeByteSize > oldCombinationTreeByteSize)
+                this.DiscardCachedItemsOverBudget(edgeCount);
+
+            // Root can only be copied partially if the result still holds what we have written there last time
+            if (result != this.lastResult)
+                changedRegion = result.Rectangle;
+            for (int y = changedRegion.Top; y < changedRegion.Bottom; ++y)
+            {
+                int rowStart = result.GetIndex(changedRegion.Left, y);
+                this.CopyCombinationTreeNodeRow(0, 0, edgeCount, edgeTermsList, y, changedRegion.Left, changedRegion.Width, result.ObjectTerms, result.BackgroundTerms, rowStart);
+                for (int index = rowStart, rowEnd = index + changedRegion.Width; index < rowEnd; ++index)
+                {
+                    result.ObjectTerms[index] = Math.Min(result.ObjectTerms[index], result.Saturation);
+                    result.BackgroundTerms[index] = Math.Max(result.BackgroundTerms[index], 0);
                 }
+            }
+
+            this.lastResult = result;
+            this.LastChangedRegion = changedRegion;
+        }
 
-                for (int x = 0; x < imageSize.Width; ++x)
-                    for (int y = 0; y < imageSize.Height; ++y)
-                        result[x, y] = new ObjectBackgroundTerm(
-                            Math.Min(result[x, y].ObjectTerm, edgeTerms[x, y].ObjectTerm),
-                            Math.Max(result[x, y].BackgroundTerm, edgeTerms[x, y].BackgroundTerm));
+        private void CopyCombinationTreeNodeRow(
+            int node, int firstEdge, int lastEdge, EdgeTerms[] edgeTermsList, int y, int minX, int count, float[] objectTerms, float[] backgroundTerms, int targetIndex)
+        {
+            if (lastEdge - firstEdge == 1)
+            {
+                edgeTermsList[firstEdge].CopyRow(y, minX, count, objectTerms, backgroundTerms, targetIndex);
+                return;
+            }
+
+            ObjectBackgroundTermPlanes terms = this.combinationTreeNodes[node];
+            Array.Copy(terms.ObjectTerms, terms.GetIndex(minX, y), objectTerms, targetIndex, count);
+            Array.Copy(terms.BackgroundTerms, terms.GetIndex(minX, y), backgroundTerms, targetIndex, count);
+        }
+
+        private void CombineCombinationTreeNodeRow(
+            int node, int firstEdge, int lastEdge, EdgeTerms[] edgeTermsList, int y, int minX, int count, float[] objectTerms, float[] backgroundTerms, int targetIndex)
+        {
+            if (lastEdge - firstEdge == 1)
+            {
+                edgeTermsList[firstEdge].CombineRow(y, minX, count, objectTerms, backgroundTerms, targetIndex);
+                return;
             }
+
+            ObjectBackgroundTermPlanes terms = this.combinationTreeNodes[node];
+            CombineRow(terms, y, minX, count, objectTerms, backgroundTerms, targetIndex);
         }
 
-        private void SetTarget(ShapeModel newShapeModel, Size newImageSize)
+        /// <summary>
+        /// Recombines the subtree for edges in [firstEdge, lastEdge) and returns the region where its terms have changed.
+        /// Terms of a node are recombined only in the union of the regions changed in its children.
+        /// </summary>
+        private Rectangle UpdateCombinationTreeNode(int node, int firstEdge, int lastEdge, EdgeTerms[] edgeTermsList, bool[] changedEdges)
         {
-            if (newShapeModel.Structure.Edges.Count > CacheCapacity)
-                throw new InvalidOperationException("Edge count is bigger than cache size. Such shape models are not currently supported.");
+            if (lastEdge - firstEdge == 1)
+                return changedEdges[firstEdge] ? new Rectangle(Point.Empty, this.imageSize) : Rectangle.Empty;
+
+            int middleEdge = (firstEdge + lastEdge) / 2;
+            int leftNode = 2 * node + 1, rightNode = 2 * node + 2;
+            Rectangle leftChangedRegion = this.UpdateCombinationTreeNode(leftNode, firstEdge, middleEdge, edgeTermsList, changedEdges);
+            Rectangle rightChangedRegion = this.UpdateCombinationTreeNode(rightNode, middleEdge, lastEdge, edgeTermsList, changedEdges);
+            Rectangle region =
+                leftChangedRegion.IsEmpty ? rightChangedRegion :
+                rightChangedRegion.IsEmpty ? leftChangedRegion :
+                Rectangle.Union(leftChangedRegion, rightChangedRegion);
+            if (region.IsEmpty)
+                return Rectangle.Empty;
 
-            this.freeTermImages = new LinkedList<Image2D<ObjectBackgroundTerm>>();
-            this.cachedEdgeTerms = new LruCache<EdgeDescription, Image2D<ObjectBackgroundTerm>>(CacheCapacity);
+            ObjectBackgroundTermPlanes terms = this.combinationTreeNodes[node];
+            bool nodeIsNew = terms == null;
+            if (nodeIsNew)
+            {
+                terms = new ObjectBackgroundTermPlanes(this.imageSize.Width, this.imageSize.Height, this.saturation);
+                this.combinationTreeNodes[node] = terms;
+                this.CombinationTreeByteSize += 2L * terms.ObjectTerms.Length * sizeof(float);
+            }
+
+            // Children are combined row by row, so that compressed edge terms never have to be fully decompressed
+            float[] rowObjectTerms = new float[region.Width], rowBackgroundTerms = new float[region.Width];
+            float[] objectTerms = terms.ObjectTerms, backgroundTerms = terms.BackgroundTerms;
+            int changedMinX = Int32.MaxValue, changedMaxX = -1, changedMinY = Int32.MaxValue, changedMaxY = -1;
+            for (int y = region.Top; y < region.Bottom; ++y)
+            {
+                this.CopyCombinationTreeNodeRow(leftNode, firstEdge, middleEdge, edgeTermsList, y, region.Left, region.Width, rowObjectTerms, rowBackgroundTerms, 0);
+                this.CombineCombinationTreeNodeRow(rightNode, middleEdge, lastEdge, edgeTermsList, y, region.Left, region.Width, rowObjectTerms, rowBackgroundTerms, 0);
+
+                int rowStart = terms.GetIndex(region.Left, y);
+                for (int i = 0; i < region.Width; ++i)
+                {
+                    int index = rowStart + i;
+                    if (rowObjectTerms[i] == objectTerms[index] && rowBackgroundTerms[i] == backgroundTerms[index])
+                        continue;
+
+                    objectTerms[index] = rowObjectTerms[i];
+                    backgroundTerms[index] = rowBackgroundTerms[i];
+                    changedMinX = Math.Min(changedMinX, region.Left + i);
+                    changedMaxX = Math.Max(changedMaxX, region.Left + i);
+                    changedMinY = Math.Min(changedMinY, y);
+                    changedMaxY = Math.Max(changedMaxY, y);
+                }
+            }
+
+            if (nodeIsNew)
+                return region;
+            if (changedMaxX < 0)
+                return Rectangle.Empty;
+            return Rectangle.FromLTRB(changedMinX, changedMinY, changedMaxX + 1, changedMaxY + 1);
+        }
+
+        private static void CombineRow(
+            ObjectBackgroundTermPlanes terms, int y, int minX, int count, float[] objectTerms, float[] backgroundTerms, int targetIndex)
+        {
+            float[] sourceObjectTerms = terms.ObjectTerms, sourceBackgroundTerms = terms.BackgroundTerms;
+            for (int sourceIndex = terms.GetIndex(minX, y), sourceEnd = sourceIndex + count; sourceIndex < sourceEnd; ++sourceIndex, ++targetIndex)
+            {
+                objectTerms[targetIndex] = Math.Min(objectTerms[targetIndex], sourceObjectTerms[sourceIndex]);
+                backgroundTerms[targetIndex] = Math.Max(backgroundTerms[targetIndex], sourceBackgroundTerms[sourceIndex]);
+            }
+        }
+
+        private void SetTarget(Size newImageSize, float newSaturation)
+        {
+            this.freeTermImages = new LinkedList<EdgeTerms>();
+            this.cachedEdgeTerms = new LruCache<EdgeDescription, EdgeTerms>(Int32.MaxValue);
             this.cachedEdgeTerms.CacheItemDiscarded += (sender, args) => this.DeallocateImage(args.DiscardedValue);
-            this.shapeModel = newShapeModel;
+            this.CachedEdgeTermsByteSize = 0;
+            this.compressionBuffer = new ObjectBackgroundTermPlanes(newImageSize.Width, newImageSize.Height, newSaturation);
+            this.edgeTermsTemplates = new LruCache<EdgeDescription, EdgeTermsTemplate>(TemplateCacheCapacity);
+            this.edgeTermsTemplates.CacheItemDiscarded += (sender, args) => this.TemplateCacheByteSize -= args.DiscardedValue.ByteSize;
+            this.TemplateCacheByteSize = 0;
             this.imageSize = newImageSize;
+            this.saturation = newSaturation;
+            this.tileCountX = (newImageSize.Width + TileSize - 1) / TileSize;
+            this.tileCountY = (newImageSize.Height + TileSize - 1) / TileSize;
+            this.combinationTreeStructure = null;
+            this.combinationTreeNodes = null;
+            this.CombinationTreeByteSize = 0;
+            this.lastResult = null;
         }
 
-        private Image2D<ObjectBackgroundTerm> AllocateImage()
+        private EdgeTerms AllocateImage()
         {
             Debug.Assert(shapeModel != null);
 
-            Image2D<ObjectBackgroundTerm> result;
+            EdgeTerms result;
             if (freeTermImages.Count > 0)
             {
                 result = freeTermImages.Last.Value;
                 freeTermImages.RemoveLast();
             }
             else
-                result = new Image2D<ObjectBackgroundTerm>(imageSize.Width, imageSize.Height);
+                result = new EdgeTerms(imageSize.Width, imageSize.Height, saturation, this.tileCountX * this.tileCountY);
 
             return result;
         }
 
-        private void DeallocateImage(Image2D<ObjectBackgroundTerm> image)
+        private void DeallocateImage(EdgeTerms image)
+        {
+            this.CachedEdgeTermsByteSize -= image.ByteSize;
+
+            // Compressed terms have different sizes, so they are not reused
+            if (!image.IsCompressed)
+                freeTermImages.AddLast(image);
+        }
+
+        internal static double MinDistanceToPolygonBoundarySqr(Vector point, Polygon polygon)
         {
-            freeTermImages.AddLast(image);
+            double minDistanceSqr = Double.PositiveInfinity;
+            for (int i = 0; i < polygon.Vertices.Count; ++i)
+            {
+                double distanceSqr = point.DistanceToSegmentSquared(
+                    polygon.Vertices[i],
+                    polygon.Vertices[(i + 1) % polygon.Vertices.Count]);
+                minDistanceSqr = Math.Min(minDistanceSqr, distanceSqr);
+            }
+
+            return minDistanceSqr;
+        }
+
+        internal static double MaxDistanceToEdgeSegmentsSqr(Vector point, VertexConstraints constraints1, VertexConstraints constraints2)
+        {
+            double maxDistanceSqr = 0;
+            foreach (Vector vertex1 in constraints1.Corners)
+            {
+                foreach (Vector vertex2 in constraints2.Corners)
+                {
+                    double distanceSqr = point.DistanceToSegmentSquared(vertex1, vertex2);
+                    maxDistanceSqr = Math.Max(maxDistanceSqr, distanceSqr);
+                }
+            }
+
+            return maxDistanceSqr;
         }
 
         private static void MinMaxDistanceForEdge(
@@ -132,25 +1064,133 @@ namespace Research.GraphBasedShapePrior
             if (convexHull.IsPointInside(point))
                 minDistanceSqr = 0;
             else
+                minDistanceSqr = MinDistanceToPolygonBoundarySqr(point, convexHull);
+
+            maxDistanceSqr = MaxDistanceToEdgeSegmentsSqr(point, constraints1, constraints2);
+        }
+
+        private class EdgeTerms
+        {
+            public EdgeTerms(int width, int height, float saturation, int tileCount)
             {
-                minDistanceSqr = Double.PositiveInfinity;
-                for (int i = 0; i < convexHull.Vertices.Count; ++i)
+                this.Terms = new ObjectBackgroundTermPlanes(width, height, saturation);
+                this.TileMinObjectTerms = new float[tileCount];
+                this.TileMaxBackgroundTerms = new float[tileCount];
+            }
+
+            public EdgeTerms(CompressedTermsPlane compressedObjectTerms, CompressedTermsPlane compressedBackgroundTerms, int tileCount)
+            {
+                this.CompressedObjectTerms = compressedObjectTerms;
+                this.CompressedBackgroundTerms = compressedBackgroundTerms;
+                this.TileMinObjectTerms = new float[tileCount];
+                this.TileMaxBackgroundTerms = new float[tileCount];
+            }
+
+            /// <summary>
+            /// Gets the terms if they are not compressed, null otherwise.
+            /// </summary>
+            public ObjectBackgroundTermPlanes Terms { get; private set; }
+
+            public CompressedTermsPlane CompressedObjectTerms { get; private set; }
+
+            public CompressedTermsPlane CompressedBackgroundTerms { get; private set; }
+
+            public float[] TileMinObjectTerms { get; private set; }
+
+            public float[] TileMaxBackgroundTerms { get; private set; }
+
+            public bool IsCompressed
+            {
+                get { return this.Terms == null; }
+            }
+
+            public long ByteSize
+            {
+                get
                 {
-                    double distanceSqr = point.DistanceToSegmentSquared(
-                        convexHull.Vertices[i],
-                        convexHull.Vertices[(i + 1) % convexHull.Vertices.Count]);
-                    minDistanceSqr = Math.Min(minDistanceSqr, distanceSqr);
+                    long tileBoundsSize = 2L * this.TileMinObjectTerms.Length * sizeof(float);
+                    if (this.IsCompressed)
+                        return this.CompressedObjectTerms.ByteSize + this.CompressedBackgroundTerms.ByteSize + tileBoundsSize;
+                    return 2L * this.Terms.ObjectTerms.Length * sizeof(float) + tileBoundsSize;
                 }
             }
-            
-            maxDistanceSqr = 0;
-            foreach (Vector vertex1 in constraints1.Corners)
+
+            public void CopyRow(int y, int minX, int count, float[] objectTerms, float[] backgroundTerms, int targetIndex)
             {
-                foreach (Vector vertex2 in constraints2.Corners)
+                if (this.IsCompressed)
                 {
-                    double distanceSqr = point.DistanceToSegmentSquared(vertex1, vertex2);
-                    maxDistanceSqr = Math.Max(maxDistanceSqr, distanceSqr);
+                    this.CompressedObjectTerms.CopyRow(y, minX, count, objectTerms, targetIndex);
+                    this.CompressedBackgroundTerms.CopyRow(y, minX, count, backgroundTerms, targetIndex);
+                    return;
                 }
+
+                Array.Copy(this.Terms.ObjectTerms, this.Terms.GetIndex(minX, y), objectTerms, targetIndex, count);
+                Array.Copy(this.Terms.BackgroundTerms, this.Terms.GetIndex(minX, y), backgroundTerms, targetIndex, count);
+            }
+
+            /// <summary>
+            /// Replaces the given object terms with their minimums with the edge terms, background terms with maximums.
+            /// </summary>
+            public void CombineRow(int y, int minX, int count, float[] objectTerms, float[] backgroundTerms, int targetIndex)
+            {
+                if (this.IsCompressed)
+                {
+                    this.CompressedObjectTerms.MinRow(y, minX, count, objectTerms, targetIndex);
+                    this.CompressedBackgroundTerms.MaxRow(y, minX, count, backgroundTerms, targetIndex);
+                    return;
+                }
+
+                CpuShapeTermsLowerBoundCalculator.CombineRow(this.Terms, y, minX, count, objectTerms, backgroundTerms, targetIndex);
+            }
+        }
+
+        private class EdgeTermsTemplate
+        {
+            // Rough size of the object headers and fields, used for memory estimates
+            private const int ObjectOverheadBytes = 128;
+
+            public EdgeTermsTemplate(
+                Rectangle band,
+                Rectangle storedRegion,
+                float[] objectTerms,
+                float[] backgroundTerms,
+                float backgroundFill,
+                int anchorX,
+                int anchorY)
+            {
+                this.Band = band;
+                this.StoredRegion = storedRegion;
+                this.ObjectTerms = objectTerms;
+                this.BackgroundTerms = backgroundTerms;
+                this.BackgroundFill = backgroundFill;
+                this.AnchorX = anchorX;
+                this.AnchorY = anchorY;
+            }
+
+            /// <summary>
+            /// Gets the region outside of which object terms are bounded using the hull bounding box
+            /// and background terms are replaced by the fill value.
+            /// </summary>
+            public Rectangle Band { get; private set; }
+
+            /// <summary>
+            /// Gets the part of the band inside the image, terms of which are stored row by row.
+            /// </summary>
+            public Rectangle StoredRegion { get; private set; }
+
+            public float[] ObjectTerms { get; private set; }
+
+            public float[] BackgroundTerms { get; private set; }
+
+            public float BackgroundFill { get; private set; }
+
+            public int AnchorX { get; private set; }
+
+            public int AnchorY { get; private set; }
+
+            public long ByteSize
+            {
+                get { return ObjectOverheadBytes + sizeof(float) * (this.ObjectTerms.Length + this.BackgroundTerms.Length); }
             }
         }
 
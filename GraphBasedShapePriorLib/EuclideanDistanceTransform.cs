@@ -0,0 +1,117 @@
+﻿using System;
+using System.Threading.Tasks;
+
+namespace Research.GraphBasedShapePrior
+{
+    /// <summary>
+    /// Exact squared Euclidean distance transform of sampled functions on a pixel grid (Felzenszwalb-Huttenlocher).
+    /// Runs in time linear in the number of pixels.
+    /// </summary>
+    public static class EuclideanDistanceTransform
+    {
+        /// <summary>
+        /// Value that should be used for pixels where function is not defined (infinities break envelope intersections).
+        /// </summary>
+        public const double Infinity = 1e20;
+
+        /// <summary>
+        /// Replaces values of a row-major function f with min over q of f(q) + |p - q|^2.
+        /// Only the first width * height values are used, so that larger buffers can be reused.
+        /// </summary>
+        public static void ComputeSquared(double[] values, int width, int height)
+        {
+            if (values == null)
+                throw new ArgumentNullException("values");
+            if (width <= 0)
+                throw new ArgumentOutOfRangeException("width", "Parameter value should be positive.");
+            if (height <= 0)
+                throw new ArgumentOutOfRangeException("height", "Parameter value should be positive.");
+            if (values.Length < width * height)
+                throw new ArgumentException("Value count is less than grid size.", "values");
+
+            // Columns first, then rows
+            Parallel.For(
+                0,
+                width,
+                () => new TransformBuffers(Math.Max(width, height)),
+                (x, loopState, buffers) =>
+                {
+                    Transform1D(values, x, width, height, buffers);
+                    return buffers;
+                },
+                buffers => { });
+            Parallel.For(
+                0,
+                height,
+                () => new TransformBuffers(Math.Max(width, height)),
+                (y, loopState, buffers) =>
+                {
+                    Transform1D(values, y * width, 1, width, buffers);
+                    return buffers;
+                },
+                buffers => { });
+        }
+
+        private static void Transform1D(double[] values, int start, int stride, int count, TransformBuffers buffers)
+        {
+            double[] function = buffers.Function;
+            int[] envelope = buffers.Envelope;
+            double[] parabolaRange = buffers.ParabolaRange;
+            for (int i = 0; i < count; ++i)
+                function[i] = values[start + i * stride];
+
+            // Find lower envelope of parabolas rooted at every point
+            int envelopeSize = 1;
+            envelope[0] = 0;
+            parabolaRange[0] = Double.NegativeInfinity;
+            parabolaRange[1] = Double.PositiveInfinity;
+            for (int i = 1; i < count; ++i)
+            {
+                bool inserted = false;
+                while (!inserted)
+                {
+                    int lastEnvCoord = envelope[envelopeSize - 1];
+                    double intersectionPoint =
+                        (function[i] + i * i - function[lastEnvCoord] - lastEnvCoord * lastEnvCoord) / (2 * (i - lastEnvCoord));
+                    if (intersectionPoint > parabolaRange[envelopeSize - 1])
+                    {
+                        envelopeSize += 1;
+                        envelope[envelopeSize - 1] = i;
+                        parabolaRange[envelopeSize - 1] = intersectionPoint;
+                        parabolaRange[envelopeSize] = Double.PositiveInfinity;
+                        inserted = true;
+                    }
+                    else
+                        envelopeSize -= 1;
+                }
+            }
+
+            // Find parabola from envelope for each point
+            int currentParabola = 0;
+            for (int i = 0; i < count; ++i)
+            {
+                while (parabolaRange[currentParabola + 1] < i)
+                    currentParabola += 1;
+
+                int diff = i - envelope[currentParabola];
+                values[start + i * stride] = function[envelope[currentParabola]] + diff * diff;
+            }
+        }
+
+        private class TransformBuffers
+        {
+            public TransformBuffers(int size)
+            {
+                this.Function = new double[size];
+                this.Envelope = new int[size];
+                this.ParabolaRange = new double[size + 1];
+            }
+
+            public double[] Function { get; private set; }
+
+            public int[] Envelope { get; private set; }
+
+            public double[] ParabolaRange { get; private set; }
+        }
+    }
+}
@@ -159,30 +159,79 @@ namespace Research.GraphBasedShapePrior
                 throw new InvalidOperationException("Given interest ranges ovelap.");
 
             // Calculate penalty (where it's finite)
-            int left = -1;
-            foreach (int i in EnumerateFinitePenaltyGridIndices())
-            {
+            int[] finitePenaltyGridIndices = this.EnumerateFinitePenaltyGridIndices().ToArray();
+            foreach (int i in finitePenaltyGridIndices)
                 functionValues[i] = penaltyFunc(GridIndexToCoord(i));
-                if (left == -1)
-                    left = i;
-            }
 
+            int[] interestGridIndices = this.EnumerateInterestGridIndices().ToArray();
+            ComputeTransform(
+                this.functionValues,
+                0,
+                finitePenaltyGridIndices,
+                interestGridIndices,
+                distanceScale,
+                this.GridStepSize,
+                this.values,
+                this.bestIndices,
+                0,
+                this.envelope,
+                this.parabolaRange);
+            foreach (int i in interestGridIndices)
+                this.timeStamps[i] = currentTimeStamp;
+
+            this.IsComputed = true;
+        }
+
+        internal int[] GetOrderedFinitePenaltyGridIndices()
+        {
+            if (!this.TryEstablishRangeOrdering(this.finitePenaltyRanges))
+                throw new InvalidOperationException("Given finite penalty ranges ovelap.");
+            return this.EnumerateFinitePenaltyGridIndices().ToArray();
+        }
+
+        internal int[] GetOrderedInterestGridIndices()
+        {
+            if (!this.TryEstablishRangeOrdering(this.interestRanges))
+                throw new InvalidOperationException("Given interest ranges ovelap.");
+            return this.EnumerateInterestGridIndices().ToArray();
+        }
+
+        /// <summary>
+        /// Computes transform of a function stored in a flat array starting from the given offset.
+        /// Grid indices should be sorted, results are written for the indices of interest only.
+        /// Best indices are not written if the corresponding array is null.
+        /// Envelope buffers should have at least grid size and grid size + 1 elements.
+        /// </summary>
+        internal static void ComputeTransform(
+            double[] functionValues,
+            int functionOffset,
+            int[] finitePenaltyGridIndices,
+            int[] interestGridIndices,
+            double distanceScale,
+            double gridStepSize,
+            double[] values,
+            int[] bestIndices,
+            int resultOffset,
+            int[] envelope,
+            double[] parabolaRange)
+        {
             // Find lower envelope
+            int left = finitePenaltyGridIndices[0];
             int envelopeSize = 1;
             envelope[0] = left;
             parabolaRange[0] = Double.NegativeInfinity;
             parabolaRange[1] = Double.PositiveInfinity;
-            double intersectionCoeff = 1.0 / (distanceScale * this.GridStepSize * this.GridStepSize);
-            foreach (int i in EnumerateFinitePenaltyGridIndices())
+            double intersectionCoeff = 1.0 / (distanceScale * gridStepSize * gridStepSize);
+            for (int index = 1; index < finitePenaltyGridIndices.Length; ++index)
             {
-                if (i == left)
-                    continue;
-
+                int i = finitePenaltyGridIndices[index];
                 bool inserted = false;
                 while (!inserted)
                 {
                     int lastEnvCoord = envelope[envelopeSize - 1];
-                    double intersectionPoint = (functionValues[i] - functionValues[lastEnvCoord]) * intersectionCoeff + i * i - lastEnvCoord * lastEnvCoord;
+                    double intersectionPoint =
+                        (functionValues[functionOffset + i] - functionValues[functionOffset + lastEnvCoord]) * intersectionCoeff +
+                        i * i - lastEnvCoord * lastEnvCoord;
                     intersectionPoint /= 2 * (i - lastEnvCoord);
 
                     if (intersectionPoint >= parabolaRange[envelopeSize - 1])
@@ -200,18 +249,16 @@ namespace Research.GraphBasedShapePrior
 
             // Find parabola from envelope for each index of interest
             int currentParabola = 0;
-            foreach (int i in this.EnumerateInterestGridIndices())
+            foreach (int i in interestGridIndices)
             {
                 while (parabolaRange[currentParabola + 1] < i)
                     currentParabola += 1;
 
-                double diff = (i - envelope[currentParabola]) * this.GridStepSize;
-                this.values[i] = functionValues[envelope[currentParabola]] + diff * diff * distanceScale;
-                this.bestIndices[i] = envelope[currentParabola];
-                this.timeStamps[i] = currentTimeStamp;
+                double diff = (i - envelope[currentParabola]) * gridStepSize;
+                values[resultOffset + i] = functionValues[functionOffset + envelope[currentParabola]] + diff * diff * distanceScale;
+                if (bestIndices != null)
+                    bestIndices[resultOffset + i] = envelope[currentParabola];
             }
-
-            this.IsComputed = true;
         }
 
         private void AddRange(Range range, IList<Range> rangeCollection)
@@ -8,22 +8,51 @@ namespace Research.GraphBasedShapePrior
 {
     public class GeneralizedDistanceTransform2D
     {
-        private readonly double[,] values;
+        // Size of square blocks used to transpose results of the first pass
+        private const int TransposeBlockSize = 32;
 
-        private readonly int[,] timeStamps;
+        // Results are stored column by column, cell (x, y) has index x * GridSize.Height + y
+        private readonly double[] values;
 
-        private readonly Tuple<int, int>[,] bestIndices;
+        private readonly int[] timeStamps;
 
-        private readonly GeneralizedDistanceTransform1D infiniteTransformX;
+        // Best indices are packed as bestX * GridSize.Height + bestY, allocated on first computation that tracks them
+        private int[] bestIndices;
 
-        private readonly GeneralizedDistanceTransform1D[] transformsForFixedGridX;
-        
-        private readonly GeneralizedDistanceTransform1D[] transformsForFixedGridY;
+        // Holds ranges and grids along X axis
+        private readonly GeneralizedDistanceTransform1D axisX;
 
-        private readonly GeneralizedDistanceTransform1D[] usedTransformsForFixedGridY;
+        // Holds ranges and grids along Y axis
+        private readonly GeneralizedDistanceTransform1D axisY;
+
+        // Penalties of rows with finite penalty, indexed by grid X
+        private double[][] rowPenalties;
+
+        // Results of the first pass, stored row by row
+        private double[] rowValues;
+
+        private int[] rowBestIndices;
+
+        // Transposed results of the first pass, stored column by column
+        private double[] columnFunctionValues;
+
+        private int[] columnBestIndices;
 
         private int currentTimeStamp = 0;
 
+        // Parameters of the last computation, needed to recover best indices on demand
+        private double lastDistanceScaleX;
+
+        private double lastDistanceScaleY;
+
+        private int[] lastFinitePenaltyGridIndicesX;
+
+        private int[] lastFinitePenaltyGridIndicesY;
+
+        private bool lastComputeTrackedBestIndices;
+
+        private bool lastComputeShrankDistances;
+
         public GeneralizedDistanceTransform2D(
             Range rangeX, Range rangeY, Size gridSize)
         {
@@ -34,21 +63,14 @@ namespace Research.GraphBasedShapePrior
             this.RangeY = rangeY;
             this.GridSize = gridSize;
 
-            this.values = new double[this.GridSize.Width, this.GridSize.Height];
-            this.bestIndices = new Tuple<int, int>[this.GridSize.Width, this.GridSize.Height];
-            this.timeStamps = new int[this.GridSize.Width, this.GridSize.Height];
+            int cellCount = this.GridSize.Width * this.GridSize.Height;
+            this.values = new double[cellCount];
+            this.timeStamps = new int[cellCount];
 
-            this.transformsForFixedGridX = new GeneralizedDistanceTransform1D[this.GridSize.Width];
-            for (int x = 0; x < this.GridSize.Width; ++x)
-                this.transformsForFixedGridX[x] = new GeneralizedDistanceTransform1D(rangeY, this.GridSize.Height);
-            
-            this.transformsForFixedGridY = new GeneralizedDistanceTransform1D[this.GridSize.Height];
-            this.usedTransformsForFixedGridY = new GeneralizedDistanceTransform1D[this.GridSize.Height];
-            for (int y = 0; y < this.GridSize.Height; ++y)
-                transformsForFixedGridY[y] = new GeneralizedDistanceTransform1D(rangeX, this.GridSize.Width);
+            this.axisX = new GeneralizedDistanceTransform1D(rangeX, this.GridSize.Width);
+            this.axisY = new GeneralizedDistanceTransform1D(rangeY, this.GridSize.Height);
 
-            this.infiniteTransformX = new GeneralizedDistanceTransform1D(rangeX, this.GridSize.Width);
-            this.infiniteTransformX.Compute(1, x => 1e+20);
+            this.TrackBestIndices = true;
         }
 
         public Range RangeX { get; private set; }
@@ -59,75 +81,81 @@ namespace Research.GraphBasedShapePrior
 
         public bool IsComputed { get; private set; }
 
+        /// <summary>
+        /// Gets or sets whether best indices should be stored for every cell of interest during computation.
+        /// If they are not, best indices of a cell are recovered on request by scanning the row and column it depends on.
+        /// </summary>
+        public bool TrackBestIndices { get; set; }
+
+        /// <summary>
+        /// Gets or sets whether distances between grid points should be reduced by one grid step (but not below zero).
+        /// Every point then stands for its whole grid cell: if penalties lower-bound the function over their cells,
+        /// values lower-bound the transform of that function over their cells as well.
+        /// Best indices are not available for transforms computed this way.
+        /// </summary>
+        public bool ShrinkDistancesByCell { get; set; }
+
         public double GridStepSizeX
         {
-            get { return this.transformsForFixedGridY[0].GridStepSize; }
+            get { return this.axisX.GridStepSize; }
         }
 
         public double GridStepSizeY
         {
-            get { return this.transformsForFixedGridX[0].GridStepSize; }
+            get { return this.axisY.GridStepSize; }
         }
 
         public void ResetFinitePenaltyRange()
         {
             this.IsComputed = false;
-            foreach (GeneralizedDistanceTransform1D transform in transformsForFixedGridX)
-                transform.ResetFinitePenaltyRange();
-            foreach (GeneralizedDistanceTransform1D transform in transformsForFixedGridY)
-                transform.ResetFinitePenaltyRange();
+            this.axisX.ResetFinitePenaltyRange();
+            this.axisY.ResetFinitePenaltyRange();
         }
 
         public void AddFinitePenaltyRangeX(Range rangeX)
         {
             this.IsComputed = false;
-            foreach (GeneralizedDistanceTransform1D transform in transformsForFixedGridY)
-                transform.AddFinitePenaltyRange(rangeX);
+            this.axisX.AddFinitePenaltyRange(rangeX);
         }
 
         public void AddFinitePenaltyRangeY(Range rangeY)
         {
             this.IsComputed = false;
-            foreach (GeneralizedDistanceTransform1D transform in transformsForFixedGridX)
-                transform.AddFinitePenaltyRange(rangeY);
+            this.axisY.AddFinitePenaltyRange(rangeY);
         }
 
         public void ResetInterestRange()
         {
             this.IsComputed = false;
-            foreach (GeneralizedDistanceTransform1D transform in transformsForFixedGridX)
-                transform.ResetInterestRange();
-            foreach (GeneralizedDistanceTransform1D transform in transformsForFixedGridY)
-                transform.ResetInterestRange();
+            this.axisX.ResetInterestRange();
+            this.axisY.ResetInterestRange();
         }
 
         public void AddInterestRangeX(Range rangeX)
         {
             this.IsComputed = false;
-            foreach (GeneralizedDistanceTransform1D transform in transformsForFixedGridY)
-                transform.AddInterestRange(rangeX);
+            this.axisX.AddInterestRange(rangeX);
         }
 
         public void AddInterestRangeY(Range rangeY)
         {
             this.IsComputed = false;
-            foreach (GeneralizedDistanceTransform1D transform in transformsForFixedGridX)
-                transform.AddInterestRange(rangeY);
+            this.axisY.AddInterestRange(rangeY);
         }
 
         public bool IsCoordXOfInterest(double coordX)
         {
-            return this.transformsForFixedGridY[0].IsCoordOfInterest(coordX);
+            return this.axisX.IsCoordOfInterest(coordX);
         }
 
         public bool IsCoordYOfInterest(double coordY)
         {
-            return this.transformsForFixedGridX[0].IsCoordOfInterest(coordY);
+            return this.axisY.IsCoordOfInterest(coordY);
         }
 
         public bool AreGridIndicesComputed(int gridX, int gridY)
         {
-            return this.timeStamps[gridX, gridY] == this.currentTimeStamp;
+            return this.timeStamps[this.GetCellIndex(gridX, gridY)] == this.currentTimeStamp;
         }
 
         public bool AreCoordsComputed(double x, double y)
@@ -137,12 +165,12 @@ namespace Research.GraphBasedShapePrior
 
         public IEnumerable<int> EnumerateInterestGridIndicesX()
         {
-            return this.transformsForFixedGridY[0].EnumerateInterestGridIndices();
+            return this.axisX.EnumerateInterestGridIndices();
         }
 
         public IEnumerable<int> EnumerateInterestGridIndicesY()
         {
-            return this.transformsForFixedGridX[0].EnumerateInterestGridIndices();
+            return this.axisY.EnumerateInterestGridIndices();
         }
 
         public double GetValueByGridIndices(int gridX, int gridY)
@@ -152,21 +180,22 @@ namespace Research.GraphBasedShapePrior
             if (!this.AreGridIndicesComputed(gridX, gridY))
                 throw new ArgumentException("Given coords were out of interest during last computation.");
 
-            return this.values[gridX, gridY];
+            return this.values[this.GetCellIndex(gridX, gridY)];
         }
 
         public bool TryGetValueByGridIndices(int gridX, int gridY, out double value)
         {
             if (!this.IsComputed)
                 throw new InvalidOperationException("You should calculate transform first.");
-            
-            if (!this.AreGridIndicesComputed(gridX, gridY))
+
+            int cellIndex = this.GetCellIndex(gridX, gridY);
+            if (this.timeStamps[cellIndex] != this.currentTimeStamp)
             {
                 value = 0;
                 return false;
             }
-            
-            value = this.values[gridX, gridY];
+
+            value = this.values[cellIndex];
             return true;
         }
 
@@ -181,11 +210,64 @@ namespace Research.GraphBasedShapePrior
         }
 
         public Tuple<int, int> GetBestIndicesByGridIndices(int gridX, int gridY)
+        {
+            int bestGridX, bestGridY;
+            this.GetBestIndicesByGridIndices(gridX, gridY, out bestGridX, out bestGridY);
+            return new Tuple<int, int>(bestGridX, bestGridY);
+        }
+
+        public void GetBestIndicesByGridIndices(int gridX, int gridY, out int bestGridX, out int bestGridY)
+        {
+            if (!this.IsComputed)
+                throw new InvalidOperationException("You should calculate transform first.");
+            if (this.lastComputeShrankDistances)
+                throw new InvalidOperationException("Best indices are not available when distances are shrunk by cell.");
+
+            if (!this.lastComputeTrackedBestIndices)
+            {
+                if (!this.AreGridIndicesComputed(gridX, gridY))
+                    throw new ArgumentException("Given coords were out of interest during last computation.");
+                this.RecoverBestIndices(gridX, gridY, out bestGridX, out bestGridY);
+                return;
+            }
+
+            int packedBestIndices = this.bestIndices[this.GetCellIndex(gridX, gridY)];
+            bestGridX = packedBestIndices / this.GridSize.Height;
+            bestGridY = packedBestIndices % this.GridSize.Height;
+        }
+
+        /// <summary>
+        /// Finds min value over all the computed cells that intersect with the given coordinate ranges.
+        /// </summary>
+        public bool TryGetMinValueByCoordRanges(Range rangeX, Range rangeY, out double value)
         {
             if (!this.IsComputed)
                 throw new InvalidOperationException("You should calculate transform first.");
+            if (rangeX.Outside || rangeY.Outside)
+                throw new ArgumentException("Outside ranges are not allowed.");
+
+            value = Double.PositiveInfinity;
+            if (!rangeX.IntersectsWith(this.RangeX) || !rangeY.IntersectsWith(this.RangeY))
+                return false;
+
+            int minGridX = this.CoordToGridIndexX(Math.Max(rangeX.Left, this.RangeX.Left));
+            int maxGridX = this.CoordToGridIndexX(Math.Min(rangeX.Right, this.RangeX.Right));
+            int minGridY = this.CoordToGridIndexY(Math.Max(rangeY.Left, this.RangeY.Left));
+            int maxGridY = this.CoordToGridIndexY(Math.Min(rangeY.Right, this.RangeY.Right));
+            bool found = false;
+            for (int x = minGridX; x <= maxGridX; ++x)
+            {
+                for (int cellIndex = x * this.GridSize.Height + minGridY, columnEnd = cellIndex + maxGridY - minGridY; cellIndex <= columnEnd; ++cellIndex)
+                {
+                    if (this.timeStamps[cellIndex] == this.currentTimeStamp && this.values[cellIndex] < value)
+                    {
+                        value = this.values[cellIndex];
+                        found = true;
+                    }
+                }
+            }
 
-            return this.bestIndices[gridX, gridY];
+            return found;
         }
 
         public Tuple<int, int> GetBestIndicesByCoords(double coordX, double coordY)
@@ -195,22 +277,22 @@ namespace Research.GraphBasedShapePrior
 
         public int CoordToGridIndexX(double coord)
         {
-            return this.transformsForFixedGridY[0].CoordToGridIndex(coord);
+            return this.axisX.CoordToGridIndex(coord);
         }
 
         public int CoordToGridIndexY(double coord)
         {
-            return this.transformsForFixedGridX[0].CoordToGridIndex(coord);
+            return this.axisY.CoordToGridIndex(coord);
         }
 
         public double GridIndexToCoordX(int gridIndex)
         {
-            return this.transformsForFixedGridY[0].GridIndexToCoord(gridIndex);
+            return this.axisX.GridIndexToCoord(gridIndex);
         }
 
         public double GridIndexToCoordY(int gridIndex)
         {
-            return this.transformsForFixedGridX[0].GridIndexToCoord(gridIndex);
+            return this.axisY.GridIndexToCoord(gridIndex);
         }
 
         public void Compute(double distanceScaleX, double distanceScaleY, Func<double, double, double> penaltyFunc)
@@ -218,39 +300,240 @@ namespace Research.GraphBasedShapePrior
             if (penaltyFunc == null)
                 throw new ArgumentNullException("penaltyFunc");
 
+            this.Compute(
+                distanceScaleX,
+                distanceScaleY,
+                (gridY, finitePenaltyGridIndicesX, rowPenalties) =>
+                {
+                    double coordY = this.GridIndexToCoordY(gridY);
+                    foreach (int gridX in finitePenaltyGridIndicesX)
+                        rowPenalties[gridX] = penaltyFunc(this.GridIndexToCoordX(gridX), coordY);
+                });
+        }
+
+        /// <summary>
+        /// Computes transform with penalties evaluated row by row. Row penalty calculator is called
+        /// with grid Y index, sorted grid X indices of finite penalty and row of penalties indexed by grid X,
+        /// which should be filled at the given indices. Calculator can be called concurrently for different rows.
+        /// </summary>
+        public void Compute(double distanceScaleX, double distanceScaleY, Action<int, int[], double[]> rowPenaltyCalculator)
+        {
+            if (rowPenaltyCalculator == null)
+                throw new ArgumentNullException("rowPenaltyCalculator");
+
             ++this.currentTimeStamp;
 
-            for (int y = 0; y < this.GridSize.Height; ++y)
-                this.usedTransformsForFixedGridY[y] = this.infiniteTransformX;
+            int[] finitePenaltyGridIndicesX = this.axisX.GetOrderedFinitePenaltyGridIndices();
+            int[] finitePenaltyGridIndicesY = this.axisY.GetOrderedFinitePenaltyGridIndices();
+            int[] interestGridIndicesX = this.axisX.GetOrderedInterestGridIndices();
+            int[] interestGridIndicesY = this.axisY.GetOrderedInterestGridIndices();
+            bool shrinkDistances = this.ShrinkDistancesByCell;
+            bool trackBestIndices = this.TrackBestIndices && !shrinkDistances;
+            this.AllocatePassBuffers(trackBestIndices);
+
+            int[] rowBestIndicesOrNull = trackBestIndices ? this.rowBestIndices : null;
+            int[] columnBestIndicesOrNull = trackBestIndices ? this.columnBestIndices : null;
+
+            int width = this.GridSize.Width, height = this.GridSize.Height;
+            int maxGridSize = Math.Max(width, height);
+
+            // Transform rows with finite penalty along X
+            Parallel.For(
+                0,
+                finitePenaltyGridIndicesY.Length,
+                () => new EnvelopeBuffers(maxGridSize),
+                (i, loopState, buffers) =>
+                {
+                    int y = finitePenaltyGridIndicesY[i];
+                    rowPenaltyCalculator(y, finitePenaltyGridIndicesX, this.rowPenalties[y]);
+                    if (shrinkDistances)
+                        ErodeByCell(this.rowPenalties[y], 0, finitePenaltyGridIndicesX);
+                    GeneralizedDistanceTransform1D.ComputeTransform(
+                        this.rowPenalties[y],
+                        0,
+                        finitePenaltyGridIndicesX,
+                        interestGridIndicesX,
+                        distanceScaleX,
+                        this.GridStepSizeX,
+                        this.rowValues,
+                        rowBestIndicesOrNull,
+                        y * width,
+                        buffers.Envelope,
+                        buffers.ParabolaRange);
+                    return buffers;
+                },
+                buffers => { });
+
+            // Only cells in finite penalty rows and columns of interest are needed for the second pass
+            this.TransposeRowValues(finitePenaltyGridIndicesY, interestGridIndicesX);
+
+            // Transform columns of interest along Y
+            Parallel.For(
+                0,
+                interestGridIndicesX.Length,
+                () => new EnvelopeBuffers(maxGridSize),
+                (i, loopState, buffers) =>
+                {
+                    int x = interestGridIndicesX[i];
+                    int columnStart = x * height;
+                    if (shrinkDistances)
+                        ErodeByCell(this.columnFunctionValues, columnStart, finitePenaltyGridIndicesY);
+                    GeneralizedDistanceTransform1D.ComputeTransform(
+                        this.columnFunctionValues,
+                        columnStart,
+                        finitePenaltyGridIndicesY,
+                        interestGridIndicesY,
+                        distanceScaleY,
+                        this.GridStepSizeY,
+                        this.values,
+                        columnBestIndicesOrNull,
+                        columnStart,
+                        buffers.Envelope,
+                        buffers.ParabolaRange);
+
+                    foreach (int y in interestGridIndicesY)
+                    {
+                        if (trackBestIndices)
+                        {
+                            int bestY = this.columnBestIndices[columnStart + y];
+                            int bestX = this.rowBestIndices[bestY * width + x];
+                            this.bestIndices[columnStart + y] = bestX * height + bestY;
+                        }
+
+                        this.timeStamps[columnStart + y] = this.currentTimeStamp;
+                    }
+
+                    return buffers;
+                },
+                buffers => { });
 
-            Parallel.ForEach(
-                this.transformsForFixedGridX[0].EnumerateFinitePenaltyGridIndices(),
-                y =>
+            this.lastDistanceScaleX = distanceScaleX;
+            this.lastDistanceScaleY = distanceScaleY;
+            this.lastFinitePenaltyGridIndicesX = finitePenaltyGridIndicesX;
+            this.lastFinitePenaltyGridIndicesY = finitePenaltyGridIndicesY;
+            this.lastComputeTrackedBestIndices = trackBestIndices;
+            this.lastComputeShrankDistances = shrinkDistances;
+            this.IsComputed = true;
+        }
+
+        private void RecoverBestIndices(int gridX, int gridY, out int bestGridX, out int bestGridY)
+        {
+            // Transposed first pass results of a column of interest are kept until the next computation
+            double bestValue = Double.PositiveInfinity;
+            bestGridY = -1;
+            int columnStart = gridX * this.GridSize.Height;
+            foreach (int y in this.lastFinitePenaltyGridIndicesY)
+            {
+                double diff = (gridY - y) * this.GridStepSizeY;
+                double value = this.columnFunctionValues[columnStart + y] + diff * diff * this.lastDistanceScaleY;
+                if (value < bestValue)
                 {
-                    Func<double, double> xPenaltyFunc = x => penaltyFunc(x, GridIndexToCoordY(y));
-                    transformsForFixedGridY[y].Compute(distanceScaleX, xPenaltyFunc);
-                    this.usedTransformsForFixedGridY[y] = this.transformsForFixedGridY[y];
-                });
+                    bestValue = value;
+                    bestGridY = y;
+                }
+            }
 
-            Parallel.ForEach(
-                this.transformsForFixedGridY[0].EnumerateInterestGridIndices(),
-                x =>
+            // Penalties of the best row are kept as well
+            bestValue = Double.PositiveInfinity;
+            bestGridX = -1;
+            double[] penalties = this.rowPenalties[bestGridY];
+            foreach (int x in this.lastFinitePenaltyGridIndicesX)
+            {
+                double diff = (gridX - x) * this.GridStepSizeX;
+                double value = penalties[x] + diff * diff * this.lastDistanceScaleX;
+                if (value < bestValue)
                 {
-                    Func<double, double> yPenaltyFunc =
-                        y => this.usedTransformsForFixedGridY[CoordToGridIndexY(y)].GetValueByGridIndex(x);
-                    this.transformsForFixedGridX[x].Compute(distanceScaleY, yPenaltyFunc);
+                    bestValue = value;
+                    bestGridX = x;
+                }
+            }
+        }
 
-                    foreach (int y in this.transformsForFixedGridX[x].EnumerateInterestGridIndices())
+        // Replaces every value with min over itself and its finite penalty neighbors.
+        // Min over a one-step neighborhood followed by the transform is the same as the transform with distances shrunk by one step.
+        private static void ErodeByCell(double[] functionValues, int offset, int[] finitePenaltyGridIndices)
+        {
+            double previousValue = Double.PositiveInfinity;
+            int previousGridIndex = -2;
+            for (int index = 0; index < finitePenaltyGridIndices.Length; ++index)
+            {
+                int i = finitePenaltyGridIndices[index];
+                double value = functionValues[offset + i];
+                double erodedValue = value;
+                if (previousGridIndex == i - 1)
+                    erodedValue = Math.Min(erodedValue, previousValue);
+                if (index + 1 < finitePenaltyGridIndices.Length && finitePenaltyGridIndices[index + 1] == i + 1)
+                    erodedValue = Math.Min(erodedValue, functionValues[offset + i + 1]);
+
+                functionValues[offset + i] = erodedValue;
+                previousValue = value;
+                previousGridIndex = i;
+            }
+        }
+
+        private int GetCellIndex(int gridX, int gridY)
+        {
+            if (gridX < 0 || gridX >= this.GridSize.Width)
+                throw new ArgumentOutOfRangeException("gridX");
+            if (gridY < 0 || gridY >= this.GridSize.Height)
+                throw new ArgumentOutOfRangeException("gridY");
+            return gridX * this.GridSize.Height + gridY;
+        }
+
+        private void AllocatePassBuffers(bool trackBestIndices)
+        {
+            // Pass buffers are needed only during computation, so they are not allocated for transforms used as grids
+            int cellCount = this.GridSize.Width * this.GridSize.Height;
+            if (this.rowValues == null)
+            {
+                this.rowPenalties = new double[this.GridSize.Height][];
+                for (int y = 0; y < this.GridSize.Height; ++y)
+                    this.rowPenalties[y] = new double[this.GridSize.Width];
+                this.rowValues = new double[cellCount];
+                this.columnFunctionValues = new double[cellCount];
+            }
+
+            if (trackBestIndices && this.bestIndices == null)
+            {
+                this.bestIndices = new int[cellCount];
+                this.rowBestIndices = new int[cellCount];
+                this.columnBestIndices = new int[cellCount];
+            }
+        }
+
+        private void TransposeRowValues(int[] rowIndices, int[] columnIndices)
+        {
+            int width = this.GridSize.Width, height = this.GridSize.Height;
+            for (int rowBlockStart = 0; rowBlockStart < rowIndices.Length; rowBlockStart += TransposeBlockSize)
+            {
+                int rowBlockEnd = Math.Min(rowBlockStart + TransposeBlockSize, rowIndices.Length);
+                for (int columnBlockStart = 0; columnBlockStart < columnIndices.Length; columnBlockStart += TransposeBlockSize)
+                {
+                    int columnBlockEnd = Math.Min(columnBlockStart + TransposeBlockSize, columnIndices.Length);
+                    for (int i = rowBlockStart; i < rowBlockEnd; ++i)
                     {
-                        this.values[x, y] = this.transformsForFixedGridX[x].GetValueByGridIndex(y);
-                        int bestY = this.transformsForFixedGridX[x].GetBestIndexByGridIndex(y);
-                        int bestX = this.usedTransformsForFixedGridY[bestY].GetBestIndexByGridIndex(x);
-                        this.bestIndices[x, y] = new Tuple<int, int>(bestX, bestY);
-                        this.timeStamps[x, y] = this.currentTimeStamp;
+                        int y = rowIndices[i];
+                        for (int j = columnBlockStart; j < columnBlockEnd; ++j)
+                        {
+                            int x = columnIndices[j];
+                            this.columnFunctionValues[x * height + y] = this.rowValues[y * width + x];
+                        }
                     }
-                });
+                }
+            }
+        }
 
-            this.IsComputed = true;
+        private class EnvelopeBuffers
+        {
+            public EnvelopeBuffers(int size)
+            {
+                this.Envelope = new int[size];
+                this.ParabolaRange = new double[size + 1];
+            }
+
+            public int[] Envelope { get; private set; }
+
+            public double[] ParabolaRange { get; private set; }
         }
     }
 }
@@ -0,0 +1,9 @@
+﻿namespace Research.GraphBasedShapePrior
+{
+    public enum HullDistanceMethod
+    {
+        Segments,
+        DistanceTransform,
+        Automatic
+    }
+}
\ No newline at end of file
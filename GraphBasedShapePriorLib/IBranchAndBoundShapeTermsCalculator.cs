@@ -4,6 +4,6 @@ namespace Research.GraphBasedShapePrior
 {
     public interface IShapeTermsLowerBoundCalculator
     {
-        void CalculateShapeTerms(ShapeModel model, ShapeConstraints constraints, Image2D<ObjectBackgroundTerm> result);
+        void CalculateShapeTerms(ShapeModel model, ShapeConstraints constraints, ObjectBackgroundTermPlanes result);
     }
 }
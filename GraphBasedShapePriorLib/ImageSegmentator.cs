@@ -13,13 +13,35 @@ namespace Research.GraphBasedShapePrior
     {
         private readonly Image2D<Color> segmentedImage;
         
-        private Image2D<ObjectBackgroundTerm> colorTerms;
+        // All the terms below are stored in row-major order
+        
+        private double[] objectColorTerms;
+
+        private double[] backgroundColorTerms;
+
+        private double[] lastObjectUnaryTerms;
+
+        private double[] lastBackgroundUnaryTerms;
+
+        private double[] lastObjectShapeTerms;
+
+        private double[] lastBackgroundShapeTerms;
+
+        // Buffers for bulk terminal weight updates
+        
+        private int[] changedPixelIndices;
+
+        private double[] changedPixelsOldToSource;
+
+        private double[] changedPixelsOldToSink;
+
+        private double[] changedPixelsNewToSource;
 
-        private Image2D<ObjectBackgroundTerm> lastUnaryTerms;
+        private double[] changedPixelsNewToSink;
 
-        private Image2D<ObjectBackgroundTerm> lastShapeTerms;
+        private int changedPixelCount;
 
-        private Image2D<bool> lastSegmentationMask;
+        private Mask2D lastSegmentationMask;
 
         private Image2D<Tuple<double, double, double>> scaledPairwiseTerms;
 
@@ -70,15 +92,48 @@ namespace Research.GraphBasedShapePrior
             this.PrepareOther();
         }
 
+        private ImageSegmentator(ImageSegmentator other)
+        {
+            this.ColorDifferencePairwiseTermCutoff = other.ColorDifferencePairwiseTermCutoff;
+            this.ColorDifferencePairwiseTermWeight = other.ColorDifferencePairwiseTermWeight;
+            this.ConstantPairwiseTermWeight = other.ConstantPairwiseTermWeight;
+            this.ObjectColorUnaryTermWeight = other.ObjectColorUnaryTermWeight;
+            this.BackgroundColorUnaryTermWeight = other.BackgroundColorUnaryTermWeight;
+            this.ObjectShapeUnaryTermWeight = other.ObjectShapeUnaryTermWeight;
+            this.BackgroundShapeUnaryTermWeight = other.BackgroundShapeUnaryTermWeight;
+
+            this.segmentedImage = other.segmentedImage;
+
+            this.UnaryTermScaleCoeff = other.UnaryTermScaleCoeff;
+            this.PairwiseTermScaleCoeff = other.PairwiseTermScaleCoeff;
+
+            this.graphCutCalculator = new GraphCutCalculator(this.segmentedImage.Width, this.segmentedImage.Height);
+
+            // Color and pairwise terms are never changed after preparation, so they can be shared
+            this.objectColorTerms = other.objectColorTerms;
+            this.backgroundColorTerms = other.backgroundColorTerms;
+            this.scaledPairwiseTerms = other.scaledPairwiseTerms;
+            this.SetGraphCutNeighborWeights();
+            this.PrepareOther();
+        }
+
         public double UnaryTermScaleCoeff { get; private set; }
 
         public double PairwiseTermScaleCoeff { get; private set; }
 
         private void PrepareOther()
         {
-            this.lastUnaryTerms = new Image2D<ObjectBackgroundTerm>(this.ImageSize.Width, this.ImageSize.Height);
-            this.lastShapeTerms = new Image2D<ObjectBackgroundTerm>(this.ImageSize.Width, this.ImageSize.Height);
-            this.lastSegmentationMask = new Image2D<bool>(this.ImageSize.Width, this.ImageSize.Height);
+            int pixelCount = this.ImageSize.Width * this.ImageSize.Height;
+            this.lastObjectUnaryTerms = new double[pixelCount];
+            this.lastBackgroundUnaryTerms = new double[pixelCount];
+            this.lastObjectShapeTerms = new double[pixelCount];
+            this.lastBackgroundShapeTerms = new double[pixelCount];
+            this.changedPixelIndices = new int[pixelCount];
+            this.changedPixelsOldToSource = new double[pixelCount];
+            this.changedPixelsOldToSink = new double[pixelCount];
+            this.changedPixelsNewToSource = new double[pixelCount];
+            this.changedPixelsNewToSink = new double[pixelCount];
+            this.lastSegmentationMask = new Mask2D(this.ImageSize.Width, this.ImageSize.Height);
         }
 
         private void PreparePairwiseTerms()
@@ -92,24 +147,34 @@ namespace Research.GraphBasedShapePrior
                 {
                     double weightRight = 0, weightBottom = 0, weightBottomRight = 0;
                     if (x < this.segmentedImage.Width - 1)
-                    {
                         weightRight = CalculateScaledPairwiseTerms(meanBrightnessDiff, new Point(x, y), new Point(x + 1, y));
-                        this.graphCutCalculator.SetNeighborWeights(x, y, Neighbor.Right, weightRight);
-                    }
                     if (y < this.segmentedImage.Height - 1)
-                    {
                         weightBottom = CalculateScaledPairwiseTerms(meanBrightnessDiff, new Point(x, y), new Point(x, y + 1));
-                        this.graphCutCalculator.SetNeighborWeights(x, y, Neighbor.Bottom, weightBottom);
-                    }
                     if (x < this.segmentedImage.Width - 1 && y < this.segmentedImage.Height - 1)
-                    {
                         weightBottomRight = CalculateScaledPairwiseTerms(meanBrightnessDiff, new Point(x, y), new Point(x + 1, y + 1));
-                        this.graphCutCalculator.SetNeighborWeights(x, y, Neighbor.RightBottom, weightBottomRight);
-                    }
 
                     this.scaledPairwiseTerms[x, y] = new Tuple<double, double, double>(weightRight, weightBottom, weightBottomRight);
                 }
             }
+
+            this.SetGraphCutNeighborWeights();
+        }
+
+        private void SetGraphCutNeighborWeights()
+        {
+            for (int x = 0; x < this.segmentedImage.Width; ++x)
+            {
+                for (int y = 0; y < this.segmentedImage.Height; ++y)
+                {
+                    Tuple<double, double, double> weights = this.scaledPairwiseTerms[x, y];
+                    if (x < this.segmentedImage.Width - 1)
+                        this.graphCutCalculator.SetNeighborWeights(x, y, Neighbor.Right, weights.Item1);
+                    if (y < this.segmentedImage.Height - 1)
+                        this.graphCutCalculator.SetNeighborWeights(x, y, Neighbor.Bottom, weights.Item2);
+                    if (x < this.segmentedImage.Width - 1 && y < this.segmentedImage.Height - 1)
+                        this.graphCutCalculator.SetNeighborWeights(x, y, Neighbor.RightBottom, weights.Item3);
+                }
+            }
         }
 
         public double ColorDifferencePairwiseTermCutoff { get; private set; }
@@ -131,7 +196,7 @@ namespace Research.GraphBasedShapePrior
             get { return this.segmentedImage.Rectangle.Size; }
         }
 
-        public Image2D<bool> GetLastSegmentationMask()
+        public Mask2D GetLastSegmentationMask()
         {
             if (this.firstTime)
                 throw new InvalidOperationException("You should perform segmentation first.");
@@ -142,19 +207,19 @@ namespace Research.GraphBasedShapePrior
         {
             if (this.firstTime)
                 throw new InvalidOperationException("You should perform segmentation first.");
-            return this.lastUnaryTerms.Clone();
+            return this.TermsToImage(this.lastObjectUnaryTerms, this.lastBackgroundUnaryTerms);
         }
 
         public Image2D<ObjectBackgroundTerm> GetLastShapeTerms()
         {
             if (this.firstTime)
                 throw new InvalidOperationException("You should perform segmentation first.");
-            return this.lastShapeTerms.Clone();
+            return this.TermsToImage(this.lastObjectShapeTerms, this.lastBackgroundShapeTerms);
         }
 
         public Image2D<ObjectBackgroundTerm> GetColorTerms()
         {
-            return this.colorTerms.Clone();
+            return this.TermsToImage(this.objectColorTerms, this.backgroundColorTerms);
         }
 
         public Image2D<double> GetHorizontalColorDifferencePairwiseTerms()
@@ -177,46 +242,152 @@ namespace Research.GraphBasedShapePrior
             return this.segmentedImage.Clone();
         }
 
+        /// <summary>
+        /// Creates a segmentator of the same image with the same terms that can be used concurrently with this one.
+        /// Terms of the last segmentation are not copied, so the first segmentation with the copy is done from scratch.
+        /// </summary>
+        public ImageSegmentator Clone()
+        {
+            return new ImageSegmentator(this);
+        }
+
         public double SegmentImageWithShapeTerms(
             Func<int, int, ObjectBackgroundTerm> shapeTermCalculator)
         {
-            // Calculate shape terms, check for changes)
-            for (int x = 0; x < this.lastUnaryTerms.Width; ++x)
+            if (shapeTermCalculator == null)
+                throw new ArgumentNullException("shapeTermCalculator");
+            
+            // Calculate shape terms, check for changes
+            this.changedPixelCount = 0;
+            for (int y = 0; y < this.ImageSize.Height; ++y)
             {
-                for (int y = 0; y < this.lastUnaryTerms.Height; ++y)
+                for (int x = 0; x < this.ImageSize.Width; ++x)
                 {
                     ObjectBackgroundTerm shapeTerms = shapeTermCalculator(x, y);
-                    
-                    if (firstTime || shapeTerms != this.lastShapeTerms[x, y])
-                    {
-                        double objectTermNew = this.UnaryTermScaleCoeff * (this.colorTerms[x, y].ObjectTerm * this.ObjectColorUnaryTermWeight + shapeTerms.ObjectTerm * this.ObjectShapeUnaryTermWeight);
-                        double backgroundTermNew = this.UnaryTermScaleCoeff * (this.colorTerms[x, y].BackgroundTerm * this.BackgroundColorUnaryTermWeight + shapeTerms.BackgroundTerm * this.BackgroundShapeUnaryTermWeight);
-                        Debug.Assert(!Double.IsInfinity(objectTermNew) && !Double.IsNaN(objectTermNew));
-                        Debug.Assert(!Double.IsInfinity(backgroundTermNew) && !Double.IsNaN(backgroundTermNew));
-
-                        if (firstTime)
-                            this.graphCutCalculator.SetTerminalWeights(x, y, backgroundTermNew, objectTermNew);
-                        else
-                        {
-                            this.graphCutCalculator.UpdateTerminalWeights(
-                                x, y, this.lastUnaryTerms[x, y].BackgroundTerm, this.lastUnaryTerms[x, y].ObjectTerm, backgroundTermNew, objectTermNew);
-                        }
-
-                        this.lastShapeTerms[x, y] = shapeTerms;
-                        this.lastUnaryTerms[x, y] = new ObjectBackgroundTerm(objectTermNew, backgroundTermNew);
-                    }
+                    this.UpdateShapeTerms(y * this.ImageSize.Width + x, shapeTerms.ObjectTerm, shapeTerms.BackgroundTerm);
                 }
             }
 
+            return this.SegmentImageWithUpdatedShapeTerms();
+        }
+
+        public double SegmentImageWithShapeTerms(ObjectBackgroundTermPlanes shapeTerms)
+        {
+            if (shapeTerms == null)
+                throw new ArgumentNullException("shapeTerms");
+            
+            return this.SegmentImageWithShapeTerms(shapeTerms, shapeTerms.Rectangle);
+        }
+
+        /// <summary>
+        /// Segments image with the given shape terms, assuming that terms outside of the changed region
+        /// are the same as in the previous call. Only the changed region is checked for changes.
+        /// </summary>
+        public double SegmentImageWithShapeTerms(ObjectBackgroundTermPlanes shapeTerms, Rectangle changedRegion)
+        {
+            if (shapeTerms == null)
+                throw new ArgumentNullException("shapeTerms");
+            if (shapeTerms.Size != this.ImageSize)
+                throw new ArgumentException("Shape terms should have the same size as the segmented image.", "shapeTerms");
+            if (!shapeTerms.Rectangle.Contains(changedRegion))
+                throw new ArgumentOutOfRangeException("changedRegion", "Changed region should be inside the segmented image.");
+
+            // All the terms should be passed to graph cut calculator on the first run
+            if (this.firstTime)
+                changedRegion = shapeTerms.Rectangle;
+
+            // Check for changes
+            this.changedPixelCount = 0;
+            float[] objectShapeTerms = shapeTerms.ObjectTerms;
+            float[] backgroundShapeTerms = shapeTerms.BackgroundTerms;
+            for (int y = changedRegion.Top; y < changedRegion.Bottom; ++y)
+            {
+                for (int i = shapeTerms.GetIndex(changedRegion.Left, y), rowEnd = i + changedRegion.Width; i < rowEnd; ++i)
+                    this.UpdateShapeTerms(i, objectShapeTerms[i], backgroundShapeTerms[i]);
+            }
+
+            return this.SegmentImageWithUpdatedShapeTerms();
+        }
+
+        /// <summary>
+        /// Calculates a lower bound for the energy of segmentation with the given shape terms without running graph cut.
+        /// Pairwise terms are never negative, so the sum of the smallest unary terms of all the pixels is enough.
+        /// </summary>
+        public double CalculateUnaryEnergyLowerBound(ObjectBackgroundTermPlanes shapeTerms)
+        {
+            if (shapeTerms == null)
+                throw new ArgumentNullException("shapeTerms");
+            if (shapeTerms.Size != this.ImageSize)
+                throw new ArgumentException("Shape terms should have the same size as the segmented image.", "shapeTerms");
+
+            float[] objectShapeTerms = shapeTerms.ObjectTerms;
+            float[] backgroundShapeTerms = shapeTerms.BackgroundTerms;
+            double result = 0;
+            for (int i = 0; i < objectShapeTerms.Length; ++i)
+            {
+                double objectTerm = this.objectColorTerms[i] * this.ObjectColorUnaryTermWeight + objectShapeTerms[i] * this.ObjectShapeUnaryTermWeight;
+                double backgroundTerm = this.backgroundColorTerms[i] * this.BackgroundColorUnaryTermWeight + backgroundShapeTerms[i] * this.BackgroundShapeUnaryTermWeight;
+                result += Math.Min(objectTerm, backgroundTerm);
+            }
+
+            return result * this.UnaryTermScaleCoeff;
+        }
+
+        private void UpdateShapeTerms(int pixelIndex, double objectShapeTerm, double backgroundShapeTerm)
+        {
+            if (!this.firstTime &&
+                objectShapeTerm == this.lastObjectShapeTerms[pixelIndex] &&
+                backgroundShapeTerm == this.lastBackgroundShapeTerms[pixelIndex])
+            {
+                return;
+            }
+            
+            double objectTermNew = this.UnaryTermScaleCoeff * (this.objectColorTerms[pixelIndex] * this.ObjectColorUnaryTermWeight + objectShapeTerm * this.ObjectShapeUnaryTermWeight);
+            double backgroundTermNew = this.UnaryTermScaleCoeff * (this.backgroundColorTerms[pixelIndex] * this.BackgroundColorUnaryTermWeight + backgroundShapeTerm * this.BackgroundShapeUnaryTermWeight);
+            Debug.Assert(!Double.IsInfinity(objectTermNew) && !Double.IsNaN(objectTermNew));
+            Debug.Assert(!Double.IsInfinity(backgroundTermNew) && !Double.IsNaN(backgroundTermNew));
+
+            if (!this.firstTime)
+            {
+                int changeIndex = this.changedPixelCount++;
+                this.changedPixelIndices[changeIndex] = pixelIndex;
+                this.changedPixelsOldToSource[changeIndex] = this.lastBackgroundUnaryTerms[pixelIndex];
+                this.changedPixelsOldToSink[changeIndex] = this.lastObjectUnaryTerms[pixelIndex];
+                this.changedPixelsNewToSource[changeIndex] = backgroundTermNew;
+                this.changedPixelsNewToSink[changeIndex] = objectTermNew;
+            }
+
+            this.lastObjectShapeTerms[pixelIndex] = objectShapeTerm;
+            this.lastBackgroundShapeTerms[pixelIndex] = backgroundShapeTerm;
+            this.lastObjectUnaryTerms[pixelIndex] = objectTermNew;
+            this.lastBackgroundUnaryTerms[pixelIndex] = backgroundTermNew;
+        }
+
+        private double SegmentImageWithUpdatedShapeTerms()
+        {
+            // Pass new terminal weights to graph cut calculator
+            if (this.firstTime)
+                this.graphCutCalculator.SetTerminalWeights(this.lastBackgroundUnaryTerms, this.lastObjectUnaryTerms);
+            else
+            {
+                this.graphCutCalculator.UpdateTerminalWeights(
+                    this.changedPixelIndices,
+                    this.changedPixelsOldToSource,
+                    this.changedPixelsOldToSink,
+                    this.changedPixelsNewToSource,
+                    this.changedPixelsNewToSink,
+                    this.changedPixelCount);
+            }
+            
             // Actually segment image
             double graphCutEnergy = this.graphCutCalculator.Calculate();
             bool wasFirstTime = this.firstTime;
             this.firstTime = false;
 
-            // Fill segmentation mask
-            for (int x = 0; x < this.lastSegmentationMask.Width; ++x)
+            // Fill segmentation mask (row by row, to match mask layout)
+            for (int y = 0; y < this.lastSegmentationMask.Height; ++y)
             {
-                for (int y = 0; y < this.lastSegmentationMask.Height; ++y)
+                for (int x = 0; x < this.lastSegmentationMask.Width; ++x)
                 {
                     bool isObject = this.graphCutCalculator.BelongsToSource(x, y);
                     this.lastSegmentationMask[x, y] = isObject;
@@ -234,7 +405,7 @@ namespace Research.GraphBasedShapePrior
         }
 
         public ImageSegmentationFeatures ExtractSegmentationFeaturesForMask(
-            Image2D<bool> mask)
+            Mask2D mask)
         {
             if (this.firstTime)
                 throw new InvalidOperationException("You should perform segmentation first.");
@@ -250,15 +421,16 @@ namespace Research.GraphBasedShapePrior
             {
                 for (int y = 0; y < mask.Height; ++y)
                 {
+                    int pixelIndex = y * this.ImageSize.Width + x;
                     if (mask[x, y])
                     {
-                        objectColorUnaryTermSum += this.colorTerms[x, y].ObjectTerm;
-                        objectShapeUnaryTermSum += this.lastShapeTerms[x, y].ObjectTerm;
+                        objectColorUnaryTermSum += this.objectColorTerms[pixelIndex];
+                        objectShapeUnaryTermSum += this.lastObjectShapeTerms[pixelIndex];
                     }
                     else
                     {
-                        backgroundColorUnaryTermSum += this.colorTerms[x, y].BackgroundTerm;
-                        backgroundShapeUnaryTermSum += this.lastShapeTerms[x, y].BackgroundTerm;
+                        backgroundColorUnaryTermSum += this.backgroundColorTerms[pixelIndex];
+                        backgroundShapeUnaryTermSum += this.lastBackgroundShapeTerms[pixelIndex];
                     }
 
                     if (x < mask.Width - 1 && mask[x, y] != mask[x + 1, y])
@@ -345,17 +517,27 @@ namespace Research.GraphBasedShapePrior
 
         private void PrepareColorTerms(ObjectBackgroundColorModels colorModels)
         {
-            this.colorTerms = new Image2D<ObjectBackgroundTerm>(this.ImageSize.Width, this.ImageSize.Height);
+            this.objectColorTerms = new double[this.ImageSize.Width * this.ImageSize.Height];
+            this.backgroundColorTerms = new double[this.ImageSize.Width * this.ImageSize.Height];
             for (int x = 0; x < this.ImageSize.Width; ++x)
             {
                 for (int y = 0; y < this.ImageSize.Height; ++y)
                 {
                     Color color = this.segmentedImage[x, y];
-                    double objectTerm = -colorModels.ObjectColorModel.LogProb(color);
-                    double backgroundTerm = -colorModels.BackgroundColorModel.LogProb(color);
-                    this.colorTerms[x, y] = new ObjectBackgroundTerm(objectTerm, backgroundTerm);
+                    int pixelIndex = y * this.ImageSize.Width + x;
+                    this.objectColorTerms[pixelIndex] = -colorModels.ObjectColorModel.LogProb(color);
+                    this.backgroundColorTerms[pixelIndex] = -colorModels.BackgroundColorModel.LogProb(color);
                 }
             }
         }
+
+        private Image2D<ObjectBackgroundTerm> TermsToImage(double[] objectTerms, double[] backgroundTerms)
+        {
+            Image2D<ObjectBackgroundTerm> result = new Image2D<ObjectBackgroundTerm>(this.ImageSize.Width, this.ImageSize.Height);
+            for (int y = 0; y < result.Height; ++y)
+                for (int x = 0; x < result.Width; ++x)
+                    result[x, y] = new ObjectBackgroundTerm(objectTerms[y * result.Width + x], backgroundTerms[y * result.Width + x]);
+            return result;
+        }
     }
 }
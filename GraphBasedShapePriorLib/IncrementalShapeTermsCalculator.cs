@@ -0,0 +1,179 @@
+﻿using System;
+using System.Drawing;
+using System.Threading.Tasks;
+using Research.GraphBasedShapePrior.Util;
+
+namespace Research.GraphBasedShapePrior
+{
+    /// <summary>
+    /// Calculates saturated shape terms of a concrete shape, keeping a layer of terms for every edge.
+    /// When the shape differs from the previous one only in some edges, only those layers are updated
+    /// and terms are recombined only where the bands of the changed edges were or are.
+    /// </summary>
+    public class IncrementalShapeTermsCalculator
+    {
+        private ShapeModel lastModel;
+
+        private Shape lastShape;
+
+        private ObjectBackgroundTermPlanes lastResult;
+
+        private ObjectBackgroundTermPlanes[] edgeLayers;
+
+        private Rectangle[] edgeBandBoxes;
+
+        public IncrementalShapeTermsCalculator()
+        {
+            this.UseIncrementalUpdates = true;
+        }
+
+        public bool UseIncrementalUpdates { get; set; }
+
+        /// <summary>
+        /// Gets the region of the result that was changed by the last call to <see cref="CalculateShapeTerms"/>.
+        /// Terms outside of it are the same as after the previous call with the same result planes,
+        /// provided that those planes were not modified by anyone else in between.
+        /// </summary>
+        public Rectangle LastChangedRegion { get; private set; }
+
+        public int LastChangedEdgeCount { get; private set; }
+
+        public void CalculateShapeTerms(ShapeModel model, Shape shape, ObjectBackgroundTermPlanes result)
+        {
+            if (model == null)
+                throw new ArgumentNullException("model");
+            if (shape == null)
+                throw new ArgumentNullException("shape");
+            if (result == null)
+                throw new ArgumentNullException("result");
+            if (shape.Structure != model.Structure)
+                throw new ArgumentException("Shape and model have different structures.", "shape");
+
+            bool canUpdate =
+                this.UseIncrementalUpdates &&
+                model == this.lastModel &&
+                result == this.lastResult &&
+                shape.Structure == this.lastShape.Structure;
+            if (!canUpdate)
+                this.PrepareEdgeLayers(model, result);
+
+            Rectangle changedRegion = Rectangle.Empty;
+            int changedEdgeCount = 0;
+            for (int edgeIndex = 0; edgeIndex < model.Structure.Edges.Count; ++edgeIndex)
+            {
+                if (canUpdate && !this.IsEdgeChanged(model, shape, edgeIndex))
+                    continue;
+
+                Rectangle edgeChangedRegion = this.UpdateEdgeLayer(model, shape, edgeIndex, result.Size);
+                changedRegion = Union(changedRegion, edgeChangedRegion);
+                changedEdgeCount += 1;
+            }
+
+            // Result should be fully recombined if it was not produced by this calculator
+            if (!canUpdate)
+                changedRegion = result.Rectangle;
+            this.CombineEdgeLayers(changedRegion, result);
+
+            this.lastModel = model;
+            this.lastShape = shape.Clone();
+            this.lastResult = result;
+            this.LastChangedRegion = changedRegion;
+            this.LastChangedEdgeCount = changedEdgeCount;
+        }
+
+        private void PrepareEdgeLayers(ShapeModel model, ObjectBackgroundTermPlanes result)
+        {
+            int edgeCount = model.Structure.Edges.Count;
+            bool layersMatch =
+                this.edgeLayers != null &&
+                this.edgeLayers.Length == edgeCount &&
+                this.edgeLayers[0].Size == result.Size &&
+                this.edgeLayers[0].Saturation == result.Saturation;
+            if (!layersMatch)
+            {
+                this.edgeLayers = new ObjectBackgroundTermPlanes[edgeCount];
+                for (int i = 0; i < edgeCount; ++i)
+                    this.edgeLayers[i] = new ObjectBackgroundTermPlanes(result.Width, result.Height, result.Saturation);
+            }
+
+            // Every layer is fully reset on the next update
+            this.edgeBandBoxes = new Rectangle[edgeCount];
+            for (int i = 0; i < edgeCount; ++i)
+                this.edgeBandBoxes[i] = result.Rectangle;
+        }
+
+        private bool IsEdgeChanged(ShapeModel model, Shape shape, int edgeIndex)
+        {
+            ShapeEdge edge = model.Structure.Edges[edgeIndex];
+            return
+                shape.VertexPositions[edge.Index1] != this.lastShape.VertexPositions[edge.Index1] ||
+                shape.VertexPositions[edge.Index2] != this.lastShape.VertexPositions[edge.Index2] ||
+                shape.EdgeWidths[edgeIndex] != this.lastShape.EdgeWidths[edgeIndex];
+        }
+
+        private Rectangle UpdateEdgeLayer(ShapeModel model, Shape shape, int edgeIndex, Size imageSize)
+        {
+            ObjectBackgroundTermPlanes layer = this.edgeLayers[edgeIndex];
+            ShapeEdgeBand band = model.GetEdgeBand(shape, edgeIndex, layer.Saturation);
+            Rectangle bandBox = band.GetBoundingBox(imageSize);
+            Rectangle region = Union(this.edgeBandBoxes[edgeIndex], bandBox);
+            this.edgeBandBoxes[edgeIndex] = bandBox;
+            if (region.IsEmpty)
+                return Rectangle.Empty;
+
+            // Old band is erased, then the new one is drawn over saturated terms
+            float saturatedObjectTerm = layer.Saturation;
+            float saturatedBackgroundTerm = model.CalculateSaturatedBackgroundPenalty(layer);
+            Parallel.For(
+                region.Top,
+                region.Bottom,
+                y =>
+                {
+                    for (int index = layer.GetIndex(region.Left, y), rowEnd = index + region.Width; index < rowEnd; ++index)
+                    {
+                        layer.ObjectTerms[index] = saturatedObjectTerm;
+                        layer.BackgroundTerms[index] = saturatedBackgroundTerm;
+                    }
+
+                    model.AddEdgePenaltiesToRow(band, y, layer);
+                });
+
+            return region;
+        }
+
+        private void CombineEdgeLayers(Rectangle region, ObjectBackgroundTermPlanes result)
+        {
+            if (region.IsEmpty)
+                return;
+
+            Parallel.For(
+                region.Top,
+                region.Bottom,
+                y =>
+                {
+                    int rowStart = result.GetIndex(region.Left, y);
+                    int rowEnd = rowStart + region.Width;
+                    Array.Copy(this.edgeLayers[0].ObjectTerms, rowStart, result.ObjectTerms, rowStart, region.Width);
+                    Array.Copy(this.edgeLayers[0].BackgroundTerms, rowStart, result.BackgroundTerms, rowStart, region.Width);
+                    for (int edgeIndex = 1; edgeIndex < this.edgeLayers.Length; ++edgeIndex)
+                    {
+                        float[] layerObjectTerms = this.edgeLayers[edgeIndex].ObjectTerms;
+                        float[] layerBackgroundTerms = this.edgeLayers[edgeIndex].BackgroundTerms;
+                        for (int index = rowStart; index < rowEnd; ++index)
+                        {
+                            result.ObjectTerms[index] = Math.Min(result.ObjectTerms[index], layerObjectTerms[index]);
+                            result.BackgroundTerms[index] = Math.Max(result.BackgroundTerms[index], layerBackgroundTerms[index]);
+                        }
+                    }
+                });
+        }
+
+        private static Rectangle Union(Rectangle region1, Rectangle region2)
+        {
+            return
+                region1.IsEmpty ? region2 :
+                region2.IsEmpty ? region1 :
+                Rectangle.Union(region1, region2);
+        }
+    }
+}
@@ -0,0 +1,132 @@
+﻿using System;
+using System.Collections.ObjectModel;
+using System.Drawing;
+using Research.GraphBasedShapePrior.Util;
+
+namespace Research.GraphBasedShapePrior
+{
+    /// <summary>
+    /// Marks the cells of a distance transform grid allowed by length-angle constraints.
+    /// Cell is allowed if <see cref="BoxSetLengthAngleConstraints.InRange"/> holds for it with tolerances covering the whole cell.
+    /// Length range of every box gives a span of length grid indices that is the same for all the angle rows,
+    /// so a row is filled from the spans of the boxes whose angle range intersects it.
+    /// </summary>
+    public class LengthAngleConstraintsRaster
+    {
+        private bool[] allowedCells = new bool[0];
+
+        private int[] boxSpanStarts = new int[0];
+
+        private int[] boxSpanEnds = new int[0];
+
+        public Size GridSize { get; private set; }
+
+        public int AllowedCellCount { get; private set; }
+
+        /// <summary>
+        /// Rasterizes constraints over the grid of the given transform, replacing the previous contents of the raster.
+        /// Grid coordinates are the scaled lengths and the shifted angles used by the shape energy bound.
+        /// </summary>
+        public void Rasterize(
+            BoxSetLengthAngleConstraints constraints, GeneralizedDistanceTransform2D grid, double lengthRatio, double meanAngle)
+        {
+            if (constraints == null)
+                throw new ArgumentNullException("constraints");
+            if (grid == null)
+                throw new ArgumentNullException("grid");
+            if (lengthRatio <= 0)
+                throw new ArgumentOutOfRangeException("lengthRatio", "Parameter value should be positive.");
+
+            int width = grid.GridSize.Width, height = grid.GridSize.Height;
+            if (this.allowedCells.Length < width * height)
+                this.allowedCells = new bool[width * height];
+            else
+                Array.Clear(this.allowedCells, 0, width * height);
+            this.GridSize = grid.GridSize;
+            this.AllowedCellCount = 0;
+
+            double lengthTolerance = grid.GridStepSizeX / lengthRatio;
+            double angleTolerance = grid.GridStepSizeY;
+
+            // Length spans of the boxes, intersected with the span of the overall range
+            ReadOnlyCollection<BoxLengthAngleConstraints> boxes = constraints.ChildConstraints;
+            if (this.boxSpanStarts.Length < boxes.Count)
+            {
+                this.boxSpanStarts = new int[boxes.Count];
+                this.boxSpanEnds = new int[boxes.Count];
+            }
+
+            int overallSpanStart, overallSpanEnd;
+            GetLengthSpan(constraints.LengthBoundary, grid, lengthRatio, lengthTolerance, out overallSpanStart, out overallSpanEnd);
+            for (int i = 0; i < boxes.Count; ++i)
+            {
+                int spanStart, spanEnd;
+                GetLengthSpan(boxes[i].LengthBoundary, grid, lengthRatio, lengthTolerance, out spanStart, out spanEnd);
+                this.boxSpanStarts[i] = Math.Max(spanStart, overallSpanStart);
+                this.boxSpanEnds[i] = Math.Min(spanEnd, overallSpanEnd);
+            }
+
+            for (int y = 0; y < height; ++y)
+            {
+                double angle = grid.GridIndexToCoordY(y) + meanAngle;
+                Range angleCell = new Range(angle - angleTolerance * 0.5, angle + angleTolerance * 0.5);
+                if (!constraints.AngleBoundary.IntersectsWith(angleCell))
+                    continue;
+
+                int rowStart = y * width;
+                for (int i = 0; i < boxes.Count; ++i)
+                {
+                    if (this.boxSpanStarts[i] > this.boxSpanEnds[i] || !boxes[i].AngleBoundary.IntersectsWith(angleCell))
+                        continue;
+
+                    for (int x = this.boxSpanStarts[i]; x <= this.boxSpanEnds[i]; ++x)
+                    {
+                        if (!this.allowedCells[rowStart + x])
+                        {
+                            this.allowedCells[rowStart + x] = true;
+                            this.AllowedCellCount += 1;
+                        }
+                    }
+                }
+            }
+        }
+
+        public bool IsAllowed(int gridIndexX, int gridIndexY)
+        {
+            return this.allowedCells[gridIndexY * this.GridSize.Width + gridIndexX];
+        }
+
+        private static void GetLengthSpan(
+            Range lengthRange, GeneralizedDistanceTransform2D grid, double lengthRatio, double lengthTolerance, out int spanStart, out int spanEnd)
+        {
+            // Cell intersects with the range iff its right end is not to the left of the range and vice versa.
+            // Both conditions are monotone in grid index, so span ends are found by binary search.
+            int left = 0, right = grid.GridSize.Width;
+            while (left < right)
+            {
+                int middle = (left + right) / 2;
+                double length = grid.GridIndexToCoordX(middle) / lengthRatio;
+                if (lengthRange.Left <= length + lengthTolerance * 0.5)
+                    right = middle;
+                else
+                    left = middle + 1;
+            }
+
+            spanStart = left;
+
+            left = 0;
+            right = grid.GridSize.Width;
+            while (left < right)
+            {
+                int middle = (left + right) / 2;
+                double length = grid.GridIndexToCoordX(middle) / lengthRatio;
+                if (length - lengthTolerance * 0.5 <= lengthRange.Right)
+                    left = middle + 1;
+                else
+                    right = middle;
+            }
+
+            spanEnd = left - 1;
+        }
+    }
+}
@@ -0,0 +1,356 @@
+﻿using System;
+using System.Drawing;
+using System.IO;
+using System.IO.MemoryMappedFiles;
+using System.Threading;
+using Research.GraphBasedShapePrior.Util;
+
+namespace Research.GraphBasedShapePrior
+{
+    /// <summary>
+    /// File-backed store of edge shape terms, shared between calculators, images and processes.
+    /// Edge terms depend only on edge geometry, so they are keyed by exact constraint values.
+    /// The store is direct-mapped: every key has a single slot, a new entry replaces the old one.
+    /// </summary>
+    public class PersistentEdgeTermsStore : IDisposable
+    {
+        private const int Magic = 0x31535445;
+
+        private const int Version = 2;
+
+        private const int HeaderSize = 64;
+
+        private const int KeyLength = 10;
+
+        // Sequence number followed by padding and the key
+        private const int SlotHeaderSize = 8 + KeyLength * 8;
+
+        // Coordinates are quantized with this step before hashing, so that nearly equal keys still spread over slots
+        private const double HashQuantizationStep = 1.0 / 64;
+
+        private readonly string lockFileName;
+
+        private readonly FileStream fileStream;
+
+        private readonly MemoryMappedFile memoryMappedFile;
+
+        private readonly MemoryMappedViewAccessor accessor;
+
+        private readonly object syncRoot = new object();
+
+        private long hitCount;
+
+        private long missCount;
+
+        private bool disposed;
+
+        /// <summary>
+        /// Opens or creates the store. Hull distance settings and compression affect the tightness of stored terms,
+        /// so a file created with other settings is refused.
+        /// </summary>
+        public PersistentEdgeTermsStore(
+            string fileName,
+            Size imageSize,
+            float saturation,
+            HullDistanceMethod hullDistanceMethod,
+            double distanceTransformMinHullArea,
+            bool compressedTerms,
+            int slotCount)
+        {
+            if (fileName == null)
+                throw new ArgumentNullException("fileName");
+            if (imageSize.Width <= 0 || imageSize.Height <= 0)
+                throw new ArgumentOutOfRangeException("imageSize", "Image size should be positive.");
+            if (saturation <= 0 || Single.IsInfinity(saturation) || Single.IsNaN(saturation))
+                throw new ArgumentOutOfRangeException("saturation", "Parameter value should be positive and finite.");
+            if (distanceTransformMinHullArea < 0)
+                throw new ArgumentOutOfRangeException("distanceTransformMinHullArea", "Parameter value should not be negative.");
+            if (slotCount <= 0)
+                throw new ArgumentOutOfRangeException("slotCount", "Parameter value should be positive.");
+
+            this.ImageSize = imageSize;
+            this.Saturation = saturation;
+            this.HullDistanceMethod = hullDistanceMethod;
+            this.DistanceTransformMinHullArea = distanceTransformMinHullArea;
+            this.CompressedTerms = compressedTerms;
+            this.SlotCount = slotCount;
+            this.lockFileName = fileName + ".lock";
+
+            long capacity = this.GetSlotDataOffset(slotCount);
+            this.fileStream = new FileStream(fileName, FileMode.OpenOrCreate, FileAccess.ReadWrite, FileShare.ReadWrite);
+            this.memoryMappedFile = MemoryMappedFile.CreateFromFile(
+                this.fileStream, null, capacity, MemoryMappedFileAccess.ReadWrite, null, HandleInheritability.None, false);
+            this.accessor = this.memoryMappedFile.CreateViewAccessor(0, capacity);
+
+            this.InitializeHeader();
+        }
+
+        public Size ImageSize { get; private set; }
+
+        public float Saturation { get; private set; }
+
+        public HullDistanceMethod HullDistanceMethod { get; private set; }
+
+        public double DistanceTransformMinHullArea { get; private set; }
+
+        /// <summary>
+        /// Gets whether the store is used by calculators that compress cached edge terms.
+        /// </summary>
+        public bool CompressedTerms { get; private set; }
+
+        public int SlotCount { get; private set; }
+
+        public long HitCount
+        {
+            get { return Interlocked.Read(ref this.hitCount); }
+        }
+
+        public long MissCount
+        {
+            get { return Interlocked.Read(ref this.missCount); }
+        }
+
+        public bool TryLoad(
+            VertexConstraints vertexConstraints1,
+            VertexConstraints vertexConstraints2,
+            EdgeConstraints edgeConstraints,
+            ObjectBackgroundTermPlanes result)
+        {
+            if (result == null)
+                throw new ArgumentNullException("result");
+            if (result.Size != this.ImageSize || result.Saturation != this.Saturation)
+                throw new ArgumentException("Result terms don't match the store.", "result");
+
+            long[] key = MakeKey(vertexConstraints1, vertexConstraints2, edgeConstraints);
+            int slot = this.GetSlot(key);
+            long slotHeaderOffset = GetSlotHeaderOffset(slot);
+
+            lock (this.syncRoot)
+            {
+                this.EnsureNotDisposed();
+
+                // Odd sequence number means that the slot is being written, zero means that it is empty
+                int sequence = this.accessor.ReadInt32(slotHeaderOffset);
+                Thread.MemoryBarrier();
+                if (sequence == 0 || sequence % 2 != 0 || !this.SlotKeyEquals(slotHeaderOffset, key))
+                {
+                    Interlocked.Increment(ref this.missCount);
+                    return false;
+                }
+
+                int pixelCount = result.ObjectTerms.Length;
+                long dataOffset = this.GetSlotDataOffset(slot);
+                this.accessor.ReadArray(dataOffset, result.ObjectTerms, 0, pixelCount);
+                this.accessor.ReadArray(dataOffset + pixelCount * sizeof(float), result.BackgroundTerms, 0, pixelCount);
+
+                // Slot could have been overwritten by another process while we were reading it
+                Thread.MemoryBarrier();
+                if (this.accessor.ReadInt32(slotHeaderOffset) != sequence)
+                {
+                    Interlocked.Increment(ref this.missCount);
+                    return false;
+                }
+            }
+
+            Interlocked.Increment(ref this.hitCount);
+            return true;
+        }
+
+        /// <summary>
+        /// Stores edge terms. If another process is writing to the store at the moment, terms are not stored.
+        /// </summary>
+        public bool TrySave(
+            VertexConstraints vertexConstraints1,
+            VertexConstraints vertexConstraints2,
+            EdgeConstraints edgeConstraints,
+            ObjectBackgroundTermPlanes terms)
+        {
+            if (terms == null)
+                throw new ArgumentNullException("terms");
+            if (terms.Size != this.ImageSize || terms.Saturation != this.Saturation)
+                throw new ArgumentException("Terms don't match the store.", "terms");
+
+            long[] key = MakeKey(vertexConstraints1, vertexConstraints2, edgeConstraints);
+            int slot = this.GetSlot(key);
+            long slotHeaderOffset = GetSlotHeaderOffset(slot);
+
+            lock (this.syncRoot)
+            {
+                this.EnsureNotDisposed();
+
+                using (FileStream writerLock = this.TryAcquireWriterLock())
+                {
+                    if (writerLock == null)
+                        return false;
+
+                    // Sequence can stay odd if a writer has crashed, new one should be odd anyway
+                    int sequence = this.accessor.ReadInt32(slotHeaderOffset);
+                    int writingSequence = sequence % 2 == 0 ? sequence + 1 : sequence + 2;
+                    Thread.MemoryBarrier();
+                    this.accessor.Write(slotHeaderOffset, writingSequence);
+                    Thread.MemoryBarrier();
+
+                    for (int i = 0; i < KeyLength; ++i)
+                        this.accessor.Write(slotHeaderOffset + 8 + i * 8, key[i]);
+                    int pixelCount = terms.ObjectTerms.Length;
+                    long dataOffset = this.GetSlotDataOffset(slot);
+                    this.accessor.WriteArray(dataOffset, terms.ObjectTerms, 0, pixelCount);
+                    this.accessor.WriteArray(dataOffset + pixelCount * sizeof(float), terms.BackgroundTerms, 0, pixelCount);
+
+                    Thread.MemoryBarrier();
+                    this.accessor.Write(slotHeaderOffset, writingSequence + 1);
+                }
+            }
+
+            return true;
+        }
+
+        public void Dispose()
+        {
+            lock (this.syncRoot)
+            {
+                if (this.disposed)
+                    return;
+
+                this.accessor.Dispose();
+                this.memoryMappedFile.Dispose();
+                this.fileStream.Dispose();
+                this.disposed = true;
+            }
+        }
+
+        private void InitializeHeader()
+        {
+            using (FileStream writerLock = this.AcquireWriterLock())
+            {
+                int magic = this.accessor.ReadInt32(0);
+                if (magic == 0)
+                {
+                    this.accessor.Write(4, Version);
+                    this.accessor.Write(8, this.ImageSize.Width);
+                    this.accessor.Write(12, this.ImageSize.Height);
+                    this.accessor.Write(16, this.Saturation);
+                    this.accessor.Write(20, this.SlotCount);
+                    this.accessor.Write(24, (int)this.HullDistanceMethod);
+                    this.accessor.Write(28, this.CompressedTerms ? 1 : 0);
+                    this.accessor.Write(32, this.DistanceTransformMinHullArea);
+                    Thread.MemoryBarrier();
+                    this.accessor.Write(0, Magic);
+                    return;
+                }
+
+                bool headerMatches =
+                    magic == Magic &&
+                    this.accessor.ReadInt32(4) == Version &&
+                    this.accessor.ReadInt32(8) == this.ImageSize.Width &&
+                    this.accessor.ReadInt32(12) == this.ImageSize.Height &&
+                    this.accessor.ReadSingle(16) == this.Saturation &&
+                    this.accessor.ReadInt32(20) == this.SlotCount &&
+                    this.accessor.ReadInt32(24) == (int)this.HullDistanceMethod &&
+                    this.accessor.ReadInt32(28) == (this.CompressedTerms ? 1 : 0) &&
+                    this.accessor.ReadDouble(32) == this.DistanceTransformMinHullArea;
+                if (!headerMatches)
+                {
+                    this.Dispose();
+                    throw new InvalidDataException("Edge terms store was created with different parameters.");
+                }
+            }
+        }
+
+        private FileStream TryAcquireWriterLock()
+        {
+            try
+            {
+                return new FileStream(this.lockFileName, FileMode.OpenOrCreate, FileAccess.ReadWrite, FileShare.None);
+            }
+            catch (IOException)
+            {
+                return null;
+            }
+        }
+
+        private FileStream AcquireWriterLock()
+        {
+            const int maxAttempts = 1000;
+            for (int i = 0; i < maxAttempts; ++i)
+            {
+                FileStream writerLock = this.TryAcquireWriterLock();
+                if (writerLock != null)
+                    return writerLock;
+                Thread.Sleep(10);
+            }
+
+            throw new IOException("Can't acquire edge terms store lock.");
+        }
+
+        private bool SlotKeyEquals(long slotHeaderOffset, long[] key)
+        {
+            for (int i = 0; i < KeyLength; ++i)
+                if (this.accessor.ReadInt64(slotHeaderOffset + 8 + i * 8) != key[i])
+                    return false;
+            return true;
+        }
+
+        private void EnsureNotDisposed()
+        {
+            if (this.disposed)
+                throw new ObjectDisposedException("PersistentEdgeTermsStore");
+        }
+
+        private int GetSlot(long[] key)
+        {
+            ulong hash = 14695981039346656037UL;
+            for (int i = 0; i < KeyLength; ++i)
+            {
+                double value = BitConverter.Int64BitsToDouble(key[i]);
+                long quantizedValue = (long)Math.Round(value / HashQuantizationStep);
+                hash = (hash ^ (ulong)quantizedValue) * 1099511628211UL;
+            }
+
+            // Quantized values often have zero low bits, so high bits are mixed into low ones
+            hash ^= hash >> 33;
+            hash *= 0xFF51AFD7ED558CCDUL;
+            hash ^= hash >> 33;
+
+            return (int)(hash % (ulong)this.SlotCount);
+        }
+
+        private static long GetSlotHeaderOffset(int slot)
+        {
+            return HeaderSize + (long)slot * SlotHeaderSize;
+        }
+
+        private long GetSlotDataOffset(int slot)
+        {
+            long slotDataSize = 2L * this.ImageSize.Width * this.ImageSize.Height * sizeof(float);
+            return GetSlotHeaderOffset(this.SlotCount) + slot * slotDataSize;
+        }
+
+        private static long[] MakeKey(
+            VertexConstraints vertexConstraints1,
+            VertexConstraints vertexConstraints2,
+            EdgeConstraints edgeConstraints)
+        {
+            if (vertexConstraints1 == null)
+                throw new ArgumentNullException("vertexConstraints1");
+            if (vertexConstraints2 == null)
+                throw new ArgumentNullException("vertexConstraints2");
+            if (edgeConstraints == null)
+                throw new ArgumentNullException("edgeConstraints");
+
+            return new[]
+            {
+                BitConverter.DoubleToInt64Bits(vertexConstraints1.MinCoord.X),
+                BitConverter.DoubleToInt64Bits(vertexConstraints1.MinCoord.Y),
+                BitConverter.DoubleToInt64Bits(vertexConstraints1.MaxCoord.X),
+                BitConverter.DoubleToInt64Bits(vertexConstraints1.MaxCoord.Y),
+                BitConverter.DoubleToInt64Bits(vertexConstraints2.MinCoord.X),
+                BitConverter.DoubleToInt64Bits(vertexConstraints2.MinCoord.Y),
+                BitConverter.DoubleToInt64Bits(vertexConstraints2.MaxCoord.X),
+                BitConverter.DoubleToInt64Bits(vertexConstraints2.MaxCoord.Y),
+                BitConverter.DoubleToInt64Bits(edgeConstraints.MinWidth),
+                BitConverter.DoubleToInt64Bits(edgeConstraints.MaxWidth),
+            };
+        }
+    }
+}
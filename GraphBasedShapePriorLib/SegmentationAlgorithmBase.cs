@@ -11,6 +11,7 @@ namespace Research.GraphBasedShapePrior
         private double colorDifferencePairwiseTermWeight;
         private double constantPairwiseTermWeight;
         private double shapeEnergyWeight;
+        private float shapeTermsSaturation;
 
         protected SegmentationAlgorithmBase()
         {
@@ -22,6 +23,7 @@ namespace Research.GraphBasedShapePrior
             this.ObjectShapeUnaryTermWeight = 1;
             this.BackgroundShapeUnaryTermWeight = 1;
             this.ShapeEnergyWeight = 1;
+            this.ShapeTermsSaturation = 1000;
         }
 
         public ShapeModel ShapeModel { get; set; }
@@ -86,6 +88,20 @@ namespace Research.GraphBasedShapePrior
             }
         }
 
+        /// <summary>
+        /// Shape terms of a fixed shape are saturated at this value, which allows to calculate them only near the shape.
+        /// </summary>
+        public float ShapeTermsSaturation
+        {
+            get { return this.shapeTermsSaturation; }
+            set
+            {
+                if (value <= 0 || Single.IsInfinity(value) || Single.IsNaN(value))
+                    throw new ArgumentOutOfRangeException("value", "Property value should be positive and finite.");
+                this.shapeTermsSaturation = value;
+            }
+        }
+
         public ImageSegmentator ImageSegmentator { get; private set; }
 
         public SegmentationSolution SegmentImage(Image2D<Color> image, ObjectBackgroundColorModels colorModels)
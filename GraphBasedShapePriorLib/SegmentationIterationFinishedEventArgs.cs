@@ -11,7 +11,7 @@ namespace Research.GraphBasedShapePrior
         public SegmentationIterationFinishedEventArgs(
             int iteration,
             Shape shape,
-            Image2D<bool> segmentationMask,
+            Mask2D segmentationMask,
             Image2D<ObjectBackgroundTerm> unaryTermsImage,
             Image2D<ObjectBackgroundTerm> shapeTermsImage)
         {
@@ -26,7 +26,7 @@ namespace Research.GraphBasedShapePrior
 
         public Shape Shape { get; private set; }
 
-        public Image2D<bool> SegmentationMask { get; private set; }
+        public Mask2D SegmentationMask { get; private set; }
 
         public Image2D<ObjectBackgroundTerm> UnaryTermsImage { get; private set; }
 
@@ -5,7 +5,7 @@ namespace Research.GraphBasedShapePrior
 {
     public class SegmentationSolution
     {
-        public SegmentationSolution(Shape shape, Image2D<bool> mask, double energy)
+        public SegmentationSolution(Shape shape, Mask2D mask, double energy)
         {
             if (shape == null && mask == null)
                 throw new ArgumentException("Segmentation solution should contain something.");
@@ -23,7 +23,7 @@ namespace Research.GraphBasedShapePrior
 
         public Shape Shape { get; private set; }
 
-        public Image2D<bool> Mask { get; private set; }
+        public Mask2D Mask { get; private set; }
 
         public double Energy { get; private set; }
     }
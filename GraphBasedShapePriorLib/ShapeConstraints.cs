@@ -12,6 +12,9 @@ namespace Research.GraphBasedShapePrior
         private List<VertexConstraints> vertexConstraints;
         private List<EdgeConstraints> edgeConstraints;
 
+        // Hulls of edge vertex pairs, shared with the children until constraints of the pair change
+        private VertexPairConvexHull[] edgeConvexHulls;
+
         private ShapeConstraints()
         {
         }
@@ -22,6 +25,8 @@ namespace Research.GraphBasedShapePrior
             this.vertexConstraints = new List<VertexConstraints>(other.vertexConstraints);
             this.edgeConstraints = new List<EdgeConstraints>(other.edgeConstraints);
             this.ShapeStructure = other.ShapeStructure;
+            if (other.edgeConvexHulls != null)
+                this.edgeConvexHulls = (VertexPairConvexHull[])other.edgeConvexHulls.Clone();
         }
 
         public ShapeStructure ShapeStructure { get; private set; }
@@ -141,14 +146,41 @@ namespace Research.GraphBasedShapePrior
 
         public Polygon GetConvexHullForVertexPair(int vertex1, int vertex2)
         {
-            List<Vector> points = new List<Vector>();
-            points.AddRange(this.VertexConstraints[vertex1].Corners);
-            points.AddRange(this.VertexConstraints[vertex2].Corners);
-            Polygon convexHull = Polygon.ConvexHull(points);
+            return this.GetVertexPairConvexHull(vertex1, vertex2).Polygon;
+        }
+
+        public VertexPairConvexHull GetVertexPairConvexHull(int vertex1, int vertex2)
+        {
+            VertexConstraints constraints1 = this.vertexConstraints[vertex1];
+            VertexConstraints constraints2 = this.vertexConstraints[vertex2];
+            int edgeIndex = this.FindEdge(vertex1, vertex2);
+            if (edgeIndex == -1)
+                return new VertexPairConvexHull(constraints1, constraints2);
+
+            if (this.edgeConvexHulls == null)
+                this.edgeConvexHulls = new VertexPairConvexHull[this.edgeConstraints.Count];
+            VertexPairConvexHull convexHull = this.edgeConvexHulls[edgeIndex];
+            if (convexHull == null || !convexHull.IsBuiltFor(constraints1, constraints2))
+            {
+                convexHull = new VertexPairConvexHull(constraints1, constraints2);
+                this.edgeConvexHulls[edgeIndex] = convexHull;
+            }
 
             return convexHull;
         }
 
+        private int FindEdge(int vertex1, int vertex2)
+        {
+            for (int i = 0; i < this.ShapeStructure.Edges.Count; ++i)
+            {
+                ShapeEdge edge = this.ShapeStructure.Edges[i];
+                if (edge.Index1 == vertex1 && edge.Index2 == vertex2)
+                    return i;
+            }
+
+            return -1;
+        }
+
         public bool CheckIfSatisfied(double maxCoordFreedom, double maxWidthFreedom)
         {
             for (int i = 0; i < vertexConstraints.Count; ++i)
@@ -0,0 +1,85 @@
+﻿using System;
+using System.Drawing;
+using Research.GraphBasedShapePrior.Util;
+
+namespace Research.GraphBasedShapePrior
+{
+    /// <summary>
+    /// Oriented bounding box of a shape edge dilated by the distance at which edge penalties become saturated.
+    /// </summary>
+    internal struct ShapeEdgeBand
+    {
+        // Protects band from rounding errors
+        private const double Margin = 1;
+
+        private readonly Vector center;
+
+        private readonly Vector direction;
+
+        private readonly double halfLength;
+
+        private readonly double halfWidth;
+
+        public ShapeEdgeBand(Vector point1, Vector point2, double width, double saturationDistance)
+            : this()
+        {
+            this.Point1 = point1;
+            this.Point2 = point2;
+            this.Width = width;
+
+            double length = (point2 - point1).Length;
+            this.center = 0.5 * (point1 + point2);
+            this.direction = length > 1e-6 ? (point2 - point1) / length : new Vector(1, 0);
+            this.halfLength = 0.5 * length + saturationDistance + Margin;
+            this.halfWidth = saturationDistance + Margin;
+        }
+
+        public Vector Point1 { get; private set; }
+
+        public Vector Point2 { get; private set; }
+
+        public double Width { get; private set; }
+
+        public bool GetRowRange(int y, int rowWidth, out int minX, out int maxX)
+        {
+            double rangeMin = 0, rangeMax = rowWidth - 1;
+            double offsetY = y - this.center.Y;
+            bool intersects =
+                this.IntersectSlab(this.direction.X, this.direction.Y * offsetY, this.halfLength, ref rangeMin, ref rangeMax) &&
+                this.IntersectSlab(-this.direction.Y, this.direction.X * offsetY, this.halfWidth, ref rangeMin, ref rangeMax);
+
+            minX = intersects ? (int)Math.Ceiling(rangeMin) : 0;
+            maxX = intersects ? (int)Math.Floor(rangeMax) : -1;
+            return minX <= maxX;
+        }
+
+        /// <summary>
+        /// Returns axis-aligned bounding box of the band clipped to the image, every row range of the band is inside it.
+        /// </summary>
+        public Rectangle GetBoundingBox(Size imageSize)
+        {
+            double extentX = Math.Abs(this.direction.X) * this.halfLength + Math.Abs(this.direction.Y) * this.halfWidth;
+            double extentY = Math.Abs(this.direction.Y) * this.halfLength + Math.Abs(this.direction.X) * this.halfWidth;
+            int left = (int)MathHelper.Trunc(Math.Floor(this.center.X - extentX), 0, imageSize.Width);
+            int top = (int)MathHelper.Trunc(Math.Floor(this.center.Y - extentY), 0, imageSize.Height);
+            int right = (int)MathHelper.Trunc(Math.Ceiling(this.center.X + extentX) + 1, 0, imageSize.Width);
+            int bottom = (int)MathHelper.Trunc(Math.Ceiling(this.center.Y + extentY) + 1, 0, imageSize.Height);
+            if (left >= right || top >= bottom)
+                return Rectangle.Empty;
+            return Rectangle.FromLTRB(left, top, right, bottom);
+        }
+
+        private bool IntersectSlab(double coeffX, double offset, double halfSize, ref double rangeMin, ref double rangeMax)
+        {
+            // Slab is |coeffX * (x - centerX) + offset| <= halfSize
+            if (Math.Abs(coeffX) < 1e-9)
+                return Math.Abs(offset) <= halfSize;
+
+            double bound1 = this.center.X + (-halfSize - offset) / coeffX;
+            double bound2 = this.center.X + (halfSize - offset) / coeffX;
+            rangeMin = Math.Max(rangeMin, Math.Min(bound1, bound2));
+            rangeMax = Math.Min(rangeMax, Math.Max(bound1, bound2));
+            return rangeMin <= rangeMax;
+        }
+    }
+}
@@ -9,10 +9,37 @@ namespace Research.GraphBasedShapePrior
 {
     public class ShapeEnergyLowerBoundCalculator : IShapeEnergyLowerBoundCalculator
     {
-        private readonly List<GeneralizedDistanceTransform2D> transformPool =
+        private const int DefaultSubtreeTransformCacheCapacity = 512;
+
+        private const int DefaultMaxGridLevel = 2;
+
+        private const int DefaultMinCellsPerConstraintRange = 8;
+
+        // Coarser grids are too small to be useful
+        private const int MinAdaptiveGridSize = 9;
+
+        private const double InfiniteEnergy = 1e+20;
+
+        // Free transforms by grid size
+        private readonly Dictionary<Size, List<GeneralizedDistanceTransform2D>> freeTransforms =
+            new Dictionary<Size, List<GeneralizedDistanceTransform2D>>();
+
+        // Transforms that are not cached are returned to the free list after each calculation
+        private readonly List<GeneralizedDistanceTransform2D> usedTransforms =
             new List<GeneralizedDistanceTransform2D>();
 
-        private int firstFreeTranform;
+        private readonly LruCache<SubtreeDescription, GeneralizedDistanceTransform2D> subtreeTransformCache;
+
+        // Transforms are computed one at a time, so they can share the raster of allowed cells
+        private readonly LengthAngleConstraintsRaster allowedCellRaster = new LengthAngleConstraintsRaster();
+
+        private int subtreeTransformCacheCapacity = DefaultSubtreeTransformCacheCapacity;
+
+        private int maxGridLevel = DefaultMaxGridLevel;
+
+        private int minCellsPerConstraintRange = DefaultMinCellsPerConstraintRange;
+
+        private ShapeModel cachedModel;
 
         private double currentMaxScaledLength = Double.NegativeInfinity;
 
@@ -20,13 +47,114 @@ namespace Research.GraphBasedShapePrior
         {
             this.LengthGridSize = lengthGridSize;
             this.AngleGridSize = angleGridSize;
+            this.UseSubtreeTransformCache = true;
+
+            // Cache is trimmed only between calculations, so that transforms being used are never discarded
+            this.subtreeTransformCache = new LruCache<SubtreeDescription, GeneralizedDistanceTransform2D>(Int32.MaxValue);
+            this.subtreeTransformCache.CacheItemDiscarded += (sender, args) => this.FreeDistanceTransform(args.DiscardedValue);
         }
 
         public int LengthGridSize { get; private set; }
 
         public int AngleGridSize { get; private set; }
 
+        /// <summary>
+        /// Gets or sets whether distance transforms of edge subtrees should be reused by later calculations.
+        /// Transform of a subtree depends only on the constraints of its edges and of its parent edge,
+        /// so it stays valid for all the branch-and-bound nodes that split constraints elsewhere.
+        /// </summary>
+        public bool UseSubtreeTransformCache { get; set; }
+
+        public int SubtreeTransformCacheCapacity
+        {
+            get { return this.subtreeTransformCacheCapacity; }
+            set
+            {
+                if (value <= 0)
+                    throw new ArgumentOutOfRangeException("value", "Property value should be positive.");
+                this.subtreeTransformCacheCapacity = value;
+            }
+        }
+
+        public int CachedSubtreeTransformCount
+        {
+            get { return this.subtreeTransformCache.Count; }
+        }
+
+        public long SubtreeTransformCacheHitCount { get; private set; }
+
+        public long SubtreeTransformCacheMissCount { get; private set; }
+
+        public double SubtreeTransformCacheHitRate
+        {
+            get
+            {
+                long lookupCount = this.SubtreeTransformCacheHitCount + this.SubtreeTransformCacheMissCount;
+                return lookupCount == 0 ? 0 : (double)this.SubtreeTransformCacheHitCount / lookupCount;
+            }
+        }
+
+        /// <summary>
+        /// Gets or sets whether grid resolution should be chosen from the length and angle ranges of the constraints.
+        /// When all the ranges span many grid cells, bound is first calculated on a coarser grid.
+        /// Coarse grid cells stand for all the lengths and angles inside them, so coarse bounds never exceed the true ones.
+        /// Full-resolution grid is used only for the lengths of the root edge where coarse bound doesn't exceed refinement threshold.
+        /// </summary>
+        public bool UseAdaptiveGrids { get; set; }
+
+        /// <summary>
+        /// Gets or sets the max number of times the grid can be coarsened by half.
+        /// </summary>
+        public int MaxGridLevel
+        {
+            get { return this.maxGridLevel; }
+            set
+            {
+                if (value < 0)
+                    throw new ArgumentOutOfRangeException("value", "Property value should not be negative.");
+                this.maxGridLevel = value;
+            }
+        }
+
+        /// <summary>
+        /// Gets or sets the min number of coarse grid cells that length and angle range of every edge should span.
+        /// </summary>
+        public int MinCellsPerConstraintRange
+        {
+            get { return this.minCellsPerConstraintRange; }
+            set
+            {
+                if (value <= 0)
+                    throw new ArgumentOutOfRangeException("value", "Property value should be positive.");
+                this.minCellsPerConstraintRange = value;
+            }
+        }
+
+        /// <summary>
+        /// Gets the grid level the last bound was finally calculated on, zero stands for the full-resolution grid.
+        /// </summary>
+        public int LastBoundGridLevel { get; private set; }
+
+        public long CalculatedBoundCount { get; private set; }
+
+        public long CoarseGridBoundCount { get; private set; }
+
+        public long GridRefinementCount { get; private set; }
+
+        public long ComputedTransformCount { get; private set; }
+
+        public long ComputedGridCellCount { get; private set; }
+
         public double CalculateLowerBound(Size imageSize, ShapeModel model, ShapeConstraints shapeConstraints)
+        {
+            return this.CalculateLowerBound(imageSize, model, shapeConstraints, Double.PositiveInfinity);
+        }
+
+        /// <summary>
+        /// Calculates lower bound, refining coarse grids only while the bound doesn't exceed the given threshold.
+        /// If the returned bound exceeds the threshold, it can be looser than the full-resolution one.
+        /// </summary>
+        public double CalculateLowerBound(Size imageSize, ShapeModel model, ShapeConstraints shapeConstraints, double refinementThreshold)
         {
             if (model == null)
                 throw new ArgumentNullException("model");
@@ -38,9 +166,10 @@ namespace Research.GraphBasedShapePrior
             List<ILengthAngleConstraints> lengthAngleConstraints = CalculateLengthAngleConstraints(shapeConstraints);
             if (model.ConstrainedEdgePairs.Count == 0)
             {
-                double lowerBound = CalculateSingleEdgeLowerBound(model, shapeConstraints, lengthAngleConstraints);
-                Debug.Assert(lowerBound >= 0);
-                return lowerBound;
+                double singleEdgeLowerBound = CalculateSingleEdgeLowerBound(model, shapeConstraints, lengthAngleConstraints);
+                Debug.Assert(singleEdgeLowerBound >= 0);
+                this.LastBoundGridLevel = 0;
+                return singleEdgeLowerBound;
             }
 
             // Determine max (scaled) length possible
@@ -55,41 +184,185 @@ namespace Research.GraphBasedShapePrior
             if (maxScaledLength != this.currentMaxScaledLength)
             {
                 this.currentMaxScaledLength = maxScaledLength;
-                this.transformPool.Clear();
+                this.ClearSubtreeTransformCache();
+                this.freeTransforms.Clear();
+            }
+
+            if (model != this.cachedModel || !this.UseSubtreeTransformCache)
+            {
+                this.cachedModel = model;
+                this.ClearSubtreeTransformCache();
+            }
+
+            int gridLevel = this.UseAdaptiveGrids ? this.ChooseGridLevel(lengthAngleConstraints) : 0;
+            this.CalculatedBoundCount += 1;
+            if (gridLevel > 0)
+                this.CoarseGridBoundCount += 1;
+
+            Range refinedLengthRange = lengthAngleConstraints[model.RootEdgeIndex].LengthBoundary;
+            double coarseMinEnergy = Double.PositiveInfinity;
+            double lowerBound;
+            while (true)
+            {
+                GeneralizedDistanceTransform2D grid;
+                double[] minEnergies = this.CalculateMinEnergiesForRootEdgeLengths(
+                    model, shapeConstraints, lengthAngleConstraints, gridLevel, refinedLengthRange, out grid);
+                lowerBound = Math.Min(minEnergies.Min(), coarseMinEnergy);
+                if (gridLevel == 0 || lowerBound > refinementThreshold)
+                    break;
+
+                // Lengths that can still give energy below the threshold are refined, others keep their coarse bounds
+                int firstRefinedGridIndex = Array.FindIndex(minEnergies, energy => energy <= refinementThreshold);
+                int lastRefinedGridIndex = Array.FindLastIndex(minEnergies, energy => energy <= refinementThreshold);
+                for (int i = 0; i < minEnergies.Length; ++i)
+                {
+                    if (i < firstRefinedGridIndex || i > lastRefinedGridIndex)
+                        coarseMinEnergy = Math.Min(coarseMinEnergy, minEnergies[i]);
+                }
+
+                double halfStep = grid.GridStepSizeX * 0.5;
+                refinedLengthRange = new Range(
+                    Math.Max(grid.GridIndexToCoordX(firstRefinedGridIndex) - halfStep, refinedLengthRange.Left),
+                    Math.Min(grid.GridIndexToCoordX(lastRefinedGridIndex) + halfStep, refinedLengthRange.Right));
+                gridLevel = 0;
+                this.GridRefinementCount += 1;
+            }
+
+            this.LastBoundGridLevel = gridLevel;
+            this.FreeUsedDistanceTransforms();
+
+            Debug.Assert(lowerBound >= 0);
+            return lowerBound;
+        }
+
+        /// <summary>
+        /// Calculates a cheap lower bound that ignores pairwise edge terms, so it never exceeds the one given by distance transforms.
+        /// </summary>
+        public double CalculateIndependentEdgesLowerBound(ShapeModel model, ShapeConstraints shapeConstraints)
+        {
+            if (model == null)
+                throw new ArgumentNullException("model");
+            if (shapeConstraints == null)
+                throw new ArgumentNullException("shapeConstraints");
+            if (model.Structure != shapeConstraints.ShapeStructure)
+                throw new ArgumentException("Shape model and shape constraints correspond to different shape structures.");
+
+            if (model.ConstrainedEdgePairs.Count == 0)
+                return CalculateSingleEdgeLowerBound(model, shapeConstraints, CalculateLengthAngleConstraints(shapeConstraints));
+
+            double result = 0;
+            for (int edgeIndex = 0; edgeIndex < model.Structure.Edges.Count; ++edgeIndex)
+            {
+                ShapeEdge edge = model.Structure.Edges[edgeIndex];
+                Range lengthRange = BoxLengthAngleConstraints.FromVertexConstraints(
+                    shapeConstraints.VertexConstraints[edge.Index1], shapeConstraints.VertexConstraints[edge.Index2]).LengthBoundary;
+                result += CalculateMinUnaryEdgeEnergy(edgeIndex, model, shapeConstraints, lengthRange);
+                if (edgeIndex == model.RootEdgeIndex)
+                    result += model.CalculateRootEdgeEnergyTerm(MathHelper.Trunc(model.RootEdgeMeanLength, lengthRange.Left, lengthRange.Right));
             }
 
-            this.FreeAllDistanceTransforms();
+            Debug.Assert(result >= 0);
+            return result;
+        }
 
+        private double[] CalculateMinEnergiesForRootEdgeLengths(
+            ShapeModel model,
+            ShapeConstraints shapeConstraints,
+            IList<ILengthAngleConstraints> lengthAngleConstraints,
+            int gridLevel,
+            Range rootEdgeLengthRange,
+            out GeneralizedDistanceTransform2D grid)
+        {
             // Calculate distance transforms for all the child edges
             List<GeneralizedDistanceTransform2D> childTransforms = new List<GeneralizedDistanceTransform2D>();
             foreach (int edgeIndex in model.IterateNeighboringEdgeIndices(model.RootEdgeIndex))
-                childTransforms.Add(CalculateMinEnergiesForAllParentEdges(model, shapeConstraints, model.RootEdgeIndex, edgeIndex, lengthAngleConstraints));
+            {
+                SubtreeDescription subtree = DescribeSubtree(
+                    model, shapeConstraints, lengthAngleConstraints, model.RootEdgeIndex, edgeIndex, gridLevel, rootEdgeLengthRange);
+                childTransforms.Add(this.GetMinEnergiesForAllParentEdges(model, shapeConstraints, subtree, lengthAngleConstraints));
+            }
 
-            // Find best overall solution
-            double minEnergySum = Double.PositiveInfinity;
+            // Find best solution for every root edge length
             GeneralizedDistanceTransform2D transform = childTransforms[0];
+            bool useCells = gridLevel > 0;
+            double halfStepX = transform.GridStepSizeX * 0.5, halfStepY = transform.GridStepSizeY * 0.5;
+            double[] result = new double[transform.GridSize.Width];
+            for (int i = 0; i < result.Length; ++i)
+                result[i] = Double.PositiveInfinity;
             foreach (int lengthGridIndex in transform.EnumerateInterestGridIndicesX())
             {
                 double length = transform.GridIndexToCoordX(lengthGridIndex);
+                Range lengthCell = new Range(Math.Max(length - halfStepX, 0), length + halfStepX);
                 double minPairwiseEnergy = Double.PositiveInfinity;
 
                 foreach (int angleGridIndex in transform.EnumerateInterestGridIndicesY())
                 {
                     double angle = transform.GridIndexToCoordY(angleGridIndex);
                     const double eps = 1e-8;
-                    if (angle > Math.PI + eps || angle < -Math.PI - eps)
-                        continue;   // Consider only natural angle representations here
+                    if (useCells)
+                    {
+                        if (angle - halfStepY > Math.PI + eps || angle + halfStepY < -Math.PI - eps)
+                            continue;
+                        minPairwiseEnergy = Math.Min(
+                            minPairwiseEnergy,
+                            CalculateMinPairwiseEdgeEnergy(lengthCell, new Range(angle - halfStepY, angle + halfStepY), childTransforms));
+                    }
+                    else
+                    {
+                        if (angle > Math.PI + eps || angle < -Math.PI - eps)
+                            continue;   // Consider only natural angle representations here
+                        minPairwiseEnergy = Math.Min(minPairwiseEnergy, CalculateMinPairwiseEdgeEnergy(length, angle, childTransforms));
+                    }
+                }
+
+                double unaryEdgeEnergy = useCells
+                    ? CalculateMinUnaryEdgeEnergy(model.RootEdgeIndex, model, shapeConstraints, lengthCell)
+                    : CalculateMinUnaryEdgeEnergy(model.RootEdgeIndex, model, shapeConstraints, length);
+                double rootEdgeEnergy = useCells
+                    ? model.CalculateRootEdgeEnergyTerm(MathHelper.Trunc(model.RootEdgeMeanLength, lengthCell.Left, lengthCell.Right))
+                    : model.CalculateRootEdgeEnergyTerm(length);
+                result[lengthGridIndex] = minPairwiseEnergy + unaryEdgeEnergy + rootEdgeEnergy;
+            }
+
+            grid = transform;
+            return result;
+        }
 
-                    minPairwiseEnergy = Math.Min(minPairwiseEnergy, CalculateMinPairwiseEdgeEnergy(length, angle, childTransforms));
+        private int ChooseGridLevel(IList<ILengthAngleConstraints> lengthAngleConstraints)
+        {
+            double minLengthRange = Double.PositiveInfinity, minAngleRange = Double.PositiveInfinity;
+            foreach (ILengthAngleConstraints constraints in lengthAngleConstraints)
+            {
+                Range angleRange = constraints.AngleBoundary;
+                minLengthRange = Math.Min(minLengthRange, constraints.LengthBoundary.Length);
+                minAngleRange = Math.Min(
+                    minAngleRange, angleRange.Outside ? Math.PI * 2 - (angleRange.Right - angleRange.Left) : angleRange.Length);
+            }
+
+            int gridLevel = 0;
+            while (gridLevel < this.maxGridLevel)
+            {
+                Size gridSize = this.GetGridSize(gridLevel + 1);
+                if (gridSize.Width < MinAdaptiveGridSize || gridSize.Height < MinAdaptiveGridSize)
+                    break;
+
+                double gridStepX = this.currentMaxScaledLength / (gridSize.Width - 1);
+                double gridStepY = Math.PI * 4 / (gridSize.Height - 1);
+                if (minLengthRange < gridStepX * this.minCellsPerConstraintRange ||
+                    minAngleRange < gridStepY * this.minCellsPerConstraintRange)
+                {
+                    break;
                 }
 
-                double unaryEdgeEnergy = CalculateMinUnaryEdgeEnergy(model.RootEdgeIndex, model, shapeConstraints, length);
-                double rootEdgeEnergy = model.CalculateRootEdgeEnergyTerm(length);
-                minEnergySum = Math.Min(minEnergySum, minPairwiseEnergy + unaryEdgeEnergy + rootEdgeEnergy);
+                gridLevel += 1;
             }
 
-            Debug.Assert(minEnergySum >= 0);
-            return minEnergySum;
+            return gridLevel;
+        }
+
+        private Size GetGridSize(int gridLevel)
+        {
+            return new Size(((this.LengthGridSize - 1) >> gridLevel) + 1, ((this.AngleGridSize - 1) >> gridLevel) + 1);
         }
 
         private static double CalculateSingleEdgeLowerBound(
@@ -140,10 +413,9 @@ namespace Research.GraphBasedShapePrior
         {
             double energySum = 0;
             double energy;
-            const double infiniteEnergy = 1e+20;
             foreach (GeneralizedDistanceTransform2D childTransform in transforms)
             {
-                double minEnergy = infiniteEnergy;
+                double minEnergy = InfiniteEnergy;
 
                 if (childTransform.TryGetValueByCoords(length, angle, out energy))
                     minEnergy = Math.Min(minEnergy, energy);
@@ -166,8 +438,35 @@ namespace Research.GraphBasedShapePrior
                         minEnergy = Math.Min(minEnergy, energy);
                 }
 
-                if (minEnergy == infiniteEnergy)
-                    return infiniteEnergy;
+                if (minEnergy == InfiniteEnergy)
+                    return InfiniteEnergy;
+
+                energySum += minEnergy;
+            }
+
+            return energySum;
+        }
+
+        private static double CalculateMinPairwiseEdgeEnergy(
+            Range lengthRange,
+            Range angleRange,
+            IEnumerable<GeneralizedDistanceTransform2D> transforms)
+        {
+            double energySum = 0;
+            double energy;
+            foreach (GeneralizedDistanceTransform2D childTransform in transforms)
+            {
+                // Look through all the representations of the given angles
+                double minEnergy = InfiniteEnergy;
+                for (int shift = -1; shift <= 1; ++shift)
+                {
+                    Range shiftedAngleRange = new Range(angleRange.Left + shift * Math.PI * 2, angleRange.Right + shift * Math.PI * 2);
+                    if (childTransform.TryGetMinValueByCoordRanges(lengthRange, shiftedAngleRange, out energy))
+                        minEnergy = Math.Min(minEnergy, energy);
+                }
+
+                if (minEnergy == InfiniteEnergy)
+                    return InfiniteEnergy;
 
                 energySum += minEnergy;
             }
@@ -175,12 +474,15 @@ namespace Research.GraphBasedShapePrior
             return energySum;
         }
 
-        private GeneralizedDistanceTransform2D AllocateDistanceTransform()
+        private GeneralizedDistanceTransform2D AllocateDistanceTransform(int gridLevel)
         {
+            Size gridSize = this.GetGridSize(gridLevel);
+            List<GeneralizedDistanceTransform2D> freeTransformsOfSize;
             GeneralizedDistanceTransform2D result;
-            if (this.firstFreeTranform < this.transformPool.Count)
+            if (this.freeTransforms.TryGetValue(gridSize, out freeTransformsOfSize) && freeTransformsOfSize.Count > 0)
             {
-                result = this.transformPool[this.firstFreeTranform++];
+                result = freeTransformsOfSize[freeTransformsOfSize.Count - 1];
+                freeTransformsOfSize.RemoveAt(freeTransformsOfSize.Count - 1);
                 result.ResetFinitePenaltyRange();
                 result.ResetInterestRange();
             }
@@ -189,83 +491,221 @@ namespace Research.GraphBasedShapePrior
                 result = new GeneralizedDistanceTransform2D(
                     new Range(0, this.currentMaxScaledLength),
                     new Range(-Math.PI * 2, Math.PI * 2),
-                    new Size(this.LengthGridSize, this.AngleGridSize));
-                this.firstFreeTranform++;
-                this.transformPool.Add(result);
+                    gridSize);
+
+                // Only values are needed for the bound
+                result.TrackBestIndices = false;
             }
 
+            // Coarse grids should give lower bounds for every point of a cell
+            result.ShrinkDistancesByCell = gridLevel > 0;
             return result;
         }
 
-        private void FreeAllDistanceTransforms()
+        private void FreeDistanceTransform(GeneralizedDistanceTransform2D transform)
         {
-            this.firstFreeTranform = 0;
+            List<GeneralizedDistanceTransform2D> freeTransformsOfSize;
+            if (!this.freeTransforms.TryGetValue(transform.GridSize, out freeTransformsOfSize))
+            {
+                freeTransformsOfSize = new List<GeneralizedDistanceTransform2D>();
+                this.freeTransforms.Add(transform.GridSize, freeTransformsOfSize);
+            }
+
+            freeTransformsOfSize.Add(transform);
         }
 
-        private static double CalculateMinUnaryEdgeEnergy(int edgeIndex, ShapeModel model, ShapeConstraints shapeConstraints, double edgeLength)
+        private void FreeUsedDistanceTransforms()
         {
-            double bestWidth = edgeLength * model.GetEdgeParams(edgeIndex).WidthToEdgeLengthRatio;
-            EdgeConstraints edgeConstraints = shapeConstraints.EdgeConstraints[edgeIndex];
-            bestWidth = MathHelper.Trunc(bestWidth, edgeConstraints.MinWidth, edgeConstraints.MaxWidth);
-            return model.CalculateEdgeWidthEnergyTerm(edgeIndex, bestWidth, edgeLength);
+            foreach (GeneralizedDistanceTransform2D transform in this.usedTransforms)
+                this.FreeDistanceTransform(transform);
+            this.usedTransforms.Clear();
+
+            while (this.subtreeTransformCache.Count > this.subtreeTransformCacheCapacity)
+                this.subtreeTransformCache.RemoveLeastRecentlyUsed();
         }
 
-        private GeneralizedDistanceTransform2D CalculateMinEnergiesForAllParentEdges(
+        private void ClearSubtreeTransformCache()
+        {
+            while (this.subtreeTransformCache.RemoveLeastRecentlyUsed())
+            {
+            }
+        }
+
+        private static SubtreeDescription DescribeSubtree(
             ShapeModel model,
             ShapeConstraints shapeConstraints,
+            IList<ILengthAngleConstraints> lengthAngleConstraints,
             int parentEdgeIndex,
             int currentEdgeIndex,
-            IList<ILengthAngleConstraints> lengthAngleConstraints)
+            int gridLevel,
+            Range parentEdgeLengthRange)
         {
-            // Calculate child transforms
-            List<GeneralizedDistanceTransform2D> childDistanceTransforms = new List<GeneralizedDistanceTransform2D>();
+            List<SubtreeDescription> children = new List<SubtreeDescription>();
             foreach (int neighborEdgeIndex in model.IterateNeighboringEdgeIndices(currentEdgeIndex))
             {
-                // Iterate only through children
-                if (neighborEdgeIndex == parentEdgeIndex)
-                    continue;
+                if (neighborEdgeIndex != parentEdgeIndex)
+                {
+                    children.Add(DescribeSubtree(
+                        model,
+                        shapeConstraints,
+                        lengthAngleConstraints,
+                        currentEdgeIndex,
+                        neighborEdgeIndex,
+                        gridLevel,
+                        lengthAngleConstraints[currentEdgeIndex].LengthBoundary));
+                }
+            }
+
+            ShapeEdge parentEdge = model.Structure.Edges[parentEdgeIndex];
+            ShapeEdge currentEdge = model.Structure.Edges[currentEdgeIndex];
+            return new SubtreeDescription(
+                parentEdgeIndex,
+                currentEdgeIndex,
+                gridLevel,
+                parentEdgeLengthRange,
+                new[]
+                {
+                    shapeConstraints.VertexConstraints[parentEdge.Index1],
+                    shapeConstraints.VertexConstraints[parentEdge.Index2],
+                    shapeConstraints.VertexConstraints[currentEdge.Index1],
+                    shapeConstraints.VertexConstraints[currentEdge.Index2]
+                },
+                shapeConstraints.EdgeConstraints[currentEdgeIndex],
+                children.ToArray());
+        }
+
+        private GeneralizedDistanceTransform2D GetMinEnergiesForAllParentEdges(
+            ShapeModel model,
+            ShapeConstraints shapeConstraints,
+            SubtreeDescription subtree,
+            IList<ILengthAngleConstraints> lengthAngleConstraints)
+        {
+            GeneralizedDistanceTransform2D transform;
+            if (this.UseSubtreeTransformCache)
+            {
+                if (this.subtreeTransformCache.TryGetValue(subtree, out transform))
+                {
+                    this.SubtreeTransformCacheHitCount += 1;
+                    return transform;
+                }
+
+                this.SubtreeTransformCacheMissCount += 1;
+            }
 
-                GeneralizedDistanceTransform2D childTransform = CalculateMinEnergiesForAllParentEdges(
-                    model, shapeConstraints, currentEdgeIndex, neighborEdgeIndex, lengthAngleConstraints);
+            // Child transforms are either cached or used until the end of the calculation, so they stay valid here
+            List<GeneralizedDistanceTransform2D> childDistanceTransforms = new List<GeneralizedDistanceTransform2D>();
+            foreach (SubtreeDescription childSubtree in subtree.Children)
+            {
+                GeneralizedDistanceTransform2D childTransform = this.GetMinEnergiesForAllParentEdges(
+                    model, shapeConstraints, childSubtree, lengthAngleConstraints);
                 Debug.Assert(childTransform.IsComputed);
                 childDistanceTransforms.Add(childTransform);
             }
 
-            ShapeEdgePairParams pairParams = model.GetEdgePairParams(parentEdgeIndex, currentEdgeIndex);
-            GeneralizedDistanceTransform2D transform = this.AllocateDistanceTransform();
-            SetupTransformFinitePenaltyRanges(transform, pairParams, lengthAngleConstraints[currentEdgeIndex]);
-            SetupTransformInterestRanges(transform, lengthAngleConstraints[parentEdgeIndex]);
+            transform = this.CalculateMinEnergiesForAllParentEdges(
+                model, shapeConstraints, subtree, childDistanceTransforms, lengthAngleConstraints);
+            if (this.UseSubtreeTransformCache)
+                this.subtreeTransformCache.Add(subtree, transform);
+            else
+                this.usedTransforms.Add(transform);
+            return transform;
+        }
+
+        private static double CalculateMinUnaryEdgeEnergy(int edgeIndex, ShapeModel model, ShapeConstraints shapeConstraints, double edgeLength)
+        {
+            double bestWidth = edgeLength * model.GetEdgeParams(edgeIndex).WidthToEdgeLengthRatio;
+            EdgeConstraints edgeConstraints = shapeConstraints.EdgeConstraints[edgeIndex];
+            bestWidth = MathHelper.Trunc(bestWidth, edgeConstraints.MinWidth, edgeConstraints.MaxWidth);
+            return model.CalculateEdgeWidthEnergyTerm(edgeIndex, bestWidth, edgeLength);
+        }
+
+        private static double CalculateMinUnaryEdgeEnergy(int edgeIndex, ShapeModel model, ShapeConstraints shapeConstraints, Range edgeLengthRange)
+        {
+            // Width to length ratio takes all the values between the extreme ones
+            double widthToLengthRatio = model.GetEdgeParams(edgeIndex).WidthToEdgeLengthRatio;
+            EdgeConstraints edgeConstraints = shapeConstraints.EdgeConstraints[edgeIndex];
+            if (edgeLengthRange.Right * widthToLengthRatio < edgeConstraints.MinWidth)
+                return model.CalculateEdgeWidthEnergyTerm(edgeIndex, edgeConstraints.MinWidth, edgeLengthRange.Right);
+            if (edgeLengthRange.Left * widthToLengthRatio > edgeConstraints.MaxWidth)
+                return model.CalculateEdgeWidthEnergyTerm(edgeIndex, edgeConstraints.MaxWidth, edgeLengthRange.Left);
+            return 0;
+        }
+
+        private GeneralizedDistanceTransform2D CalculateMinEnergiesForAllParentEdges(
+            ShapeModel model,
+            ShapeConstraints shapeConstraints,
+            SubtreeDescription subtree,
+            IList<GeneralizedDistanceTransform2D> childDistanceTransforms,
+            IList<ILengthAngleConstraints> lengthAngleConstraints)
+        {
+            int currentEdgeIndex = subtree.EdgeIndex;
+            bool useCells = subtree.GridLevel > 0;
+            ShapeEdgePairParams pairParams = model.GetEdgePairParams(subtree.ParentEdgeIndex, currentEdgeIndex);
+            GeneralizedDistanceTransform2D transform = this.AllocateDistanceTransform(subtree.GridLevel);
+            SetupTransformFinitePenaltyRanges(transform, pairParams, lengthAngleConstraints[currentEdgeIndex], useCells);
+            SetupTransformInterestRanges(
+                transform, subtree.ParentEdgeLengthRange, lengthAngleConstraints[subtree.ParentEdgeIndex].AngleBoundary);
+
+            // Tolerances cover the whole grid cell
+            double lengthTolerance = transform.GridStepSizeX / pairParams.MeanLengthRatio;
+            double angleTolerance = transform.GridStepSizeY;
+
+            // Box set constraints are checked for all the cells at once
+            BoxSetLengthAngleConstraints boxSetConstraints = lengthAngleConstraints[currentEdgeIndex] as BoxSetLengthAngleConstraints;
+            if (boxSetConstraints != null)
+                this.allowedCellRaster.Rasterize(boxSetConstraints, transform, pairParams.MeanLengthRatio, pairParams.MeanAngle);
+
+            // Unary energy depends on length only, so it is calculated once per length grid cell
+            double[] unaryEdgeEnergies = new double[transform.GridSize.Width];
+            for (int gridX = 0; gridX < unaryEdgeEnergies.Length; ++gridX)
+            {
+                double length = transform.GridIndexToCoordX(gridX) / pairParams.MeanLengthRatio;
+                unaryEdgeEnergies[gridX] = useCells
+                    ? CalculateMinUnaryEdgeEnergy(currentEdgeIndex, model, shapeConstraints, GetCell(length, lengthTolerance, 0))
+                    : CalculateMinUnaryEdgeEnergy(currentEdgeIndex, model, shapeConstraints, length);
+            }
 
-            Func<double, double, double> penaltyFunction =
-                (scaledLength, shiftedAngle) =>
+            Action<int, int[], double[]> rowPenaltyCalculator =
+                (angleGridIndex, lengthGridIndices, rowPenalties) =>
                 {
-                    double length = scaledLength / pairParams.MeanLengthRatio;
-                    double angle = shiftedAngle + pairParams.MeanAngle;
-                    
-                    double lengthTolerance = transform.GridStepSizeX / pairParams.MeanLengthRatio;
-                    double angleTolerance = transform.GridStepSizeY;
-                    if (!lengthAngleConstraints[currentEdgeIndex].InRange(length, lengthTolerance, angle, angleTolerance))
-                        return 1e+20;
-
-                    double penalty =
-                        CalculateMinUnaryEdgeEnergy(currentEdgeIndex, model, shapeConstraints, length) +
-                        CalculateMinPairwiseEdgeEnergy(length, angle, childDistanceTransforms);
-                    return penalty;
+                    double angle = transform.GridIndexToCoordY(angleGridIndex) + pairParams.MeanAngle;
+                    foreach (int lengthGridIndex in lengthGridIndices)
+                    {
+                        double length = transform.GridIndexToCoordX(lengthGridIndex) / pairParams.MeanLengthRatio;
+                        bool isAllowed = boxSetConstraints != null
+                            ? this.allowedCellRaster.IsAllowed(lengthGridIndex, angleGridIndex)
+                            : lengthAngleConstraints[currentEdgeIndex].InRange(length, lengthTolerance, angle, angleTolerance);
+                        if (!isAllowed)
+                        {
+                            rowPenalties[lengthGridIndex] = InfiniteEnergy;
+                            continue;
+                        }
+
+                        double pairwiseEdgeEnergy = useCells
+                            ? CalculateMinPairwiseEdgeEnergy(
+                                GetCell(length, lengthTolerance, 0), GetCell(angle, angleTolerance, Double.NegativeInfinity), childDistanceTransforms)
+                            : CalculateMinPairwiseEdgeEnergy(length, angle, childDistanceTransforms);
+                        rowPenalties[lengthGridIndex] = unaryEdgeEnergies[lengthGridIndex] + pairwiseEdgeEnergy;
+                    }
                 };
 
             transform.Compute(
                 0.5 / MathHelper.Sqr(pairParams.LengthDiffDeviation),
                 0.5 / MathHelper.Sqr(pairParams.AngleDeviation),
-                penaltyFunction);
+                rowPenaltyCalculator);
+            this.ComputedTransformCount += 1;
+            this.ComputedGridCellCount += transform.GridSize.Width * transform.GridSize.Height;
 
             return transform;
         }
 
-        private void SetupTransformInterestRanges(GeneralizedDistanceTransform2D transform, ILengthAngleConstraints lengthAngleConstraints)
+        private static Range GetCell(double coord, double cellSize, double minCoord)
+        {
+            return new Range(Math.Max(coord - cellSize * 0.5, minCoord), coord + cellSize * 0.5);
+        }
+
+        private void SetupTransformInterestRanges(GeneralizedDistanceTransform2D transform, Range lengthRange, Range angleRange)
         {
-            Range lengthRange = lengthAngleConstraints.LengthBoundary;
-            Range angleRange = lengthAngleConstraints.AngleBoundary;
-            
             transform.AddInterestRangeX(lengthRange);
 
             if (!angleRange.Outside)
@@ -320,20 +760,129 @@ namespace Research.GraphBasedShapePrior
         }
 
         private void SetupTransformFinitePenaltyRanges(
-            GeneralizedDistanceTransform2D transform, ShapeEdgePairParams pairParams, ILengthAngleConstraints lengthAngleConstraints)
+            GeneralizedDistanceTransform2D transform,
+            ShapeEdgePairParams pairParams,
+            ILengthAngleConstraints lengthAngleConstraints,
+            bool addNeighborCells)
         {
             Range lengthRange = lengthAngleConstraints.LengthBoundary;
             Range angleRange = lengthAngleConstraints.AngleBoundary;
-            
-            transform.AddFinitePenaltyRangeX(
-                new Range(lengthRange.Left * pairParams.MeanLengthRatio, lengthRange.Right * pairParams.MeanLengthRatio));
+
+            // When distances are shrunk by cell, penalties of the neighboring cells are needed as well
+            double marginX = addNeighborCells ? transform.GridStepSizeX : 0;
+            double marginY = addNeighborCells ? transform.GridStepSizeY : 0;
+
+            transform.AddFinitePenaltyRangeX(ExpandRange(
+                new Range(lengthRange.Left * pairParams.MeanLengthRatio, lengthRange.Right * pairParams.MeanLengthRatio),
+                marginX,
+                transform.RangeX));
 
             if (!angleRange.Outside)
-                transform.AddFinitePenaltyRangeY(new Range(angleRange.Left - pairParams.MeanAngle, angleRange.Right - pairParams.MeanAngle));
+            {
+                transform.AddFinitePenaltyRangeY(ExpandRange(
+                    new Range(angleRange.Left - pairParams.MeanAngle, angleRange.Right - pairParams.MeanAngle), marginY, transform.RangeY));
+            }
+            else if (angleRange.Right - angleRange.Left >= marginY * 2)
+            {
+                transform.AddFinitePenaltyRangeY(ExpandRange(
+                    new Range(-Math.PI - pairParams.MeanAngle, angleRange.Left - pairParams.MeanAngle), marginY, transform.RangeY));
+                transform.AddFinitePenaltyRangeY(ExpandRange(
+                    new Range(angleRange.Right - pairParams.MeanAngle, Math.PI - pairParams.MeanAngle), marginY, transform.RangeY));
+            }
             else
             {
-                transform.AddFinitePenaltyRangeY(new Range(-Math.PI - pairParams.MeanAngle, angleRange.Left - pairParams.MeanAngle));
-                transform.AddFinitePenaltyRangeY(new Range(angleRange.Right - pairParams.MeanAngle, Math.PI - pairParams.MeanAngle));
+                transform.AddFinitePenaltyRangeY(ExpandRange(
+                    new Range(-Math.PI - pairParams.MeanAngle, Math.PI - pairParams.MeanAngle), marginY, transform.RangeY));
+            }
+        }
+
+        private static Range ExpandRange(Range range, double margin, Range bounds)
+        {
+            return new Range(Math.Max(range.Left - margin, bounds.Left), Math.Min(range.Right + margin, bounds.Right));
+        }
+
+        private class SubtreeDescription
+        {
+            private readonly int hashCode;
+
+            public SubtreeDescription(
+                int parentEdgeIndex,
+                int edgeIndex,
+                int gridLevel,
+                Range parentEdgeLengthRange,
+                VertexConstraints[] vertexConstraints,
+                EdgeConstraints edgeConstraints,
+                SubtreeDescription[] children)
+            {
+                this.ParentEdgeIndex = parentEdgeIndex;
+                this.EdgeIndex = edgeIndex;
+                this.GridLevel = gridLevel;
+                this.ParentEdgeLengthRange = parentEdgeLengthRange;
+                this.VertexConstraints = vertexConstraints;
+                this.EdgeConstraints = edgeConstraints;
+                this.Children = children;
+
+                this.hashCode = parentEdgeIndex ^ (edgeIndex << 16) ^ (gridLevel << 24) ^ edgeConstraints.GetHashCode();
+                this.hashCode = this.hashCode * 31 + parentEdgeLengthRange.Left.GetHashCode();
+                this.hashCode = this.hashCode * 31 + parentEdgeLengthRange.Right.GetHashCode();
+                foreach (VertexConstraints constraints in vertexConstraints)
+                    this.hashCode = this.hashCode * 31 + constraints.GetHashCode();
+                foreach (SubtreeDescription child in children)
+                    this.hashCode = this.hashCode * 31 + child.GetHashCode();
+            }
+
+            public int ParentEdgeIndex { get; private set; }
+
+            public int EdgeIndex { get; private set; }
+
+            public int GridLevel { get; private set; }
+
+            // Lengths of the parent edge the transform is calculated for
+            public Range ParentEdgeLengthRange { get; private set; }
+
+            // Constraints of the vertices of the parent edge and of the edge itself
+            public VertexConstraints[] VertexConstraints { get; private set; }
+
+            public EdgeConstraints EdgeConstraints { get; private set; }
+
+            public SubtreeDescription[] Children { get; private set; }
+
+            public override bool Equals(object obj)
+            {
+                if (obj == null || GetType() != obj.GetType())
+                    return false;
+
+                SubtreeDescription objCasted = (SubtreeDescription)obj;
+                if (objCasted.hashCode != this.hashCode ||
+                    objCasted.ParentEdgeIndex != this.ParentEdgeIndex ||
+                    objCasted.EdgeIndex != this.EdgeIndex ||
+                    objCasted.GridLevel != this.GridLevel ||
+                    objCasted.ParentEdgeLengthRange.Left != this.ParentEdgeLengthRange.Left ||
+                    objCasted.ParentEdgeLengthRange.Right != this.ParentEdgeLengthRange.Right ||
+                    objCasted.EdgeConstraints != this.EdgeConstraints ||
+                    objCasted.Children.Length != this.Children.Length)
+                {
+                    return false;
+                }
+
+                for (int i = 0; i < this.VertexConstraints.Length; ++i)
+                {
+                    if (objCasted.VertexConstraints[i] != this.VertexConstraints[i])
+                        return false;
+                }
+
+                for (int i = 0; i < this.Children.Length; ++i)
+                {
+                    if (!objCasted.Children[i].Equals(this.Children[i]))
+                        return false;
+                }
+
+                return true;
+            }
+
+            public override int GetHashCode()
+            {
+                return this.hashCode;
             }
         }
     }
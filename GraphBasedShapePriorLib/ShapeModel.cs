@@ -5,6 +5,7 @@ using System.Diagnostics;
 using System.IO;
 using System.Linq;
 using System.Runtime.Serialization;
+using System.Threading.Tasks;
 using Research.GraphBasedShapePrior.Util;
 
 namespace Research.GraphBasedShapePrior
@@ -560,6 +561,83 @@ namespace Research.GraphBasedShapePrior
                 this.CalculateObjectPenalty(shape, point), this.CalculateBackgroundPenalty(shape, point));
         }
 
+        /// <summary>
+        /// Calculates penalties of the given shape for every pixel of the result, saturating them.
+        /// Each edge is rasterized only inside its band (oriented edge bounding box dilated by the distance
+        /// at which edge penalties become saturated), pixels outside of all bands get saturated penalties.
+        /// </summary>
+        public void CalculatePenalties(Shape shape, ObjectBackgroundTermPlanes result)
+        {
+            if (shape == null)
+                throw new ArgumentNullException("shape");
+            if (result == null)
+                throw new ArgumentNullException("result");
+            if (shape.Structure != this.Structure)
+                throw new ArgumentException("Shape and model have different structures.", "shape");
+
+            ShapeEdgeBand[] bands = new ShapeEdgeBand[this.Structure.Edges.Count];
+            for (int i = 0; i < bands.Length; ++i)
+                bands[i] = this.GetEdgeBand(shape, i, result.Saturation);
+
+            float saturatedObjectTerm = result.Saturation;
+            float saturatedBackgroundTerm = this.CalculateSaturatedBackgroundPenalty(result);
+            Parallel.For(
+                0,
+                result.Height,
+                y =>
+                {
+                    int rowStart = result.GetIndex(0, y);
+                    for (int index = rowStart, rowEnd = rowStart + result.Width; index < rowEnd; ++index)
+                    {
+                        result.ObjectTerms[index] = saturatedObjectTerm;
+                        result.BackgroundTerms[index] = saturatedBackgroundTerm;
+                    }
+
+                    for (int i = 0; i < bands.Length; ++i)
+                        this.AddEdgePenaltiesToRow(bands[i], y, result);
+                });
+        }
+
+        internal ShapeEdgeBand GetEdgeBand(Shape shape, int edgeIndex, float saturation)
+        {
+            // Beyond this distance object penalty is saturated and exp() in background penalty underflows to zero
+            const double BackgroundPenaltyUnderflowThreshold = 750;
+
+            ShapeEdge edge = this.Structure.Edges[edgeIndex];
+            double edgeWidth = shape.EdgeWidths[edgeIndex];
+            double objectPenaltyAtUnitDistance = this.CalculateObjectPenaltyForEdge(1, edgeWidth);
+            double saturationDistance = Math.Sqrt(Math.Max(saturation, BackgroundPenaltyUnderflowThreshold) / objectPenaltyAtUnitDistance);
+            return new ShapeEdgeBand(
+                shape.VertexPositions[edge.Index1], shape.VertexPositions[edge.Index2], edgeWidth, saturationDistance);
+        }
+
+        internal float CalculateSaturatedBackgroundPenalty(ObjectBackgroundTermPlanes result)
+        {
+            return result.Saturate(this.CalculateBackgroundPenaltyForEdge(Double.PositiveInfinity, 1));
+        }
+
+        /// <summary>
+        /// Combines penalties of a single edge with the given row of terms. Terms outside of the band are not touched,
+        /// since edge penalties are saturated there.
+        /// </summary>
+        internal void AddEdgePenaltiesToRow(ShapeEdgeBand band, int y, ObjectBackgroundTermPlanes result)
+        {
+            int minX, maxX;
+            if (!band.GetRowRange(y, result.Width, out minX, out maxX))
+                return;
+
+            for (int x = minX, index = result.GetIndex(minX, y); x <= maxX; ++x, ++index)
+            {
+                double distanceSqr = new Vector(x, y).DistanceToSegmentSquared(band.Point1, band.Point2);
+                result.ObjectTerms[index] = Math.Min(
+                    result.ObjectTerms[index],
+                    result.Saturate(this.CalculateObjectPenaltyForEdge(distanceSqr, band.Width)));
+                result.BackgroundTerms[index] = Math.Max(
+                    result.BackgroundTerms[index],
+                    result.Saturate(this.CalculateBackgroundPenaltyForEdge(distanceSqr, band.Width)));
+            }
+        }
+
         public double CalculateEnergy(Shape shape)
         {
             if (shape == null)
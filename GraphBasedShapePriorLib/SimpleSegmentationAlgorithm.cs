@@ -12,8 +12,12 @@ namespace Research.GraphBasedShapePrior
             if (this.Shape != null && this.Shape.Structure != this.ShapeModel.Structure)
                 throw new InvalidOperationException("Specified shape differs in structure from shape model.");
 
-            double segmentationEnergy = this.ImageSegmentator.SegmentImageWithShapeTerms(
-                (x, y) => this.Shape == null ? ObjectBackgroundTerm.Zero : CalculateShapeTerms(new Vector(x, y)));
+            ObjectBackgroundTermPlanes shapeTerms = new ObjectBackgroundTermPlanes(
+                this.ImageSegmentator.ImageSize.Width, this.ImageSegmentator.ImageSize.Height, this.ShapeTermsSaturation);
+            if (this.Shape != null)
+                this.ShapeModel.CalculatePenalties(this.Shape, shapeTerms);
+
+            double segmentationEnergy = this.ImageSegmentator.SegmentImageWithShapeTerms(shapeTerms);
             double shapeEnergy = this.Shape == null ? 0 : this.ShapeModel.CalculateEnergy(this.Shape);
             double totalEnergy = segmentationEnergy + shapeEnergy * this.ShapeEnergyWeight;
             DebugConfiguration.WriteImportantDebugText(
@@ -25,12 +29,5 @@ namespace Research.GraphBasedShapePrior
 
             return new SegmentationSolution(this.Shape, this.ImageSegmentator.GetLastSegmentationMask(), totalEnergy);
         }
-
-        private ObjectBackgroundTerm CalculateShapeTerms(Vector point)
-        {
-            double objectTerm = this.ShapeModel.CalculateObjectPenalty(this.Shape, point);
-            double backgroundTerm = this.ShapeModel.CalculateBackgroundPenalty(this.Shape, point);
-            return new ObjectBackgroundTerm(objectTerm, backgroundTerm);
-        }
     }
 }
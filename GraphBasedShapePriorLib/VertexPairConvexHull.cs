@@ -0,0 +1,196 @@
+﻿using System;
+using System.Diagnostics;
+using Research.GraphBasedShapePrior.Util;
+
+namespace Research.GraphBasedShapePrior
+{
+    /// <summary>
+    /// Convex hull of the union of two vertex constraint boxes.
+    /// Vertices are stored as flat coordinate arrays (x0, y0, x1, y1, ...) in clockwise order, starting from the leftmost one,
+    /// which is the order expected by the native and GPU shape term calculators.
+    /// </summary>
+    public class VertexPairConvexHull
+    {
+        public const int MaxVertexCount = 8;
+
+        // Hull is built in the scratch buffer, which has room for the repeated start point
+        [ThreadStatic]
+        private static double[] scratchCoords;
+
+        private readonly double[] coords;
+
+        private readonly float[] floatCoords;
+
+        private Polygon polygon;
+
+        public VertexPairConvexHull(VertexConstraints constraints1, VertexConstraints constraints2)
+        {
+            if (constraints1 == null)
+                throw new ArgumentNullException("constraints1");
+            if (constraints2 == null)
+                throw new ArgumentNullException("constraints2");
+
+            this.Constraints1 = constraints1;
+            this.Constraints2 = constraints2;
+
+            if (scratchCoords == null)
+                scratchCoords = new double[(MaxVertexCount * 2 + 1) * 2];
+            this.VertexCount = Calculate(constraints1.MinCoord, constraints1.MaxCoord, constraints2.MinCoord, constraints2.MaxCoord, scratchCoords);
+
+            this.coords = new double[this.VertexCount * 2];
+            this.floatCoords = new float[this.VertexCount * 2];
+            for (int i = 0; i < this.coords.Length; ++i)
+            {
+                this.coords[i] = scratchCoords[i];
+                this.floatCoords[i] = (float)scratchCoords[i];
+            }
+        }
+
+        public VertexConstraints Constraints1 { get; private set; }
+
+        public VertexConstraints Constraints2 { get; private set; }
+
+        public int VertexCount { get; private set; }
+
+        public double[] Coords
+        {
+            get { return this.coords; }
+        }
+
+        public float[] FloatCoords
+        {
+            get { return this.floatCoords; }
+        }
+
+        public Polygon Polygon
+        {
+            get
+            {
+                if (this.polygon == null)
+                {
+                    Vector[] vertices = new Vector[this.VertexCount];
+                    for (int i = 0; i < vertices.Length; ++i)
+                        vertices[i] = new Vector(this.coords[i * 2], this.coords[i * 2 + 1]);
+                    this.polygon = Polygon.FromPoints(vertices);
+                }
+
+                return this.polygon;
+            }
+        }
+
+        /// <summary>
+        /// Checks if the hull is built for the given constraints. Constraints are compared by value.
+        /// </summary>
+        public bool IsBuiltFor(VertexConstraints constraints1, VertexConstraints constraints2)
+        {
+            return constraints1 == this.Constraints1 && constraints2 == this.Constraints2;
+        }
+
+        /// <summary>
+        /// Calculates convex hull of two boxes using monotone chain algorithm without allocating any memory.
+        /// </summary>
+        /// <param name="min1">Min corner of the first box.</param>
+        /// <param name="max1">Max corner of the first box.</param>
+        /// <param name="min2">Min corner of the second box.</param>
+        /// <param name="max2">Max corner of the second box.</param>
+        /// <param name="result">Buffer for hull vertex coordinates, should have room for 17 points.</param>
+        /// <returns>Number of hull vertices, duplicate and collinear points are removed.</returns>
+        public static int Calculate(Vector min1, Vector max1, Vector min2, Vector max2, double[] result)
+        {
+            Debug.Assert(result != null && result.Length >= (MaxVertexCount * 2 + 1) * 2);
+
+            // Corners are sorted by x, then by y, in the tail of the buffer, hull grows from its head
+            const int pointOffset = (MaxVertexCount + 1) * 2;
+            int pointCount = 0;
+            InsertPoint(result, pointOffset, ref pointCount, min1.X, min1.Y);
+            InsertPoint(result, pointOffset, ref pointCount, min1.X, max1.Y);
+            InsertPoint(result, pointOffset, ref pointCount, max1.X, max1.Y);
+            InsertPoint(result, pointOffset, ref pointCount, max1.X, min1.Y);
+            InsertPoint(result, pointOffset, ref pointCount, min2.X, min2.Y);
+            InsertPoint(result, pointOffset, ref pointCount, min2.X, max2.Y);
+            InsertPoint(result, pointOffset, ref pointCount, max2.X, max2.Y);
+            InsertPoint(result, pointOffset, ref pointCount, max2.X, min2.Y);
+
+            // Remove duplicates, they are next to each other after sorting
+            int distinctPointCount = 1;
+            for (int i = 1; i < pointCount; ++i)
+            {
+                int pointIndex = pointOffset + i * 2, lastDistinctPointIndex = pointOffset + (distinctPointCount - 1) * 2;
+                if (result[pointIndex] == result[lastDistinctPointIndex] && result[pointIndex + 1] == result[lastDistinctPointIndex + 1])
+                    continue;
+
+                result[lastDistinctPointIndex + 2] = result[pointIndex];
+                result[lastDistinctPointIndex + 3] = result[pointIndex + 1];
+                distinctPointCount += 1;
+            }
+
+            pointCount = distinctPointCount;
+            if (pointCount == 1)
+            {
+                result[0] = result[pointOffset];
+                result[1] = result[pointOffset + 1];
+                return 1;
+            }
+
+            // Lower and upper chains, each point turns counter-clockwise relative to the previous ones
+            int hullCount = 0;
+            for (int i = 0; i < pointCount; ++i)
+                AddHullPoint(result, pointOffset + i * 2, 2, ref hullCount);
+            for (int i = pointCount - 2, lowerChainCount = hullCount + 1; i >= 0; --i)
+                AddHullPoint(result, pointOffset + i * 2, lowerChainCount, ref hullCount);
+
+            // Last point repeats the first one, other points are reversed to get clockwise order
+            hullCount -= 1;
+            for (int i = 1, j = hullCount - 1; i < j; ++i, --j)
+            {
+                Swap(result, i * 2, j * 2);
+                Swap(result, i * 2 + 1, j * 2 + 1);
+            }
+
+            return hullCount;
+        }
+
+        private static void InsertPoint(double[] buffer, int offset, ref int pointCount, double x, double y)
+        {
+            int position = pointCount;
+            while (position > 0)
+            {
+                double prevX = buffer[offset + (position - 1) * 2], prevY = buffer[offset + (position - 1) * 2 + 1];
+                if (prevX < x || (prevX == x && prevY <= y))
+                    break;
+
+                buffer[offset + position * 2] = prevX;
+                buffer[offset + position * 2 + 1] = prevY;
+                position -= 1;
+            }
+
+            buffer[offset + position * 2] = x;
+            buffer[offset + position * 2 + 1] = y;
+            pointCount += 1;
+        }
+
+        private static void AddHullPoint(double[] buffer, int pointIndex, int minHullCount, ref int hullCount)
+        {
+            double x = buffer[pointIndex], y = buffer[pointIndex + 1];
+            while (hullCount >= minHullCount)
+            {
+                double x1 = buffer[(hullCount - 2) * 2], y1 = buffer[(hullCount - 2) * 2 + 1];
+                double x2 = buffer[(hullCount - 1) * 2], y2 = buffer[(hullCount - 1) * 2 + 1];
+                if ((x2 - x1) * (y - y1) - (y2 - y1) * (x - x1) > 0)
+                    break;
+                hullCount -= 1;
+            }
+
+            buffer[hullCount * 2] = x;
+            buffer[hullCount * 2 + 1] = y;
+            hullCount += 1;
+        }
+
+        private static void Swap(double[] buffer, int index1, int index2)
+        {
+            double temp = buffer[index1];
+            buffer[index1] = buffer[index2];
+            buffer[index2] = temp;
+        }
+    }
+}
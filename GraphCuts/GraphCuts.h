@@ -121,6 +121,74 @@ namespace Research
 					graph->add_tweights(node, toSource, toSink);
 				}
 
+				// Bulk version of SetTerminalWeights, weights are given for all pixels in row-major order
+				void SetTerminalWeights(array<double> ^toSource, array<double> ^toSink)
+				{
+					if (toSource == nullptr)
+						throw gcnew ArgumentNullException("toSource");
+					if (toSink == nullptr)
+						throw gcnew ArgumentNullException("toSink");
+					if (toSource->Length != width * height || toSink->Length != width * height)
+						throw gcnew ArgumentException("Weight count should be equal to pixel count.");
+					if (!firstGraphCut)
+						throw gcnew InvalidOperationException("Use UpdateTerminalWeights on consequent iterations.");
+
+					pin_ptr<double> toSourcePinned = &toSource[0];
+					pin_ptr<double> toSinkPinned = &toSink[0];
+					const double *toSourcePtr = toSourcePinned;
+					const double *toSinkPtr = toSinkPinned;
+					for (int node = 0; node < width * height; ++node)
+						graph->add_tweights(node, toSourcePtr[node], toSinkPtr[node]);
+				}
+
+				// Bulk version of UpdateTerminalWeights for the first 'count' pixels with given row-major indices
+				void UpdateTerminalWeights(
+					array<int> ^pixelIndices,
+					array<double> ^toSourceOld,
+					array<double> ^toSinkOld,
+					array<double> ^toSource,
+					array<double> ^toSink,
+					int count)
+				{
+					if (pixelIndices == nullptr || toSourceOld == nullptr || toSinkOld == nullptr || toSource == nullptr || toSink == nullptr)
+						throw gcnew ArgumentNullException();
+					if (count < 0 || count > pixelIndices->Length || count > toSourceOld->Length || count > toSinkOld->Length || count > toSource->Length || count > toSink->Length)
+						throw gcnew ArgumentOutOfRangeException("count");
+					if (firstGraphCut)
+						throw gcnew InvalidOperationException("Use SetTerminalWeights on first iteration.");
+					if (count == 0)
+						return;
+
+					pin_ptr<int> pixelIndicesPinned = &pixelIndices[0];
+					pin_ptr<double> toSourceOldPinned = &toSourceOld[0];
+					pin_ptr<double> toSinkOldPinned = &toSinkOld[0];
+					pin_ptr<double> toSourcePinned = &toSource[0];
+					pin_ptr<double> toSinkPinned = &toSink[0];
+					for (int i = 0; i < count; ++i)
+					{
+						int node = pixelIndicesPinned[i];
+						if (node < 0 || node >= width * height)
+							throw gcnew ArgumentOutOfRangeException("pixelIndices");
+						
+						double oldCapacity = toSourceOldPinned[i] - toSinkOldPinned[i];
+						double toSourceDelta = toSourcePinned[i], toSinkDelta = toSinkPinned[i];
+						if (oldCapacity > 0)
+						{
+							toSinkDelta += oldCapacity - toSinkOldPinned[i];
+							toSourceDelta += -toSinkOldPinned[i];
+						}
+						else
+						{
+							toSourceDelta += -oldCapacity - toSourceOldPinned[i];
+							toSinkDelta += -toSourceOldPinned[i];
+						}
+						graph->add_tweights(node, toSourceDelta, toSinkDelta);
+						graph->mark_node(node);
+					}
+
+					dirty = true;
+				}
+
 				void SetNeighborWeights(int x, int y, Neighbor neighbor, double weight)
 				{
 					if (!firstGraphCut)
@@ -0,0 +1,169 @@
+#pragma once
+
+using namespace System;
+using namespace System::Collections::Generic;
+using namespace System::Threading;
+
+public enum class ReportDropPolicy {
+	Block,
+	DropNewest,
+	DropOldest
+};
+
+public ref class LearningReport abstract {
+public:
+	// Reports that can't be dropped are always queued, waiting for free space if needed
+	virtual property bool CanBeDropped {
+		bool get() { return true; }
+	}
+
+	virtual void Write() = 0;
+};
+
+// Writes reports on a background thread, so that training threads only have to enqueue them
+public ref class LearningReportWriter {
+private:
+	LinkedList<LearningReport^> ^queue;
+	int capacity;
+	ReportDropPolicy dropPolicy;
+	bool isWriting;
+	bool isClosing;
+	int droppedReportCount;
+	Thread ^writerThread;
+
+	void WriterLoop() {
+		for (;;) {
+			LearningReport ^report;
+
+			Monitor::Enter(queue);
+			try {
+				while (queue->Count == 0 && !isClosing)
+					Monitor::Wait(queue);
+				if (queue->Count == 0)
+					return;
+				report = queue->First->Value;
+				queue->RemoveFirst();
+				isWriting = true;
+				Monitor::PulseAll(queue);
+			} finally {
+				Monitor::Exit(queue);
+			}
+
+			try {
+				report->Write();
+			} catch (Exception ^e) {
+				Console::WriteLine("Failed to write learning report: {0}", e->Message);
+			}
+
+			Monitor::Enter(queue);
+			try {
+				isWriting = false;
+				Monitor::PulseAll(queue);
+			} finally {
+				Monitor::Exit(queue);
+			}
+		}
+	}
+
+	bool TryDropOldest() {
+		for (LinkedListNode<LearningReport^> ^node = queue->First; node != nullptr; node = node->Next) {
+			if (node->Value->CanBeDropped) {
+				queue->Remove(node);
+				++droppedReportCount;
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+public:
+	LearningReportWriter(int capacity, ReportDropPolicy dropPolicy) {
+		if (capacity <= 0)
+			throw gcnew ArgumentOutOfRangeException("capacity", "Parameter value should be positive.");
+		if (!Enum::IsDefined(ReportDropPolicy::typeid, dropPolicy))
+			throw gcnew ArgumentOutOfRangeException("dropPolicy", "Unknown report drop policy.");
+
+		this->queue = gcnew LinkedList<LearningReport^>();
+		this->capacity = capacity;
+		this->dropPolicy = dropPolicy;
+		this->isWriting = false;
+		this->isClosing = false;
+		this->droppedReportCount = 0;
+
+		this->writerThread = gcnew Thread(gcnew ThreadStart(this, &LearningReportWriter::WriterLoop));
+		this->writerThread->IsBackground = true;
+		this->writerThread->Name = "Learning report writer";
+		this->writerThread->Start();
+	}
+
+	property int Capacity {
+		int get() { return capacity; }
+	}
+
+	property ReportDropPolicy DropPolicy {
+		ReportDropPolicy get() { return dropPolicy; }
+	}
+
+	property int DroppedReportCount {
+		int get() {
+			Monitor::Enter(queue);
+			try {
+				return droppedReportCount;
+			} finally {
+				Monitor::Exit(queue);
+			}
+		}
+	}
+
+	void Enqueue(LearningReport ^report) {
+		if (report == nullptr)
+			throw gcnew ArgumentNullException("report");
+
+		Monitor::Enter(queue);
+		try {
+			if (isClosing)
+				throw gcnew InvalidOperationException("Report writer is closed.");
+			if (queue->Count >= capacity && report->CanBeDropped) {
+				if (dropPolicy == ReportDropPolicy::DropNewest) {
+					++droppedReportCount;
+					return;
+				}
+				if (dropPolicy == ReportDropPolicy::DropOldest)
+					TryDropOldest();
+			}
+
+			while (queue->Count >= capacity)
+				Monitor::Wait(queue);
+
+			queue->AddLast(report);
+			Monitor::PulseAll(queue);
+		} finally {
+			Monitor::Exit(queue);
+		}
+	}
+
+	// Waits until every queued report is written
+	void Flush() {
+		Monitor::Enter(queue);
+		try {
+			while (queue->Count > 0 || isWriting)
+				Monitor::Wait(queue);
+		} finally {
+			Monitor::Exit(queue);
+		}
+	}
+
+	// Writes every queued report and stops the writer thread
+	void Close() {
+		Monitor::Enter(queue);
+		try {
+			isClosing = true;
+			Monitor::PulseAll(queue);
+		} finally {
+			Monitor::Exit(queue);
+		}
+
+		writerThread->Join();
+	}
+};
@@ -1,5 +1,7 @@
 #pragma once
 
+#include "LearningReportWriter.h"
+
 using namespace System;
 using namespace System::Drawing;
 using namespace System::Diagnostics;
@@ -54,31 +56,198 @@ private:
 		graphics->DrawPolygon(pen, points);
     }
 
-	static void ReportDoubleValue(String ^fileName, double value) {
-		FileStream ^stream = gcnew FileStream(Path::Combine(loggingDir, fileName), FileMode::Append);
-		StreamWriter ^writer = gcnew StreamWriter(stream);
-		writer->WriteLine("{0:000}\t{1:0000}\t{2:0.0000}", outerIteration, innerIteration, value);
+	static LearningReportWriter ^reportWriter;
+	static int reportSampleRate;
+	static bool writeRawReports;
+
+	static void SaveMaskAsPbm(Mask2D ^mask, String ^fileName) {
+		FileStream ^stream = gcnew FileStream(fileName, FileMode::Create);
+		BinaryWriter ^writer = gcnew BinaryWriter(stream);
+		writer->Write(Encoding::ASCII->GetBytes(String::Format("P4\n{0} {1}\n", mask->Width, mask->Height)));
+		array<unsigned char> ^row = gcnew array<unsigned char>((mask->Width + 7) / 8);
+		for (int y = 0; y < mask->Height; ++y) {
+			Array::Clear(row, 0, row->Length);
+			for (int x = 0; x < mask->Width; ++x) {
+				if (mask[x, y])
+					row[x / 8] |= static_cast<unsigned char>(0x80 >> (x % 8));
+			}
+			writer->Write(row);
+		}
 		writer->Close();
 	}
 
+	static bool IsSampleReported(int sampleIndex) {
+		return sampleIndex % reportSampleRate == 0;
+	}
+
+	ref class TextReport : LearningReport {
+	private:
+		String ^fileName;
+		String ^line;
+
+	public:
+		TextReport(String ^fileName, String ^line) {
+			this->fileName = fileName;
+			this->line = line;
+		}
+
+		virtual property bool CanBeDropped {
+			bool get() override { return false; }
+		}
+
+		virtual void Write() override {
+			FileStream ^stream = gcnew FileStream(Path::Combine(loggingDir, fileName), FileMode::Append);
+			StreamWriter ^writer = gcnew StreamWriter(stream);
+			writer->WriteLine(line);
+			writer->Close();
+		}
+	};
+
+	ref class InferredLatentVariablesReport : LearningReport {
+	private:
+		int outerIteration;
+		int sampleIndex;
+		Mask2D ^mask;
+		bool writeRaw;
+
+	public:
+		InferredLatentVariablesReport(int outerIteration, int sampleIndex, Mask2D ^mask, bool writeRaw) {
+			this->outerIteration = outerIteration;
+			this->sampleIndex = sampleIndex;
+			this->mask = mask;
+			this->writeRaw = writeRaw;
+		}
+
+		virtual void Write() override {
+			if (writeRaw) {
+				String ^fileName = String::Format("latent_{0:000}_{1:000}.pbm", outerIteration, sampleIndex);
+				SaveMaskAsPbm(mask, Path::Combine(loggingDir, fileName));
+				return;
+			}
+
+			Bitmap ^canvas = gcnew Bitmap(mask->Width, mask->Height);
+			Graphics ^graphics = Graphics::FromImage(canvas);
+			graphics->DrawImage(Image2D::ToRegularImage(mask), 0, 0, canvas->Width, canvas->Height);
+
+			String ^fileName = String::Format("latent_{0:000}_{1:000}.png", outerIteration, sampleIndex);
+			Image2D::SaveToFile(Image2D::FromRegularImage(canvas), Path::Combine(loggingDir, fileName));
+		}
+	};
+
+	ref class GroundTruthReport : LearningReport {
+	private:
+		int sampleIndex;
+		Image2D<Color> ^image;
+		Shape ^trueShape;
+		Image2D<ObjectBackgroundTerm> ^colorTerms;
+		Image2D<ObjectBackgroundTerm> ^shapeTerms;
+		Image2D<double> ^horizontalPairwiseTerms;
+
+	public:
+		GroundTruthReport(
+			int sampleIndex,
+			Image2D<Color> ^image,
+			Shape ^trueShape,
+			Image2D<ObjectBackgroundTerm> ^colorTerms,
+			Image2D<ObjectBackgroundTerm> ^shapeTerms,
+			Image2D<double> ^horizontalPairwiseTerms)
+		{
+			this->sampleIndex = sampleIndex;
+			this->image = image;
+			this->trueShape = trueShape;
+			this->colorTerms = colorTerms;
+			this->shapeTerms = shapeTerms;
+			this->horizontalPairwiseTerms = horizontalPairwiseTerms;
+		}
+
+		virtual void Write() override {
+			Bitmap ^canvas = gcnew Bitmap(image->Width, image->Height);
+			Graphics ^graphics = Graphics::FromImage(canvas);
+			graphics->DrawImage(Image2D::ToRegularImage(image), 0, 0, image->Width, image->Height);
+			DrawShape(graphics, Color::Blue, trueShape);
+
+			Image2D::SaveToFile(Image2D::FromRegularImage(canvas), Path::Combine(loggingDir, String::Format("ground_truth_{0:000}.png", sampleIndex)));
+			Image2D::SaveToFile(colorTerms, -4, 4, Path::Combine(loggingDir, String::Format("ground_truth_color_{0:000}.png", sampleIndex)));
+			Image2D::SaveToFile(shapeTerms, -4, 4, Path::Combine(loggingDir, String::Format("ground_truth_shape_{0:000}.png", sampleIndex)));
+			Image2D::SaveToFile(horizontalPairwiseTerms, Path::Combine(loggingDir, String::Format("ground_truth_pairwise_h_{0:000}.png", sampleIndex)));
+		}
+	};
+
+	ref class MostViolatedConstraintReport : LearningReport {
+	private:
+		int outerIteration;
+		int innerIteration;
+		int sampleIndex;
+		Image2D<Color> ^image;
+		Shape ^foundShape;
+		Mask2D ^foundMask;
+		bool writeRaw;
+
+	public:
+		MostViolatedConstraintReport(
+			int outerIteration, int innerIteration, int sampleIndex, Image2D<Color> ^image, Shape ^foundShape, Mask2D ^foundMask, bool writeRaw)
+		{
+			this->outerIteration = outerIteration;
+			this->innerIteration = innerIteration;
+			this->sampleIndex = sampleIndex;
+			this->image = image;
+			this->foundShape = foundShape;
+			this->foundMask = foundMask;
+			this->writeRaw = writeRaw;
+		}
+
+		virtual void Write() override {
+			if (writeRaw) {
+				String ^shapeFileName = String::Format("constraint_{0:000}_{1:0000}_{2:000}.shp", outerIteration, innerIteration, sampleIndex);
+				foundShape->SaveToFile(Path::Combine(loggingDir, shapeFileName));
+				String ^maskFileName = String::Format("constraint_mask_{0:000}_{1:0000}_{2:000}.pbm", outerIteration, innerIteration, sampleIndex);
+				SaveMaskAsPbm(foundMask, Path::Combine(loggingDir, maskFileName));
+				return;
+			}
+
+			// Draw desired shape vs found shape
+			{
+				Bitmap ^imageCanvas = gcnew Bitmap(image->Width, image->Height);
+				Graphics ^imageGraphics = Graphics::FromImage(imageCanvas);
+				imageGraphics->DrawImage(Image2D::ToRegularImage(image), 0, 0, imageCanvas->Width, imageCanvas->Height);
+				DrawShape(imageGraphics, Color::Red, foundShape);
+
+				String ^imageFileName = String::Format("constraint_{0:000}_{1:0000}_{2:000}.png", outerIteration, innerIteration, sampleIndex);
+				Image2D::SaveToFile(Image2D::FromRegularImage(imageCanvas), Path::Combine(loggingDir, imageFileName));
+			}
+
+			// Draw found mask & shape
+			{
+				Bitmap ^maskCanvas = gcnew Bitmap(foundMask->Width, foundMask->Height);
+				Graphics ^maskGraphics = Graphics::FromImage(maskCanvas);
+				maskGraphics->DrawImage(Image2D::ToRegularImage(foundMask), 0, 0, maskCanvas->Width, maskCanvas->Height);
+				DrawShape(maskGraphics, Color::Red, foundShape);
+
+				String ^maskFileName = String::Format("constraint_mask_{0:000}_{1:0000}_{2:000}.png", outerIteration, innerIteration, sampleIndex);
+				Image2D::SaveToFile(Image2D::FromRegularImage(maskCanvas), Path::Combine(loggingDir, maskFileName));
+			}
+		}
+	};
+
+	static void ReportDoubleValue(String ^fileName, double value) {
+		reportWriter->Enqueue(gcnew TextReport(
+			fileName, String::Format("{0:000}\t{1:0000}\t{2:0.0000}", outerIteration, innerIteration, value)));
+	}
+
 	static void ReportDoubleValueArray(String ^fileName, array<double> ^values) {
-		FileStream ^stream = gcnew FileStream(Path::Combine(loggingDir, fileName), FileMode::Append);
-		StreamWriter ^writer = gcnew StreamWriter(stream);
-		writer->Write("{0:000}\t{1:0000}", outerIteration, innerIteration);
+		StringBuilder ^line = gcnew StringBuilder();
+		line->AppendFormat("{0:000}\t{1:0000}", outerIteration, innerIteration);
 		for (int i = 0; i < values->Length; ++i)
-			writer->Write("\t{0:0.0000}", values[i]);
-		writer->WriteLine();
-		writer->Close();
+			line->AppendFormat("\t{0:0.0000}", values[i]);
+		reportWriter->Enqueue(gcnew TextReport(fileName, line->ToString()));
 	}
 
 	static void ReportPerSampleDoubleValueArray(String ^fileName, int sample, array<double> ^values) {
-		FileStream ^stream = gcnew FileStream(Path::Combine(loggingDir, fileName), FileMode::Append);
-		StreamWriter ^writer = gcnew StreamWriter(stream);
-		writer->Write("{0:000}\t{1:0000}\t{2}", outerIteration, innerIteration, sample);
+		StringBuilder ^line = gcnew StringBuilder();
+		line->AppendFormat("{0:000}\t{1:0000}\t{2}", outerIteration, innerIteration, sample);
 		for (int i = 0; i < values->Length; ++i)
-			writer->Write("\t{0:0.0000}", values[i]);
-		writer->WriteLine();
-		writer->Close();
+			line->AppendFormat("\t{0:0.0000}", values[i]);
+		reportWriter->Enqueue(gcnew TextReport(fileName, line->ToString()));
 	}
 
 public:
@@ -91,6 +260,29 @@ public:
 		if (Directory::Exists(loggingDir))
 			Directory::Delete(loggingDir, true);
 		Directory::CreateDirectory(loggingDir);
+
+		reportWriter = gcnew LearningReportWriter(64, ReportDropPolicy::Block);
+		reportSampleRate = 1;
+		writeRawReports = false;
+	}
+
+	// Image reports are written only for every reportSampleRate-th sample.
+	// Raw reports store masks as PBM and shapes as serialized objects instead of rendering them.
+	static void ConfigureReports(int queueCapacity, ReportDropPolicy dropPolicy, int sampleRate, bool writeRaw) {
+		if (sampleRate <= 0)
+			throw gcnew ArgumentOutOfRangeException("sampleRate", "Parameter value should be positive.");
+
+		LearningReportWriter ^newReportWriter = gcnew LearningReportWriter(queueCapacity, dropPolicy);
+		reportWriter->Close();
+		reportWriter = newReportWriter;
+		reportSampleRate = sampleRate;
+		writeRawReports = writeRaw;
+	}
+
+	static void Flush() {
+		reportWriter->Flush();
+		if (reportWriter->DroppedReportCount > 0)
+			Console::WriteLine("{0} learning reports were dropped.", reportWriter->DroppedReportCount);
 	}
 
 	static void NextOuterIteration() {
@@ -124,13 +316,10 @@ public:
 		ReportDoubleValue("upper_bound.txt", value);
 	}
 
-	static void ReportInferredLatentVariables(int sampleIndex, Shape ^desiredShape, Image2D<bool> ^mask) {
-		Bitmap ^canvas = gcnew Bitmap(mask->Width, mask->Height);
-        Graphics ^graphics = Graphics::FromImage(canvas);
-		graphics->DrawImage(Image2D::ToRegularImage(mask), 0, 0, canvas->Width, canvas->Height);
-
-		String ^fileName = String::Format("latent_{0:000}_{1:000}.png", outerIteration, sampleIndex);
-		Image2D::SaveToFile(Image2D::FromRegularImage(canvas), Path::Combine(loggingDir, fileName));
+	static void ReportInferredLatentVariables(int sampleIndex, Shape ^desiredShape, Mask2D ^mask) {
+		if (!IsSampleReported(sampleIndex))
+			return;
+		reportWriter->Enqueue(gcnew InferredLatentVariablesReport(outerIteration, sampleIndex, mask->Clone(), writeRawReports));
 	}
 
 	static void ReportGroundTruth(
@@ -141,39 +330,16 @@ public:
 		Image2D<ObjectBackgroundTerm> ^shapeTerms,
 		Image2D<double> ^horizontalPairwiseTerms)
 	{
-		Bitmap ^canvas = gcnew Bitmap(image->Width, image->Height);
-		Graphics ^graphics = Graphics::FromImage(canvas);
-		graphics->DrawImage(Image2D::ToRegularImage(image), 0, 0, image->Width, image->Height);
-		DrawShape(graphics, Color::Blue, trueShape);
-		
-		Image2D::SaveToFile(Image2D::FromRegularImage(canvas), Path::Combine(loggingDir, String::Format("ground_truth_{0:000}.png", sampleIndex)));
-		Image2D::SaveToFile(colorTerms, -4, 4, Path::Combine(loggingDir, String::Format("ground_truth_color_{0:000}.png", sampleIndex)));
-		Image2D::SaveToFile(shapeTerms, -4, 4, Path::Combine(loggingDir, String::Format("ground_truth_shape_{0:000}.png", sampleIndex)));
-		Image2D::SaveToFile(horizontalPairwiseTerms, Path::Combine(loggingDir, String::Format("ground_truth_pairwise_h_{0:000}.png", sampleIndex)));
+		if (!IsSampleReported(sampleIndex))
+			return;
+		reportWriter->Enqueue(gcnew GroundTruthReport(sampleIndex, image, trueShape, colorTerms, shapeTerms, horizontalPairwiseTerms));
 	}
 	
-	static void ReportMostViolatedConstraint(int sampleIndex, Image2D<Color> ^image, Shape ^desiredShape, Shape ^foundShape, Image2D<bool> ^foundMask)
+	static void ReportMostViolatedConstraint(int sampleIndex, Image2D<Color> ^image, Shape ^desiredShape, Shape ^foundShape, Mask2D ^foundMask)
 	{
-		// Draw desired shape vs found shape
-		{
-			Bitmap ^imageCanvas = gcnew Bitmap(image->Width, image->Height);
-			Graphics ^imageGraphics = Graphics::FromImage(imageCanvas);
-			imageGraphics->DrawImage(Image2D::ToRegularImage(image), 0, 0, imageCanvas->Width, imageCanvas->Height);
-			DrawShape(imageGraphics, Color::Red, foundShape);
-
-			String ^imageFileName = String::Format("constraint_{0:000}_{1:0000}_{2:000}.png", outerIteration, innerIteration, sampleIndex);
-			Image2D::SaveToFile(Image2D::FromRegularImage(imageCanvas), Path::Combine(loggingDir, imageFileName));
-		}
-
-		// Draw found mask & shape
-		{
-			Bitmap ^maskCanvas = gcnew Bitmap(foundMask->Width, foundMask->Height);
-			Graphics ^maskGraphics = Graphics::FromImage(maskCanvas);
-			maskGraphics->DrawImage(Image2D::ToRegularImage(foundMask), 0, 0, maskCanvas->Width, maskCanvas->Height);
-			DrawShape(maskGraphics, Color::Red, foundShape);
-
-			String ^maskFileName = String::Format("constraint_mask_{0:000}_{1:0000}_{2:000}.png", outerIteration, innerIteration, sampleIndex);
-			Image2D::SaveToFile(Image2D::FromRegularImage(maskCanvas), Path::Combine(loggingDir, maskFileName));
-		}
+		if (!IsSampleReported(sampleIndex))
+			return;
+		reportWriter->Enqueue(gcnew MostViolatedConstraintReport(
+			outerIteration, innerIteration, sampleIndex, image, foundShape, foundMask->Clone(), writeRawReports));
 	}
 };
\ No newline at end of file
@@ -195,21 +195,12 @@ public:
 	}
 };
 
-ref class ShapeTermsCalcer {
-private:
-	Shape ^shape;
-	ShapeModel ^shapeModel;
-
-public:
-	ShapeTermsCalcer(Shape ^shape, ShapeModel ^shapeModel) {
-		this->shape = shape;
-		this->shapeModel = shapeModel;
-	}
-
-	ObjectBackgroundTerm Calc(int x, int y) {
-		return shapeModel->CalculatePenalties(shape, Vector(x, y));
-	}
-};
+ObjectBackgroundTermPlanes^ calc_shape_terms(Shape ^shape, ShapeModel ^shapeModel, Size imageSize) {
+	// Features are sums of shape terms, so they should not be affected by saturation
+	ObjectBackgroundTermPlanes ^shapeTerms = gcnew ObjectBackgroundTermPlanes(imageSize.Width, imageSize.Height);
+	shapeModel->CalculatePenalties(shape, shapeTerms);
+	return shapeTerms;
+}
 
 SAMPLE read_struct_examples(char *file, STRUCT_LEARN_PARM *sparm) {
 	array<String^>^ lines = File::ReadAllLines(gcnew String(file));
@@ -239,7 +230,7 @@ SAMPLE read_struct_examples(char *file, STRUCT_LEARN_PARM *sparm) {
 			sparm->color_models,
 			COLOR_DIFFERENCE_CUTOFF,
 			1, 1, 1, 1, 1, 1);
-		segmentator->SegmentImageWithShapeTerms(gcnew Func<int, int, ObjectBackgroundTerm>(gcnew ShapeTermsCalcer(shapes[i], sparm->shape_model), &ShapeTermsCalcer::Calc));
+		segmentator->SegmentImageWithShapeTerms(calc_shape_terms(shapes[i], sparm->shape_model, segmentator->ImageSize));
 		LearningTracker::ReportGroundTruth(i, images[i], shapes[i], segmentator->GetColorTerms(), segmentator->GetLastShapeTerms(), segmentator->GetHorizontalColorDifferencePairwiseTerms());
 	}
 
@@ -285,7 +276,7 @@ SVECTOR *psi(PATTERN x, LABEL y, LATENT_VAR h, STRUCTMODEL *sm, STRUCT_LEARN_PAR
 		sparm->color_models,
 		COLOR_DIFFERENCE_CUTOFF,
 		1, 1, 1, 1, 1, 1);
-	segmentator->SegmentImageWithShapeTerms(gcnew Func<int, int, ObjectBackgroundTerm>(gcnew ShapeTermsCalcer(y.shape, sparm->shape_model), &ShapeTermsCalcer::Calc));
+	segmentator->SegmentImageWithShapeTerms(calc_shape_terms(y.shape, sparm->shape_model, segmentator->ImageSize));
 	
 	ImageSegmentationFeatures ^features = segmentator->ExtractSegmentationFeaturesForMask(h.mask);
 
@@ -436,5 +427,28 @@ void free_struct_sample(SAMPLE s) {
 }
 
 void parse_struct_parameters(STRUCT_LEARN_PARM *sparm) {
+	int reportQueueCapacity = 64;
+	ReportDropPolicy reportDropPolicy = ReportDropPolicy::Block;
+	int reportSampleRate = 1;
+	bool writeRawReports = false;
+
+	for (int i = 0; (i < sparm->custom_argc) && ((sparm->custom_argv[i])[0] == '-'); i++) {
+		switch ((sparm->custom_argv[i])[2]) {
+			case 'q': i++; reportQueueCapacity = atoi(sparm->custom_argv[i]); break;
+			case 'd':
+				i++;
+				reportDropPolicy = static_cast<ReportDropPolicy>(atoi(sparm->custom_argv[i]));
+				if (!Enum::IsDefined(ReportDropPolicy::typeid, reportDropPolicy)) {
+					printf("\nInvalid report drop policy %s!\n\n", sparm->custom_argv[i]);
+					exit(0);
+				}
+				break;
+			case 's': i++; reportSampleRate = atoi(sparm->custom_argv[i]); break;
+			case 'r': i++; writeRawReports = atoi(sparm->custom_argv[i]) != 0; break;
+			default: printf("\nUnrecognized option %s!\n\n", sparm->custom_argv[i]); exit(0);
+		}
+	}
+
+	LearningTracker::ConfigureReports(reportQueueCapacity, reportDropPolicy, reportSampleRate, writeRawReports);
 }
 
@@ -40,7 +40,7 @@ typedef struct label {
 } LABEL;
 
 typedef struct latent_var {
-  gcroot<Research::GraphBasedShapePrior::Util::Image2D<bool>^> mask;
+  gcroot<Research::GraphBasedShapePrior::Util::Mask2D^> mask;
 } LATENT_VAR;
 
 typedef struct example {
@@ -675,6 +675,7 @@ int main(int argc, char* argv[]) {
 
   /* write structural model */
   write_struct_model(modelfile, &sm, &sparm);
+  LearningTracker::Flush();
   // skip testing for the moment  
 
   /* free memory */
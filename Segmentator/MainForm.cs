@@ -114,6 +114,14 @@ namespace Segmentator
 
             ShapeEnergyLowerBoundCalculator shapeEnergyCalculator;
             algorithm.ProgressReportRate = this.segmentationProperties.BranchAndBoundReportRate;
+            algorithm.WorkerCount = this.segmentationProperties.BranchAndBoundWorkerCount;
+            algorithm.CoarseShapeTermsCalculatorFactory = () => new CoarseShapeTermsLowerBoundCalculator();
+            algorithm.FrontMemoryBudget = this.segmentationProperties.BranchAndBoundFrontMemoryBudgetMb * 1024L * 1024L;
+            algorithm.CheckpointPath = String.IsNullOrEmpty(this.segmentationProperties.BranchAndBoundCheckpoint)
+                ? null
+                : this.segmentationProperties.BranchAndBoundCheckpoint;
+            algorithm.CheckpointInterval = TimeSpan.FromMinutes(this.segmentationProperties.BranchAndBoundCheckpointIntervalMinutes);
+            algorithm.ResumeCheckpointPath = this.segmentationProperties.ResumeBranchAndBoundFromCheckpoint ? algorithm.CheckpointPath : null;
             algorithm.MinEdgeWidth = this.segmentationProperties.MinEdgeWidth;
             algorithm.MaxEdgeWidth = this.segmentationProperties.MaxEdgeWidth;
             if (this.segmentationProperties.UseTwoStepApproach)
@@ -122,6 +130,8 @@ namespace Segmentator
                 algorithm.MaxWidthFreedom = this.segmentationProperties.MaxWidthFreedomPre;
                 shapeEnergyCalculator = new ShapeEnergyLowerBoundCalculator(
                     this.segmentationProperties.LengthGridSizePre, this.segmentationProperties.AngleGridSizePre);
+                algorithm.ShapeEnergyLowerBoundCalculatorFactory = CreateShapeEnergyCalculatorFactory(
+                    this.segmentationProperties.LengthGridSizePre, this.segmentationProperties.AngleGridSizePre);
             }
             else
             {
@@ -129,10 +139,17 @@ namespace Segmentator
                 algorithm.MaxWidthFreedom = this.segmentationProperties.MaxWidthFreedom;
                 shapeEnergyCalculator = new ShapeEnergyLowerBoundCalculator(
                     this.segmentationProperties.LengthGridSize, this.segmentationProperties.AngleGridSize);
+                algorithm.ShapeEnergyLowerBoundCalculatorFactory = CreateShapeEnergyCalculatorFactory(
+                    this.segmentationProperties.LengthGridSize, this.segmentationProperties.AngleGridSize);
             }
             algorithm.ShapeEnergyLowerBoundCalculator = shapeEnergyCalculator;
         }
 
+        private static Func<IShapeEnergyLowerBoundCalculator> CreateShapeEnergyCalculatorFactory(int lengthGridSize, int angleGridSize)
+        {
+            return () => new ShapeEnergyLowerBoundCalculator(lengthGridSize, angleGridSize);
+        }
+
         private void SetupCoordinateDescentSegmentationAlgorithm(CoordinateDescentSegmentationAlgorithm algorithm)
         {
             algorithm.MinIterationCount = this.segmentationProperties.MinDescentIterations;
@@ -245,8 +262,11 @@ namespace Segmentator
                 branchAndBoundSegmentator.MaxCoordFreedom = this.segmentationProperties.MaxCoordFreedom;
                 branchAndBoundSegmentator.MaxWidthFreedom = this.segmentationProperties.MaxWidthFreedom;
                 branchAndBoundSegmentator.StartConstraints = this.bestConstraints;
+                branchAndBoundSegmentator.ResumeCheckpointPath = null;
                 branchAndBoundSegmentator.ShapeEnergyLowerBoundCalculator = new ShapeEnergyLowerBoundCalculator(
                     this.segmentationProperties.LengthGridSize, this.segmentationProperties.AngleGridSize);
+                branchAndBoundSegmentator.ShapeEnergyLowerBoundCalculatorFactory = CreateShapeEnergyCalculatorFactory(
+                    this.segmentationProperties.LengthGridSize, this.segmentationProperties.AngleGridSize);
 
                 Console.WriteLine("Performing second pass...");
                 solution = segmentator.SegmentImage(downscaledImage, colorModels);
@@ -376,6 +396,7 @@ namespace Segmentator
             {
                 BranchAndBoundSegmentationAlgorithm branchAndBoundSegmentator = new BranchAndBoundSegmentationAlgorithm();
                 branchAndBoundSegmentator.ShapeTermCalculator = new GpuShapeTermsLowerBoundCalculator();
+                branchAndBoundSegmentator.ShapeTermsCalculatorFactory = () => new GpuShapeTermsLowerBoundCalculator();
                 this.segmentator = branchAndBoundSegmentator;
                 this.RunSegmentation();
             }
@@ -392,7 +413,11 @@ namespace Segmentator
         private void OnStartCpuButtonClick(object sender, EventArgs e)
         {
             if (this.segmentationProperties.Algorithm == SegmentationAlgorithm.BranchAndBound)
-                this.segmentator = new BranchAndBoundSegmentationAlgorithm();
+            {
+                BranchAndBoundSegmentationAlgorithm branchAndBoundSegmentator = new BranchAndBoundSegmentationAlgorithm();
+                branchAndBoundSegmentator.ShapeTermsCalculatorFactory = () => new CpuShapeTermsLowerBoundCalculator();
+                this.segmentator = branchAndBoundSegmentator;
+            }
             else if (this.segmentationProperties.Algorithm == SegmentationAlgorithm.CoordinateDescent)
                 this.segmentator = new CoordinateDescentSegmentationAlgorithm();
             else if (this.segmentationProperties.Algorithm == SegmentationAlgorithm.Annealing)
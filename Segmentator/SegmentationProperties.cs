@@ -73,6 +73,27 @@ namespace Segmentator
         [DisplayName("Report rate")]
         public int BranchAndBoundReportRate { get; set; }
 
+        [Category("Branch-and-bound")]
+        [DisplayName("Worker count")]
+        public int BranchAndBoundWorkerCount { get; set; }
+
+        [Category("Branch-and-bound")]
+        [DisplayName("Front memory budget (MB)")]
+        public int BranchAndBoundFrontMemoryBudgetMb { get; set; }
+
+        [Category("Branch-and-bound")]
+        [DisplayName("Checkpoint file")]
+        [Editor(typeof(FileNameEditor), typeof(UITypeEditor))]
+        public string BranchAndBoundCheckpoint { get; set; }
+
+        [Category("Branch-and-bound")]
+        [DisplayName("Checkpoint interval (min)")]
+        public double BranchAndBoundCheckpointIntervalMinutes { get; set; }
+
+        [Category("Branch-and-bound")]
+        [DisplayName("Resume from checkpoint")]
+        public bool ResumeBranchAndBoundFromCheckpoint { get; set; }
+
         [Category("Branch-and-bound")]
         [DisplayName("Max coord freedom on pre-step")]
         public double MaxCoordFreedomPre { get; set; }
@@ -255,6 +276,9 @@ namespace Segmentator
             this.MaxEdgeWidth = 15;
             this.UseTwoStepApproach = true;
             this.BranchAndBoundReportRate = 500;
+            this.BranchAndBoundWorkerCount = 1;
+            this.BranchAndBoundFrontMemoryBudgetMb = 1024;
+            this.BranchAndBoundCheckpointIntervalMinutes = 10;
             this.MaxCoordFreedom = 4;
             this.MaxCoordFreedomPre = 20;
             this.MaxWidthFreedom = 4;
@@ -376,7 +376,7 @@ namespace Research.GraphBasedShapePrior.ShapeModelLearning
             SegmentationSolution result = segmentator.SegmentImage(image, this.colorModels);
             Image2D.SaveToFile(result.Mask, "mask.png");
             BitmapSource maskImage = ImageHelper.ResizeImage(
-                ImageHelper.MaskToBitmapSource(result.Mask), originalImage.PixelWidth, originalImage.PixelHeight);
+                ImageHelper.MaskToBitmapSource(result.Mask.ToImage()), originalImage.PixelWidth, originalImage.PixelHeight);
             this.imageInfos[selectedIndex].SegmentationMask = maskImage;
 
             // Show results
@@ -0,0 +1,316 @@
+﻿using System;
+using System.Drawing;
+using System.IO;
+using Microsoft.VisualStudio.TestTools.UnitTesting;
+using Research.GraphBasedShapePrior.Util;
+
+namespace Research.GraphBasedShapePrior.Tests
+{
+    [TestClass]
+    public class BranchAndBoundTests
+    {
+        private const double EnergyTolerance = 1e-6;
+
+        private class BrightnessColorModel : IColorModel
+        {
+            private readonly bool isBright;
+
+            public BrightnessColorModel(bool isBright)
+            {
+                this.isBright = isBright;
+            }
+
+            public double LogProb(Color color)
+            {
+                double brightness = color.GetBrightness();
+                return Math.Log(this.isBright ? 0.05 + 0.9 * brightness : 0.95 - 0.9 * brightness);
+            }
+        }
+
+        private class FailingShapeEnergyLowerBoundCalculator : IShapeEnergyLowerBoundCalculator
+        {
+            public double CalculateLowerBound(Size imageSize, ShapeModel model, ShapeConstraints shapeConstraints)
+            {
+                throw new InvalidOperationException("Worker failure.");
+            }
+        }
+
+        private static Image2D<Color> CreateBarImage(int width, int height)
+        {
+            // Thick bright segment on a dark background with some deterministic noise
+            Image2D<Color> image = new Image2D<Color>(width, height);
+            for (int x = 0; x < width; ++x)
+                for (int y = 0; y < height; ++y)
+                {
+                    double distanceSqr = new Vector(x, y).DistanceToSegmentSquared(new Vector(8, 8), new Vector(30, 20));
+                    int intensity = (distanceSqr < 9 ? 220 : 30) + (x * 7 + y * 13) % 11 - 5;
+                    image[x, y] = Color.FromArgb(intensity, intensity, intensity);
+                }
+
+            return image;
+        }
+
+        private static ObjectBackgroundColorModels CreateBarColorModels()
+        {
+            return new ObjectBackgroundColorModels(new BrightnessColorModel(true), new BrightnessColorModel(false));
+        }
+
+        private static BranchAndBoundSegmentationAlgorithm CreateAlgorithm(int workerCount, bool useDiving)
+        {
+            return CreateAlgorithm(TestHelper.CreateTestShapeModelWith1Edge(), workerCount, useDiving);
+        }
+
+        private static BranchAndBoundSegmentationAlgorithm CreateAlgorithm(ShapeModel shapeModel, int workerCount, bool useDiving)
+        {
+            BranchAndBoundSegmentationAlgorithm algorithm = new BranchAndBoundSegmentationAlgorithm();
+            algorithm.ShapeModel = shapeModel;
+            algorithm.ShapeEnergyLowerBoundCalculator = new ShapeEnergyLowerBoundCalculator(51, 51);
+            algorithm.ShapeEnergyLowerBoundCalculatorFactory = () => new ShapeEnergyLowerBoundCalculator(51, 51);
+            algorithm.ShapeTermsCalculatorFactory = () => new CpuShapeTermsLowerBoundCalculator();
+            algorithm.CoarseShapeTermsCalculatorFactory = () => new CoarseShapeTermsLowerBoundCalculator();
+            algorithm.WorkerCount = workerCount;
+            algorithm.UseDiving = useDiving;
+            algorithm.MaxCoordFreedom = 4;
+            algorithm.MaxWidthFreedom = 4;
+            algorithm.MinEdgeWidth = 2;
+            algorithm.MaxEdgeWidth = 10;
+            algorithm.ProgressReportRate = 100000;
+            return algorithm;
+        }
+
+        private static double CalculateShapeEnergy(
+            BranchAndBoundSegmentationAlgorithm algorithm, Image2D<Color> image, ObjectBackgroundColorModels colorModels, Shape shape)
+        {
+            ImageSegmentator segmentator = new ImageSegmentator(
+                image,
+                colorModels,
+                algorithm.ColorDifferencePairwiseTermCutoff,
+                algorithm.ColorDifferencePairwiseTermWeight,
+                algorithm.ConstantPairwiseTermWeight,
+                algorithm.ObjectColorUnaryTermWeight,
+                algorithm.BackgroundColorUnaryTermWeight,
+                algorithm.ObjectShapeUnaryTermWeight,
+                algorithm.BackgroundShapeUnaryTermWeight);
+            ObjectBackgroundTermPlanes shapeTerms = new ObjectBackgroundTermPlanes(image.Width, image.Height);
+            algorithm.ShapeModel.CalculatePenalties(shape, shapeTerms);
+            return segmentator.SegmentImageWithShapeTerms(shapeTerms) + algorithm.ShapeModel.CalculateEnergy(shape) * algorithm.ShapeEnergyWeight;
+        }
+
+        private static void WriteStoppedSearchCheckpoint(Image2D<Color> image, string checkpointPath)
+        {
+            // Checkpoint is written when the search is stopped after the first progress report
+            BranchAndBoundSegmentationAlgorithm algorithm = CreateAlgorithm(1, false);
+            algorithm.CheckpointPath = checkpointPath;
+            algorithm.CheckpointInterval = TimeSpan.FromDays(1);
+            algorithm.ProgressReportRate = 30;
+            algorithm.BreadthFirstBranchAndBoundProgress += (sender, args) => algorithm.Stop();
+            algorithm.SegmentImage(image, CreateBarColorModels());
+            Assert.IsTrue(algorithm.WasStopped);
+        }
+
+        [TestMethod]
+        public void TestParallelSearchFindsSameSolution()
+        {
+            Image2D<Color> image = CreateBarImage(36, 26);
+            SegmentationSolution sequentialSolution = CreateAlgorithm(1, false).SegmentImage(image, CreateBarColorModels());
+            SegmentationSolution parallelSolution = CreateAlgorithm(4, false).SegmentImage(image, CreateBarColorModels());
+
+            Assert.AreEqual(sequentialSolution.Energy, parallelSolution.Energy, EnergyTolerance);
+        }
+
+        [TestMethod]
+        public void TestSpilledFrontFindsSameSolution()
+        {
+            Image2D<Color> image = CreateBarImage(36, 26);
+            SegmentationSolution inMemorySolution = CreateAlgorithm(1, false).SegmentImage(image, CreateBarColorModels());
+
+            // Budget is exceeded by a few dozen bounds, so most of the front goes to disk and back
+            BranchAndBoundSegmentationAlgorithm spillingAlgorithm = CreateAlgorithm(1, false);
+            spillingAlgorithm.FrontMemoryBudget = 4000;
+            SegmentationSolution spilledSolution = spillingAlgorithm.SegmentImage(image, CreateBarColorModels());
+
+            Assert.AreEqual(inMemorySolution.Energy, spilledSolution.Energy, EnergyTolerance);
+        }
+
+        [TestMethod]
+        public void TestDivingKeepsSolution()
+        {
+            Image2D<Color> image = CreateBarImage(36, 26);
+
+            double lowerBound = 0;
+            BranchAndBoundSegmentationAlgorithm exhaustiveAlgorithm = CreateAlgorithm(1, false);
+            exhaustiveAlgorithm.BranchAndBoundCompleted += (sender, args) => lowerBound = args.LowerBound;
+            SegmentationSolution exhaustiveSolution = exhaustiveAlgorithm.SegmentImage(image, CreateBarColorModels());
+
+            // Bounds pruned by the shapes found while diving can't hide a better solution
+            BranchAndBoundSegmentationAlgorithm divingAlgorithm = CreateAlgorithm(1, true);
+            divingAlgorithm.DivingRate = 10;
+            SegmentationSolution divingSolution = divingAlgorithm.SegmentImage(image, CreateBarColorModels());
+
+            Assert.IsTrue(divingSolution.Energy <= exhaustiveSolution.Energy + EnergyTolerance);
+            Assert.IsTrue(divingSolution.Energy >= lowerBound - EnergyTolerance);
+        }
+
+        [TestMethod]
+        public void TestDivingReportsShapeEnergyWithSeveralEdges()
+        {
+            // Shape energy bounds of several edges are not exact for collapsed constraints, unlike the bound of a single edge
+            Image2D<Color> image = CreateBarImage(36, 26);
+            ShapeModel shapeModel = TestHelper.CreateTestShapeModelWith2Edges(0, 1);
+
+            double lowerBound = 0;
+            BranchAndBoundSegmentationAlgorithm exhaustiveAlgorithm = CreateAlgorithm(shapeModel, 1, false);
+            exhaustiveAlgorithm.BranchAndBoundCompleted += (sender, args) => lowerBound = args.LowerBound;
+            SegmentationSolution exhaustiveSolution = exhaustiveAlgorithm.SegmentImage(image, CreateBarColorModels());
+
+            BranchAndBoundSegmentationAlgorithm divingAlgorithm = CreateAlgorithm(shapeModel, 1, true);
+            divingAlgorithm.DivingRate = 10;
+            SegmentationSolution divingSolution = divingAlgorithm.SegmentImage(image, CreateBarColorModels());
+
+            Assert.AreEqual(
+                CalculateShapeEnergy(exhaustiveAlgorithm, image, CreateBarColorModels(), exhaustiveSolution.Shape),
+                exhaustiveSolution.Energy,
+                EnergyTolerance);
+            Assert.AreEqual(
+                CalculateShapeEnergy(divingAlgorithm, image, CreateBarColorModels(), divingSolution.Shape),
+                divingSolution.Energy,
+                EnergyTolerance);
+            Assert.IsTrue(divingSolution.Energy <= exhaustiveSolution.Energy + EnergyTolerance);
+            Assert.IsTrue(divingSolution.Energy >= lowerBound - EnergyTolerance);
+        }
+
+        [TestMethod]
+        public void TestBoundCascadeKeepsSolutionOfLetterModel()
+        {
+            // Letter model has a branching structure, so cascade stages are deferred for bounds of different edges
+            Image2D<Color> image = CreateBarImage(36, 26);
+            ShapeModel shapeModel = TestHelper.CreateLetterShapeModel();
+
+            BranchAndBoundSegmentationAlgorithm fullBoundAlgorithm = CreateAlgorithm(shapeModel, 1, false);
+            fullBoundAlgorithm.UseBoundCascade = false;
+            fullBoundAlgorithm.MaxCoordFreedom = 16;
+            fullBoundAlgorithm.MaxWidthFreedom = 8;
+            SegmentationSolution fullBoundSolution = fullBoundAlgorithm.SegmentImage(image, CreateBarColorModels());
+
+            BranchAndBoundSegmentationAlgorithm cascadeAlgorithm = CreateAlgorithm(shapeModel, 1, false);
+            cascadeAlgorithm.UseBoundCascade = true;
+            cascadeAlgorithm.MaxCoordFreedom = 16;
+            cascadeAlgorithm.MaxWidthFreedom = 8;
+            SegmentationSolution cascadeSolution = cascadeAlgorithm.SegmentImage(image, CreateBarColorModels());
+
+            Assert.AreEqual(fullBoundSolution.Energy, cascadeSolution.Energy, EnergyTolerance);
+            Assert.AreEqual(
+                CalculateShapeEnergy(cascadeAlgorithm, image, CreateBarColorModels(), cascadeSolution.Shape),
+                cascadeSolution.Energy,
+                EnergyTolerance);
+        }
+
+        [TestMethod]
+        public void TestResumedSearchFindsSameSolution()
+        {
+            Image2D<Color> image = CreateBarImage(36, 26);
+            string checkpointPath = Path.GetTempFileName();
+            try
+            {
+                WriteStoppedSearchCheckpoint(image, checkpointPath);
+                BranchAndBoundSegmentationAlgorithm resumedAlgorithm = CreateAlgorithm(1, false);
+                resumedAlgorithm.ResumeCheckpointPath = checkpointPath;
+                SegmentationSolution resumedSolution = resumedAlgorithm.SegmentImage(image, CreateBarColorModels());
+
+                SegmentationSolution solution = CreateAlgorithm(1, false).SegmentImage(image, CreateBarColorModels());
+                Assert.AreEqual(solution.Energy, resumedSolution.Energy, EnergyTolerance);
+            }
+            finally
+            {
+                File.Delete(checkpointPath);
+            }
+        }
+
+        [TestMethod]
+        public void TestCheckpointOfDifferentInputIsRejected()
+        {
+            Image2D<Color> image = CreateBarImage(36, 26);
+            string checkpointPath = Path.GetTempFileName();
+            try
+            {
+                WriteStoppedSearchCheckpoint(image, checkpointPath);
+
+                // Image of the same size with a single pixel changed
+                Image2D<Color> changedImage = CreateBarImage(36, 26);
+                changedImage[0, 0] = Color.White;
+                BranchAndBoundSegmentationAlgorithm changedImageAlgorithm = CreateAlgorithm(1, false);
+                changedImageAlgorithm.ResumeCheckpointPath = checkpointPath;
+                AssertResumeFails(changedImageAlgorithm, changedImage, CreateBarColorModels());
+
+                // Color models with the object and background swapped
+                BranchAndBoundSegmentationAlgorithm changedColorModelsAlgorithm = CreateAlgorithm(1, false);
+                changedColorModelsAlgorithm.ResumeCheckpointPath = checkpointPath;
+                AssertResumeFails(
+                    changedColorModelsAlgorithm,
+                    image,
+                    new ObjectBackgroundColorModels(new BrightnessColorModel(false), new BrightnessColorModel(true)));
+
+                BranchAndBoundSegmentationAlgorithm changedWeightAlgorithm = CreateAlgorithm(1, false);
+                changedWeightAlgorithm.ResumeCheckpointPath = checkpointPath;
+                changedWeightAlgorithm.ConstantPairwiseTermWeight += 0.5;
+                AssertResumeFails(changedWeightAlgorithm, image, CreateBarColorModels());
+            }
+            finally
+            {
+                File.Delete(checkpointPath);
+            }
+        }
+
+        private static void AssertResumeFails(
+            BranchAndBoundSegmentationAlgorithm algorithm, Image2D<Color> image, ObjectBackgroundColorModels colorModels)
+        {
+            try
+            {
+                algorithm.SegmentImage(image, colorModels);
+                Assert.Fail("Checkpoint made for a different input should be rejected.");
+            }
+            catch (InvalidOperationException)
+            {
+            }
+        }
+
+        [TestMethod]
+        public void TestParallelSearchRequiresCalculatorFactories()
+        {
+            BranchAndBoundSegmentationAlgorithm algorithm = new BranchAndBoundSegmentationAlgorithm();
+            algorithm.ShapeModel = TestHelper.CreateTestShapeModelWith1Edge();
+            CpuShapeTermsLowerBoundCalculator shapeTermsCalculator = new CpuShapeTermsLowerBoundCalculator();
+            shapeTermsCalculator.HullDistanceMethod = HullDistanceMethod.Segments;
+            algorithm.ShapeTermCalculator = shapeTermsCalculator;
+            algorithm.WorkerCount = 2;
+
+            try
+            {
+                algorithm.SegmentImage(CreateBarImage(36, 26), CreateBarColorModels());
+                Assert.Fail("Workers should not get calculators different from the configured ones.");
+            }
+            catch (InvalidOperationException)
+            {
+            }
+        }
+
+        [TestMethod]
+        public void TestParallelSearchRethrowsWorkerException()
+        {
+            BranchAndBoundSegmentationAlgorithm algorithm = CreateAlgorithm(4, false);
+            algorithm.ShapeEnergyLowerBoundCalculatorFactory = () => new FailingShapeEnergyLowerBoundCalculator();
+
+            try
+            {
+                algorithm.SegmentImage(CreateBarImage(36, 26), CreateBarColorModels());
+                Assert.Fail("Exception thrown by a worker should stop the search.");
+            }
+            catch (AggregateException e)
+            {
+                Assert.IsInstanceOfType(e.InnerException, typeof(InvalidOperationException));
+            }
+
+            Assert.IsFalse(algorithm.IsRunning);
+        }
+    }
+}
@@ -92,5 +92,96 @@ namespace Research.GraphBasedShapePrior.Tests
                 Assert.AreEqual(5, transform.GetBestIndexByCoord(3));
             }
         }
+
+        [TestMethod]
+        public void TestGeneralizedDistanceTransform2D()
+        {
+            TestGeneralizedDistanceTransform2DImpl(true);
+        }
+
+        [TestMethod]
+        public void TestGeneralizedDistanceTransform2DBestIndicesRecovery()
+        {
+            TestGeneralizedDistanceTransform2DImpl(false);
+        }
+
+        private static void TestGeneralizedDistanceTransform2DImpl(bool trackBestIndices)
+        {
+            Util.Random.SetSeed(666);
+            GeneralizedDistanceTransform2D transform = new GeneralizedDistanceTransform2D(
+                new Range(0, 14), new Range(-5, 5), new Size(15, 11));
+            transform.TrackBestIndices = trackBestIndices;
+            transform.AddFinitePenaltyRangeX(new Range(2, 5));
+            transform.AddFinitePenaltyRangeX(new Range(8, 12));
+            transform.AddFinitePenaltyRangeY(new Range(-3, 2));
+            transform.AddInterestRangeX(new Range(0, 6));
+            transform.AddInterestRangeX(new Range(10, 14));
+            transform.AddInterestRangeY(new Range(-5, 0));
+
+            double[,] penalties = new double[15, 11];
+            for (int x = 0; x < 15; ++x)
+                for (int y = 0; y < 11; ++y)
+                    penalties[x, y] = Util.Random.Double(-3, 3);
+
+            const double distanceScaleX = 0.3, distanceScaleY = 1.7;
+            transform.Compute(distanceScaleX, distanceScaleY, (x, y) => penalties[transform.CoordToGridIndexX(x), transform.CoordToGridIndexY(y)]);
+
+            for (int x = 0; x < 15; ++x)
+            {
+                for (int y = 0; y < 11; ++y)
+                {
+                    bool isOfInterest = transform.IsCoordXOfInterest(transform.GridIndexToCoordX(x)) && transform.IsCoordYOfInterest(transform.GridIndexToCoordY(y));
+                    Assert.AreEqual(isOfInterest, transform.AreGridIndicesComputed(x, y));
+                    if (!isOfInterest)
+                        continue;
+
+                    double expected = Double.PositiveInfinity;
+                    for (int i = 2; i <= 12; ++i)
+                    {
+                        for (int j = 2; j <= 7; ++j)
+                        {
+                            if (i <= 5 || i >= 8)
+                                expected = Math.Min(expected, penalties[i, j] + distanceScaleX * (x - i) * (x - i) + distanceScaleY * (y - j) * (y - j));
+                        }
+                    }
+
+                    Assert.AreEqual(expected, transform.GetValueByGridIndices(x, y), 1e-8);
+                    Tuple<int, int> bestIndices = transform.GetBestIndicesByGridIndices(x, y);
+                    double bestValue =
+                        penalties[bestIndices.Item1, bestIndices.Item2] +
+                        distanceScaleX * MathHelper.Sqr(x - bestIndices.Item1) +
+                        distanceScaleY * MathHelper.Sqr(y - bestIndices.Item2);
+                    Assert.AreEqual(expected, bestValue, 1e-8);
+                }
+            }
+        }
+
+        [TestMethod]
+        public void TestEuclideanDistanceTransform()
+        {
+            Util.Random.SetSeed(666);
+            const int width = 40, height = 25;
+            double[] values = new double[width * height];
+            List<Point> seeds = new List<Point>();
+            for (int i = 0; i < values.Length; ++i)
+                values[i] = EuclideanDistanceTransform.Infinity;
+            for (int i = 0; i < 15; ++i)
+            {
+                Point seed = new Point(Util.Random.Int(width), Util.Random.Int(height));
+                seeds.Add(seed);
+                values[seed.Y * width + seed.X] = 0;
+            }
+
+            EuclideanDistanceTransform.ComputeSquared(values, width, height);
+
+            for (int x = 0; x < width; ++x)
+            {
+                for (int y = 0; y < height; ++y)
+                {
+                    double expected = seeds.Min(p => (p.X - x) * (p.X - x) + (p.Y - y) * (p.Y - y));
+                    Assert.AreEqual(expected, values[y * width + x]);
+                }
+            }
+        }
     }
 }
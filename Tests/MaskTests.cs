@@ -0,0 +1,108 @@
+﻿using System;
+using System.Drawing;
+using System.Linq;
+using Microsoft.VisualStudio.TestTools.UnitTesting;
+using Research.GraphBasedShapePrior.Util;
+using Random = Research.GraphBasedShapePrior.Util.Random;
+
+namespace Research.GraphBasedShapePrior.Tests
+{
+    [TestClass]
+    public class MaskTests
+    {
+        [TestMethod]
+        public void TestMaskImageConversion()
+        {
+            Random.SetSeed(666);
+            Image2D<bool> image = new Image2D<bool>(131, 17);
+            for (int x = 0; x < image.Width; ++x)
+                for (int y = 0; y < image.Height; ++y)
+                    image[x, y] = Random.Int(2) == 1;
+
+            Mask2D mask = Mask2D.FromImage(image);
+            Image2D<bool> convertedImage = mask.ToImage();
+            Assert.AreEqual(0, Image2D<bool>.DifferentValueCount(image, convertedImage));
+            Assert.AreEqual(image.Count(v => v), mask.CountSetBits());
+        }
+
+        [TestMethod]
+        public void TestMaskDifferentValueCount()
+        {
+            Random.SetSeed(666);
+            Image2D<bool> image1 = new Image2D<bool>(200, 33);
+            Image2D<bool> image2 = new Image2D<bool>(200, 33);
+            for (int x = 0; x < image1.Width; ++x)
+            {
+                for (int y = 0; y < image1.Height; ++y)
+                {
+                    image1[x, y] = Random.Int(2) == 1;
+                    image2[x, y] = Random.Int(3) == 1;
+                }
+            }
+
+            Mask2D mask1 = Mask2D.FromImage(image1);
+            Mask2D mask2 = Mask2D.FromImage(image2);
+            Assert.AreEqual(Image2D<bool>.DifferentValueCount(image1, image2), Mask2D.DifferentValueCount(mask1, mask2));
+        }
+
+        [TestMethod]
+        public void TestMaskCloneIsIndependent()
+        {
+            Mask2D mask = new Mask2D(70, 5);
+            mask[65, 3] = true;
+
+            Mask2D clone = mask.Clone();
+            Assert.AreEqual(0, Mask2D.DifferentValueCount(mask, clone));
+
+            clone[1, 1] = true;
+            mask[65, 3] = false;
+            Assert.IsTrue(clone[65, 3]);
+            Assert.IsFalse(mask[1, 1]);
+            Assert.AreEqual(2, Mask2D.DifferentValueCount(mask, clone));
+        }
+
+        [TestMethod]
+        [ExpectedException(typeof(ArgumentOutOfRangeException))]
+        public void TestImageIndexerChecksPaddedColumns()
+        {
+            Image2D<bool> image = new Image2D<bool>(10, 5, 16);
+            image[12, 0] = true;
+        }
+
+        [TestMethod]
+        public void TestMaskViews()
+        {
+            Random.SetSeed(666);
+            Image2D<bool> image = new Image2D<bool>(150, 20);
+            for (int x = 0; x < image.Width; ++x)
+                for (int y = 0; y < image.Height; ++y)
+                    image[x, y] = Random.Int(2) == 1;
+            Mask2D mask = Mask2D.FromImage(image);
+
+            // Regions starting at different bit offsets
+            Mask2DView view1 = mask.GetView(new Rectangle(3, 2, 130, 10));
+            Mask2DView view2 = mask.GetView(new Rectangle(17, 5, 130, 10));
+            int expectedSetBitCount = 0, expectedDifferentValueCount = 0;
+            for (int x = 0; x < view1.Width; ++x)
+            {
+                for (int y = 0; y < view1.Height; ++y)
+                {
+                    Assert.AreEqual(image[x + 3, y + 2], view1[x, y]);
+                    expectedSetBitCount += image[x + 3, y + 2] ? 1 : 0;
+                    expectedDifferentValueCount += image[x + 3, y + 2] != image[x + 17, y + 5] ? 1 : 0;
+                }
+            }
+
+            Assert.AreEqual(expectedSetBitCount, view1.CountSetBits());
+            Assert.AreEqual(expectedSetBitCount, view1.ToMask().CountSetBits());
+            Assert.AreEqual(expectedDifferentValueCount, Mask2DView.DifferentValueCount(view1, view2));
+            Assert.AreEqual(image.Count(v => v), Enumerable.Range(0, image.Height).Sum(y => mask.GetRowView(y).CountSetBits()));
+
+            // View is not affected by the later changes of the mask
+            bool value = view1[0, 0];
+            mask[3, 2] = !value;
+            Assert.AreEqual(value, view1[0, 0]);
+            Assert.AreEqual(!value, mask[3, 2]);
+        }
+    }
+}
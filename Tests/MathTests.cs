@@ -4,6 +4,7 @@ using System.Collections.Generic;
 using System.Linq;
 using Microsoft.VisualStudio.TestTools.UnitTesting;
 using Research.GraphBasedShapePrior.Util;
+using Random = Research.GraphBasedShapePrior.Util.Random;
 
 namespace Research.GraphBasedShapePrior.Tests
 {
@@ -176,5 +177,61 @@ namespace Research.GraphBasedShapePrior.Tests
             Assert.AreEqual(Math.PI * 0.5, MathHelper.AngleAbsDifference(Math.PI * 0.75, -Math.PI * 0.75), eps);
             Assert.AreEqual(Math.PI * 0.5, MathHelper.AngleAbsDifference(-Math.PI * 0.75, Math.PI * 0.75), eps);
         }
+
+        [TestMethod]
+        public void TestRoundDownToFloat()
+        {
+            Random.SetSeed(666);
+
+            for (int i = 0; i < 10000; ++i)
+            {
+                double value = Random.Double(-1000, 1000);
+                float result = MathHelper.RoundDownToFloat(value);
+                Assert.IsTrue(result <= value);
+                Assert.IsTrue(result == (float)value || MathHelper.NextFloatDown((float)value) == result);
+            }
+
+            Assert.AreEqual(-Single.Epsilon, MathHelper.NextFloatDown(0));
+            Assert.AreEqual(1 - Math.Pow(2, -24), MathHelper.NextFloatDown(1), 0);
+            Assert.AreEqual(-1 - Math.Pow(2, -23), MathHelper.NextFloatDown(-1), 0);
+            Assert.AreEqual(0.1f, MathHelper.RoundDownToFloat(0.1f));
+        }
+
+        [TestMethod]
+        public void TestDaryHeap()
+        {
+            Random.SetSeed(666);
+
+            DaryHeap<int> heap = new DaryHeap<int>(4);
+            List<int> items = new List<int>();
+            for (int i = 0; i < 1000; ++i)
+            {
+                if (heap.Count > 0 && Random.Int(3) == 0)
+                {
+                    int min = items.Min();
+                    items.Remove(min);
+                    Assert.AreEqual(min, heap.RemoveMin());
+                }
+                else
+                {
+                    int item = Random.Int(100);
+                    items.Add(item);
+                    heap.Add(item);
+                }
+
+                Assert.AreEqual(items.Count, heap.Count);
+            }
+
+            Assert.AreEqual(items.Count(item => item % 2 == 0), heap.RemoveWhere(item => item % 2 == 0));
+            items.RemoveAll(item => item % 2 == 0);
+            items.Sort();
+            foreach (int item in items)
+                Assert.AreEqual(item, heap.RemoveMin());
+            Assert.AreEqual(0, heap.Count);
+
+            heap.Reset(new[] { 5, 3, 8, 1 });
+            Assert.AreEqual(1, heap.Min);
+            Assert.AreEqual(4, heap.Count);
+        }
     }
 }
@@ -1,6 +1,8 @@
 ﻿using System;
 using System.Collections.Generic;
 using System.Drawing;
+using System.IO;
+using System.Linq;
 using Microsoft.VisualStudio.TestTools.UnitTesting;
 using Research.GraphBasedShapePrior.Util;
 using Random = Research.GraphBasedShapePrior.Util.Random;
@@ -364,6 +366,178 @@ namespace Research.GraphBasedShapePrior.Tests
             Assert.IsFalse(range1.IntersectsWith(range2));
         }
 
+        [TestMethod]
+        public void TestLengthAngleConstraintsRaster()
+        {
+            Random.SetSeed(666);
+
+            GeneralizedDistanceTransform2D transform = new GeneralizedDistanceTransform2D(
+                new Range(0, 90), new Range(-Math.PI * 2, Math.PI * 2), new Size(101, 101));
+            LengthAngleConstraintsRaster raster = new LengthAngleConstraintsRaster();
+            for (int i = 0; i < 20; ++i)
+            {
+                Vector corner1 = new Vector(Random.Double(0, 40), Random.Double(0, 40));
+                Vector corner2 = new Vector(Random.Double(0, 40), Random.Double(0, 40));
+                VertexConstraints constraint1 = new VertexConstraints(corner1, corner1 + new Vector(Random.Double(1, 20), Random.Double(1, 20)));
+                VertexConstraints constraint2 = new VertexConstraints(corner2, corner2 + new Vector(Random.Double(1, 20), Random.Double(1, 20)));
+                BoxSetLengthAngleConstraints lengthAngleConstraints =
+                    BoxSetLengthAngleConstraints.FromVertexConstraints(constraint1, constraint2, 1, 16);
+                double lengthRatio = Random.Double(0.5, 2);
+                double meanAngle = Random.Double(-Math.PI, Math.PI);
+
+                // Raster should agree with the per-cell checks exactly
+                raster.Rasterize(lengthAngleConstraints, transform, lengthRatio, meanAngle);
+                int allowedCellCount = 0;
+                for (int x = 0; x < transform.GridSize.Width; ++x)
+                {
+                    for (int y = 0; y < transform.GridSize.Height; ++y)
+                    {
+                        double length = transform.GridIndexToCoordX(x) / lengthRatio;
+                        double angle = transform.GridIndexToCoordY(y) + meanAngle;
+                        bool inRange = lengthAngleConstraints.InRange(
+                            length, transform.GridStepSizeX / lengthRatio, angle, transform.GridStepSizeY);
+                        Assert.AreEqual(inRange, raster.IsAllowed(x, y));
+                        if (inRange)
+                            allowedCellCount += 1;
+                    }
+                }
+
+                Assert.AreEqual(allowedCellCount, raster.AllowedCellCount);
+            }
+        }
+
+        [TestMethod]
+        public void TestVertexPairConvexHull()
+        {
+            Random.SetSeed(666);
+
+            for (int i = 0; i < 100; ++i)
+            {
+                // Some boxes are degenerate
+                Vector corner1 = new Vector(Random.Double(0, 40), Random.Double(0, 40));
+                Vector corner2 = i % 4 == 0 ? corner1 : new Vector(Random.Double(0, 40), Random.Double(0, 40));
+                Vector size1 = i % 3 == 0 ? new Vector(0, 0) : new Vector(Random.Double(0, 20), Random.Double(0, 20));
+                Vector size2 = i % 5 == 0 ? new Vector(Random.Double(0, 20), 0) : new Vector(Random.Double(0, 20), Random.Double(0, 20));
+                VertexConstraints constraints1 = new VertexConstraints(corner1, corner1 + size1);
+                VertexConstraints constraints2 = new VertexConstraints(corner2, corner2 + size2);
+
+                VertexPairConvexHull convexHull = new VertexPairConvexHull(constraints1, constraints2);
+                Assert.IsTrue(convexHull.VertexCount >= 1 && convexHull.VertexCount <= VertexPairConvexHull.MaxVertexCount);
+                List<Vector> points = new List<Vector>(constraints1.Corners.Concat(constraints2.Corners));
+                if (points.Distinct().Count() < 3)
+                    continue;
+
+                // Vertices should go in the same order as in gift wrapping
+                Polygon expectedConvexHull = Polygon.ConvexHull(points);
+                Polygon actualConvexHull = convexHull.Polygon;
+                Assert.AreEqual(expectedConvexHull.Vertices[0], actualConvexHull.Vertices[0]);
+                Assert.AreEqual(expectedConvexHull.Area, actualConvexHull.Area, 1e-6);
+                for (int j = 0; j < actualConvexHull.Vertices.Count && actualConvexHull.Vertices.Count >= 3; ++j)
+                {
+                    Vector prev = actualConvexHull.Vertices[j];
+                    Vector cur = actualConvexHull.Vertices[(j + 1) % actualConvexHull.Vertices.Count];
+                    Vector next = actualConvexHull.Vertices[(j + 2) % actualConvexHull.Vertices.Count];
+                    Assert.IsTrue(Vector.CrossProduct(cur - prev, next - cur) < 0);
+                }
+
+                for (int j = 0; j < 20; ++j)
+                {
+                    Vector point = new Vector(Random.Double(-5, 65), Random.Double(-5, 65));
+                    Assert.AreEqual(expectedConvexHull.IsPointInside(point), actualConvexHull.IsPointInside(point));
+                }
+            }
+
+            // Hulls of the pairs not affected by split should be shared with the children
+            ShapeModel model = TestHelper.CreateLetterShapeModel();
+            ShapeConstraints constraints = ShapeConstraints.CreateFromBounds(model.Structure, new Vector(0, 0), new Vector(100, 100), 1, 10);
+            VertexPairConvexHull[] parentConvexHulls = model.Structure.Edges.Select(e => constraints.GetVertexPairConvexHull(e.Index1, e.Index2)).ToArray();
+            foreach (ShapeConstraints child in constraints.SplitMostFree(1, 1))
+            {
+                for (int edgeIndex = 0; edgeIndex < model.Structure.Edges.Count; ++edgeIndex)
+                {
+                    ShapeEdge edge = model.Structure.Edges[edgeIndex];
+                    bool pairChanged =
+                        child.VertexConstraints[edge.Index1] != constraints.VertexConstraints[edge.Index1] ||
+                        child.VertexConstraints[edge.Index2] != constraints.VertexConstraints[edge.Index2];
+                    VertexPairConvexHull childConvexHull = child.GetVertexPairConvexHull(edge.Index1, edge.Index2);
+                    Assert.AreEqual(pairChanged, childConvexHull != parentConvexHulls[edgeIndex]);
+                    Assert.AreSame(childConvexHull, child.GetVertexPairConvexHull(edge.Index1, edge.Index2));
+                }
+            }
+        }
+
+        [TestMethod]
+        public void TestCompactShapeConstraints()
+        {
+            Random.SetSeed(666);
+
+            // Random descent through the search tree, deeper than the max delta chain
+            ShapeModel model = TestHelper.CreateLetterShapeModel();
+            ShapeConstraints constraints = ShapeConstraints.CreateFromBounds(model.Structure, new Vector(0, 0), new Vector(100, 100), 1, 10);
+            CompactShapeConstraints compactConstraints = CompactShapeConstraints.FromConstraints(constraints);
+            for (int i = 0; i < CompactShapeConstraints.MaxDeltaChainLength * 3 && !constraints.CheckIfSatisfied(1, 1); ++i)
+            {
+                List<ShapeConstraints> children = constraints.SplitMostFree(1, 1);
+                ShapeConstraints child = children[Random.Int(children.Count)];
+                compactConstraints = CompactShapeConstraints.FromConstraints(child, compactConstraints, constraints);
+                constraints = child;
+
+                ShapeConstraints expandedConstraints = compactConstraints.Expand();
+                Assert.IsTrue(expandedConstraints.VertexConstraints.SequenceEqual(constraints.VertexConstraints));
+                Assert.IsTrue(expandedConstraints.EdgeConstraints.SequenceEqual(constraints.EdgeConstraints));
+                Assert.AreEqual(constraints.CheckIfSatisfied(1, 1), compactConstraints.CheckIfSatisfied(1, 1));
+                Assert.AreEqual(constraints.CheckIfSatisfied(30, 3), compactConstraints.CheckIfSatisfied(30, 3));
+            }
+
+            // Unchanged constraints share the representation of the parent
+            Assert.AreSame(compactConstraints, CompactShapeConstraints.FromConstraints(constraints, compactConstraints, constraints));
+
+            using (MemoryStream stream = new MemoryStream())
+            {
+                BinaryWriter writer = new BinaryWriter(stream);
+                compactConstraints.WriteTo(writer);
+                writer.Flush();
+                stream.Position = 0;
+
+                ShapeConstraints readConstraints = CompactShapeConstraints.ReadFrom(new BinaryReader(stream), model.Structure).Expand();
+                Assert.IsTrue(readConstraints.VertexConstraints.SequenceEqual(constraints.VertexConstraints));
+                Assert.IsTrue(readConstraints.EdgeConstraints.SequenceEqual(constraints.EdgeConstraints));
+                Assert.AreEqual(stream.Length, stream.Position);
+            }
+        }
+
+        [TestMethod]
+        public void TestCompactShapeConstraintsRebuildConvexHulls()
+        {
+            ShapeModel model = TestHelper.CreateLetterShapeModel();
+            ShapeConstraints constraints = ShapeConstraints.CreateFromBounds(model.Structure, new Vector(0, 0), new Vector(100, 100), 1, 10);
+            CompactShapeConstraints compactConstraints = CompactShapeConstraints.FromConstraints(constraints);
+            long byteSizeBeforeHulls = CompactShapeConstraints.FromConstraints(constraints).ByteSize;
+            VertexPairConvexHull[] convexHulls = model.Structure.Edges.Select(e => constraints.GetVertexPairConvexHull(e.Index1, e.Index2)).ToArray();
+
+            // Compact constraints don't keep the hulls, so they don't affect the memory estimate
+            Assert.AreEqual(byteSizeBeforeHulls, CompactShapeConstraints.FromConstraints(constraints).ByteSize);
+
+            // Expanded constraints rebuild the hulls on demand, and the hulls match the ones of the original constraints
+            ShapeConstraints child = compactConstraints.Expand().SplitMostFree(1, 1)[0];
+            CompactShapeConstraints compactChild = CompactShapeConstraints.FromConstraints(child, compactConstraints, constraints);
+            ShapeConstraints expandedConstraints = compactConstraints.Expand();
+            ShapeConstraints expandedChild = compactChild.Expand();
+            for (int i = 0; i < model.Structure.Edges.Count; ++i)
+            {
+                ShapeEdge edge = model.Structure.Edges[i];
+                VertexPairConvexHull convexHull = expandedConstraints.GetVertexPairConvexHull(edge.Index1, edge.Index2);
+                Assert.AreNotSame(convexHulls[i], convexHull);
+                Assert.IsTrue(convexHull.Coords.SequenceEqual(convexHulls[i].Coords));
+
+                VertexPairConvexHull childConvexHull = expandedChild.GetVertexPairConvexHull(edge.Index1, edge.Index2);
+                Assert.IsTrue(childConvexHull.IsBuiltFor(child.VertexConstraints[edge.Index1], child.VertexConstraints[edge.Index2]));
+                Assert.IsTrue(childConvexHull.Coords.SequenceEqual(child.GetVertexPairConvexHull(edge.Index1, edge.Index2).Coords));
+            }
+
+            Assert.IsTrue(compactChild.ByteSize < compactConstraints.ByteSize);
+        }
+
         [TestMethod]
         public void TestLengthAngleRepresentation()
         {
@@ -381,5 +555,183 @@ namespace Research.GraphBasedShapePrior.Tests
             for (int i = 0; i < model.Structure.Edges.Count; ++i)
                 Assert.AreEqual(meanShape.EdgeWidths[i], meanShape2.EdgeWidths[i], 1e-6);
         }
+
+        [TestMethod]
+        public void TestRasterizedPenalties()
+        {
+            ShapeModel model = TestHelper.CreateLetterShapeModel();
+            Shape shape = model.FitMeanShape(100, 80);
+            foreach (float saturation in new[] { 30, 1000, ObjectBackgroundTermPlanes.DefaultSaturation })
+            {
+                ObjectBackgroundTermPlanes rasterizedPenalties = new ObjectBackgroundTermPlanes(100, 80, saturation);
+                model.CalculatePenalties(shape, rasterizedPenalties);
+
+                for (int x = 0; x < rasterizedPenalties.Width; ++x)
+                {
+                    for (int y = 0; y < rasterizedPenalties.Height; ++y)
+                    {
+                        ObjectBackgroundTerm penalties = model.CalculatePenalties(shape, new Vector(x, y));
+                        Assert.AreEqual(rasterizedPenalties.Saturate(penalties.ObjectTerm), rasterizedPenalties[x, y].ObjectTerm);
+                        Assert.AreEqual(rasterizedPenalties.Saturate(penalties.BackgroundTerm), rasterizedPenalties[x, y].BackgroundTerm);
+                    }
+                }
+            }
+        }
+
+        [TestMethod]
+        public void TestIncrementalShapeTerms()
+        {
+            Random.SetSeed(666);
+
+            ShapeModel model = TestHelper.CreateLetterShapeModel();
+            Size imageSize = new Size(100, 80);
+            ShapeMutator mutator = new ShapeMutator();
+            mutator.ShapeTranslationWeight = 0;
+            IncrementalShapeTermsCalculator calculator = new IncrementalShapeTermsCalculator();
+            ObjectBackgroundTermPlanes incrementalTerms = new ObjectBackgroundTermPlanes(imageSize.Width, imageSize.Height, 100);
+            ObjectBackgroundTermPlanes terms = new ObjectBackgroundTermPlanes(imageSize.Width, imageSize.Height, 100);
+
+            Shape shape = model.FitMeanShape(imageSize.Width, imageSize.Height);
+            calculator.CalculateShapeTerms(model, shape, incrementalTerms);
+            Assert.AreEqual(incrementalTerms.Rectangle, calculator.LastChangedRegion);
+
+            int partialUpdateCount = 0;
+            for (int i = 0; i < 100; ++i)
+            {
+                shape = mutator.MutateShape(shape, model, imageSize, 0.1);
+                ObjectBackgroundTermPlanes previousTerms = incrementalTerms.Clone();
+                calculator.CalculateShapeTerms(model, shape, incrementalTerms);
+                model.CalculatePenalties(shape, terms);
+                if (calculator.LastChangedEdgeCount < model.Structure.Edges.Count)
+                    partialUpdateCount += 1;
+
+                for (int x = 0; x < imageSize.Width; ++x)
+                {
+                    for (int y = 0; y < imageSize.Height; ++y)
+                    {
+                        Assert.AreEqual(terms[x, y].ObjectTerm, incrementalTerms[x, y].ObjectTerm);
+                        Assert.AreEqual(terms[x, y].BackgroundTerm, incrementalTerms[x, y].BackgroundTerm);
+                        if (!calculator.LastChangedRegion.Contains(x, y))
+                        {
+                            Assert.AreEqual(previousTerms[x, y].ObjectTerm, incrementalTerms[x, y].ObjectTerm);
+                            Assert.AreEqual(previousTerms[x, y].BackgroundTerm, incrementalTerms[x, y].BackgroundTerm);
+                        }
+                    }
+                }
+            }
+
+            Assert.IsTrue(partialUpdateCount > 0);
+        }
+
+        [TestMethod]
+        public void TestSubtreeTransformCache()
+        {
+            ShapeModel model = TestHelper.CreateTestShapeModel5Edges();
+            Size imageSize = new Size(100, 140);
+            ShapeEnergyLowerBoundCalculator cachingCalculator = new ShapeEnergyLowerBoundCalculator(51, 51);
+            ShapeEnergyLowerBoundCalculator calculator = new ShapeEnergyLowerBoundCalculator(51, 51);
+            calculator.UseSubtreeTransformCache = false;
+
+            // Siblings in the search tree differ in a single constraint, so most of their subtrees can be reused
+            ShapeConstraints constraints = ShapeConstraints.CreateFromBounds(
+                model.Structure, Vector.Zero, new Vector(imageSize.Width, imageSize.Height), 5, 15);
+            for (int i = 0; i < 30; ++i)
+            {
+                List<ShapeConstraints> children = constraints.SplitMostFree(4, 2);
+                foreach (ShapeConstraints child in children)
+                {
+                    Assert.AreEqual(
+                        calculator.CalculateLowerBound(imageSize, model, child),
+                        cachingCalculator.CalculateLowerBound(imageSize, model, child));
+                }
+
+                constraints = children[i % children.Count];
+            }
+
+            Assert.IsTrue(cachingCalculator.SubtreeTransformCacheHitCount > 0);
+            Assert.IsTrue(cachingCalculator.CachedSubtreeTransformCount <= cachingCalculator.SubtreeTransformCacheCapacity);
+            Assert.AreEqual(0, calculator.CachedSubtreeTransformCount);
+        }
+
+        [TestMethod]
+        public void TestIndependentEdgesLowerBound()
+        {
+            ShapeModel model = TestHelper.CreateTestShapeModel5Edges();
+            Size imageSize = new Size(100, 140);
+            ShapeEnergyLowerBoundCalculator calculator = new ShapeEnergyLowerBoundCalculator(51, 51);
+
+            ShapeConstraints constraints = ShapeConstraints.CreateFromBounds(
+                model.Structure, Vector.Zero, new Vector(imageSize.Width, imageSize.Height), 5, 15);
+            bool wasPositive = false;
+            for (int i = 0; i < 30; ++i)
+            {
+                List<ShapeConstraints> children = constraints.SplitMostFree(4, 2);
+                foreach (ShapeConstraints child in children)
+                {
+                    double independentEdgesBound = calculator.CalculateIndependentEdgesLowerBound(model, child);
+                    Assert.IsTrue(independentEdgesBound <= calculator.CalculateLowerBound(imageSize, model, child) + 1e-6);
+                    wasPositive |= independentEdgesBound > 0;
+                }
+
+                constraints = children[i % children.Count];
+            }
+
+            Assert.IsTrue(wasPositive);
+        }
+
+        [TestMethod]
+        public void TestAdaptiveGridBounds()
+        {
+            Random.SetSeed(666);
+
+            ShapeModel model = TestHelper.CreateLetterShapeModel();
+            Size imageSize = new Size(100, 160);
+            Shape meanShape = model.FitMeanShape(imageSize.Width, imageSize.Height);
+            ShapeEnergyLowerBoundCalculator adaptiveCalculator = new ShapeEnergyLowerBoundCalculator(201, 201);
+            adaptiveCalculator.UseAdaptiveGrids = true;
+            ShapeEnergyLowerBoundCalculator calculator = new ShapeEnergyLowerBoundCalculator(201, 201);
+
+            int coarseBoundCount = 0;
+            for (int i = 0; i < 20; ++i)
+            {
+                // Perturbed shape inside loose constraints
+                List<Vector> vertices = new List<Vector>();
+                List<VertexConstraints> vertexConstraints = new List<VertexConstraints>();
+                foreach (Vector vertex in meanShape.VertexPositions)
+                {
+                    Vector perturbedVertex = vertex + new Vector(Random.Double(-8, 8), Random.Double(-8, 8));
+                    double boxSize = Random.Double(10, 40);
+                    Vector boxCorner = perturbedVertex - new Vector(Random.Double(0, boxSize), Random.Double(0, boxSize));
+                    vertices.Add(perturbedVertex);
+                    vertexConstraints.Add(new VertexConstraints(boxCorner, boxCorner + new Vector(boxSize, boxSize)));
+                }
+
+                List<double> edgeWidths = new List<double>();
+                List<EdgeConstraints> edgeConstraints = new List<EdgeConstraints>();
+                foreach (double width in meanShape.EdgeWidths)
+                {
+                    double perturbedWidth = width + Random.Double(-1, 1);
+                    edgeWidths.Add(perturbedWidth);
+                    edgeConstraints.Add(new EdgeConstraints(perturbedWidth - 1, perturbedWidth + 1));
+                }
+
+                Shape shape = new Shape(model.Structure, vertices, edgeWidths);
+                ShapeConstraints constraints = ShapeConstraints.CreateFromConstraints(model.Structure, vertexConstraints, edgeConstraints);
+
+                // Coarse bound should never exceed energy of a shape satisfying constraints
+                double coarseBound = adaptiveCalculator.CalculateLowerBound(imageSize, model, constraints, Double.NegativeInfinity);
+                if (adaptiveCalculator.LastBoundGridLevel > 0)
+                    coarseBoundCount += 1;
+                Assert.IsTrue(coarseBound <= model.CalculateEnergy(shape) + 1e-6);
+
+                // Fully refined bound is the same as the full-resolution one
+                double refinedBound = adaptiveCalculator.CalculateLowerBound(imageSize, model, constraints, Double.PositiveInfinity);
+                Assert.AreEqual(0, adaptiveCalculator.LastBoundGridLevel);
+                Assert.AreEqual(calculator.CalculateLowerBound(imageSize, model, constraints), refinedBound);
+            }
+
+            Assert.IsTrue(coarseBoundCount > 0);
+            Assert.IsTrue(adaptiveCalculator.GridRefinementCount > 0);
+        }
     }
 }
@@ -1,8 +1,10 @@
 ﻿using System;
 using System.Collections.Generic;
 using System.Drawing;
+using System.IO;
 using Microsoft.VisualStudio.TestTools.UnitTesting;
 using Research.GraphBasedShapePrior.Util;
+using Random = Research.GraphBasedShapePrior.Util.Random;
 
 namespace Research.GraphBasedShapePrior.Tests
 {
@@ -14,16 +16,22 @@ namespace Research.GraphBasedShapePrior.Tests
             ShapeConstraints constraintSet = ShapeConstraints.CreateFromConstraints(shapeModel.Structure, vertexConstraints, edgeConstraints);
 
             // Get CPU results
-            Image2D<ObjectBackgroundTerm> shapeTermsCpu = new Image2D<ObjectBackgroundTerm>(imageSize.Width, imageSize.Height);
+            ObjectBackgroundTermPlanes shapeTermsCpu = new ObjectBackgroundTermPlanes(imageSize.Width, imageSize.Height);
             CpuShapeTermsLowerBoundCalculator calculatorCpu = new CpuShapeTermsLowerBoundCalculator();
             calculatorCpu.CalculateShapeTerms(shapeModel, constraintSet, shapeTermsCpu);
-            Image2D.SaveToFile(shapeTermsCpu, -1000, 1000, String.Format("./{0}_cpu.png", testName));
+            Image2D.SaveToFile(shapeTermsCpu.ToImage(), -1000, 1000, String.Format("./{0}_cpu.png", testName));
 
             // Get GPU results
-            Image2D<ObjectBackgroundTerm> shapeTermsGpu = new Image2D<ObjectBackgroundTerm>(imageSize.Width, imageSize.Height);
+            ObjectBackgroundTermPlanes shapeTermsGpu = new ObjectBackgroundTermPlanes(imageSize.Width, imageSize.Height);
             GpuShapeTermsLowerBoundCalculator calculatorGpu = new GpuShapeTermsLowerBoundCalculator();
             calculatorGpu.CalculateShapeTerms(shapeModel, constraintSet, shapeTermsGpu);
-            Image2D.SaveToFile(shapeTermsGpu, -1000, 1000, String.Format("./{0}_gpu.png", testName));
+            Image2D.SaveToFile(shapeTermsGpu.ToImage(), -1000, 1000, String.Format("./{0}_gpu.png", testName));
+
+            // Get native CPU results
+            ObjectBackgroundTermPlanes shapeTermsNativeCpu = new ObjectBackgroundTermPlanes(imageSize.Width, imageSize.Height);
+            NativeCpuShapeTermsLowerBoundCalculator calculatorNativeCpu = new NativeCpuShapeTermsLowerBoundCalculator();
+            calculatorNativeCpu.CalculateShapeTerms(shapeModel, constraintSet, shapeTermsNativeCpu);
+            Image2D.SaveToFile(shapeTermsNativeCpu.ToImage(), -1000, 1000, String.Format("./{0}_native_cpu.png", testName));
 
             // Compare with CPU results
             for (int x = 0; x < imageSize.Width; ++x)
@@ -31,6 +39,8 @@ namespace Research.GraphBasedShapePrior.Tests
                 {
                     Assert.AreEqual(shapeTermsCpu[x, y].ObjectTerm, shapeTermsGpu[x, y].ObjectTerm, 1e-2f);
                     Assert.AreEqual(shapeTermsCpu[x, y].BackgroundTerm, shapeTermsGpu[x, y].BackgroundTerm, 1e-2f);
+                    Assert.AreEqual(shapeTermsCpu[x, y].ObjectTerm, shapeTermsNativeCpu[x, y].ObjectTerm, 1e-2f);
+                    Assert.AreEqual(shapeTermsCpu[x, y].BackgroundTerm, shapeTermsNativeCpu[x, y].BackgroundTerm, 1e-2f);
                 }
         }
 
@@ -119,5 +129,387 @@ namespace Research.GraphBasedShapePrior.Tests
 
             TestShapeTermsImpl("test6", TestHelper.CreateTestShapeModelWith1Edge(), vertexConstraints, edgeConstraints, new Size(320, 240));
         }
+
+        [TestMethod]
+        public void TestTiledShapeTermsMatchFullEvaluation()
+        {
+            ShapeModel shapeModel = TestHelper.CreateTestShapeModelWith2Edges(Math.PI * 0.5, 1.1);
+            Size imageSize = new Size(150, 100);
+            List<ShapeConstraints> constraintSets = TestHelper.CreateRandomShapeConstraints(shapeModel, imageSize, 20, 40);
+            for (int i = 0; i < constraintSets.Count; ++i)
+            {
+                ShapeConstraints constraintSet = constraintSets[i];
+                float saturation = i % 2 == 0 ? ObjectBackgroundTermPlanes.DefaultSaturation : 50;
+
+                ObjectBackgroundTermPlanes shapeTermsFull = new ObjectBackgroundTermPlanes(imageSize.Width, imageSize.Height, saturation);
+                CpuShapeTermsLowerBoundCalculator calculatorFull = new CpuShapeTermsLowerBoundCalculator();
+                calculatorFull.UseTiling = false;
+                calculatorFull.CalculateShapeTerms(shapeModel, constraintSet, shapeTermsFull);
+
+                ObjectBackgroundTermPlanes shapeTermsTiled = new ObjectBackgroundTermPlanes(imageSize.Width, imageSize.Height, saturation);
+                CpuShapeTermsLowerBoundCalculator calculatorTiled = new CpuShapeTermsLowerBoundCalculator();
+                calculatorTiled.UseTiling = true;
+                calculatorTiled.CalculateShapeTerms(shapeModel, constraintSet, shapeTermsTiled);
+
+                // Tiling should never change the result
+                for (int j = 0; j < shapeTermsFull.ObjectTerms.Length; ++j)
+                {
+                    Assert.AreEqual(shapeTermsFull.ObjectTerms[j], shapeTermsTiled.ObjectTerms[j]);
+                    Assert.AreEqual(shapeTermsFull.BackgroundTerms[j], shapeTermsTiled.BackgroundTerms[j]);
+                }
+            }
+        }
+
+        [TestMethod]
+        public void TestIncrementalShapeTermsCombination()
+        {
+            Random.SetSeed(666);
+            ShapeModel shapeModel = TestHelper.CreateTestShapeModelWith2Edges(Math.PI * 0.5, 1.1);
+            Size imageSize = new Size(150, 100);
+            List<VertexConstraints> vertexConstraints = new List<VertexConstraints>();
+            for (int j = 0; j < shapeModel.Structure.VertexCount; ++j)
+            {
+                Vector min = new Vector(Random.Int(0, imageSize.Width), Random.Int(0, imageSize.Height));
+                vertexConstraints.Add(new VertexConstraints(min, min + new Vector(Random.Int(1, 30), Random.Int(1, 30))));
+            }
+            List<EdgeConstraints> edgeConstraints = new List<EdgeConstraints>();
+            for (int j = 0; j < shapeModel.Structure.Edges.Count; ++j)
+                edgeConstraints.Add(new EdgeConstraints(3, 10));
+
+            CpuShapeTermsLowerBoundCalculator calculatorIncremental = new CpuShapeTermsLowerBoundCalculator();
+            ObjectBackgroundTermPlanes shapeTermsIncremental = new ObjectBackgroundTermPlanes(imageSize.Width, imageSize.Height);
+            ObjectBackgroundTermPlanes shapeTermsPrevious = null;
+            for (int i = 0; i < 30; ++i)
+            {
+                // Change a single vertex, like B&B split does
+                int vertexIndex = Random.Int(shapeModel.Structure.VertexCount);
+                Vector min = new Vector(Random.Int(0, imageSize.Width), Random.Int(0, imageSize.Height));
+                vertexConstraints[vertexIndex] = new VertexConstraints(min, min + new Vector(Random.Int(1, 30), Random.Int(1, 30)));
+                ShapeConstraints constraintSet = ShapeConstraints.CreateFromConstraints(shapeModel.Structure, vertexConstraints, edgeConstraints);
+
+                calculatorIncremental.CalculateShapeTerms(shapeModel, constraintSet, shapeTermsIncremental);
+
+                ObjectBackgroundTermPlanes shapeTermsExpected = new ObjectBackgroundTermPlanes(imageSize.Width, imageSize.Height);
+                CpuShapeTermsLowerBoundCalculator calculatorFull = new CpuShapeTermsLowerBoundCalculator();
+                calculatorFull.UseIncrementalCombination = false;
+                calculatorFull.CalculateShapeTerms(shapeModel, constraintSet, shapeTermsExpected);
+
+                Rectangle changedRegion = calculatorIncremental.LastChangedRegion;
+                for (int y = 0; y < imageSize.Height; ++y)
+                {
+                    for (int x = 0; x < imageSize.Width; ++x)
+                    {
+                        Assert.AreEqual(shapeTermsExpected[x, y].ObjectTerm, shapeTermsIncremental[x, y].ObjectTerm);
+                        Assert.AreEqual(shapeTermsExpected[x, y].BackgroundTerm, shapeTermsIncremental[x, y].BackgroundTerm);
+
+                        // Nothing should change outside of the reported region
+                        if (shapeTermsPrevious != null && !changedRegion.Contains(x, y))
+                        {
+                            Assert.AreEqual(shapeTermsPrevious[x, y].ObjectTerm, shapeTermsIncremental[x, y].ObjectTerm);
+                            Assert.AreEqual(shapeTermsPrevious[x, y].BackgroundTerm, shapeTermsIncremental[x, y].BackgroundTerm);
+                        }
+                    }
+                }
+
+                shapeTermsPrevious = shapeTermsIncremental.Clone();
+            }
+
+            // Tree has an inner node per edge but one, and it is charged to the cache budget
+            long nodeByteSize = 2L * sizeof(float) * imageSize.Width * imageSize.Height;
+            Assert.AreEqual(nodeByteSize * (shapeModel.Structure.Edges.Count - 1), calculatorIncremental.CombinationTreeByteSize);
+            Assert.IsTrue(
+                calculatorIncremental.CachedEdgeTermsByteSize + calculatorIncremental.CombinationTreeByteSize <= calculatorIncremental.CacheByteBudget);
+        }
+
+        [TestMethod]
+        public void TestCompressedEdgeTerms()
+        {
+            ShapeModel shapeModel = TestHelper.CreateTestShapeModelWith2Edges(Math.PI * 0.5, 1.1);
+            Size imageSize = new Size(150, 100);
+
+            List<ShapeConstraints> constraintSets = TestHelper.CreateRandomShapeConstraints(shapeModel, imageSize, 20, 40);
+
+            CpuShapeTermsLowerBoundCalculator calculatorCompressed = new CpuShapeTermsLowerBoundCalculator();
+            calculatorCompressed.CompressCachedEdgeTerms = true;
+            calculatorCompressed.CacheByteBudget = 100000;
+            for (int i = 0; i < constraintSets.Count; ++i)
+            {
+                ShapeConstraints constraintSet = constraintSets[i];
+                calculatorCompressed.UseTiling = i % 2 == 0;
+                calculatorCompressed.UseIncrementalCombination = i % 3 != 0;
+
+                ObjectBackgroundTermPlanes shapeTerms = new ObjectBackgroundTermPlanes(imageSize.Width, imageSize.Height);
+                CpuShapeTermsLowerBoundCalculator calculator = new CpuShapeTermsLowerBoundCalculator();
+                calculator.CalculateShapeTerms(shapeModel, constraintSet, shapeTerms);
+
+                ObjectBackgroundTermPlanes shapeTermsCompressed = new ObjectBackgroundTermPlanes(imageSize.Width, imageSize.Height);
+                calculatorCompressed.CalculateShapeTerms(shapeModel, constraintSet, shapeTermsCompressed);
+
+                // Compressed terms should be slightly smaller
+                for (int j = 0; j < shapeTerms.ObjectTerms.Length; ++j)
+                {
+                    Assert.IsTrue(shapeTermsCompressed.ObjectTerms[j] <= shapeTerms.ObjectTerms[j]);
+                    Assert.IsTrue(shapeTermsCompressed.BackgroundTerms[j] <= shapeTerms.BackgroundTerms[j]);
+                    Assert.AreEqual(shapeTerms.ObjectTerms[j], shapeTermsCompressed.ObjectTerms[j], 1e-2 * Math.Abs(shapeTerms.ObjectTerms[j]));
+                    Assert.AreEqual(shapeTerms.BackgroundTerms[j], shapeTermsCompressed.BackgroundTerms[j], 1e-2 * Math.Abs(shapeTerms.BackgroundTerms[j]));
+                }
+
+                // Compression should save memory, and budget should be respected
+                Assert.IsTrue(calculatorCompressed.CachedEdgeTermsByteSize < calculator.CachedEdgeTermsByteSize);
+                Assert.IsTrue(calculatorCompressed.CachedEdgeTermsByteSize <= calculatorCompressed.CacheByteBudget);
+            }
+        }
+
+        [TestMethod]
+        public void TestDistanceTransformShapeTerms()
+        {
+            ShapeModel shapeModel = TestHelper.CreateTestShapeModelWith2Edges(Math.PI * 0.5, 1.1);
+            Size imageSize = new Size(150, 100);
+            List<ShapeConstraints> constraintSets = TestHelper.CreateRandomShapeConstraints(shapeModel, imageSize, 10, 40);
+
+            // Thin edges crossing the image, with vertices far outside of it (tested with both saturations)
+            ShapeConstraints farConstraintSet = ShapeConstraints.CreateFromConstraints(
+                shapeModel.Structure,
+                new[]
+                {
+                    new VertexConstraints(new Vector(-200, -160), new Vector(-195.5, -150)),
+                    new VertexConstraints(new Vector(320, 250.5), new Vector(330, 260)),
+                    new VertexConstraints(new Vector(-170, 270), new Vector(-160, 275))
+                },
+                new[] { new EdgeConstraints(2, 3), new EdgeConstraints(1, 2.5) });
+            constraintSets.Add(farConstraintSet);
+            constraintSets.Add(farConstraintSet);
+
+            // Calculator is shared, so that its distance transform buffers are reused for windows of different sizes
+            CpuShapeTermsLowerBoundCalculator calculatorTransform = new CpuShapeTermsLowerBoundCalculator();
+            calculatorTransform.HullDistanceMethod = HullDistanceMethod.DistanceTransform;
+            for (int i = 0; i < constraintSets.Count; ++i)
+            {
+                // Low saturation makes distance transform window smaller than the hull
+                ShapeConstraints constraintSet = constraintSets[i];
+                float saturation = i % 2 == 0 ? ObjectBackgroundTermPlanes.DefaultSaturation : 50;
+
+                ObjectBackgroundTermPlanes shapeTerms = new ObjectBackgroundTermPlanes(imageSize.Width, imageSize.Height, saturation);
+                CpuShapeTermsLowerBoundCalculator calculator = new CpuShapeTermsLowerBoundCalculator();
+                calculator.CalculateShapeTerms(shapeModel, constraintSet, shapeTerms);
+
+                ObjectBackgroundTermPlanes shapeTermsTransform = new ObjectBackgroundTermPlanes(imageSize.Width, imageSize.Height, saturation);
+                calculatorTransform.CalculateShapeTerms(shapeModel, constraintSet, shapeTermsTransform);
+
+                ObjectBackgroundTermPlanes shapeTermsTransformFull = new ObjectBackgroundTermPlanes(imageSize.Width, imageSize.Height, saturation);
+                CpuShapeTermsLowerBoundCalculator calculatorTransformFull = new CpuShapeTermsLowerBoundCalculator();
+                calculatorTransformFull.HullDistanceMethod = HullDistanceMethod.DistanceTransform;
+                calculatorTransformFull.UseTiling = false;
+                calculatorTransformFull.CalculateShapeTerms(shapeModel, constraintSet, shapeTermsTransformFull);
+
+                for (int j = 0; j < shapeTerms.ObjectTerms.Length; ++j)
+                {
+                    // Distance transform should give a slightly looser lower bound for object terms
+                    Assert.IsTrue(shapeTermsTransform.ObjectTerms[j] <= shapeTerms.ObjectTerms[j]);
+                    Assert.IsTrue(shapeTermsTransform.ObjectTerms[j] >= shapeTerms.ObjectTerms[j] * 0.5 - 2);
+                    Assert.AreEqual(shapeTerms.BackgroundTerms[j], shapeTermsTransform.BackgroundTerms[j]);
+
+                    Assert.AreEqual(shapeTermsTransform.ObjectTerms[j], shapeTermsTransformFull.ObjectTerms[j]);
+                    Assert.AreEqual(shapeTermsTransform.BackgroundTerms[j], shapeTermsTransformFull.BackgroundTerms[j]);
+                }
+            }
+        }
+
+        [TestMethod]
+        public void TestCoarseShapeTermsAreLowerBounds()
+        {
+            ShapeModel shapeModel = TestHelper.CreateTestShapeModelWith2Edges(Math.PI * 0.5, 1.1);
+            Size imageSize = new Size(150, 100);
+            List<ShapeConstraints> constraintSets = TestHelper.CreateRandomShapeConstraints(shapeModel, imageSize, 10, 60);
+            for (int i = 0; i < constraintSets.Count; ++i)
+            {
+                ShapeConstraints constraintSet = constraintSets[i];
+                ObjectBackgroundTermPlanes shapeTerms = new ObjectBackgroundTermPlanes(imageSize.Width, imageSize.Height);
+                CpuShapeTermsLowerBoundCalculator calculator = new CpuShapeTermsLowerBoundCalculator();
+                calculator.CalculateShapeTerms(shapeModel, constraintSet, shapeTerms);
+
+                ObjectBackgroundTermPlanes coarseShapeTerms = new ObjectBackgroundTermPlanes(imageSize.Width, imageSize.Height);
+                CoarseShapeTermsLowerBoundCalculator coarseCalculator = new CoarseShapeTermsLowerBoundCalculator();
+                coarseCalculator.BlockSize = 1 + i;
+                coarseCalculator.CalculateShapeTerms(shapeModel, constraintSet, coarseShapeTerms);
+
+                for (int j = 0; j < shapeTerms.ObjectTerms.Length; ++j)
+                {
+                    Assert.IsTrue(coarseShapeTerms.ObjectTerms[j] <= shapeTerms.ObjectTerms[j]);
+                    Assert.IsTrue(coarseShapeTerms.BackgroundTerms[j] <= shapeTerms.BackgroundTerms[j]);
+                }
+            }
+        }
+
+        [TestMethod]
+        public void TestNativeCpuShapeTermsAreLowerBounds()
+        {
+            ShapeModel shapeModel = TestHelper.CreateTestShapeModelWith2Edges(Math.PI * 0.5, 1.1);
+            Size imageSize = new Size(157, 101);
+            List<VertexConstraints> vertexConstraints = new List<VertexConstraints>();
+            vertexConstraints.Add(new VertexConstraints(new Vector(30.1, 30.3), new Vector(40.7, 35.2)));
+            vertexConstraints.Add(new VertexConstraints(new Vector(80.05, 60.75), new Vector(81.3, 62.9)));
+            vertexConstraints.Add(new VertexConstraints(new Vector(20.125, 70.01), new Vector(30.6, 90.5)));
+            List<EdgeConstraints> edgeConstraints = new List<EdgeConstraints>();
+            edgeConstraints.Add(new EdgeConstraints(2.3, 8.1));
+            edgeConstraints.Add(new EdgeConstraints(5.7, 12.2));
+            ShapeConstraints constraintSet = ShapeConstraints.CreateFromConstraints(shapeModel.Structure, vertexConstraints, edgeConstraints);
+
+            // Distance transform would make managed terms looser than exact ones
+            ObjectBackgroundTermPlanes shapeTermsCpu = new ObjectBackgroundTermPlanes(imageSize.Width, imageSize.Height);
+            CpuShapeTermsLowerBoundCalculator calculatorCpu = new CpuShapeTermsLowerBoundCalculator();
+            calculatorCpu.HullDistanceMethod = HullDistanceMethod.Segments;
+            calculatorCpu.CalculateShapeTerms(shapeModel, constraintSet, shapeTermsCpu);
+
+            // Scalar and AVX paths should both stay below the managed terms in every pixel
+            foreach (bool useAvx in new[] { false, true })
+            {
+                ObjectBackgroundTermPlanes shapeTermsNativeCpu = new ObjectBackgroundTermPlanes(imageSize.Width, imageSize.Height);
+                NativeCpuShapeTermsLowerBoundCalculator calculatorNativeCpu = new NativeCpuShapeTermsLowerBoundCalculator();
+                calculatorNativeCpu.UseAvx = useAvx;
+                calculatorNativeCpu.CalculateShapeTerms(shapeModel, constraintSet, shapeTermsNativeCpu);
+
+                for (int i = 0; i < shapeTermsCpu.ObjectTerms.Length; ++i)
+                {
+                    Assert.IsTrue(shapeTermsNativeCpu.ObjectTerms[i] <= shapeTermsCpu.ObjectTerms[i]);
+                    Assert.IsTrue(shapeTermsNativeCpu.BackgroundTerms[i] <= shapeTermsCpu.BackgroundTerms[i]);
+                    Assert.AreEqual(shapeTermsCpu.ObjectTerms[i], shapeTermsNativeCpu.ObjectTerms[i], 1e-3 * Math.Max(1, shapeTermsCpu.ObjectTerms[i]));
+                    Assert.AreEqual(shapeTermsCpu.BackgroundTerms[i], shapeTermsNativeCpu.BackgroundTerms[i], 1e-3);
+                }
+            }
+        }
+
+        [TestMethod]
+        public void TestTranslatedShapeTermsFromTemplates()
+        {
+            ShapeModel shapeModel = TestHelper.CreateTestShapeModelWith2Edges(Math.PI * 0.5, 1.1);
+            Size imageSize = new Size(150, 100);
+            List<VertexConstraints> vertexConstraints = new List<VertexConstraints>();
+            vertexConstraints.Add(new VertexConstraints(new Vector(30.25, 30.5), new Vector(40.25, 35)));
+            vertexConstraints.Add(new VertexConstraints(new Vector(80, 60.75), new Vector(81.5, 62)));
+            vertexConstraints.Add(new VertexConstraints(new Vector(20.125, 70), new Vector(30, 90.5)));
+            List<EdgeConstraints> edgeConstraints = new List<EdgeConstraints>();
+            edgeConstraints.Add(new EdgeConstraints(3, 8));
+            edgeConstraints.Add(new EdgeConstraints(5, 12));
+
+            CpuShapeTermsLowerBoundCalculator calculator = new CpuShapeTermsLowerBoundCalculator();
+            calculator.UseTemplateCache = true;
+            ObjectBackgroundTermPlanes shapeTerms = new ObjectBackgroundTermPlanes(imageSize.Width, imageSize.Height);
+            ShapeConstraints constraintSet = ShapeConstraints.CreateFromConstraints(shapeModel.Structure, vertexConstraints, edgeConstraints);
+            calculator.CalculateShapeTerms(shapeModel, constraintSet, shapeTerms);
+            Assert.AreEqual(0, calculator.TemplateCacheHitCount);
+
+            // Templates store only the bands around edges
+            Assert.IsTrue(calculator.TemplateCacheByteSize < 2L * sizeof(float) * shapeTerms.ObjectTerms.Length * shapeModel.Structure.Edges.Count);
+            Assert.IsTrue(
+                calculator.CachedEdgeTermsByteSize + calculator.TemplateCacheByteSize + calculator.CombinationTreeByteSize <= calculator.CacheByteBudget);
+
+            Vector[] shifts = { new Vector(7, -3), new Vector(-25, 12), new Vector(60, 0) };
+            foreach (Vector shift in shifts)
+            {
+                List<VertexConstraints> shiftedVertexConstraints = new List<VertexConstraints>();
+                foreach (VertexConstraints constraints in vertexConstraints)
+                    shiftedVertexConstraints.Add(new VertexConstraints(constraints.MinCoord + shift, constraints.MaxCoord + shift));
+                ShapeConstraints shiftedConstraintSet = ShapeConstraints.CreateFromConstraints(shapeModel.Structure, shiftedVertexConstraints, edgeConstraints);
+
+                ObjectBackgroundTermPlanes shapeTermsFromTemplates = new ObjectBackgroundTermPlanes(imageSize.Width, imageSize.Height);
+                calculator.CalculateShapeTerms(shapeModel, shiftedConstraintSet, shapeTermsFromTemplates);
+
+                ObjectBackgroundTermPlanes shapeTermsExpected = new ObjectBackgroundTermPlanes(imageSize.Width, imageSize.Height);
+                CpuShapeTermsLowerBoundCalculator calculatorNoTemplates = new CpuShapeTermsLowerBoundCalculator();
+                calculatorNoTemplates.CalculateShapeTerms(shapeModel, shiftedConstraintSet, shapeTermsExpected);
+
+                // Shifted terms are lower bounds of the direct ones,
+                // far from the edges object terms are replaced by a lower bound that is still large
+                for (int i = 0; i < shapeTermsExpected.ObjectTerms.Length; ++i)
+                {
+                    double tolerance = 1e-4 * Math.Max(1, shapeTermsExpected.ObjectTerms[i]);
+                    Assert.IsTrue(shapeTermsFromTemplates.ObjectTerms[i] <= shapeTermsExpected.ObjectTerms[i]);
+                    Assert.IsTrue(shapeTermsFromTemplates.ObjectTerms[i] >= Math.Min(shapeTermsExpected.ObjectTerms[i], 50) - tolerance);
+                    Assert.IsTrue(shapeTermsFromTemplates.BackgroundTerms[i] <= shapeTermsExpected.BackgroundTerms[i]);
+                    Assert.AreEqual(shapeTermsExpected.BackgroundTerms[i], shapeTermsFromTemplates.BackgroundTerms[i], 1e-4);
+                }
+            }
+
+            Assert.AreEqual(shifts.Length * shapeModel.Structure.Edges.Count, calculator.TemplateCacheHitCount);
+        }
+
+        [TestMethod]
+        public void TestPersistentEdgeTermsStore()
+        {
+            ShapeModel shapeModel = TestHelper.CreateTestShapeModelWith2Edges(Math.PI * 0.5, 1.1);
+            Size imageSize = new Size(120, 80);
+            List<VertexConstraints> vertexConstraints = new List<VertexConstraints>();
+            vertexConstraints.Add(new VertexConstraints(new Vector(10, 10), new Vector(20.5, 15)));
+            vertexConstraints.Add(new VertexConstraints(new Vector(70, 50.25), new Vector(72, 52)));
+            vertexConstraints.Add(new VertexConstraints(new Vector(15, 60), new Vector(25, 70)));
+            List<EdgeConstraints> edgeConstraints = new List<EdgeConstraints>();
+            edgeConstraints.Add(new EdgeConstraints(2, 6));
+            edgeConstraints.Add(new EdgeConstraints(4, 9));
+            ShapeConstraints constraintSet = ShapeConstraints.CreateFromConstraints(shapeModel.Structure, vertexConstraints, edgeConstraints);
+
+            string storeFileName = Path.Combine(Path.GetTempPath(), "edge_terms_store_test.bin");
+            File.Delete(storeFileName);
+
+            ObjectBackgroundTermPlanes shapeTerms = new ObjectBackgroundTermPlanes(imageSize.Width, imageSize.Height);
+            using (PersistentEdgeTermsStore store = new PersistentEdgeTermsStore(
+                storeFileName, imageSize, shapeTerms.Saturation, HullDistanceMethod.Segments, 0, false, 64))
+            {
+                CpuShapeTermsLowerBoundCalculator calculator = new CpuShapeTermsLowerBoundCalculator();
+                calculator.PersistentStore = store;
+                calculator.CalculateShapeTerms(shapeModel, constraintSet, shapeTerms);
+                Assert.AreEqual(0, store.HitCount);
+            }
+
+            // Terms should survive reopening the store
+            ObjectBackgroundTermPlanes shapeTermsFromStore = new ObjectBackgroundTermPlanes(imageSize.Width, imageSize.Height);
+            using (PersistentEdgeTermsStore store = new PersistentEdgeTermsStore(
+                storeFileName, imageSize, shapeTerms.Saturation, HullDistanceMethod.Segments, 0, false, 64))
+            {
+                CpuShapeTermsLowerBoundCalculator calculator = new CpuShapeTermsLowerBoundCalculator();
+                calculator.PersistentStore = store;
+                calculator.CalculateShapeTerms(shapeModel, constraintSet, shapeTermsFromStore);
+                Assert.AreEqual(shapeModel.Structure.Edges.Count, store.HitCount);
+            }
+
+            for (int i = 0; i < shapeTerms.ObjectTerms.Length; ++i)
+            {
+                Assert.AreEqual(shapeTerms.ObjectTerms[i], shapeTermsFromStore.ObjectTerms[i]);
+                Assert.AreEqual(shapeTerms.BackgroundTerms[i], shapeTermsFromStore.BackgroundTerms[i]);
+            }
+
+            // Terms calculated with less tight settings should not be mixed with the stored ones
+            try
+            {
+                using (new PersistentEdgeTermsStore(
+                    storeFileName, imageSize, shapeTerms.Saturation, HullDistanceMethod.DistanceTransform, 0, false, 64))
+                {
+                }
+
+                Assert.Fail("Store created with different hull distance method should be refused.");
+            }
+            catch (InvalidDataException)
+            {
+            }
+
+            using (PersistentEdgeTermsStore store = new PersistentEdgeTermsStore(
+                storeFileName, imageSize, shapeTerms.Saturation, HullDistanceMethod.Segments, 0, false, 64))
+            {
+                CpuShapeTermsLowerBoundCalculator calculator = new CpuShapeTermsLowerBoundCalculator();
+                calculator.CompressCachedEdgeTerms = true;
+                calculator.PersistentStore = store;
+                try
+                {
+                    calculator.CalculateShapeTerms(shapeModel, constraintSet, shapeTermsFromStore);
+                    Assert.Fail("Calculator should refuse a store created for different compression settings.");
+                }
+                catch (InvalidOperationException)
+                {
+                }
+            }
+
+            File.Delete(storeFileName);
+            File.Delete(storeFileName + ".lock");
+        }
     }
 }
@@ -1,6 +1,9 @@
 ﻿using System;
 using System.Collections.Generic;
+using System.Drawing;
 using System.Linq;
+using Research.GraphBasedShapePrior.Util;
+using Random = Research.GraphBasedShapePrior.Util.Random;
 
 namespace Research.GraphBasedShapePrior.Tests
 {
@@ -87,5 +90,37 @@ namespace Research.GraphBasedShapePrior.Tests
 
             return ShapeModel.Create(new ShapeStructure(edges), vertexParams, edgePairParams, 2, 40, 10);
         }
+
+        /// <summary>
+        /// Creates reproducible random constraints with vertex boxes placed around and partially outside of the image.
+        /// </summary>
+        public static List<ShapeConstraints> CreateRandomShapeConstraints(ShapeModel shapeModel, Size imageSize, int count, double maxVertexBoxSize)
+        {
+            Random.SetSeed(666);
+
+            List<ShapeConstraints> result = new List<ShapeConstraints>();
+            for (int i = 0; i < count; ++i)
+            {
+                List<VertexConstraints> vertexConstraints = new List<VertexConstraints>();
+                for (int j = 0; j < shapeModel.Structure.VertexCount; ++j)
+                {
+                    Vector min = new Vector(
+                        Random.Int(-20, imageSize.Width + 20) + Random.Double(), Random.Int(-20, imageSize.Height + 20) + Random.Double());
+                    Vector size = new Vector(Random.Double(0.1, maxVertexBoxSize), Random.Double(0.1, maxVertexBoxSize));
+                    vertexConstraints.Add(new VertexConstraints(min, min + size));
+                }
+
+                List<EdgeConstraints> edgeConstraints = new List<EdgeConstraints>();
+                for (int j = 0; j < shapeModel.Structure.Edges.Count; ++j)
+                {
+                    double minWidth = Random.Int(1, 20);
+                    edgeConstraints.Add(new EdgeConstraints(minWidth, minWidth + Random.Int(0, 20)));
+                }
+
+                result.Add(ShapeConstraints.CreateFromConstraints(shapeModel.Structure, vertexConstraints, edgeConstraints));
+            }
+
+            return result;
+        }
     }
 }
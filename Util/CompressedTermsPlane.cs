@@ -0,0 +1,211 @@
+﻿using System;
+using System.Collections.Generic;
+using System.Diagnostics;
+using System.Runtime.InteropServices;
+
+namespace Research.GraphBasedShapePrior.Util
+{
+    /// <summary>
+    /// Row-major plane of terms stored with 16-bit precision (upper half of the float representation)
+    /// and run-length encoding of repeated values. Values are always rounded down, so lower bounds stay valid.
+    /// </summary>
+    public class CompressedTermsPlane
+    {
+        // Segment header is either a run (flag set, single value follows) or a literal (values follow)
+        private const int RunFlag = 0x8000;
+
+        private const int MaxSegmentLength = 0x7FFF;
+
+        // Runs shorter than that are stored as literals
+        private const int MinRunLength = 3;
+
+        private readonly ushort[] data;
+
+        private readonly int[] rowOffsets;
+
+        public CompressedTermsPlane(float[] values, int width, int height)
+        {
+            if (values == null)
+                throw new ArgumentNullException("values");
+            if (width < 0)
+                throw new ArgumentOutOfRangeException("width", "Parameter value should not be negative.");
+            if (height < 0)
+                throw new ArgumentOutOfRangeException("height", "Parameter value should not be negative.");
+            if (values.Length != width * height)
+                throw new ArgumentException("Value count doesn't match plane size.", "values");
+
+            this.Width = width;
+            this.Height = height;
+            this.rowOffsets = new int[height + 1];
+
+            List<ushort> encoded = new List<ushort>();
+            for (int y = 0; y < height; ++y)
+            {
+                this.rowOffsets[y] = encoded.Count;
+                EncodeRow(values, y * width, width, encoded);
+            }
+
+            this.rowOffsets[height] = encoded.Count;
+            this.data = encoded.ToArray();
+        }
+
+        public int Width { get; private set; }
+
+        public int Height { get; private set; }
+
+        public long ByteSize
+        {
+            get { return this.data.Length * sizeof(ushort) + this.rowOffsets.Length * sizeof(int); }
+        }
+
+        public static float RoundDown(float value)
+        {
+            FloatBits bits = new FloatBits { Value = value };
+            ushort result = (ushort)(bits.Bits >> 16);
+
+            // Truncation rounds towards zero, negative values should go away from it
+            if ((bits.Bits & 0x8000FFFF) > 0x80000000)
+                result += 1;
+            return ToFloat(result);
+        }
+
+        public static void RoundDown(float[] values)
+        {
+            if (values == null)
+                throw new ArgumentNullException("values");
+
+            for (int i = 0; i < values.Length; ++i)
+                values[i] = RoundDown(values[i]);
+        }
+
+        public void CopyRow(int y, int minX, int count, float[] target, int targetIndex)
+        {
+            this.ApplyToRow(y, minX, count, target, targetIndex, RowOperation.Copy);
+        }
+
+        public void MinRow(int y, int minX, int count, float[] target, int targetIndex)
+        {
+            this.ApplyToRow(y, minX, count, target, targetIndex, RowOperation.Min);
+        }
+
+        public void MaxRow(int y, int minX, int count, float[] target, int targetIndex)
+        {
+            this.ApplyToRow(y, minX, count, target, targetIndex, RowOperation.Max);
+        }
+
+        private void ApplyToRow(int y, int minX, int count, float[] target, int targetIndex, RowOperation operation)
+        {
+            Debug.Assert(y >= 0 && y < this.Height && minX >= 0 && minX + count <= this.Width);
+
+            int position = this.rowOffsets[y];
+            int x = 0;
+            int maxX = minX + count;
+            while (x < maxX)
+            {
+                int header = this.data[position];
+                bool isRun = (header & RunFlag) != 0;
+                int segmentLength = header & MaxSegmentLength;
+                int segmentEnd = x + segmentLength;
+
+                // Skip segments before the requested range
+                if (segmentEnd <= minX)
+                {
+                    position += isRun ? 2 : segmentLength + 1;
+                    x = segmentEnd;
+                    continue;
+                }
+
+                int from = Math.Max(x, minX), to = Math.Min(segmentEnd, maxX);
+                int index = targetIndex + from - minX;
+                if (isRun)
+                {
+                    float value = ToFloat(this.data[position + 1]);
+                    for (int i = from; i < to; ++i, ++index)
+                        target[index] = Apply(target[index], value, operation);
+                    position += 2;
+                }
+                else
+                {
+                    int valuePosition = position + 1 + from - x;
+                    for (int i = from; i < to; ++i, ++index, ++valuePosition)
+                        target[index] = Apply(target[index], ToFloat(this.data[valuePosition]), operation);
+                    position += segmentLength + 1;
+                }
+
+                x = segmentEnd;
+            }
+        }
+
+        private static float Apply(float current, float value, RowOperation operation)
+        {
+            switch (operation)
+            {
+                case RowOperation.Min:
+                    return Math.Min(current, value);
+                case RowOperation.Max:
+                    return Math.Max(current, value);
+                default:
+                    return value;
+            }
+        }
+
+        private static void EncodeRow(float[] values, int rowStart, int width, List<ushort> encoded)
+        {
+            int literalHeaderPosition = -1;
+            int x = 0;
+            while (x < width)
+            {
+                ushort value = ToStored(values[rowStart + x]);
+                int runLength = 1;
+                while (x + runLength < width && runLength < MaxSegmentLength && ToStored(values[rowStart + x + runLength]) == value)
+                    ++runLength;
+
+                if (runLength >= MinRunLength)
+                {
+                    encoded.Add((ushort)(RunFlag | runLength));
+                    encoded.Add(value);
+                    literalHeaderPosition = -1;
+                    x += runLength;
+                    continue;
+                }
+
+                if (literalHeaderPosition == -1 || encoded[literalHeaderPosition] == MaxSegmentLength)
+                {
+                    literalHeaderPosition = encoded.Count;
+                    encoded.Add(0);
+                }
+
+                encoded[literalHeaderPosition] += 1;
+                encoded.Add(value);
+                x += 1;
+            }
+        }
+
+        private static ushort ToStored(float value)
+        {
+            return (ushort)(new FloatBits { Value = RoundDown(value) }.Bits >> 16);
+        }
+
+        private static float ToFloat(ushort stored)
+        {
+            return new FloatBits { Bits = (uint)stored << 16 }.Value;
+        }
+
+        private enum RowOperation
+        {
+            Copy,
+            Min,
+            Max
+        }
+
+        [StructLayout(LayoutKind.Explicit)]
+        private struct FloatBits
+        {
+            [FieldOffset(0)]
+            public float Value;
+
+            [FieldOffset(0)]
+            public uint Bits;
+        }
+    }
+}
@@ -0,0 +1,180 @@
+﻿using System;
+using System.Collections.Generic;
+
+namespace Research.GraphBasedShapePrior.Util
+{
+    /// <summary>
+    /// Array-based min-heap where every node has the given number of children.
+    /// Wider nodes make the heap shallower, so insertions do fewer comparisons and memory accesses than in a binary heap.
+    /// </summary>
+    public class DaryHeap<T>
+    {
+        private readonly int arity;
+
+        private readonly IComparer<T> comparer;
+
+        private T[] items = new T[16];
+
+        private int count;
+
+        public DaryHeap(int arity)
+            : this(arity, Comparer<T>.Default)
+        {
+        }
+
+        public DaryHeap(int arity, IComparer<T> comparer)
+        {
+            if (arity < 2)
+                throw new ArgumentOutOfRangeException("arity", "Parameter value should be at least 2.");
+            if (comparer == null)
+                throw new ArgumentNullException("comparer");
+
+            this.arity = arity;
+            this.comparer = comparer;
+        }
+
+        public int Count
+        {
+            get { return this.count; }
+        }
+
+        public T Min
+        {
+            get
+            {
+                if (this.count == 0)
+                    throw new InvalidOperationException("Heap is empty.");
+                return this.items[0];
+            }
+        }
+
+        public void Add(T item)
+        {
+            if (this.count == this.items.Length)
+                Array.Resize(ref this.items, this.items.Length * 2);
+
+            this.items[this.count] = item;
+            this.count += 1;
+            this.SiftUp(this.count - 1);
+        }
+
+        public T RemoveMin()
+        {
+            T result = this.Min;
+            this.count -= 1;
+            this.items[0] = this.items[this.count];
+            this.items[this.count] = default(T);
+            if (this.count > 0)
+                this.SiftDown(0);
+            return result;
+        }
+
+        /// <summary>
+        /// Removes all the items matching the predicate and restores the heap property in linear time.
+        /// </summary>
+        /// <returns>Number of removed items.</returns>
+        public int RemoveWhere(Predicate<T> match)
+        {
+            if (match == null)
+                throw new ArgumentNullException("match");
+
+            int keptCount = 0;
+            for (int i = 0; i < this.count; ++i)
+            {
+                if (!match(this.items[i]))
+                    this.items[keptCount++] = this.items[i];
+            }
+
+            int removedCount = this.count - keptCount;
+            Array.Clear(this.items, keptCount, removedCount);
+            this.count = keptCount;
+            if (removedCount > 0)
+                this.Heapify();
+            return removedCount;
+        }
+
+        /// <summary>
+        /// Replaces the contents of the heap with the given items.
+        /// </summary>
+        public void Reset(IEnumerable<T> newItems)
+        {
+            if (newItems == null)
+                throw new ArgumentNullException("newItems");
+
+            this.Clear();
+            foreach (T item in newItems)
+            {
+                if (this.count == this.items.Length)
+                    Array.Resize(ref this.items, this.items.Length * 2);
+                this.items[this.count++] = item;
+            }
+
+            this.Heapify();
+        }
+
+        public void Clear()
+        {
+            Array.Clear(this.items, 0, this.count);
+            this.count = 0;
+        }
+
+        /// <summary>
+        /// Returns the items of the heap in no particular order.
+        /// </summary>
+        public T[] ToArray()
+        {
+            T[] result = new T[this.count];
+            Array.Copy(this.items, result, this.count);
+            return result;
+        }
+
+        private void Heapify()
+        {
+            for (int i = (this.count - 2) / this.arity; i >= 0; --i)
+                this.SiftDown(i);
+        }
+
+        private void SiftUp(int index)
+        {
+            T item = this.items[index];
+            while (index > 0)
+            {
+                int parentIndex = (index - 1) / this.arity;
+                if (this.comparer.Compare(this.items[parentIndex], item) <= 0)
+                    break;
+
+                this.items[index] = this.items[parentIndex];
+                index = parentIndex;
+            }
+
+            this.items[index] = item;
+        }
+
+        private void SiftDown(int index)
+        {
+            T item = this.items[index];
+            while (true)
+            {
+                int firstChildIndex = index * this.arity + 1;
+                if (firstChildIndex >= this.count)
+                    break;
+
+                int minChildIndex = firstChildIndex;
+                int lastChildIndex = Math.Min(firstChildIndex + this.arity, this.count);
+                for (int i = firstChildIndex + 1; i < lastChildIndex; ++i)
+                {
+                    if (this.comparer.Compare(this.items[i], this.items[minChildIndex]) < 0)
+                        minChildIndex = i;
+                }
+
+                if (this.comparer.Compare(item, this.items[minChildIndex]) <= 0)
+                    break;
+
+                this.items[index] = this.items[minChildIndex];
+                index = minChildIndex;
+            }
+
+            this.items[index] = item;
+        }
+    }
+}
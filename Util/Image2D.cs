@@ -19,6 +19,18 @@ namespace Research.GraphBasedShapePrior.Util
             return ToRegularImage(image, x => x ? Color.White : Color.Black);
         }
 
+        public static Image ToRegularImage(Mask2D mask)
+        {
+            if (mask == null)
+                throw new ArgumentNullException("mask");
+            
+            Bitmap result = new Bitmap(mask.Width, mask.Height);
+            for (int i = 0; i < mask.Width; ++i)
+                for (int j = 0; j < mask.Height; ++j)
+                    result.SetPixel(i, j, mask[i, j] ? Color.White : Color.Black);
+            return result;
+        }
+
         public static Image ToRegularImage(Image2D<bool?> image)
         {
             return ToRegularImage(image, x => x.HasValue ? (x.Value ? Color.Red : Color.Blue) : Color.Black);
@@ -123,6 +135,11 @@ namespace Research.GraphBasedShapePrior.Util
             ToRegularImage(image).Save(fileName);
         }
 
+        public static void SaveToFile(Mask2D mask, string fileName)
+        {
+            ToRegularImage(mask).Save(fileName);
+        }
+
         public static void SaveToFile(Image2D<bool?> image, string fileName)
         {
             ToRegularImage(image).Save(fileName);
@@ -167,21 +184,46 @@ namespace Research.GraphBasedShapePrior.Util
         }
     }
 
+    /// <summary>
+    /// Image stored in a single contiguous row-major buffer.
+    /// Pixel (x, y) is located at index y * Stride + x of <see cref="Buffer"/>,
+    /// so the buffer can be pinned and passed to native code as is.
+    /// </summary>
     public class Image2D<T> : IEnumerable<T>
     {
-        private readonly T[,] data;
+        private readonly T[] data;
 
         public Image2D(int width, int height)
+            : this(width, height, width)
+        {
+        }
+
+        public Image2D(int width, int height, int stride)
         {
+            if (width < 0)
+                throw new ArgumentOutOfRangeException("width", "Parameter value should not be negative.");
+            if (height < 0)
+                throw new ArgumentOutOfRangeException("height", "Parameter value should not be negative.");
+            if (stride < width)
+                throw new ArgumentOutOfRangeException("stride", "Stride should not be less than width.");
+            
             this.Width = width;
             this.Height = height;
-            this.data = new T[width, height];
+            this.Stride = stride;
+            this.data = new T[stride * height];
         }
 
         public int Width { get; private set; }
 
         public int Height { get; private set; }
 
+        public int Stride { get; private set; }
+
+        public T[] Buffer
+        {
+            get { return this.data; }
+        }
+
         public Size Size
         {
             get { return new Size(this.Width, this.Height); }
@@ -192,10 +234,30 @@ namespace Research.GraphBasedShapePrior.Util
             get { return new Rectangle(0, 0, this.Width, this.Height); }
         }
 
+        /// <summary>
+        /// Gets or sets the pixel at the given position. Coordinates are always checked, since with a padded stride
+        /// an out-of-range column would silently address another pixel. Hot loops should use <see cref="Buffer"/> instead.
+        /// </summary>
         public T this[int i, int j]
         {
-            get { return this.data[i, j]; }
-            set { this.data[i, j] = value; }
+            get
+            {
+                this.CheckCoords(i, j);
+                return this.data[j * this.Stride + i];
+            }
+            set
+            {
+                this.CheckCoords(i, j);
+                this.data[j * this.Stride + i] = value;
+            }
+        }
+
+        /// <summary>
+        /// Gets the index of the given pixel in <see cref="Buffer"/>. Coordinates are not checked.
+        /// </summary>
+        public int GetIndex(int x, int y)
+        {
+            return y * this.Stride + x;
         }
 
         public Image2D<T> Shrink(Rectangle takeWhat)
@@ -204,9 +266,8 @@ namespace Research.GraphBasedShapePrior.Util
 
             Image2D<T> result = new Image2D<T>(takeWhat.Width, takeWhat.Height);
 
-            for (int i = takeWhat.Left; i < takeWhat.Right; ++i)
-                for (int j = takeWhat.Top; j < takeWhat.Bottom; ++j)
-                    result[i - takeWhat.Left, j - takeWhat.Top] = this.data[i, j];
+            for (int j = takeWhat.Top; j < takeWhat.Bottom; ++j)
+                Array.Copy(this.data, j * this.Stride + takeWhat.Left, result.data, (j - takeWhat.Top) * result.Stride, takeWhat.Width);
 
             return result;
         }
@@ -217,11 +278,12 @@ namespace Research.GraphBasedShapePrior.Util
             Debug.Assert(mask1.Height == mask2.Height);
 
             int count = 0;
-            for (int i = 0; i < mask1.Width; ++i)
+            for (int j = 0; j < mask1.Height; ++j)
             {
-                for (int j = 0; j < mask1.Height; ++j)
+                int offset1 = j * mask1.Stride, offset2 = j * mask2.Stride;
+                for (int i = 0; i < mask1.Width; ++i)
                 {
-                    if (!Equals(mask1[i, j], mask2[i, j]))
+                    if (!Equals(mask1.data[offset1 + i], mask2.data[offset2 + i]))
                         ++count;
                 }
             }
@@ -231,10 +293,8 @@ namespace Research.GraphBasedShapePrior.Util
 
         public Image2D<T> Clone()
         {
-            Image2D<T> result = new Image2D<T>(this.Width, this.Height);
-            for (int i = 0; i < this.Width; ++i)
-                for (int j = 0; j < this.Height; ++j)
-                    result[i, j] = this.data[i, j];
+            Image2D<T> result = new Image2D<T>(this.Width, this.Height, this.Stride);
+            Array.Copy(this.data, result.data, this.data.Length);
             return result;
         }
 
@@ -242,12 +302,20 @@ namespace Research.GraphBasedShapePrior.Util
         {
             for (int i = 0; i < this.Width; ++i)
                 for (int j = 0; j < this.Height; ++j)
-                    yield return this.data[i, j];
+                    yield return this.data[j * this.Stride + i];
         }
 
         IEnumerator IEnumerable.GetEnumerator()
         {
             return GetEnumerator();
         }
+
+        private void CheckCoords(int x, int y)
+        {
+            if ((uint)x >= (uint)this.Width)
+                throw new ArgumentOutOfRangeException("x", "Coordinate should be inside the image.");
+            if ((uint)y >= (uint)this.Height)
+                throw new ArgumentOutOfRangeException("y", "Coordinate should be inside the image.");
+        }
     }
 }
@@ -10,25 +10,40 @@ namespace Research.GraphBasedShapePrior.Util
 
         private readonly LinkedList<StorageItem> storage = new LinkedList<StorageItem>();
 
+        private readonly int capacity;
+
         public LruCache(int capacity)
         {
-            for (int i = 0; i < capacity; ++i)
-                storage.AddLast(new StorageItem());
+            if (capacity <= 0)
+                throw new ArgumentOutOfRangeException("capacity", "Parameter value should be positive.");
+            this.capacity = capacity;
+        }
+
+        public int Count
+        {
+            get { return keyToStorage.Count; }
         }
 
         public void Add(TKey key, TValue value)
+        {
+            if (keyToStorage.Count == this.capacity)
+                RemoveLeastRecentlyUsed();
+
+            LinkedListNode<StorageItem> storageNode = storage.AddFirst(new StorageItem { Key = key, Value = value });
+            keyToStorage.Add(key, storageNode);
+        }
+
+        public bool RemoveLeastRecentlyUsed()
         {
             LinkedListNode<StorageItem> storageNode = storage.Last;
-            if (keyToStorage.Count == storage.Count)
-            {
-                keyToStorage.Remove(storageNode.Value.Key);
+            if (storageNode == null)
+                return false;
+
+            storage.RemoveLast();
+            keyToStorage.Remove(storageNode.Value.Key);
+            if (CacheItemDiscarded != null)
                 CacheItemDiscarded(this, new LruCacheItemDiscardedEventArgs<TKey, TValue>(storageNode.Value.Key, storageNode.Value.Value));
-            }
-            
-            storageNode.Value.Key = key;
-            storageNode.Value.Value = value;
-            keyToStorage.Add(key, storageNode);
-            Touch(storageNode);
+            return true;
         }
 
         public bool TryGetValue(TKey key, out TValue value)
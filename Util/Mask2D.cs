@@ -0,0 +1,184 @@
+﻿using System;
+using System.Diagnostics;
+using System.Drawing;
+
+namespace Research.GraphBasedShapePrior.Util
+{
+    /// <summary>
+    /// Binary image that stores one bit per pixel. Rows are packed into 64-bit words,
+    /// so comparisons between masks are done by XOR and population count.
+    /// Cloning is O(1): clones share storage until one of them is modified.
+    /// </summary>
+    public class Mask2D
+    {
+        private const int BitsPerWord = 64;
+
+        private ulong[] words;
+
+        private bool storageShared;
+
+        public Mask2D(int width, int height)
+        {
+            if (width < 0)
+                throw new ArgumentOutOfRangeException("width", "Parameter value should not be negative.");
+            if (height < 0)
+                throw new ArgumentOutOfRangeException("height", "Parameter value should not be negative.");
+
+            this.Width = width;
+            this.Height = height;
+            this.WordsPerRow = (width + BitsPerWord - 1) / BitsPerWord;
+            this.words = new ulong[this.WordsPerRow * height];
+        }
+
+        private Mask2D(Mask2D other)
+        {
+            this.Width = other.Width;
+            this.Height = other.Height;
+            this.WordsPerRow = other.WordsPerRow;
+            this.words = other.words;
+            this.storageShared = true;
+        }
+
+        public int Width { get; private set; }
+
+        public int Height { get; private set; }
+
+        public int WordsPerRow { get; private set; }
+
+        public Size Size
+        {
+            get { return new Size(this.Width, this.Height); }
+        }
+
+        public Rectangle Rectangle
+        {
+            get { return new Rectangle(0, 0, this.Width, this.Height); }
+        }
+
+        public bool this[int x, int y]
+        {
+            get
+            {
+                Debug.Assert(x >= 0 && x < this.Width && y >= 0 && y < this.Height);
+                return (this.words[y * this.WordsPerRow + x / BitsPerWord] & (1UL << (x % BitsPerWord))) != 0;
+            }
+            set
+            {
+                Debug.Assert(x >= 0 && x < this.Width && y >= 0 && y < this.Height);
+
+                this.EnsureStorageNotShared();
+                ulong bit = 1UL << (x % BitsPerWord);
+                int wordIndex = y * this.WordsPerRow + x / BitsPerWord;
+                if (value)
+                    this.words[wordIndex] |= bit;
+                else
+                    this.words[wordIndex] &= ~bit;
+            }
+        }
+
+        public int CountSetBits()
+        {
+            int count = 0;
+            for (int i = 0; i < this.words.Length; ++i)
+                count += PopCount(this.words[i]);
+            return count;
+        }
+
+        public static int DifferentValueCount(Mask2D mask1, Mask2D mask2)
+        {
+            if (mask1 == null)
+                throw new ArgumentNullException("mask1");
+            if (mask2 == null)
+                throw new ArgumentNullException("mask2");
+            if (mask1.Width != mask2.Width || mask1.Height != mask2.Height)
+                throw new ArgumentException("Masks should have the same size.");
+
+            // Padding bits are always zero, so they never contribute to the difference
+            int count = 0;
+            ulong[] words1 = mask1.words, words2 = mask2.words;
+            if (ReferenceEquals(words1, words2))
+                return 0;
+            for (int i = 0; i < words1.Length; ++i)
+                count += PopCount(words1[i] ^ words2[i]);
+            return count;
+        }
+
+        public Mask2D Clone()
+        {
+            this.storageShared = true;
+            return new Mask2D(this);
+        }
+
+        /// <summary>
+        /// Creates a view of the given region without copying the mask.
+        /// </summary>
+        public Mask2DView GetView(Rectangle region)
+        {
+            if (!this.Rectangle.Contains(region))
+                throw new ArgumentOutOfRangeException("region", "Region should be inside the mask.");
+
+            this.storageShared = true;
+            return new Mask2DView(this.words, this.WordsPerRow, region);
+        }
+
+        public Mask2DView GetRowView(int y)
+        {
+            return this.GetView(new Rectangle(0, y, this.Width, 1));
+        }
+
+        public static Mask2D FromImage(Image2D<bool> image)
+        {
+            if (image == null)
+                throw new ArgumentNullException("image");
+
+            Mask2D result = new Mask2D(image.Width, image.Height);
+            for (int y = 0; y < image.Height; ++y)
+            {
+                int rowStart = y * result.WordsPerRow;
+                for (int x = 0; x < image.Width; ++x)
+                {
+                    if (image[x, y])
+                        result.words[rowStart + x / BitsPerWord] |= 1UL << (x % BitsPerWord);
+                }
+            }
+
+            return result;
+        }
+
+        public Image2D<bool> ToImage()
+        {
+            Image2D<bool> result = new Image2D<bool>(this.Width, this.Height);
+            for (int y = 0; y < this.Height; ++y)
+            {
+                int rowStart = y * this.WordsPerRow;
+                for (int x = 0; x < this.Width; ++x)
+                    result[x, y] = (this.words[rowStart + x / BitsPerWord] & (1UL << (x % BitsPerWord))) != 0;
+            }
+
+            return result;
+        }
+
+        internal void SetWord(int y, int wordIndex, ulong value)
+        {
+            this.EnsureStorageNotShared();
+            this.words[y * this.WordsPerRow + wordIndex] = value;
+        }
+
+        internal static int PopCount(ulong value)
+        {
+            value = value - ((value >> 1) & 0x5555555555555555UL);
+            value = (value & 0x3333333333333333UL) + ((value >> 2) & 0x3333333333333333UL);
+            value = (value + (value >> 4)) & 0x0F0F0F0F0F0F0F0FUL;
+            return (int)((value * 0x0101010101010101UL) >> 56);
+        }
+
+        private void EnsureStorageNotShared()
+        {
+            if (!this.storageShared)
+                return;
+
+            this.words = (ulong[])this.words.Clone();
+            this.storageShared = false;
+        }
+    }
+}
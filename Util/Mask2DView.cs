@@ -0,0 +1,106 @@
+﻿using System;
+using System.Diagnostics;
+using System.Drawing;
+
+namespace Research.GraphBasedShapePrior.Util
+{
+    /// <summary>
+    /// Read-only view of a rectangular region of <see cref="Mask2D"/> that shares its packed words.
+    /// View sees the mask as it was when the view was created: mask storage is copied on the next write to the mask.
+    /// </summary>
+    public class Mask2DView
+    {
+        private const int BitsPerWord = 64;
+
+        private readonly ulong[] words;
+
+        private readonly int wordsPerRow;
+
+        internal Mask2DView(ulong[] words, int wordsPerRow, Rectangle region)
+        {
+            this.words = words;
+            this.wordsPerRow = wordsPerRow;
+            this.Region = region;
+        }
+
+        /// <summary>
+        /// Gets the region of the mask covered by the view.
+        /// </summary>
+        public Rectangle Region { get; private set; }
+
+        public int Width
+        {
+            get { return this.Region.Width; }
+        }
+
+        public int Height
+        {
+            get { return this.Region.Height; }
+        }
+
+        public bool this[int x, int y]
+        {
+            get
+            {
+                Debug.Assert(x >= 0 && x < this.Width && y >= 0 && y < this.Height);
+                int maskX = this.Region.X + x;
+                int wordIndex = (this.Region.Y + y) * this.wordsPerRow + maskX / BitsPerWord;
+                return (this.words[wordIndex] & (1UL << (maskX % BitsPerWord))) != 0;
+            }
+        }
+
+        public int CountSetBits()
+        {
+            int count = 0;
+            for (int y = 0; y < this.Height; ++y)
+                for (int x = 0; x < this.Width; x += BitsPerWord)
+                    count += Mask2D.PopCount(this.GetBits(x, y));
+            return count;
+        }
+
+        public static int DifferentValueCount(Mask2DView view1, Mask2DView view2)
+        {
+            if (view1 == null)
+                throw new ArgumentNullException("view1");
+            if (view2 == null)
+                throw new ArgumentNullException("view2");
+            if (view1.Width != view2.Width || view1.Height != view2.Height)
+                throw new ArgumentException("Views should have the same size.");
+
+            // Regions can start at different bit offsets, so words are realigned on the fly
+            int count = 0;
+            for (int y = 0; y < view1.Height; ++y)
+                for (int x = 0; x < view1.Width; x += BitsPerWord)
+                    count += Mask2D.PopCount(view1.GetBits(x, y) ^ view2.GetBits(x, y));
+            return count;
+        }
+
+        public Mask2D ToMask()
+        {
+            Mask2D result = new Mask2D(this.Width, this.Height);
+            for (int y = 0; y < this.Height; ++y)
+                for (int x = 0; x < this.Width; x += BitsPerWord)
+                    result.SetWord(y, x / BitsPerWord, this.GetBits(x, y));
+            return result;
+        }
+
+        /// <summary>
+        /// Returns up to 64 bits of the view row starting from the given view column, bits past the region are zero.
+        /// </summary>
+        private ulong GetBits(int x, int y)
+        {
+            int maskX = this.Region.X + x;
+            int rowStart = (this.Region.Y + y) * this.wordsPerRow;
+            int wordIndex = maskX / BitsPerWord, shift = maskX % BitsPerWord;
+
+            ulong result = this.words[rowStart + wordIndex] >> shift;
+            if (shift != 0 && wordIndex + 1 < this.wordsPerRow)
+                result |= this.words[rowStart + wordIndex + 1] << (BitsPerWord - shift);
+
+            int bitCount = this.Width - x;
+            if (bitCount < BitsPerWord)
+                result &= (1UL << bitCount) - 1;
+            return result;
+        }
+    }
+}
@@ -1,6 +1,7 @@
 ﻿using System;
 using System.Diagnostics;
 using System.Drawing;
+using System.Runtime.InteropServices;
 
 namespace Research.GraphBasedShapePrior.Util
 {
@@ -34,6 +35,30 @@ namespace Research.GraphBasedShapePrior.Util
             return x * x;
         }
 
+        /// <summary>
+        /// Returns the largest float that is less than the given one.
+        /// </summary>
+        public static float NextFloatDown(float value)
+        {
+            if (Single.IsNaN(value) || Single.IsNegativeInfinity(value))
+                return value;
+            if (value == 0)
+                return -Single.Epsilon;
+
+            FloatBits bits = new FloatBits { Float = value };
+            bits.Int += value > 0 ? -1 : 1;
+            return bits.Float;
+        }
+
+        /// <summary>
+        /// Converts the given value to the largest float not exceeding it, so that lower bounds stay lower bounds.
+        /// </summary>
+        public static float RoundDownToFloat(double value)
+        {
+            float result = (float)value;
+            return result > value ? NextFloatDown(result) : result;
+        }
+
         public static double LogInf(double x)
         {
             Debug.Assert(x >= 0);
@@ -121,5 +146,15 @@ namespace Research.GraphBasedShapePrior.Util
 
             return Polygon.FromPoints(line1Point1, line1Point2, line2Point2, line2Point1);
         }
+
+        [StructLayout(LayoutKind.Explicit)]
+        private struct FloatBits
+        {
+            [FieldOffset(0)]
+            public float Float;
+
+            [FieldOffset(0)]
+            public int Int;
+        }
     }
 }
@@ -0,0 +1,152 @@
+﻿using System;
+using System.Diagnostics;
+using System.Drawing;
+
+namespace Research.GraphBasedShapePrior.Util
+{
+    /// <summary>
+    /// Object and background terms stored as two separate row-major float planes.
+    /// Terms are clamped to [-Saturation, Saturation], so no infinities are ever stored.
+    /// </summary>
+    public class ObjectBackgroundTermPlanes
+    {
+        public const float DefaultSaturation = 1e+20f;
+
+        private readonly float[] objectTerms;
+
+        private readonly float[] backgroundTerms;
+
+        public ObjectBackgroundTermPlanes(int width, int height)
+            : this(width, height, DefaultSaturation)
+        {
+        }
+
+        public ObjectBackgroundTermPlanes(int width, int height, float saturation)
+        {
+            if (width < 0)
+                throw new ArgumentOutOfRangeException("width", "Parameter value should not be negative.");
+            if (height < 0)
+                throw new ArgumentOutOfRangeException("height", "Parameter value should not be negative.");
+            if (saturation <= 0 || Single.IsInfinity(saturation) || Single.IsNaN(saturation))
+                throw new ArgumentOutOfRangeException("saturation", "Parameter value should be positive and finite.");
+
+            this.Width = width;
+            this.Height = height;
+            this.Saturation = saturation;
+            this.objectTerms = new float[width * height];
+            this.backgroundTerms = new float[width * height];
+        }
+
+        public int Width { get; private set; }
+
+        public int Height { get; private set; }
+
+        public float Saturation { get; private set; }
+
+        public Size Size
+        {
+            get { return new Size(this.Width, this.Height); }
+        }
+
+        public Rectangle Rectangle
+        {
+            get { return new Rectangle(0, 0, this.Width, this.Height); }
+        }
+
+        public float[] ObjectTerms
+        {
+            get { return this.objectTerms; }
+        }
+
+        public float[] BackgroundTerms
+        {
+            get { return this.backgroundTerms; }
+        }
+
+        public ObjectBackgroundTerm this[int x, int y]
+        {
+            get
+            {
+                int index = this.GetIndex(x, y);
+                return new ObjectBackgroundTerm(this.objectTerms[index], this.backgroundTerms[index]);
+            }
+            set
+            {
+                int index = this.GetIndex(x, y);
+                this.objectTerms[index] = this.Saturate(value.ObjectTerm);
+                this.backgroundTerms[index] = this.Saturate(value.BackgroundTerm);
+            }
+        }
+
+        public int GetIndex(int x, int y)
+        {
+            Debug.Assert(x >= 0 && x < this.Width && y >= 0 && y < this.Height);
+            return y * this.Width + x;
+        }
+
+        /// <summary>
+        /// Clamps the given term to the saturation range and rounds it down to float.
+        /// Both planes hold lower bounds (object terms are combined by min and background terms by max),
+        /// so rounding to nearest could make a bound exceed the true value.
+        /// </summary>
+        public float Saturate(double value)
+        {
+            Debug.Assert(!Double.IsNaN(value));
+            if (value >= this.Saturation)
+                return this.Saturation;
+            if (value <= -this.Saturation)
+                return -this.Saturation;
+            return MathHelper.RoundDownToFloat(value);
+        }
+
+        public void Fill(float objectTerm, float backgroundTerm)
+        {
+            Debug.Assert(Math.Abs(objectTerm) <= this.Saturation && Math.Abs(backgroundTerm) <= this.Saturation);
+
+            for (int i = 0; i < this.objectTerms.Length; ++i)
+            {
+                this.objectTerms[i] = objectTerm;
+                this.backgroundTerms[i] = backgroundTerm;
+            }
+        }
+
+        public ObjectBackgroundTermPlanes Clone()
+        {
+            ObjectBackgroundTermPlanes result = new ObjectBackgroundTermPlanes(this.Width, this.Height, this.Saturation);
+            Array.Copy(this.objectTerms, result.objectTerms, this.objectTerms.Length);
+            Array.Copy(this.backgroundTerms, result.backgroundTerms, this.backgroundTerms.Length);
+            return result;
+        }
+
+        public Image2D<ObjectBackgroundTerm> ToImage()
+        {
+            Image2D<ObjectBackgroundTerm> result = new Image2D<ObjectBackgroundTerm>(this.Width, this.Height);
+            ObjectBackgroundTerm[] resultBuffer = result.Buffer;
+            for (int y = 0; y < this.Height; ++y)
+            {
+                int rowStart = y * this.Width;
+                int resultRowStart = result.GetIndex(0, y);
+                for (int x = 0; x < this.Width; ++x)
+                {
+                    resultBuffer[resultRowStart + x] = new ObjectBackgroundTerm(
+                        this.objectTerms[rowStart + x], this.backgroundTerms[rowStart + x]);
+                }
+            }
+
+            return result;
+        }
+
+        public static ObjectBackgroundTermPlanes FromImage(Image2D<ObjectBackgroundTerm> image)
+        {
+            if (image == null)
+                throw new ArgumentNullException("image");
+
+            ObjectBackgroundTermPlanes result = new ObjectBackgroundTermPlanes(image.Width, image.Height);
+            for (int y = 0; y < image.Height; ++y)
+                for (int x = 0; x < image.Width; ++x)
+                    result[x, y] = image[x, y];
+
+            return result;
+        }
+    }
+}
@@ -1,4 +1,5 @@
-﻿using System.Collections.Generic;
+﻿using System;
+using System.Collections.Generic;
 using System.Collections.ObjectModel;
 using System.Diagnostics;
 using System.Linq;
@@ -55,6 +56,22 @@ namespace Research.GraphBasedShapePrior.Util
             return winding;
         }
 
+        public double Area
+        {
+            get
+            {
+                double doubleArea = 0;
+                Vector prev = this.vertices[this.vertices.Count - 1];
+                foreach (Vector cur in this.vertices)
+                {
+                    doubleArea += Vector.CrossProduct(prev, cur);
+                    prev = cur;
+                }
+
+                return Math.Abs(doubleArea) * 0.5;
+            }
+        }
+
         /// <summary>
         /// Implements gift wrapping algorithm.
         /// </summary>